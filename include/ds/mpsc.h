@@ -0,0 +1,108 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * (c) Copyright 2006,2007,2008 MString Core Team <http://mstring.jarios.org>
+ *
+ * include/ds/mpsc.h: Intrusive lock-free multi-producer/single-consumer
+ *                    queue (D. Vyukov's algorithm).
+ *
+ */
+
+#ifndef __MPSC_H__
+#define __MPSC_H__
+
+#include <arch/types.h>
+#include <arch/atomic.h>
+#include <mstring/stddef.h>
+
+typedef struct __mpsc_node {
+  struct __mpsc_node * volatile next;
+} mpsc_node_t;
+
+/* Producers only touch 'head', the consumer owns 'tail'. */
+typedef struct __mpsc_queue {
+  atomic_t head;
+  uint8_t __pad[56];
+  mpsc_node_t *tail;
+  mpsc_node_t stub;
+} mpsc_queue_t;
+
+static inline void mpsc_init(mpsc_queue_t *q)
+{
+  q->stub.next=NULL;
+  atomic_set(&q->head,(ulong_t)&q->stub);
+  q->tail=&q->stub;
+}
+
+/**
+ * @fn static inline void mpsc_push(mpsc_queue_t *q,mpsc_node_t *n)
+ * Appends @a n to the queue. Can be called by any number of producers
+ * concurrently. Callers should disable preemption around this call: the
+ * consumer can't pass a node until its producer links it to the queue.
+ */
+static inline void mpsc_push(mpsc_queue_t *q,mpsc_node_t *n)
+{
+  mpsc_node_t *prev;
+
+  n->next=NULL;
+  prev=(mpsc_node_t *)atomic_xchg(&q->head,(ulong_t)n);
+  prev->next=n;
+}
+
+/**
+ * @fn static inline mpsc_node_t *mpsc_pop(mpsc_queue_t *q)
+ * Removes the first node of the queue. Must be called by one consumer
+ * at a time.
+ * @return The first node, or NULL if the queue is empty or the first node
+ * is still being linked by its producer.
+ */
+static inline mpsc_node_t *mpsc_pop(mpsc_queue_t *q)
+{
+  mpsc_node_t *tail=q->tail;
+  mpsc_node_t *next=tail->next;
+
+  if( tail == &q->stub ) {
+    if( !next ) {
+      return NULL;
+    }
+    q->tail=next;
+    tail=next;
+    next=next->next;
+  }
+
+  if( next ) {
+    q->tail=next;
+    return tail;
+  }
+
+  if( tail != (mpsc_node_t *)atomic_get(&q->head) ) {
+    return NULL;
+  }
+
+  /* The last node: put the stub behind it to be able to detach it. */
+  mpsc_push(q,&q->stub);
+  next=tail->next;
+  if( next ) {
+    q->tail=next;
+    return tail;
+  }
+  return NULL;
+}
+
+#define mpsc_is_empty(q)                                        \
+  ((q)->tail == &(q)->stub && !(q)->stub.next)
+
+#endif
@@ -30,6 +30,7 @@
 
 typedef struct __ipc_buffer {
   page_idx_t *chunks;
+  uintptr_t base;
   size_t length;
   uint32_t offset;
   uint32_t num_chunks;
@@ -45,4 +46,6 @@ long ipc_transfer_buffer_data_iov(ipc_buffer_t *bufs, uint32_t numbufs,
                                   struct __iovec *iovecs, uint32_t numvecs,
                                   ulong_t offset, bool to_buffer);
 void ipc_release_buffer_pages(ipc_buffer_t *bufs, uint32_t numbufs);
+long ipc_remap_buffer_pages(ipc_buffer_t *buf, struct __iovec *iovec,
+                            ulong_t len, struct __task_struct *owner);
 #endif
@@ -83,5 +83,8 @@ static inline void ipc_put_channel(ipc_channel_t *channel)
 #define channel_in_blocked_mode(c) ((c)->flags & IPC_CHANNEL_FLAG_BLOCKED_MODE)
 
 #define IPC_CHANNEL_CTL_GET_SYNC_MODE  0x1
+#define IPC_CHANNEL_CTL_RING_MAP       0x2 /* Map server port's ring. */
+#define IPC_CHANNEL_CTL_RING_WAIT      0x3 /* Sleep until 'arg' bytes are free. */
+#define IPC_CHANNEL_CTL_RING_NOTIFY    0x4 /* Wake up the consumer. */
 
 #endif
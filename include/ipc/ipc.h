@@ -15,6 +15,14 @@
 #define IPC_BLOCKED_ACCESS  0x01
 #define IPC_AUTOREF         0x02
 #define IPC_KERNEL_SIDE     0x04
+/* Synchronous messages are passed directly to a sleeping receiver. */
+#define IPC_HANDOFF_ACCESS  0x08
+/* Port carries a shared-memory ring for bulk asynchronous data (see ipc/ring.h). */
+#define IPC_RING_ACCESS     0x10
+/* Page-aligned parts of long replies are moved to a client instead of copying. */
+#define IPC_REMAP_ACCESS    0x20
+/* Senders of a non-blocking port enqueue messages without taking its lock. */
+#define IPC_MPSC_ACCESS     0x40
 
 /**< Maximum numbers of vectors for I/O operations. */
 #define MAX_IOVECS  8
@@ -27,6 +35,9 @@
 #define IPC_MAX_PORT_MESSAGES  512
 #define IPC_DEFAULT_BUFFERS 512
 
+/**< Maximum number of pollsets per task. */
+#define IPC_TASK_POLLSETS  16
+
 /**< Number of pages statically allocated for a task for its large messages. */
 #define IPC_PERTASK_PAGES 1
 
@@ -58,6 +69,9 @@ typedef struct __task_ipc {
   //ipc_channel_t **channels;
   spinlock_t channel_lock;
   int allocated_channels;
+
+  /* Pollsets (protected by the mutex). */
+  struct __ipc_pollset *pollsets[IPC_TASK_POLLSETS];
 } task_ipc_t;
 #define get_ports_count(I)    (I->ports->num_items)
 #define get_channels_count(I) (I->channels->num_items)
@@ -96,6 +110,12 @@ typedef struct __iovec {
   size_t iov_len;
 } iovec_t;
 
+/* Describes one message of a batched send. */
+typedef struct __iovec_group {
+  iovec_t *iovecs;
+  ulong_t numvecs;
+} iovec_group_t;
+
 static inline task_ipc_t *get_task_ipc(task_t *t)
 {
   task_ipc_t *ipc;
@@ -214,6 +234,54 @@ long sys_port_receive(ulong_t port, ulong_t flags, ulong_t recv_buf,
 size_t sys_port_reply(ulong_t port, ulong_t msg_id,ulong_t reply_buf,
                       ulong_t reply_len);
 
+/**
+ * @fn status_t sys_port_receive_batch(ulong_t port, ulong_t flags,
+ *                                     iovec_t *recv_iovs,
+ *                                     port_msg_info_t *msg_info, ulong_t nmsgs)
+ * @brief Receives several pending messages from target port at once.
+ *
+ * This system call works like 'sys_port_receive()' but drains up to
+ * @a nmsgs (at most IPC_RECV_BATCH_MAX) pending messages in one call.
+ * It sleeps only if there are no messages at all and blocking access
+ * was requested.
+ *
+ * @param port Target port that belongs to the calling process.
+ * @param flags Receive flags (see 'sys_port_receive()').
+ * @param recv_iovs Array of @a nmsgs buffers, one per message (may be NULL).
+ * @param msg_info Array of @a nmsgs structures that will contain message details.
+ * @param nmsgs Maximum number of messages to receive.
+ *
+ * @return Number of received messages. If the first message couldn't be
+ * received, negation of the same errors as for 'sys_port_receive()'
+ * is returned.
+ */
+long sys_port_receive_batch(ulong_t port, ulong_t flags, iovec_t *recv_iovs,
+                            port_msg_info_t *msg_info, ulong_t nmsgs);
+
+/**
+ * @fn status_t sys_port_send_iov_batch(ulong_t channel, iovec_group_t *groups,
+ *                                      ulong_t ngroups, long *statuses)
+ * @brief Asynchronously send several messages over target channel.
+ *
+ * All messages are enqueued to the server port under a single lock hold
+ * and receivers are woken up only after the whole batch was enqueued.
+ * This call works only for channels in non-blocking mode.
+ *
+ * @param channel Identificator of the channel.
+ * @param groups Array of I/O vector groups, one group per message.
+ * @param ngroups Number of messages (at most IPC_SEND_BATCH_MAX).
+ * @param statuses Array of @a ngroups elements that will contain size
+ *        of each sent message or a negation of error that occured.
+ *
+ * @return Number of messages that were sent, or a negation of the
+ * following errors (reported only if no messages were sent):
+ *    EINVAL - insufficient channel, or channel is in blocking mode, or
+ *             insufficient number of messages.
+ *    EFAULT - insufficient memory address was passed.
+ */
+long sys_port_send_iov_batch(ulong_t channel, iovec_group_t *groups,
+                             ulong_t ngroups, long *statuses);
+
 long replicate_ipc(task_ipc_t *source,task_t *rcpt);
 void initialize_ipc(void);
 
@@ -232,5 +300,33 @@ long sys_port_reply_iov(ulong_t port, ulong_t msg_id,
 long sys_port_msg_read(ulong_t port, ulong_t msg_id, uintptr_t recv_buf,
                        size_t recv_len, off_t offset);
 
+/**
+ * @fn status_t sys_port_reply_and_receive(ulong_t port, ulong_t msg_id,
+ *                                         iovec_t reply_iov[], uint32_t numvecs,
+ *                                         iovec_t *recv_iov,
+ *                                         port_msg_info_t *msg_info)
+ * @brief Reply to port message and wait for the next one.
+ *
+ * This system call combines 'sys_port_reply_iov()' and a blocking
+ * 'sys_port_receive()' so that server loops need only one syscall
+ * (and one port lookup) per request.
+ *
+ * @param port The port used for message reception.
+ * @param msg_id ID of the message to reply to.
+ * @param reply_iov I/O vectors containing reply data.
+ * @param numvecs Number of reply vectors (zero means empty reply).
+ * @param recv_iov Single I/O vector for the next message (may be NULL).
+ * @param msg_info Structure that will contain details of the next message.
+ *
+ * @return Zero upon successful reception of the next message. If reply
+ * fails, its error is returned and no message is received. Otherwise
+ * errors are the same as for 'sys_port_receive()'. Invalid arguments
+ * (including NULL or inaccessible @a msg_info) are reported before the
+ * reply is sent.
+ */
+long sys_port_reply_and_receive(ulong_t port, ulong_t msg_id,
+                                iovec_t reply_iov[], uint32_t numvecs,
+                                iovec_t *recv_iov, port_msg_info_t *msg_info);
+
 
 #endif
@@ -0,0 +1,73 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * (c) Copyright 2006,2007,2008 MString Core Team <http://mstring.jarios.org>
+ *
+ * include/ipc/pollset.h: Data types and prototypes for persistent sets of
+ *                        polled IPC ports.
+ *
+ */
+
+#ifndef __IPC_POLLSET_H__
+#define __IPC_POLLSET_H__
+
+#include <arch/types.h>
+#include <arch/atomic.h>
+#include <sync/mutex.h>
+#include <sync/spinlock.h>
+#include <ds/list.h>
+#include <mstring/waitqueue.h>
+#include <ipc/poll.h>
+#include <ipc/port.h>
+
+/* Commands for 'sys_ipc_pollset_control()'. */
+#define IPC_POLLSET_CTL_ADD  0  /**< Start watching a port. */
+#define IPC_POLLSET_CTL_MOD  1  /**< Change the set of watched events. */
+#define IPC_POLLSET_CTL_DEL  2  /**< Stop watching a port. */
+
+/**< Maximum number of events reported by one wait. */
+#define IPC_POLLSET_WAIT_MAX  32
+
+/* Ports register in a pollset once and then notify it from their
+ * 'insert_message()', so waiting costs O(number of ready ports)
+ * instead of O(number of watched ports).
+ */
+typedef struct __ipc_pollset {
+  mutex_t mutex;       /**< Serializes control operations and scans. */
+  spinlock_t lock;     /**< Protects the ready list and the waitqueue. */
+  atomic_t use_count;
+  list_head_t entries,ready;
+  ulong_t num_entries;
+  wqueue_t waitqueue;
+  bool closed;
+} ipc_pollset_t;
+
+typedef struct __ipc_poll_entry {
+  ipc_pollset_t *set;
+  ipc_gen_port_t *port;
+  ulong_t fd;
+  poll_event_t events,revents;
+  list_node_t set_node;    /**< In 'set->entries'. */
+  list_node_t ready_node;  /**< In 'set->ready' or in a scanned batch. */
+  list_node_t port_node;   /**< In 'port->pollsets'. */
+  bool queued;    /**< Is on the ready list or is being scanned. */
+  bool signaled;  /**< Port was signaled since the last scan. */
+} ipc_poll_entry_t;
+
+void ipc_port_signal_pollsets(ipc_gen_port_t *port);
+void ipc_close_pollsets(struct __task_ipc *ipc);
+
+#endif
@@ -31,6 +31,7 @@
 #include <arch/atomic.h>
 #include <ds/idx_allocator.h>
 #include <ds/list.h>
+#include <ds/mpsc.h>
 #include <mstring/waitqueue.h>
 #include <mstring/event.h>
 #include <ipc/buffer.h>
@@ -39,6 +40,10 @@
 
 #define IPC_BUFFERED_PORT_LENGTH  PAGE_SIZE
 #define MAX_PORT_MSG_LENGTH  MB2B(2)
+/**< Maximum number of messages received via one batched receive. */
+#define IPC_RECV_BATCH_MAX  32
+/**< Maximum number of messages sent via one batched send. */
+#define IPC_SEND_BATCH_MAX  32
 
 /* Common port flags. */
 #define IPC_PORT_SHUTDOWN     0x800 /**< Port is under shutdown. */
@@ -49,7 +54,8 @@
 
 #define REF_PORT(p)  atomic_inc(&p->use_count)
 
-#define IPC_PORT_DIRECT_FLAGS  (IPC_BLOCKED_ACCESS | IPC_AUTOREF)
+#define IPC_PORT_DIRECT_FLAGS  (IPC_BLOCKED_ACCESS | IPC_AUTOREF | IPC_HANDOFF_ACCESS | \
+                                IPC_RING_ACCESS | IPC_REMAP_ACCESS | IPC_MPSC_ACCESS)
 #define __MSG_WAS_DEQUEUED  (ipc_port_message_t *)0x007
 
 typedef enum __ipc_msg_state {
@@ -71,7 +77,8 @@ typedef struct __ipc_port_message_t {
   long replied_size;
   void *send_buffer,*receive_buffer;
   list_node_t l,messages_list;
-  list_head_t h;  /* For implementing skiplists. */
+  ulong_t prio;  /* Queue the message was put in. */
+  mpsc_node_t mpsc_node;
   event_t event;
   ipc_buffer_t *snd_buf, *rcv_buf;
   ulong_t num_send_bufs,num_recv_buffers;
@@ -99,6 +106,14 @@ typedef struct __port_msg_info {
   uint8_t ns_tr_flag;
 } port_msg_info_t;
 
+/* Published by a receiver sleeping on a port in handoff mode (via
+ * 'private' field of its waitqueue entry). Sender fills it in under
+ * the port lock before waking the receiver up.
+ */
+typedef struct __ipc_port_handoff {
+  ipc_port_message_t *msg;
+} ipc_port_handoff_t;
+
 struct __ipc_gen_port;
 struct __ipc_channel;
 
@@ -114,6 +129,19 @@ typedef struct __ipc_port_msg_ops {
   int (*remove_message)(struct __ipc_gen_port *port,
                                     ipc_port_message_t *msg);
   ipc_port_message_t *(*remove_head_message)(struct __ipc_gen_port *port);
+  /* Puts an extracted message back in front of the messages that were
+   * queued after it. Called with the port locked.
+   */
+  void (*requeue_message)(struct __ipc_gen_port *port,ipc_port_message_t *msg);
+  /* Optional: reports events not reflected by 'avail_messages'.
+   * Called with the port locked.
+   */
+  poll_event_t (*check_events)(struct __ipc_gen_port *port);
+  /* Optional: same as 'check_events', but also makes the other side wake
+   * up the port's waitqueue once new events arrive. Called with the port
+   * locked right before a task starts waiting on the port.
+   */
+  poll_event_t (*arm_events)(struct __ipc_gen_port *port);
 } ipc_port_msg_ops_t;
 
 typedef struct __ipc_port_ops {
@@ -124,12 +152,15 @@ typedef struct __ipc_gen_port {
   ulong_t flags;
   spinlock_t lock;
   atomic_t use_count,own_count;
-  ulong_t avail_messages,total_messages,capacity;
+  atomic_t avail_messages;  /* Updated without the lock by MPSC ports. */
+  ulong_t total_messages,capacity;
   wqueue_t waitqueue;
   ipc_port_msg_ops_t *msg_ops;
   ipc_port_ops_t *port_ops;
   void *data_storage;
   list_head_t channels;
+  list_head_t pollsets;  /* Entries of pollsets watching this port. */
+  struct __ipc_port_ring *ring;
   struct __s_object sobject;
 } ipc_gen_port_t;
 
@@ -145,6 +176,13 @@ long ipc_create_port(task_t *owner,ulong_t flags,ulong_t queue_size);
 long ipc_port_receive(ipc_gen_port_t *port, ulong_t flags,
                       struct __iovec *iovec, uint32_t numvec,
                       port_msg_info_t *msg_info);
+long ipc_port_receive_batch(ipc_gen_port_t *port, ulong_t flags,
+                            struct __iovec *iovecs, port_msg_info_t *msg_info,
+                            ulong_t nmsgs);
+long ipc_port_reply_and_receive(ipc_gen_port_t *port,ulong_t msg_id,
+                                struct __iovec *reply_iovecs,ulong_t numvecs,
+                                long reply_len,struct __iovec *recv_iovec,
+                                port_msg_info_t *msg_info);
 ipc_gen_port_t *ipc_get_port(task_t *task,ulong_t port,long *e);
 void ipc_put_port(ipc_gen_port_t *p);
 int ipc_port_reply(ipc_gen_port_t *port, ulong_t msg_id,
@@ -153,6 +191,10 @@ int ipc_close_port(struct __task_ipc *ipc,ulong_t port);
 
 extern ipc_port_msg_ops_t prio_port_msg_ops;
 extern ipc_port_ops_t prio_port_ops;
+extern ipc_port_msg_ops_t ring_port_msg_ops;
+extern ipc_port_ops_t ring_port_ops;
+extern ipc_port_msg_ops_t mpsc_port_msg_ops;
+extern ipc_port_ops_t mpsc_port_ops;
 
 #define IPC_LOCK_PORT(p) spinlock_lock(&p->lock)
 #define IPC_UNLOCK_PORT(p) spinlock_unlock(&p->lock)
@@ -168,6 +210,7 @@ struct __iovec;
 
 poll_event_t ipc_port_check_events(ipc_gen_port_t *port,wqueue_task_t *w,
                                    poll_event_t evmask);
+poll_event_t ipc_port_arm_events(ipc_gen_port_t *port,poll_event_t evmask);
 void ipc_port_remove_poller(ipc_gen_port_t *port,wqueue_task_t *w);
 
 void ipc_port_remove_poller(ipc_gen_port_t *port,wqueue_task_t *w);
@@ -177,6 +220,9 @@ ipc_port_message_t *ipc_create_port_message_iov_v(struct __ipc_channel *channel,
                                                   ipc_buffer_t *snd_bufs, ipc_buffer_t *rcv_bufs, size_t rcv_size, int *err);
 long ipc_port_send_iov(struct __ipc_channel *channel, struct __iovec *snd_kiovecs, ulong_t snd_numvecs,
                        struct __iovec *rcv_kiovecs, ulong_t rcv_numvecs);
+struct __iovec_group;
+long ipc_port_send_iov_batch(struct __ipc_channel *channel, struct __iovec_group *groups,
+                             ulong_t ngroups, long *statuses);
 long ipc_port_send_iov_core(ipc_gen_port_t *port,
                             ipc_port_message_t *msg,bool sync_send,
                             struct __iovec *iovecs,ulong_t numvecs,
@@ -190,7 +236,19 @@ long ipc_port_msg_write(struct __ipc_gen_port *port,ulong_t msg_id,
 ipc_gen_port_t *ipc_clone_port(ipc_gen_port_t *p);
 void put_ipc_port_message(ipc_port_message_t *msg);
 
-#define IPC_NB_MESSAGE_MAXLEN  (512-sizeof(ipc_port_message_t))
+/**< Size of a non-blocking message object (header plus inline data). */
+#define IPC_NB_MESSAGE_SIZE  512
+#define IPC_NB_MESSAGE_MAXLEN  (IPC_NB_MESSAGE_SIZE-sizeof(ipc_port_message_t))
+/**< Maximum number of free non-blocking messages cached by one CPU. */
+#define IPC_MSG_CACHE_MAX  128
+
+ipc_port_message_t *ipc_alloc_nb_message(void);
+void ipc_free_nb_message(ipc_port_message_t *msg);
+void ipc_msg_cache_resize(long delta);
+ulong_t ipc_msg_caches_drain(void);
+long ipc_msg_cache_hits(void);
+long ipc_msg_cache_misses(void);
+void ipc_msg_caches_initialize(void);
 
 #define IPC_RESET_MESSAGE(m,t)                  \
     do {                                        \
@@ -45,6 +45,9 @@ enum ipc_port_ctrl_command {
   IPC_PORT_CTL_MSG_APPEND = 1, /** Append extra data to original message */
   IPC_PORT_CTL_MSG_CUT = 2,    /** Cut extra data from message */
   IPC_PORT_CTL_MSG_REPLY_RETCODE = 3, /*Just wake up sender and transfer the retcode. */
+  IPC_PORT_CTL_RING_MAP = 4,   /** Map port's ring into caller's address space. */
+  IPC_PORT_CTL_RING_WAIT = 5,  /** Sleep until port's ring is non-empty. */
+  IPC_PORT_CTL_RING_NOTIFY = 6, /** Wake up the producer waiting for free space. */
 };
 
 #endif
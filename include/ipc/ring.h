@@ -0,0 +1,97 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * (c) Copyright 2006,2007,2008 MString Core Team <http://mstring.jarios.org>
+ *
+ * include/ipc/ring.h: Data types and prototypes for shared-memory ring ports.
+ *
+ */
+
+#ifndef __IPC_RING_H__
+#define __IPC_RING_H__
+
+#include <arch/types.h>
+#include <mstring/waitqueue.h>
+#include <mm/page.h>
+#include <mm/memobj.h>
+#include <ipc/poll.h>
+
+/* A ring port carries a single-producer/single-consumer byte ring that is
+ * mapped both into the server (consumer) and into the client (producer)
+ * address spaces. The ring consists of one header page followed by
+ * IPC_RING_DATA_PAGES pages of data.
+ *
+ * 'head' and 'tail' are free-running byte counters, so the ring is empty
+ * when 'head == tail' and full when 'head - tail == size'. Framing of
+ * records inside the data area is up to the users of the ring.
+ *
+ * Data are exchanged without any kernel involvement. The kernel is entered
+ * only when one side has to sleep or to wake the other one up:
+ *  - the consumer found the ring empty: IPC_PORT_CTL_RING_WAIT;
+ *  - the producer found the ring full: IPC_CHANNEL_CTL_RING_WAIT;
+ *  - the producer advanced 'head' and 'cons_waiting' is set:
+ *    IPC_CHANNEL_CTL_RING_NOTIFY;
+ *  - the consumer advanced 'tail' and 'prod_waiting' is set:
+ *    IPC_PORT_CTL_RING_NOTIFY.
+ * Both sides must issue a full memory barrier between updating their
+ * counter and checking the 'waiting' flag of the other side.
+ */
+#define IPC_RING_HDR_PAGES   1
+#define IPC_RING_DATA_PAGES  16
+#define IPC_RING_PAGES       (IPC_RING_HDR_PAGES + IPC_RING_DATA_PAGES)
+#define IPC_RING_DATA_SIZE   (IPC_RING_DATA_PAGES << PAGE_WIDTH)
+
+typedef struct __ipc_ring_hdr {
+  volatile uint32_t head;          /**< Written by producer only. */
+  volatile uint32_t prod_waiting;  /**< Producer waits for free space. */
+  uint8_t __pad0[56];
+  volatile uint32_t tail;          /**< Written by consumer only. */
+  volatile uint32_t cons_waiting;  /**< Consumer waits for data. */
+  uint8_t __pad1[56];
+  uint32_t size;                   /**< Size of the data area (power of 2). */
+  uint32_t data_offset;            /**< Offset of the data area from the header. */
+} ipc_ring_hdr_t;
+
+typedef struct __ipc_ring_info {
+  uintptr_t addr;  /**< Address the ring was mapped at. */
+  ulong_t size;    /**< Size of the whole mapping in bytes. */
+} ipc_ring_info_t;
+
+#define ipc_ring_used(h)  ((uint32_t)((h)->head - (h)->tail))
+
+struct __task_struct;
+
+typedef struct __ipc_port_ring {
+  memobj_t *memobj;
+  ipc_ring_hdr_t *hdr;
+  wqueue_t producers;
+  struct __task_struct *owner;     /**< Pages are charged to its memory limit. */
+  struct __task_struct *producer;  /**< The only task allowed to map it via a channel. */
+} ipc_port_ring_t;
+
+struct __ipc_gen_port;
+
+int ring_init_data_storage(struct __ipc_gen_port *port,
+                           struct __task_struct *owner,ulong_t queue_size);
+poll_event_t ring_check_events(struct __ipc_gen_port *port);
+poll_event_t ring_arm_events(struct __ipc_gen_port *port);
+void ipc_port_ring_shutdown(struct __ipc_gen_port *port);
+long ipc_port_ring_map(struct __ipc_gen_port *port,bool producer,
+                       ipc_ring_info_t *uinfo);
+long ipc_port_ring_wait(struct __ipc_gen_port *port,bool producer,ulong_t space);
+long ipc_port_ring_notify(struct __ipc_gen_port *port,bool producer);
+
+#endif
@@ -105,6 +105,14 @@
 #define SC_SET_TASK_LIMITS    52
 #define SC_GET_TASK_LIMITS    53
 
+#define SC_PORT_REPLY_AND_RECEIVE  54
+#define SC_PORT_RECEIVE_BATCH      55
+#define SC_PORT_SEND_IOV_BATCH     56
+#define SC_IPC_POLLSET_CREATE      57
+#define SC_IPC_POLLSET_CONTROL     58
+#define SC_IPC_POLLSET_WAIT        59
+#define SC_IPC_POLLSET_CLOSE       60
+
 #ifndef __ASM__
 typedef uint32_t shm_id_t; /* FIXME: remove after merging */
 
@@ -310,6 +318,72 @@ int sys_wait_on_irq_array(ulong_t id);
  */
 long sys_ipc_port_poll(pollfd_t *pfds,ulong_t nfds,timeval_t *timeout);
 
+/**
+ * @fn status_t sys_ipc_pollset_create(void)
+ * Creates a persistent set of polled IPC ports.
+ *
+ * Unlike 'sys_ipc_port_poll()', ports are registered in a pollset once
+ * and then notify it when messages arrive, so waiting on a pollset costs
+ * time proportional to the number of ready ports only.
+ * Pollsets aren't inherited by child processes.
+ *
+ * @return Descriptor of a new pollset, or a negation of error:
+ *         EMFILE - calling process has reached IPC_TASK_POLLSETS pollsets.
+ *         ENOMEM - memory allocation error occured.
+ */
+long sys_ipc_pollset_create(void);
+
+/**
+ * @fn status_t sys_ipc_pollset_control(ulong_t set,ulong_t cmd,ulong_t port,
+ *                                      poll_event_t events)
+ * Adds a port to a pollset, removes it or changes its events.
+ *
+ * @param set - pollset descriptor.
+ * @param cmd - IPC_POLLSET_CTL_ADD, IPC_POLLSET_CTL_MOD or IPC_POLLSET_CTL_DEL.
+ * @param port - port descriptor.
+ * @param events - events to watch (see 'sys_ipc_port_poll()').
+ *
+ * @return Zero on success, or a negation of error:
+ *         EINVAL - insufficient pollset, port or command passed.
+ *         EEXIST - port was already added to the pollset.
+ *         ENOENT - port wasn't added to the pollset.
+ *         ENOSPC - pollset already watches MAX_POLL_OBJECTS ports.
+ */
+long sys_ipc_pollset_control(ulong_t set,ulong_t cmd,ulong_t port,
+                             poll_event_t events);
+
+/**
+ * @fn status_t sys_ipc_pollset_wait(ulong_t set,pollfd_t *events,ulong_t nevents,
+ *                                   timeval_t *timeout)
+ * Waits for events on ports of a pollset.
+ *
+ * The pollset is level-triggered: a port is reported by every call until
+ * its events are consumed.
+ *
+ * @param set - pollset descriptor.
+ * @param events - array that will contain ready ports and their events.
+ * @param nevents - size of the array (at most IPC_POLLSET_WAIT_MAX entries
+ *        are reported at once).
+ * @param timeout - operation timeout.
+ *        NOTE: Currently only zero timeouts (don't sleep) are supported,
+ *        other values mean infinite timeout.
+ *
+ * @return Number of ready ports, zero if timeout has elapsed, or a negation
+ *         of error:
+ *         EINVAL - insufficient pollset or array passed.
+ *         EFAULT - insufficient memory address was passed.
+ *         EINTR - the calling process was interrupted.
+ *         EPIPE - the pollset was closed.
+ */
+long sys_ipc_pollset_wait(ulong_t set,pollfd_t *events,ulong_t nevents,
+                          timeval_t *timeout);
+
+/**
+ * @fn status_t sys_ipc_pollset_close(ulong_t set)
+ * Closes a pollset and wakes up all tasks waiting on it.
+ */
+long sys_ipc_pollset_close(ulong_t set);
+
 /**
  * @fn status_t sys_nanosleep(timeval_t *in,timeval_t *out)
  *
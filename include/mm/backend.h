@@ -14,6 +14,7 @@ typedef enum __mm_event {
   MMEV_MMAP_CHECK   = 0x20,
   MMEV_MUNMAP       = 0x40,
   MMEV_DEPOPULATE   = 0x80,
+  MMEV_FAULT_RANGE  = 0x100,
 } mm_event_t;
 
 typedef struct __memobj_backend_t {
@@ -34,6 +35,32 @@ struct mmev_fault {
   pgoff_t offset;
 };
 
+/* Maximum number of pages requested by one MMEV_FAULT_RANGE */
+#define MMEV_RANGE_MAX_PAGES 32
+
+/*
+ * Sent instead of MMEV_PAGE_FAULT to backends of objects having
+ * MMO_FLG_READAHEAD. Asks for pages [offset, offset + npages): the
+ * first one has caused the fault, the others are read-ahead.
+ */
+struct mmev_fault_range {
+  struct mmev_hdr hdr;
+  uint32_t pfmask;
+  pgoff_t offset;
+  ulong_t npages;
+};
+
+/*
+ * Reply on MMEV_FAULT_RANGE. addrs[i] is the address of the page by
+ * offset + i in server's address space or 0 if server doesn't provide
+ * it. The faulting page(addrs[0]) is mandatory. Negative status is
+ * an error code.
+ */
+struct mmev_fault_range_reply {
+  long status;
+  uintptr_t addrs[MMEV_RANGE_MAX_PAGES];
+};
+
 struct mmev_mdep {
   struct mmev_hdr hdr;
   pgoff_t offset;
@@ -36,12 +36,16 @@ typedef struct __rpd {
   void *root_dir;
   rw_spinlock_t rpd_lock;
   struct __vmm *vmm;
+  ulong_t tlb_ctx;  /* Unique ID of TLB context, never reused */
+  atomic_t tlb_gen; /* Bumped by each TLB invalidation */
 } rpd_t;
 
 struct pt_ops {
   int (*map_page)(rpd_t *rpd, uintptr_t vaddr,
                   page_idx_t pidx, ptable_flags_t flags);
   void (*unmap_page)(rpd_t *rpd, uintptr_t vaddr);
+  int (*map_large_page)(rpd_t *rpd, uintptr_t vaddr,
+                        page_idx_t pidx, ptable_flags_t flags);
   page_idx_t (*vaddr_to_pidx)(rpd_t *rpd, uintptr_t vaddr,
                               /* OUT */ pde_t **retpde);
   void *(*alloc_pagedir)(void);
@@ -100,6 +104,19 @@ static inline int mmap_page(rpd_t *rpd, uintptr_t addr,
                          kmap_to_ptable_flags(flags));
 }
 
+/*
+ * Map LARGE_PAGE_PAGES pages starting from @a pidx with one large page.
+ * Both @a addr and @a pidx must be aligned to the large page size.
+ * Returns -EBUSY if some page of the range is already mapped.
+ * Parts of large page can be remapped and unmapped as usual.
+ */
+static inline int mmap_large_page(rpd_t *rpd, uintptr_t addr,
+                                  page_idx_t pidx, kmap_flags_t flags)
+{
+  return pt_ops.map_large_page(rpd, addr, pidx,
+                               kmap_to_ptable_flags(flags));
+}
+
 static inline void munmap_page(rpd_t *rpd, uintptr_t addr)
 {
   pt_ops.unmap_page(rpd, addr);
@@ -121,9 +138,15 @@ static inline bool page_is_mapped(rpd_t *rpd, uintptr_t va)
   return (vaddr_to_pidx(rpd, va) != PAGE_IDX_INVAL);
 }
 
+/*
+ * Page may be still accessible via TLB of other CPUs until the batched
+ * invalidation of current task is done. Its freeing is deferred until then.
+ */
+bool tlb_batch_defer_free(page_frame_t *page);
+
 static inline void unpin_page_frame(page_frame_t *pf)
 {
-  if (atomic_dec_and_test(&pf->refcount)) {
+  if (atomic_dec_and_test(&pf->refcount) && !tlb_batch_defer_free(pf)) {
     free_page(pf);
   }
 }
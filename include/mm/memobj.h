@@ -29,6 +29,7 @@
 #include <ds/list.h>
 #include <mm/page.h>
 #include <mm/memobjctl.h>
+#include <mstring/stddef.h>
 #include <mstring/types.h>
 #include <sync/spinlock.h>
 
@@ -45,12 +46,23 @@ typedef enum __memobj_flags { /* memory object flags */
   MMO_FLG_BACKENDED  = 0x20,
   MMO_FLG_SHARED     = 0x40,
   MMO_FLG_INACTIVE   = 0x80,
+  MMO_FLG_READAHEAD  = 0x100, /* Backend serves MMEV_FAULT_RANGE */
 } memobj_flags_t;
 
 #define MMO_LIFE_MASK   (MMO_FLG_SPIRIT | MMO_FLG_STICKY | MMO_FLG_LEECH | MMO_FLG_IMMORTAL)
-#define MMO_FLAGS_MASK  (MMO_FLG_DPC | MMO_FLG_SHARED | MMO_FLG_BACKENDED)
+#define MMO_FLAGS_MASK  (MMO_FLG_DPC | MMO_FLG_SHARED | MMO_FLG_BACKENDED | \
+                         MMO_FLG_READAHEAD)
 #define MMO_FLAGS_SHIFT 4
 
+/*
+ * Fault-around window: on a not-present fault memory object may also
+ * map neighbouring pages it already has, so sequential access faults
+ * once per window instead of once per page. Windows are powers of two
+ * and aligned to their size.
+ */
+#define FAULT_AROUND_PAGES     16
+#define FAULT_AROUND_MAX_PAGES 512
+
 struct __memobj;
 struct __vmrange;
 struct __ipc_channel;
@@ -94,6 +106,7 @@ typedef struct __memobj {
   atomic_t users_count;
   memobj_nature_t nature;
   uint32_t flags;
+  page_idx_t fault_around; /* Default window of new VM ranges */
   
   struct {
     uid_t owner_uid;
@@ -141,6 +154,15 @@ int memobj_prepare_page_backended(memobj_t *memobj, pgoff_t offset, page_frame_t
 bool __try_destroy_memobj(memobj_t *memobj);
 int sys_memobj_create(struct memobj_info *user_mmo_info);
 
+/* Window of at most @npages pages, 0 means fault-around is disabled */
+static inline page_idx_t fault_around_window(page_idx_t npages)
+{
+  if (npages <= 1)
+    return 0;
+
+  return round_down_pow2(MIN(npages, FAULT_AROUND_MAX_PAGES));
+}
+
 static inline void pin_memobj(memobj_t *memobj)
 {
   if (!(memobj->flags & MMO_FLG_IMMORTAL))
@@ -165,6 +187,7 @@ static inline bool unpin_memobj(memobj_t *memobj)
 int generic_memobj_initialize(memobj_t *memobj, uint32_t flags);
 void pagecache_memobjs_prepare(void);
 int pagecache_memobj_initialize(memobj_t *memobj, uint32_t flags);
+int pagecache_memobj_insert_page(memobj_t *memobj, pgoff_t offset, page_frame_t *page);
 int proxy_memobj_initialize(memobj_t *memobj, uint32_t flags);
 
 #endif /* __MEMOBJ_H__ */
@@ -25,6 +25,7 @@ enum {
   MEMOBJ_BACKENDED  = 0x02,
   MEMOBJ_SHARED     = 0x04,
   MEMOBJ_SLAVE      = 0x08,
+  MEMOBJ_READAHEAD  = 0x10,
 };
 
 struct memobj_info {
@@ -64,6 +65,7 @@ enum {
   MEMOBJ_CTL_CHANGE_INFO,
   MEMOBJ_CTL_SET_BACKEND,
   MEMOBJ_CTL_GET_BACKEND,
+  MEMOBJ_CTL_SET_FAULT_AROUND,
 };
 
 #endif /* __MSTRING_MEMOBJCTL_H__ */
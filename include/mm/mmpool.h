@@ -28,6 +28,8 @@
 #include <ds/list.h>
 #include <mm/page.h>
 #include <mm/page_alloc.h>
+#include <mm/numa.h>
+#include <mstring/kcontrol.h>
 #include <sync/spinlock.h>
 #include <mstring/kprintf.h>
 #include <mstring/assert.h>
@@ -92,6 +94,13 @@ typedef struct mmpool {
   page_idx_t num_reserved_pages;  /**< Number of reserved pages fitting given pool */
   mmpool_flags_t flags;           /**< Memory pool flags */
   mmpool_type_t type;             /**< Unique integer fitting in 4 bits identifying memory pool type */
+  int node;                       /**< NUMA node pool's memory belongs to */
+
+  /**
+   * Per-CPU histograms of alloc_pages latency in CPU cycles, each one
+   * takes a cache line of its own. @see KCTRL_LATENCY_BUCKETS
+   */
+  ulong_t alloc_latency[CONFIG_NRCPUS][KCTRL_LATENCY_BUCKETS];
 } mmpool_t;
 
 /**
@@ -102,8 +111,7 @@ typedef struct mmpool {
  * @see mm_pool_t
  */
 #define for_each_mmpool(p)                              \
-  for (p = mmpools[0]; (p)->type < ARCH_NUM_MMPOOLS;    \
-       p = mmpools[(p)->type])
+  for (p = mmpools[0]; p != NULL; p = mmpool_next(p))
 #define for_each_active_mmpool(p)               \
   for_each_mmpool(p)                            \
     if (((p)->flags & MMPOOL_ACTIVE))
@@ -112,10 +120,45 @@ extern mmpool_t *mmpools[ARCH_NUM_MMPOOLS];
 extern mmpool_t *preferred_mmpools[NUM_PREFERRED_MMPOOLS];
 extern list_head_t mmpools_list;
 
+/**
+ * Preferred pools of each NUMA node and all pools of the system
+ * sorted by their distance from the node. The latter are NULL-terminated.
+ */
+extern mmpool_t *node_mmpools[NUMA_MAX_NODES][NUM_PREFERRED_MMPOOLS];
+extern mmpool_t *mmpools_fallback[NUMA_MAX_NODES][ARCH_NUM_MMPOOLS + 1];
+
+/**
+ * @def for_each_fallback_mmpool(p, node, i)
+ * @brief Iterate through all memory pools starting from the nearest to @a node
+ */
+#define for_each_fallback_mmpool(p, node, i)                    \
+  for (i = 0; (p = mmpools_fallback[node][i]) != NULL; i++)
+
 INITCODE void mmpool_register(mmpool_t *mmpool);
 INITCODE void mmpool_set_preferred(int mmpool_id, mmpool_t *pref_mmpool);
 void mmpools_register_page(page_frame_t *pframe);
 
+/**
+ * @brief Bind memory pools to NUMA nodes and choose preferred pools of each node
+ * @note Must be called after all pools were activated.
+ */
+INITCODE void mmpools_configure_nodes(void);
+
+/**
+ * @brief Get preferred pool of type @a mmpool_id of the current CPU's node
+ */
+mmpool_t *mmpool_get_local(int mmpool_id);
+
+/**
+ * @brief Account page allocation from @a mmpool that took @a cycles CPU cycles
+ */
+void mmpool_account_latency(mmpool_t *mmpool, uint64_t cycles);
+
+/**
+ * @brief Fill @a stat with statistics of @a mmpool
+ */
+void mmpool_get_stat(mmpool_t *mmpool, kcontrol_mmpool_stat_t *stat);
+
 /**
  * @brief Get pool by its type
  * @param type - pool type
@@ -164,6 +207,17 @@ static inline mmpool_t *mmpool_get_preferred(int mmpool_id)
   return preferred_mmpools[mmpool_id];
 }
 
+static inline mmpool_t *mmpool_get_node_preferred(int node, int mmpool_id)
+{
+  ASSERT((node >= 0) && (node < NUMA_MAX_NODES));
+  ASSERT((mmpool_id >= 0) &&
+         (mmpool_id <= LAST_PREF_MMPOOL));
+  if (unlikely(!node_mmpools[node][mmpool_id]))
+    return preferred_mmpools[mmpool_id];
+
+  return node_mmpools[node][mmpool_id];
+}
+
 static inline page_frame_t *mmpool_alloc_pages(mmpool_t *pool, page_idx_t num_pages)
 {
   ASSERT(pool->allocator != NULL);
@@ -0,0 +1,102 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * (c) Copyright 2006,2007,2008 MString Core Team <http://mstring.jarios.org>
+ *
+ * include/mm/numa.h: NUMA topology: memory ranges and CPUs of nodes
+ *                    and distances between them.
+ *
+ */
+
+/**
+ * @file include/mm/numa.h
+ * @brief NUMA topology API
+ */
+
+#ifndef __MSTRING_NUMA_H__
+#define __MSTRING_NUMA_H__
+
+#include <config.h>
+#include <mstring/types.h>
+
+/** Distances as ACPI SLIT defines them: local access costs 10. */
+#define NUMA_LOCAL_DISTANCE  10
+#define NUMA_REMOTE_DISTANCE 20
+
+#ifdef CONFIG_NUMA
+#define NUMA_MAX_NODES     CONFIG_NUMA_NODES
+#define NUMA_MAX_MEMBLOCKS (NUMA_MAX_NODES * 4)
+
+/**
+ * @struct numa_memblock_t
+ * @brief Physical memory range [start, end) belonging to a node
+ */
+typedef struct numa_memblock {
+  uintptr_t start;
+  uintptr_t end;
+  int node;
+} numa_memblock_t;
+
+/**
+ * Memory blocks sorted by their start addresses. Adjacent blocks of
+ * the same node are merged.
+ */
+extern numa_memblock_t numa_memblocks[NUMA_MAX_MEMBLOCKS];
+extern int numa_num_memblocks;
+extern int numa_num_nodes;
+
+/**
+ * @brief Get node id of firmware's proximity @a domain
+ * @return Node id or -1 if there are more than NUMA_MAX_NODES domains.
+ */
+INITCODE int numa_domain_to_node(uint32_t domain);
+
+/** @brief Get node id of already known proximity @a domain or -1 */
+INITCODE int numa_lookup_domain(uint32_t domain);
+INITCODE void numa_add_memblock(int node, uintptr_t start, uintptr_t end);
+INITCODE void numa_set_distance(int from, int to, int distance);
+INITCODE void numa_set_cpu_node(cpu_id_t cpu, int node);
+
+int numa_distance(int from, int to);
+int cpu_to_node(cpu_id_t cpu);
+
+/**
+ * @brief Get node owning the memory range [@a start, @a end)
+ * If the range doesn't overlap any known block, node 0 is returned.
+ */
+int numa_range_to_node(uintptr_t start, uintptr_t end);
+
+#else /* CONFIG_NUMA */
+#define NUMA_MAX_NODES 1
+#define numa_num_nodes 1
+
+static inline int numa_distance(int from, int to)
+{
+  return NUMA_LOCAL_DISTANCE;
+}
+
+static inline int cpu_to_node(cpu_id_t cpu)
+{
+  return 0;
+}
+
+static inline int numa_range_to_node(uintptr_t start, uintptr_t end)
+{
+  return 0;
+}
+#endif /* !CONFIG_NUMA */
+
+#endif /* __MSTRING_NUMA_H__ */
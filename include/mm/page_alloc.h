@@ -92,6 +92,17 @@ void free_pages_chain(page_frame_t *pages);
 uintptr_t sys_alloc_dma_pages(int num_pages);
 void sys_free_dma_pages(uintptr_t paddr, int num_pages);
 
+/*
+ * Pre-zeroed pages caches (mm/zeroed_pages.c). Single page AF_ZERO
+ * allocations are served from them first.
+ */
+void zeroed_pages_initialize(void);
+page_frame_t *get_zeroed_page(struct mmpool *pool);
+void zeroed_pages_count_misses(page_idx_t num_pages);
+void zeroing_thread(void *data);
+long zeroed_pages_hits(void);
+long zeroed_pages_misses(void);
+
 static inline void *alloc_pages_addr(int n, palloc_flags_t flags)
 {
   page_frame_t *pf = alloc_pages(n, flags);
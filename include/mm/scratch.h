@@ -0,0 +1,77 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * (c) Copyright 2006,2007,2008 MString Core Team <http://mstring.jarios.org>
+ *
+ * include/mm/scratch.h: Per-task arena of short-lived kernel buffers.
+ *
+ */
+
+/**
+ * @file include/mm/scratch.h
+ * @brief Scratch arena API
+ *
+ * Scratch arena is a per-task bump-pointer allocator for temporary
+ * buffers that would otherwise be taken from slab or kernel stack.
+ * Everything allocated during a system call is released at once when
+ * the task returns from it. Code that may run outside of system calls
+ * (i.e. in kernel threads) must release its buffers explicitly:
+ *
+ *   scratch_mark_t mark = scratch_mark();
+ *   buf = scratch_alloc(size);
+ *   ...
+ *   scratch_release(mark);
+ *
+ * Scratch memory must not be used from interrupt context.
+ */
+
+#ifndef __MSTRING_SCRATCH_H__
+#define __MSTRING_SCRATCH_H__
+
+#include <config.h>
+#include <mm/page.h>
+#include <mstring/task.h>
+#include <mstring/types.h>
+
+#define SCRATCH_ARENA_PAGES 2
+#define SCRATCH_ARENA_SIZE  (SCRATCH_ARENA_PAGES * PAGE_SIZE)
+
+typedef ulong_t scratch_mark_t;
+
+/**
+ * @brief Allocate @a size bytes of scratch memory of current task
+ * @return A pointer to memory aligned by sizeof(long) or NULL if there is
+ * no room for @a size bytes in the arena.
+ * @note The arena is allocated on the first use, so it may sleep.
+ */
+void *scratch_alloc(size_t size);
+
+static inline scratch_mark_t scratch_mark(void)
+{
+  return task_scratch_top(current_task());
+}
+
+/**
+ * @brief Release all scratch memory allocated after @a mark was taken
+ */
+static inline void scratch_release(scratch_mark_t mark)
+{
+  task_scratch_top(current_task()) = mark;
+}
+
+void scratch_arena_free(task_t *task);
+
+#endif /* __MSTRING_SCRATCH_H__ */
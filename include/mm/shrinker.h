@@ -0,0 +1,95 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * (c) Copyright 2006,2007,2008 MString Core Team <http://mstring.jarios.org>
+ *
+ * include/mm/shrinker.h: Registry of kernel caches releasing memory
+ *                        under memory pressure.
+ *
+ */
+
+/**
+ * @file include/mm/shrinker.h
+ * @brief Shrinkers API
+ */
+
+#ifndef __MSTRING_SHRINKER_H__
+#define __MSTRING_SHRINKER_H__
+
+#include <config.h>
+#include <ds/list.h>
+#include <mm/mmpool.h>
+#include <mstring/types.h>
+
+/**
+ * Shrinkers of object caches run before the ones returning empty pages,
+ * so objects released by the former are reclaimed in the same pass.
+ * Page allocator caches run last and get pages released by all others.
+ */
+#define SHRINK_PRIO_OBJECTS    0
+#define SHRINK_PRIO_PAGES      1
+#define SHRINK_PRIO_ALLOCATOR  2
+
+/**
+ * Reclaim starts when an allocation leaves fewer free pages than that
+ * in its memory pool.
+ */
+#define SHRINK_WATERMARK(pool)  ((pool)->num_pages >> 6)
+
+/**
+ * @struct shrinker_t
+ * @brief A cache that can release its memory on demand
+ */
+typedef struct __shrinker {
+  const char *name;
+  /** Release as much cached memory as possible, return number of released items */
+  ulong_t (*shrink)(struct __shrinker *shrinker);
+  int prio;                   /**< SHRINK_PRIO_OBJECTS or SHRINK_PRIO_PAGES */
+  ulong_t nr_calls;           /**< How many times shrinker was called */
+  ulong_t nr_freed;           /**< Total number of released items */
+  list_node_t node;
+} shrinker_t;
+
+#define SHRINKER_INITIALIZE(_name, _shrink, _prio)      \
+  { .name = (_name), .shrink = (_shrink), .prio = (_prio), }
+
+void register_shrinker(shrinker_t *shrinker);
+
+/**
+ * @brief Remove @a shrinker from the registry
+ * @note It may sleep waiting for running reclaim to complete.
+ */
+void unregister_shrinker(shrinker_t *shrinker);
+
+/**
+ * @brief Run all registered shrinkers
+ * @return Number of pages returned to the page allocator.
+ * @note It may sleep.
+ */
+page_idx_t shrink_memory(void);
+
+/**
+ * @brief Wake up reclaim thread if free pages of @a pool
+ * dropped below the watermark. May be called from any context.
+ */
+void shrinkers_check_watermark(mmpool_t *pool);
+
+void shrinkers_initialize(void);
+
+long shrink_reclaimed_pages(void);
+long shrink_reclaim_runs(void);
+
+#endif /* __MSTRING_SHRINKER_H__ */
@@ -36,6 +36,8 @@
 #include <mm/page.h>
 #include <mm/mmpool.h>
 #include <mstring/smp.h>
+#include <mstring/cpucache.h>
+#include <mstring/kcontrol.h>
 #include <sync/spinlock.h>
 #include <arch/atomic.h>
 #include <mstring/types.h>
@@ -54,8 +56,12 @@
 /* Max allowed object size */
 #define SLAB_OBJECT_MAX_SIZE (1 << LAST_GENSLABS_POW2)
 
-/* number of generic memory caches(except memory caches for memcache_t and slab_t) */
-#define SLAB_GENERIC_CACHES  (LAST_GENSLABS_POW2 - FIRST_GENSLABS_POW2 + 1)
+/*
+ * number of generic memory caches(except memory caches for memcache_t and slab_t).
+ * Generic caches are size classes: powers of 2 with up to three intermediate
+ * steps between them (8, 16, 32, 48, 64, 80, 96, 128, 160, ...).
+ */
+#define SLAB_GENERIC_CACHES  17
 
 #ifdef CONFIG_DEBUG_SLAB_MARK_PAGES
 #define SLAB_PAGE_MARK_SIZE  (sizeof(unsigned int))
@@ -76,10 +82,8 @@
 #define SLAB_OBJRIGHT_GUARD   (0xDCBA)
 #endif /* CONFIG_DEBUG_SLAB_OBJGUARDS */
 
-#ifdef CONFIG_DEBUG_SLAB
-/* Max length of memory cache debug name */
-#define MEMCACHE_DBG_NAME_MAX 128
-#endif /* CONFIG_DEBUG_SLAB */
+/* Max length of memory cache name */
+#define MEMCACHE_NAME_MAX 32
 
 
 /**
@@ -117,6 +121,56 @@ typedef struct __slab {
 
 typedef uint16_t memcache_flags_t;
 
+/**
+ * @struct slab_magazine_t
+ * @brief A bounded stack of cached free objects.
+ *
+ * Freed objects are first put into the magazines of current CPU and
+ * are taken from there by following allocations, so the common
+ * alloc/free pair touches neither slab nor memory cache locks.
+ * Full and empty magazines are exchanged with per-cache depot.
+ */
+typedef struct __slab_magazine {
+  list_node_t node;   /**< In depot's full or empty list */
+  int rounds;         /**< Number of cached objects */
+  int size;           /**< Capacity of the magazine */
+  void *objs[0];
+} slab_magazine_t;
+
+/*
+ * Per-CPU pair of magazines (Bonwick's 'loaded' and 'previous' ones).
+ * The lock is contended only when the magazines are drained by a shrinker.
+ * Each CPU takes its lock on every alloc/free, so pairs of different CPUs
+ * don't share cache lines.
+ */
+typedef struct __memcache_mags {
+  spinlock_t lock;
+  slab_magazine_t *loaded;
+  slab_magazine_t *prev;
+} __l1_cache_aligned__ memcache_mags_t;
+
+/* Max number of objects magazine can hold: it is allocated from generic caches */
+#define SLAB_MAGAZINE_MAX                                               \
+  ((SLAB_OBJECT_MAX_SIZE - sizeof(slab_magazine_t)) / sizeof(void *))
+
+/**
+ * @struct memcache_cpu_stat_t
+ * @brief Per-CPU allocation counters of memory cache.
+ *
+ * Counters are updated by their CPU only with local interrupts
+ * disabled, so they need no atomic operations. Each CPU writes its
+ * counters on every alloc/free, so they are padded to a cache line.
+ */
+typedef struct __memcache_cpu_stat {
+  ulong_t allocs;           /**< Objects allocated on the CPU */
+  ulong_t frees;            /**< Objects freed on the CPU */
+  ulong_t remote_frees;     /**< Objects freed into a slab active on another CPU */
+  ulong_t lock_contentions; /**< Memory cache or depot lock found already taken */
+} __l1_cache_aligned__ memcache_cpu_stat_t;
+
+/* Max number of full magazines memory cache depot keeps */
+#define MEMCACHE_DEPOT_FULL_MAX  (CONFIG_NRCPUS * 2)
+
 /**
  * The following flags controls memory cache behaviour
  * @see memcache_t
@@ -160,12 +214,25 @@ struct __memcache {
     int nslabs;
     int nempty_slabs;
     int npartial_slabs;
+    long max_objects;       /**< High watermark of allocated objects */
   } stat;
 
+  memcache_cpu_stat_t *cpu_stat; /**< CONFIG_NRCPUS counters, allocated separately */
+
   memcache_flags_t flags;
-  
+
+  memcache_mags_t *mags;    /**< Per-CPU magazines (NULL if disabled) */
+  int mag_size;             /**< Capacity of new magazines, 0 disables caching */
+  struct {
+    spinlock_t lock;
+    list_head_t full;
+    list_head_t empty;
+    int nfull;
+    int nempty;
+  } depot;
+
+  char name[MEMCACHE_NAME_MAX];
 #ifdef CONFIG_DEBUG_SLAB
-  char name[MEMCACHE_DBG_NAME_MAX];
   int mark_version;
 #endif /* CONFIG_DEBUG_SLAB */
 };
@@ -188,6 +255,33 @@ memcache_t *create_memcache(const char *name, size_t size,
 
 int destroy_memcache(memcache_t *memcache);
 
+/**
+ * @brief Set capacity of per-CPU magazines of memory cache @a memcache
+ *
+ * Magazines that are already filled keep their capacity until they
+ * return to the depot empty. Zero @a size stops caching of freed objects.
+ *
+ * @return 0 on success, -EINVAL if @a size exceeds SLAB_MAGAZINE_MAX,
+ * -ENOMEM if per-CPU magazines couldn't be allocated.
+ */
+int memcache_set_magazine_size(memcache_t *memcache, int size);
+
+/**
+ * @brief Return objects cached in per-CPU magazines and depot of
+ *        @a memcache to their slabs.
+ * @return Number of objects that were returned.
+ */
+int memcache_drain_magazines(memcache_t *memcache);
+
+/**
+ * @brief Call @a fn for statistics of every memory cache in the system
+ *
+ * Walking stops when @a fn returns non-zero value. @a fn may sleep.
+ * @return The value @a fn stopped walking with or 0.
+ */
+int memcaches_walk_stats(int (*fn)(kcontrol_memcache_stat_t *stat, void *ctx),
+                         void *ctx);
+
 /**
  * @brief Allocate object from memory cache @a cache
  *
@@ -197,6 +291,12 @@ int destroy_memcache(memcache_t *memcache);
  */
 void *alloc_from_memcache(memcache_t *cache, int alloc_flags);
 
+/**
+ * @brief Free object @a obj allocated from memory cache @a cache
+ * @see alloc_from_memcache
+ */
+void free_to_memcache(memcache_t *cache, void *obj);
+
 void *__memalloc(size_t size, int alloc_flags);
 
 /**
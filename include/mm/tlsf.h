@@ -40,20 +40,34 @@
 #include <mstring/smp.h>
 #include <mstring/types.h>
 
-#define TLSF_FLD_SIZE       8  /**< TLSF first level directory size */
+#define TLSF_FLD_SIZE       12 /**< TLSF first level directory size */
 #define TLSF_SLD_SIZE       4  /**< TLSF second level directory size */
-#define TLSF_CPUCACHE_PAGES 32 /*  */
+#define TLSF_CPUCACHE_PAGES 32 /**< Max number of pages per-CPU cache keeps for each order */
+#define TLSF_CPUCACHE_ORDERS 4 /**< Per-CPU cache holds blocks of 1, 2, 4 and 8 pages */
 #define TLSF_FIRST_OFFSET   4  /**< TLSF first offset */
+#define TLSF_LARGE_BLOCK    64 /**< Blocks of that many pages and more are carved from the end of free blocks */
 
 #define TLSF_SLDS_MIN 2 /* Minimal number of SLDs in each FLD entry */
-#define TLSF_FLDS_MAX 10 /* Maximum number of FLDs */
+#define TLSF_FLDS_MAX 16 /* Maximum number of FLDs */
 #define TLSF_FLD_BITMAP_SIZE TLSF_FLD_SIZE /* FLD bitmap size */
 #define TLSF_SLD_BITMAP_SIZE round_up((TLSF_FLD_SIZE * TLSF_SLD_SIZE), 8) /* SLD bitmap size */
 
+/*
+ * Per-CPU cache of each order is refilled from the TLSF map up to the
+ * low watermark when it becomes empty, and drained back to the low
+ * watermark when it exceeds the high one. Both are in blocks.
+ */
+#define TLSF_CPUCACHE_HIGH(order) (TLSF_CPUCACHE_PAGES >> (order))
+#define TLSF_CPUCACHE_LOW(order)  (TLSF_CPUCACHE_HIGH(order) >> 1)
+
 #ifdef CONFIG_SMP
 typedef struct tlsf_percpu_cache {
   int noc_pages;     /**< Number of pages in cache */
-  list_head_t pages; /**< List of available pages */
+  struct {
+    int noc_blocks;     /**< Number of blocks of given order */
+    list_head_t blocks; /**< List of available blocks */
+  } orders[TLSF_CPUCACHE_ORDERS];
+  spinlock_t lock;   /**< Taken by the owner CPU and by CPUs draining the cache */
   bool ready;
 } tlsf_percpu_cache_t;
 #endif /* CONFIG_SMP */
@@ -94,7 +108,11 @@ typedef struct tlsf {
   spinlock_t lock;
   mmpool_t *owner;                   /**< Type of pool that owns given TLSF allocator */
   uint8_t slds_bitmap[TLSF_SLD_BITMAP_SIZE];
-  uint8_t fld_bitmap;  
+  uint16_t fld_bitmap;
 } tlsf_t;
 
+#ifdef CONFIG_DEBUG_MM
+void tlsf_validate_dbg(void *_tlsf);
+#endif /* CONFIG_DEBUG_MM */
+
 #endif /* !__MSTRING_TLSF_H__ */
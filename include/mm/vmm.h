@@ -100,6 +100,11 @@ typedef struct __vmrange {
   list_node_t rmap_node;
   pgoff_t offset;
   vmrange_flags_t flags;
+  page_idx_t fault_around;
+
+  /* Sequential access detection for read-ahead of backended objects */
+  pgoff_t ra_next;
+  page_idx_t ra_window;
 } vmrange_t;
 
 typedef struct __vmm {
@@ -143,6 +148,7 @@ int vmm_handle_page_fault(vmm_t *vmm, uintptr_t addr, uint32_t pfmask);
 long vmrange_map(memobj_t *memobj, vmm_t *vmm, uintptr_t addr, page_idx_t npages,
                  vmrange_flags_t flags, pgoff_t offset);
 int unmap_vmranges(vmm_t *vmm, uintptr_t va_from, page_idx_t npages);
+int vmrange_set_fault_around(vmm_t *vmm, uintptr_t addr, page_idx_t npages);
 vmrange_t *vmrange_find(vmm_t *vmm, uintptr_t va_start, uintptr_t va_end, ttree_cursor_t *cursor);
 void vmranges_find_covered(vmm_t *vmm, uintptr_t va_from, uintptr_t va_to, vmrange_set_t *vmrs);
 int fault_in_user_pages(vmm_t *vmm, uintptr_t address, size_t length, uint32_t pfmask,
@@ -173,6 +179,24 @@ static inline uintptr_t pgoff2addr(vmrange_t *vmr, pgoff_t offset)
           ((uintptr_t)(offset - vmr->offset) << PAGE_WIDTH));
 }
 
+/*
+ * Get bounds [*from, *to) of fault-around window of "vmr" containing
+ * "addr". Return false if fault-around is disabled for the range.
+ */
+static inline bool vmrange_fault_around(vmrange_t *vmr, uintptr_t addr,
+                                        uintptr_t *from, uintptr_t *to)
+{
+  uintptr_t size = (uintptr_t)vmr->fault_around << PAGE_WIDTH;
+
+  if (!vmr->fault_around)
+    return false;
+
+  *from = align_down(addr, size);
+  *to = MIN(*from + size, vmr->bounds.space_end);
+  *from = MAX(*from, vmr->bounds.space_start);
+  return true;
+}
+
 struct mmap_args;
 
 /**
@@ -30,7 +30,7 @@
 #include <mstring/smp.h>
 #include <mstring/event.h>
 
-#define NUM_MASTER_PERCPU_THREADS 1
+#define NUM_MASTER_PERCPU_THREADS 2
 
 #ifdef CONFIG_SMP
   #define NUM_SMP_PERCPU_THREADS  1
@@ -15,6 +15,23 @@
   #define KCTRL_SYSTEM_INFO      1
     /* Address of the SWKS area. */
     #define KCTRL_SWKS_ADDR           0
+  /* IPC subsystem statistics. */
+  #define KCTRL_IPC_INFO         2
+    /* Hits and misses of per-CPU caches of non-blocking port messages. */
+    #define KCTRL_IPC_MSG_CACHE_HITS    0
+    #define KCTRL_IPC_MSG_CACHE_MISSES  1
+  /* Memory management statistics. */
+  #define KCTRL_MM_INFO          3
+    /* Number of memory reclaim runs and pages returned by shrinkers. */
+    #define KCTRL_MM_RECLAIM_RUNS       0
+    #define KCTRL_MM_RECLAIMED_PAGES    1
+    /* AF_ZERO pages taken pre-zeroed and zeroed on demand. */
+    #define KCTRL_MM_ZEROED_HITS        2
+    #define KCTRL_MM_ZEROED_MISSES      3
+    /* Array of kcontrol_memcache_stat_t: one per memory cache. */
+    #define KCTRL_MM_MEMCACHE_STATS     4
+    /* Array of kcontrol_mmpool_stat_t: one per active memory pool. */
+    #define KCTRL_MM_MMPOOL_STATS       5
 
 /* Top level node related to kernel debug parameters. */
 #define KCTRL_DEBUG             100000
@@ -23,6 +40,42 @@
 
 #define KCTRL_MAX_NAME_LEN  8
 
+/*
+ * Nodes exporting arrays of records take capacity of user buffer
+ * in bytes from *old_data_size, copy as many whole records as fit
+ * and store size of all records to *old_data_size.
+ */
+#define KCTRL_STAT_NAME_LEN  32
+
+typedef struct __kcontrol_memcache_stat {
+  char name[KCTRL_STAT_NAME_LEN];
+  unsigned long object_size;
+  unsigned long nslabs;
+  unsigned long allocs;
+  unsigned long frees;
+  unsigned long objects;          /* Objects allocated at the moment */
+  unsigned long max_objects;      /* High watermark of allocated objects */
+  unsigned long lock_contentions;
+  unsigned long remote_frees;     /* Frees into slabs active on other CPUs */
+} kcontrol_memcache_stat_t;
+
+/*
+ * Bucket i of page allocation latency histogram counts allocations
+ * that took less than 2^(KCTRL_LATENCY_FIRST_SHIFT + i) CPU cycles,
+ * the last bucket counts all slower ones.
+ */
+#define KCTRL_LATENCY_BUCKETS      16
+#define KCTRL_LATENCY_FIRST_SHIFT  7
+
+typedef struct __kcontrol_mmpool_stat {
+  char name[KCTRL_STAT_NAME_LEN];
+  unsigned long type;
+  unsigned long node;
+  unsigned long num_pages;
+  unsigned long num_free_pages;
+  unsigned long alloc_latency[KCTRL_LATENCY_BUCKETS];
+} kcontrol_mmpool_stat_t;
+
 typedef struct __kcontrol_args {
   int *name;
   unsigned name_len;
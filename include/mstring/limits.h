@@ -51,6 +51,13 @@ void set_default_task_limits(task_limits_t *l);
 void set_limit(task_limits_t *l, uint_t id, ulong_t limit);
 ulong_t get_limit(task_limits_t *l, uint_t id);
 
+/**
+ * @brief Account @a n more items of limit @a id (i.e. pages of LIMIT_MEMORY).
+ * @return 0 on success, -ENOMEM if the limit would be exceeded.
+ */
+int charge_limit(task_limits_t *l, uint_t id, ulong_t n);
+void uncharge_limit(task_limits_t *l, uint_t id, ulong_t n);
+
 static inline task_limits_t * get_task_limits(task_limits_t *l)
 {
   task_limits_t  * ret;
@@ -101,6 +101,7 @@ typedef struct __mstring_sched_cpudata {
   mstring_sched_prio_array_t *active_array,*expired_array;
   mstring_sched_prio_array_t arrays[EZA_SCHED_NUM_ARRAYS];
   task_t *running_task;
+  task_t *handoff_task; /**< Task to run next regardless of its priority. */
   cpu_id_t cpu_id;
 } mstring_sched_cpudata_t;
 
@@ -76,6 +76,7 @@ typedef struct __scheduler {
                                          void *data,ulong_t mask);
   int (*setup_idle_task)(struct __task_struct *task);
   int (*scheduler_control)(struct __task_struct *task, ulong_t cmd,ulong_t arg);
+  int (*yield_to)(struct __task_struct *target);
 } scheduler_t;
 
 /* Main scheduling policies. */
@@ -91,6 +92,7 @@ typedef enum __sched_discipline {
 typedef struct __scheduler_cpu_stats {
   uint64_t task_switches, idle_switches, idle_ticks;
   uint64_t active_tasks,sleeping_tasks;
+  uint64_t handoff_switches;
 } scheduler_cpu_stats_t;
 
 void initialize_scheduler(void);
@@ -123,6 +125,7 @@ int sched_del_task(struct __task_struct *task);
 int sched_setup_idle_task(struct __task_struct *task);
 int sched_add_cpu(cpu_id_t cpu);
 int sched_move_task_to_cpu(struct __task_struct *task,cpu_id_t cpu);
+int sched_yield_to(struct __task_struct *target);
 void update_idle_tick_statistics(scheduler_cpu_stats_t *stats);
 
 extern scheduler_t *get_default_scheduler(void);
@@ -57,7 +57,7 @@
 #define align_up(s,a)    (((s)+((a)-1)) & ~((a)-1))
 #define align_down(s,a)  ((s) & ~((a)-1))
 #define round_up_pow2(x) (!is_powerof2(x) ? (1 << (bit_find_msf(x) + 1)) : (x))
-#define round_down_pow2(x) (!is_poweofr2(x) ? (1 << bit_find_msf(x)) : x)
+#define round_down_pow2(x) (!is_powerof2(x) ? (1 << bit_find_msf(x)) : (x))
 
 #define is_powerof2(num) (((num) & ~((num) - 1)) == (num))
 #define ABS(x) (((x) < 0) ? -(x) : (x))
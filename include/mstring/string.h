@@ -42,6 +42,14 @@ extern int memcmp(const void *s1, const void *s2, size_t n);
 extern void *memcpy(void *dst, const void *src, size_t n);
 extern void *memmove(void *dst, const void *src, size_t n);
 
+/*
+ * memset_nt() fills memory that won't be accessed soon without
+ * polluting CPU caches, if architecture supports it.
+ */
+#ifndef ARCH_MEMSET_NT
+#define memset_nt(s, c, n)  memset((s), (c), (n))
+#endif /* !ARCH_MEMSET_NT */
+
 #ifndef ARCH_STRLEN
 static inline size_t strlen(const char *s)
 {
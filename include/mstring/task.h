@@ -353,6 +353,12 @@ typedef struct __task_struct {
   /* Userspace works-related stuff. */
   uworks_data_t uworks_data;
 
+  /* Per-syscall scratch memory (see mm/scratch.h) */
+  void *scratch_arena;
+
+  /* Pending TLB invalidations of current unmap (see arch/tlb.h) */
+  struct tlb_batch *tlb_batch;
+
   /* Security-related stuff */
   struct __task_s_object *sobject;
 
@@ -551,6 +557,9 @@ void exit_task_events(struct __task_struct *target);
 #define read_task_pending_uworks(t)             \
   arch_read_pending_uworks( &(((task_t*)(t))->arch_context[0]) )
 
+#define task_scratch_top(t)                     \
+  arch_scratch_top( &(((task_t*)(t))->arch_context[0]) )
+
 #define __UNUSABLE_PTR (void *)0x007  /* Target pointer is not usable now. */
 
 #define grab_task_struct(t) atomic_inc(&(t)->refcount)
@@ -97,6 +97,7 @@ static inline void waitqueue_prepare_task(wqueue_task_t *wq_task, struct __task_
   wq_task->task = task;
   wq_task->wq = NULL;
   wq_task->wq_stat=NULL;
+  wq_task->private=NULL;
 }
 
 #define waitqueue_push(wq, wq_task)                     \
@@ -107,7 +107,7 @@ static inline void spinlock_unlock(spinlock_t *spin)
   preempt_enable();
 }
 
-static inline bool spinlcok_trylock(spinlock_t *spin)
+static inline bool spinlock_trylock(spinlock_t *spin)
 {
   bool ret;
 
@@ -149,6 +149,20 @@ static always_inline bool atomic_dec_and_test(atomic_t *a)
   return (ret != 0);
 }
 
+/**
+ * @fn static always_inline ulong_t atomic_xchg(atomic_t *a, ulong_t val)
+ * Atomically store @a val to an atomic variable @a a
+ *
+ * @return The previous value of @a a
+ */
+static always_inline ulong_t atomic_xchg(atomic_t *a, ulong_t val)
+{
+  __asm__ volatile ("xchgq %0, %1\n\t"
+                    : "+r" (val), "+m" (*a)
+                    :: "memory");
+  return val;
+}
+
 #define atomic_bit_set(bitmap, bit)             \
   arch_bit_set(bitmap, bit)
 #define atomic_bit_clear(bitmap, bit)           \
@@ -162,4 +176,11 @@ static always_inline bool atomic_dec_and_test(atomic_t *a)
 #define atomic_test_and_clear_bit(bitmap, bit)  \
   arch_bit_test_and_clear(bitmap, bit)
 
+/**
+ * @def atomic_mb()
+ * Full memory barrier: neither loads nor stores are reordered across it.
+ */
+#define atomic_mb()                             \
+  __asm__ volatile ("mfence\n\t" ::: "memory")
+
 #endif /* __ARCH_ATOMIC_H__ */
@@ -127,6 +127,7 @@
 #define ARCH_CTX_URSP_OFFSET    0x30
 #define ARCH_CTX_UWORKS_OFFSET  0x38
 #define ARCH_CTX_PTD_OFFSET     0x40
+#define ARCH_CTX_SCRATCH_OFFSET 0x48
 
 #ifdef __ASM__
 #include <arch/current.h>
@@ -180,6 +181,8 @@
 #include <arch/interrupt.h>
 #include <mstring/types.h>
 
+struct __rpd;
+
 #define KERNEL_RFLAGS (DEFAULT_RFLAGS_VALUE | (3 << RFLAGS_IOPL_BIT))
      /* The most sensetive bits in RFLAGS.  */
 #define RFLAGS_IOPL_BIT 12
@@ -229,10 +232,12 @@ typedef struct __arch_context_t {
   uintptr_t cr3, rsp, fs, gs, es, ds, user_rsp;
   uintptr_t uworks;
   uintptr_t per_task_data;
+  uintptr_t scratch_top; /* Zeroed on return from syscall, see mm/scratch.h */
   tss_t *tss;
   uintptr_t ldt;
   uint16_t tss_limit;
   uint16_t ldt_limit;
+  struct __rpd *rpd; /* Address space loaded by arch_activate_task() */
 } arch_context_t;
 
 #define arch_set_uworks_bit(ctx,bit)                    \
@@ -247,6 +252,8 @@ typedef struct __arch_context_t {
 
 #define arch_read_pending_uworks(ctx) ((arch_context_t *)(ctx))->uworks
 
+#define arch_scratch_top(ctx) (((arch_context_t *)(ctx))->scratch_top)
+
 struct __vmm;
 struct __task_struct;
 
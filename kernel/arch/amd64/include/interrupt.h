@@ -42,6 +42,7 @@
 
 #define APIC_SPURIOUS_IRQ (IRQ_VECTORS - 1)
 #define APIC_ERROR_IRQ    (IRQ_VECTORS - 2)
+#define TLB_SHOOTDOWN_IRQ (IRQ_VECTORS - 3)
 #define APIC_TIMER_IRQ    (IRQ_VECTORS - 17)
 
 #define IRQ_NUM_TO_VECTOR(irq_num) ((irq_num) + IRQ_BASE)
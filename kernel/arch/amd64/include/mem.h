@@ -8,14 +8,18 @@
 #include <mstring/stddef.h>
 #include <mstring/types.h>
 
-#define ARCH_NUM_MMPOOLS 2
+/* Lowmem, highmem and up to one pool per NUMA node splitting them */
+#ifdef CONFIG_NUMA
+#define ARCH_NUM_MMPOOLS    (2 + CONFIG_NUMA_NODES)
+#else
+#define ARCH_NUM_MMPOOLS    2
+#endif /* CONFIG_NUMA */
 
 #define MIN_MEM_REQUIRED    MB2B(4)
 #define MAX_PAGES_MAP_FIRST (MB2B(512) >> PAGE_WIDTH)
 #define IDENT_MAP_PAGES     (MB2B(2) >> PAGE_WIDTH)
 #define KERNEL_END_VIRT     ((uintptr_t)__kernel_end)
 #define KERNEL_END_PHYS     KVIRT_TO_PHYS(KERNEL_END_VIRT)
-#define ARCH_NUM_MMPOOLS    2
 #define USPACE_VADDR_TOP    (16UL << 40UL) /* 16 terabytes */
 #define USPACE_VADDR_BOTTOM 0x1001000UL
 
@@ -26,6 +30,9 @@ INITCODE void arch_mem_init(void);
 INITCODE void arch_cpu_enable_paging(void);
 INITCODE void arch_register_mmpools(void);
 INITCODE void arch_configure_mmpools(void);
+#ifdef CONFIG_NUMA
+INITCODE void arch_register_numa_mmpools(uintptr_t mem_end);
+#endif /* CONFIG_NUMA */
 
 void *arch_root_pdir_allocate_ctx(void);
 void arch_root_pdir_free_ctx(void *ctx);
@@ -27,6 +27,12 @@
 #define PAGE_MASK     (PAGE_SIZE - 1)
 #define PAGE_WIDTH    12
 
+/* Large pages are mapped by the PDEs of the second level */
+#define LARGE_PAGE_WIDTH (PAGE_WIDTH + 9)
+#define LARGE_PAGE_SIZE  (1 << LARGE_PAGE_WIDTH)
+#define LARGE_PAGE_MASK  (LARGE_PAGE_SIZE - 1)
+#define LARGE_PAGE_PAGES (LARGE_PAGE_SIZE >> PAGE_WIDTH)
+
 #ifdef __ASM__
 #define KERNEL_OFFSET 0xffffffff80000000
 
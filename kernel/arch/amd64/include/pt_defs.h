@@ -35,7 +35,7 @@
                               physical page to which this entry points has been accessed */
 #define PDE_DIRTY   0x0040 /**< Indicates whether the page-translation table or physical page to which this
                               entry points has been written. */
-#define PDE_PS      0x0080 
+#define PDE_PS      0x0080 /**< Page size. When set in the second level PDE, it maps a large page. */
 #define PDE_GLOBAL  0x0100 /**< The TLB entry for a global page (G=1) is not invalidated when CR3 is loaded */
 #define PDE_PAT     0x1000 /**< Page-Attribute Table. See “Page-Attribute Table Mechanism” on page 193
                               of AMD architecture programmers manual vol. 2 for more info. */
@@ -80,6 +80,7 @@ typedef struct __pde {
 #define PTABLE_DIR_ENTRIES 0x200 /**< Number of entries per page table directory */
 #define PTABLE_LEVEL_FIRST 0     /**< Level of the lowest pde */
 #define PTABLE_LEVEL_LAST  3     /**< Level of the highest pde */
+#define PTABLE_LEVEL_LARGE 1     /**< Level of pde mapping a large page */
 
 #define pagedir_set_ref(pde, val)               \
     ((pde)->count = (val))
@@ -92,6 +93,7 @@ typedef struct __pde {
 
 #define pde_is_present(pde) (!!((pde)->flags & PDE_PRESENT))
 #define pde_set_not_present(pde) ((pde)->flags &= ~PDE_PRESENT)
+#define pde_is_large(pde) (!!((pde)->flags & PDE_PS))
 
 /**
  * @brief Translate virtual address to PDE index.
@@ -60,10 +60,11 @@ static always_inline bool arch_spinlock_trylock(struct raw_spinlock *lock)
 {
   int ret = __SPINLOCK_UNLOCKED_V;
   __asm__ volatile (__LOCK_PREFIX "cmpxchgl %2, %0\n\t"
-                    : "+m" (lock->__spin_val), "=&a" (ret)
-                    : "Ir" (__SPINLOCK_LOCKED_V));
+                    : "+m" (lock->__spin_val), "+a" (ret)
+                    : "r" (__SPINLOCK_LOCKED_V)
+                    : "memory");
 
-  return !ret;
+  return (ret == __SPINLOCK_UNLOCKED_V);
 }
 
 static always_inline bool arch_spinlock_is_locked(struct raw_spinlock *lock)
@@ -27,5 +27,10 @@
 
 //#define ARCH_MEMSET
 //#define ARCH_MEMCPY
+#define ARCH_MEMSET_NT
+
+/* amd64_memset() bypasses CPU caches when filling 256 bytes and more */
+extern void *amd64_memset(void *s, int c, size_t n);
+#define memset_nt(s, c, n)  amd64_memset((s), (c), (n))
 
 #endif /* __ARCH_STRING_H__ */
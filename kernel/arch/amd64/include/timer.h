@@ -30,5 +30,16 @@
 void arch_timer_init(void);
 uint64_t arch_calibrate_delay_loop(void);
 
+/* Read CPU's time stamp counter */
+static inline uint64_t arch_cycles(void)
+{
+  uint32_t eax, edx;
+
+  __asm__ volatile ("rdtsc\n"
+                    : "=a" (eax), "=d" (edx));
+
+  return (((uint64_t)edx << 32) | eax);
+}
+
 #endif 
 
@@ -24,12 +24,50 @@
 #ifndef __ARCH_TLB_H__
 #define __ARCH_TLB_H__
 
+#include <config.h>
 #include <arch/ptable.h>
 #include <arch/asm.h>
+#include <arch/atomic.h>
 #include <arch/cpu.h>
+#include <ds/list.h>
+#include <mm/page.h>
+#include <mm/mem.h>
+#include <mstring/smp.h>
 #include <mstring/task.h>
 #include <mstring/types.h>
 
+/*
+ * Invalidations requested while a batch is active are collected
+ * and done at once by tlb_batch_finish(). If there are more than
+ * TLB_BATCH_PAGES of them, whole TLB is flushed instead.
+ */
+#define TLB_BATCH_PAGES 32
+#define TLB_FLUSH_ALL   (-1)
+
+struct tlb_batch {
+  rpd_t *rpd;
+  int nr_addrs;  /* Number of addresses or TLB_FLUSH_ALL */
+  uintptr_t addrs[TLB_BATCH_PAGES];
+  list_head_t frees; /* Pages freed after invalidation, by chain_node */
+};
+
+/*
+ * With PCIDs TLB entries of the last TLB_NR_PCIDS - 1 address spaces
+ * loaded on a CPU survive the switch. PCID 0 is used by the kernel
+ * page directory. Invalidations of address spaces which aren't loaded
+ * are tracked by rpd->tlb_gen and done when they are loaded again.
+ */
+#define TLB_NR_PCIDS 8
+
+/* Physical address of root page directory loaded on each CPU */
+extern uintptr_t PER_CPU_VAR(active_cr3);
+
+/* Set if CPUs tag TLB entries by PCID, see tlb_set_pcid() */
+extern bool tlb_pcid_enabled;
+
+/* Number of shootdown IPIs sent to other CPUs */
+extern ulong_t tlb_shootdown_ipis;
+
 static inline void __tlb_flush(void)
 {
   write_cr3(read_cr3());
@@ -41,16 +79,79 @@ static inline void __tlb_flush_entry(uintptr_t vaddr)
                    :: "r" (vaddr));
 }
 
+void tlb_init_rpd(rpd_t *rpd);
+
+/*
+ * Load root page directory @a cr3 of @a rpd on current CPU with
+ * interrupts disabled. @a rpd is NULL if it may be already freed.
+ */
+void tlb_switch_rpd(rpd_t *rpd, uintptr_t cr3);
+
+/*
+ * Load address space of @a rpd on current CPU out of the context switch.
+ * Caller must have preemption disabled until the original one is loaded back.
+ */
+void load_rpd(rpd_t *rpd);
+
+/*
+ * Make current kernel thread run in address space of @a rpd across
+ * context switches, or in its own one again if @a rpd is NULL.
+ */
+void tlb_use_rpd(rpd_t *rpd);
+
+/* Turn PCIDs on or off at runtime, -ENOTSUP if CPU lacks them */
+int tlb_set_pcid(bool on);
+
+void tlb_shootdown(rpd_t *rpd, uintptr_t *addrs, int nr_addrs);
+void tlb_shootdown_interrupt(void *unused);
+
+/*
+ * Start collecting TLB invalidations of @a rpd done by current task.
+ * If the task already has a batch, the outer one collects them.
+ */
+void tlb_batch_start(struct tlb_batch *batch, rpd_t *rpd);
+void tlb_batch_finish(struct tlb_batch *batch);
+
 static inline void tlb_flush(rpd_t *rpd)
 {
-  if (rpd->vmm && (rpd->vmm == current_task()->task_mm))
-    __tlb_flush();
+  struct tlb_batch *batch;
+
+  if (!rpd->vmm) {
+    /* Kernel mappings are flushed by the next address space switch */
+    atomic_inc(&KERNEL_ROOT_PDIR()->tlb_gen);
+    return;
+  }
+
+  batch = current_task()->tlb_batch;
+  if (batch && (batch->rpd == rpd)) {
+    batch->nr_addrs = TLB_FLUSH_ALL;
+    return;
+  }
+
+  tlb_shootdown(rpd, NULL, TLB_FLUSH_ALL);
 }
 
 static inline void tlb_flush_entry(rpd_t *rpd, uintptr_t vaddr)
 {
-  if (rpd->vmm && (rpd->vmm == current_task()->task_mm))
-    __tlb_flush_entry(vaddr);
+  struct tlb_batch *batch;
+
+  if (!rpd->vmm) {
+    /* Kernel mappings are flushed by the next address space switch */
+    atomic_inc(&KERNEL_ROOT_PDIR()->tlb_gen);
+    return;
+  }
+
+  batch = current_task()->tlb_batch;
+  if (batch && (batch->rpd == rpd)) {
+    if (batch->nr_addrs == TLB_BATCH_PAGES)
+      batch->nr_addrs = TLB_FLUSH_ALL;
+    else if (batch->nr_addrs != TLB_FLUSH_ALL)
+      batch->addrs[batch->nr_addrs++] = vaddr;
+
+    return;
+  }
+
+  tlb_shootdown(rpd, &vaddr, 1);
 }
 
 #endif /* __ARCH_TLB_H__ */
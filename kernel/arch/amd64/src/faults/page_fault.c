@@ -102,6 +102,15 @@ void FH_page_fault(struct fault_ctx *fctx)
   struct intr_stack_frame *stack_frame = fctx->istack_frame;
 
   fault_addr = read_cr2();
+
+  /*
+   * Fault handler may wait for TLB shootdown done by another CPU
+   * holding the page tables lock, so it must not block IPIs.
+   */
+  if (stack_frame->rflags & RFLAGS_IF) {
+    interrupts_enable();
+  }
+
   fixup_addr = fixup_fault_address(stack_frame->rip);
   if (IS_KERNEL_FAULT(fctx) && !fixup_addr) {
     display_unhandled_pf_info(fctx, fault_addr);
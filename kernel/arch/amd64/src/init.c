@@ -29,6 +29,7 @@
 #include <arch/apic.h>
 #include <arch/ioapic.h>
 #include <arch/current.h>
+#include <arch/tlb.h>
 #include <mstring/kprintf.h>
 #include <mstring/smp.h>
 #include <mstring/task.h>
@@ -104,6 +105,13 @@ static INITCODE void init_cpu_features(void)
 
   val = read_cr4();
   val |= CR4_OSFXSR | CR4_OSXMMEXCPT;
+
+  /* Keep TLB entries of several address spaces tagged, see arch/tlb.h */
+  if (cpu_has_feature(X86_FTR_PCID)) {
+    val |= CR4_PCIDE;
+    tlb_pcid_enabled = true;
+  }
+
   write_cr4(val);
 }
 
@@ -165,6 +173,9 @@ static INITCODE void prepare_lapic_info(void)
     }
 
     *lapic_id = lapic_tlb->apic_id;
+#ifdef CONFIG_NUMA
+    acpi_numa_bind_cpu(cpu, *lapic_id);
+#endif /* CONFIG_NUMA */
     i++;
     cpu++;
   }
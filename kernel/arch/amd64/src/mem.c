@@ -27,6 +27,8 @@
 #include <arch/msr.h>
 #include <arch/mem.h>
 #include <arch/cpufeatures.h>
+#include <arch/acpi.h>
+#include <arch/tlb.h>
 #include <mm/page.h>
 #include <mm/mem.h>
 #include <mm/mmpool.h>
@@ -162,6 +164,7 @@ static int root_pdir_init_arch(rpd_t *rpd)
     return ERR(-ENOMEM);
   }
 
+  tlb_init_rpd(rpd);
   return 0;
 }
 
@@ -179,6 +182,7 @@ static void root_pdir_deinit_arch(rpd_t *rpd)
 struct pt_ops pt_ops = {
   .map_page = ptable_map_page,
   .unmap_page = ptable_unmap_page,
+  .map_large_page = ptable_map_large_page,
   .vaddr_to_pidx = ptable_vaddr_to_pidx,
   .alloc_pagedir = boottime_alloc_pdir,
   .free_pagedir = boottime_free_pdir,
@@ -194,17 +198,27 @@ static inline bool is_kernel_page(page_frame_t *page)
 static INITCODE void __map_kmem(page_idx_t pidx, page_idx_t npages,
                                     uintptr_t addr, ptable_flags_t flags)
 {
+  page_idx_t n;
   int ret = 0;
 
   while (pidx < npages) {
-    ret = pt_ops.map_page(&kernel_root_pdir, addr, pidx, flags);
+    /* Use large pages wherever both addresses are suitably aligned */
+    if (!(addr & LARGE_PAGE_MASK) && !(pidx & (LARGE_PAGE_PAGES - 1))
+        && ((npages - pidx) >= LARGE_PAGE_PAGES)) {
+      ret = pt_ops.map_large_page(&kernel_root_pdir, addr, pidx, flags);
+      n = LARGE_PAGE_PAGES;
+    }
+    else {
+      ret = pt_ops.map_page(&kernel_root_pdir, addr, pidx, flags);
+      n = 1;
+    }
     if (ret) {
       panic("Failed to create kernel mapping: %p -> %p. [ERR = %d]\n",
-            (uintptr_t)pidx << PAGE_WIDTH, addr);
+            (uintptr_t)pidx << PAGE_WIDTH, addr, ret);
     }
 
-    pidx++;
-    addr += PAGE_SIZE;
+    pidx += n;
+    addr += (uintptr_t)n << PAGE_WIDTH;
   }
 }
 
@@ -369,6 +383,16 @@ INITCODE void arch_mem_init(void)
   initialize_rpd(&kernel_root_pdir, NULL);
   paging_init();
 
+#ifdef CONFIG_NUMA
+  /*
+   * Memory pools must be split by nodes before they get their pages.
+   * ACPI tables lying out of kernel mapping are mapped using ealloc.
+   */
+  if (!acpi_numa_init()) {
+    arch_register_numa_mmpools(last_usable_addr);
+  }
+#endif /* CONFIG_NUMA */
+
   /*
    * After kerenl mapping was sucessfully configured,
    * ealloc page allocator can be disabled.
@@ -24,6 +24,8 @@
 #include <mm/page.h>
 #include <mm/page_alloc.h>
 #include <mm/mmpool.h>
+#include <mm/numa.h>
+#include <mstring/kprintf.h>
 #include <mstring/panic.h>
 #include <mstring/types.h>
 
@@ -44,20 +46,94 @@ INITCODE void arch_register_mmpools(void)
   mmpool_register(&highmem_pool);
 }
 
-INITCODE void arch_configure_mmpools(void)
+#ifdef CONFIG_NUMA
+static mmpool_t node_pools[CONFIG_NUMA_NODES];
+static char node_pool_names[CONFIG_NUMA_NODES][16];
+
+/*
+ * Pages are distributed among pools by pools' bound addresses, so
+ * lowmem and highmem pools are split at the end of each node's
+ * memory range lying inside them. Pools get their nodes later, when
+ * their pages are known.
+ */
+INITCODE void arch_register_numa_mmpools(uintptr_t mem_end)
 {
+  int i, n = 0;
+  uintptr_t bound;
   mmpool_t *p;
 
-  ASSERT(atomic_get(&lowmem_pool.num_free_pages) > 0);
+  for (i = 0; i < numa_num_memblocks - 1; i++) {
+    bound = numa_memblocks[i].end;
+    if ((bound >= mem_end) || (bound == lowmem_pool.bound_addr)) {
+      continue;
+    }
+    if (n == CONFIG_NUMA_NODES) {
+      kprintf(KO_WARNING "NUMA: too many memory ranges, memory above %p "
+              "is not split by nodes\n", bound);
+      break;
+    }
+
+    p = &node_pools[n];
+    snprintf(node_pool_names[n], sizeof(node_pool_names[n]),
+             "Node%d mem", numa_memblocks[i].node);
+    p->name = node_pool_names[n];
+    p->flags = MMPOOL_KERN | MMPOOL_USER;
+    if (bound < lowmem_pool.bound_addr) {
+      p->flags |= MMPOOL_DMA;
+    }
+
+    p->bound_addr = bound;
+    mmpool_register(p);
+    n++;
+  }
+}
+
+/*
+ * Lowmem pool may be left without free pages after splitting,
+ * return the biggest of low node pools to replace it.
+ */
+static INITCODE mmpool_t *numa_configure_mmpools(void)
+{
+  mmpool_t *lowpool = NULL;
+  int i;
+
+  for (i = 0; i < CONFIG_NUMA_NODES; i++) {
+    if (!node_pools[i].name) {
+      continue;
+    }
+
+    node_pools[i].allocator = default_allocator;
+    if ((node_pools[i].flags & MMPOOL_DMA) &&
+        (!lowpool || (atomic_get(&node_pools[i].num_free_pages) >
+                      atomic_get(&lowpool->num_free_pages)))) {
+      lowpool = &node_pools[i];
+    }
+  }
+
+  return lowpool;
+}
+#else
+#define numa_configure_mmpools() NULL
+#endif /* CONFIG_NUMA */
+
+INITCODE void arch_configure_mmpools(void)
+{
+  mmpool_t *p, *lowpool;
+
   highmem_pool.allocator = default_allocator;
   lowmem_pool.allocator = default_allocator;
-  
-  mmpool_set_preferred(PREF_MMPOOL_DMA, &lowmem_pool);
+  lowpool = numa_configure_mmpools();
+  if (!lowpool || (atomic_get(&lowmem_pool.num_free_pages) > 0)) {
+    lowpool = &lowmem_pool;
+  }
+
+  ASSERT(atomic_get(&lowpool->num_free_pages) > 0);
+  mmpool_set_preferred(PREF_MMPOOL_DMA, lowpool);
   if (atomic_get(&highmem_pool.num_free_pages) > 0) {    
     p = &highmem_pool;
   }
   else {
-    p = &lowmem_pool;    
+    p = lowpool;    
   }
 
   mmpool_set_preferred(PREF_MMPOOL_KERN, p);
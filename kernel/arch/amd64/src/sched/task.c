@@ -41,6 +41,7 @@
 #include <mstring/process.h>
 #include <arch/context.h>
 #include <arch/ptable.h>
+#include <arch/tlb.h>
 #include <security/security.h>
 #include <mstring/ptrace.h>
 #include <config.h>
@@ -90,7 +91,8 @@ static void __arch_setup_ctx(task_t *newtask,uint64_t rsp,
 
   ctx->rsp = rsp;
   /* Setup CR3 */
-  ctx->cr3 = KVIRT_TO_PHYS((uintptr_t)task_get_rpd(newtask)->root_dir);
+  ctx->rpd = task_get_rpd(newtask);
+  ctx->cr3 = KVIRT_TO_PHYS((uintptr_t)ctx->rpd->root_dir);
   ctx->user_rsp = 0;
 
   /* Default TSS value which means: use per-CPU TSS. */
@@ -99,6 +101,7 @@ static void __arch_setup_ctx(task_t *newtask,uint64_t rsp,
   ctx->ldt=0;
   ctx->ldt_limit=0;
   ctx->per_task_data=0;
+  ctx->scratch_top=0;
 }
 
 void kernel_thread_helper(void (*fn)(void*), void *data)
@@ -475,6 +478,12 @@ void arch_activate_task(task_t *to)
            to->pid,to->tid,to->cpu, current_task()->pid, current_task()->tid);
 #endif
 
+  /*
+   * Kernel mappings are shared by all address spaces, so new %cr3
+   * is loaded on the current stack. VMM of exiting task may be gone.
+   */
+  tlb_switch_rpd((to->flags & TF_EXITING) ? NULL : to_ctx->rpd, to_ctx->cr3);
+
       /* Let's jump ! */
   arch_hw_activate_task(to_ctx,to,from_ctx,to->kernel_stack.high_address);
 }
@@ -0,0 +1,352 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * (c) Copyright 2006,2007,2008 MString Core Team <http://mstring.jarios.org>
+ *
+ * mstring/amd64/tlb.c: TLB shootdown and batching of invalidations.
+ *
+ */
+
+#include <config.h>
+#include <mm/page.h>
+#include <mm/page_alloc.h>
+#include <mm/mem.h>
+#include <arch/tlb.h>
+#include <arch/atomic.h>
+#include <arch/interrupt.h>
+#include <arch/apic.h>
+#include <arch/context.h>
+#include <sync/spinlock.h>
+#include <mstring/smp.h>
+#include <mstring/task.h>
+#include <mstring/assert.h>
+#include <mstring/errno.h>
+#include <mstring/types.h>
+
+/*
+ * Set by arch_activate_task() before %cr3 is loaded. A CPU which
+ * doesn't have the address space loaded has no TLB entries of it:
+ * loading another %cr3 flushed them.
+ */
+uintptr_t PER_CPU_VAR(active_cr3);
+ulong_t tlb_shootdown_ipis = 0;
+bool tlb_pcid_enabled = false;
+
+/*
+ * PCID N is given to the address space in slots[N]. Slot 0 is used
+ * only for the kernel page directory, others are recycled round-robin.
+ * A slot is valid while TLB entries of its PCID were flushed at or
+ * after tlb_gen of the address space it belongs to.
+ */
+struct tlb_pcid_slot {
+  ulong_t ctx;
+  ulong_t gen;
+};
+
+struct tlb_pcids {
+  struct tlb_pcid_slot slots[TLB_NR_PCIDS];
+  int next; /* Slot to recycle minus one */
+  ulong_t kernel_gen; /* Generation of kernel mappings slots are valid for */
+};
+
+static struct tlb_pcids PER_CPU_VAR(tlb_pcids);
+static SPINLOCK_DEFINE(tlb_ctx_lock, "TLB contexts");
+static ulong_t tlb_next_ctx = 1;
+
+static void __flush_local(uintptr_t *addrs, int nr_addrs)
+{
+  int i;
+
+  if (nr_addrs == TLB_FLUSH_ALL) {
+    __tlb_flush();
+    return;
+  }
+
+  for (i = 0; i < nr_addrs; i++)
+    __tlb_flush_entry(addrs[i]);
+}
+
+#ifdef CONFIG_SMP
+/*
+ * Only one shootdown is in flight. Its initiator waits for targets
+ * with interrupts disabled, so a CPU waiting for the lock to start
+ * its own shootdown serves the current one by polling.
+ */
+#define SHOOTDOWN_RESEND_SPINS 1000000
+
+static SPINLOCK_DEFINE(shootdown_lock, "TLB shootdown");
+static volatile cpumask_t shootdown_pending = 0;
+static uintptr_t *shootdown_addrs;
+static int shootdown_nr_addrs;
+
+static void __serve_shootdown(cpu_id_t cpu)
+{
+  if (!atomic_bit_test(&shootdown_pending, cpu))
+    return;
+
+  atomic_mb();
+  __flush_local(shootdown_addrs, shootdown_nr_addrs);
+  atomic_bit_clear(&shootdown_pending, cpu);
+}
+
+void tlb_shootdown_interrupt(void *unused)
+{
+  __serve_shootdown(cpu_id());
+}
+
+static void __send_shootdown(cpumask_t targets, int nr_targets,
+                             uintptr_t *addrs, int nr_addrs)
+{
+  cpu_id_t c, self = cpu_id();
+  ulong_t spins;
+
+  while (!spinlock_trylock(&shootdown_lock))
+    __serve_shootdown(self);
+
+  shootdown_addrs = addrs;
+  shootdown_nr_addrs = nr_addrs;
+  atomic_mb();
+  shootdown_pending = targets;
+  lapic_send_ipi(targets, IRQ_NUM_TO_VECTOR(TLB_SHOOTDOWN_IRQ));
+  tlb_shootdown_ipis += nr_targets;
+  for (spins = 0; shootdown_pending; spins++) {
+    if (spins < SHOOTDOWN_RESEND_SPINS)
+      continue;
+
+    /*
+     * The IPI didn't get through: send it again to the CPUs which
+     * still haven't answered. Offline CPUs have nothing to flush.
+     */
+    spins = 0;
+    for_each_cpu(c) {
+      if (atomic_bit_test(&shootdown_pending, c) && !is_cpu_online(c))
+        atomic_bit_clear(&shootdown_pending, c);
+    }
+    if (shootdown_pending)
+      lapic_send_ipi(shootdown_pending, IRQ_NUM_TO_VECTOR(TLB_SHOOTDOWN_IRQ));
+  }
+
+  spinlock_unlock(&shootdown_lock);
+}
+#endif /* CONFIG_SMP */
+
+/*
+ * Invalidate @a nr_addrs addresses from @a addrs (or whole TLB if
+ * @a nr_addrs is TLB_FLUSH_ALL) on each CPU having @a rpd loaded.
+ * Page tables must be already updated.
+ */
+void tlb_shootdown(rpd_t *rpd, uintptr_t *addrs, int nr_addrs)
+{
+  uintptr_t cr3 = KVIRT_TO_PHYS((uintptr_t)rpd->root_dir);
+  int irqstat;
+#ifdef CONFIG_SMP
+  cpumask_t targets = 0;
+  int nr_targets = 0;
+  cpu_id_t c;
+#endif /* CONFIG_SMP */
+
+  if (!nr_addrs)
+    return;
+
+  /*
+   * CPUs which don't have the address space loaded flush its PCID
+   * when they load it again. The locked increment also makes page
+   * table updates visible before active_cr3 is read.
+   */
+  atomic_inc(&rpd->tlb_gen);
+  interrupts_save_and_disable(irqstat);
+  if (*percpu_get_var(active_cr3) == cr3)
+    __flush_local(addrs, nr_addrs);
+
+#ifdef CONFIG_SMP
+  for_each_cpu(c) {
+    if ((c != cpu_id()) && is_cpu_online(c) &&
+        (*raw_percpu_get_var(active_cr3, c) == cr3)) {
+      targets |= (1UL << c);
+      nr_targets++;
+    }
+  }
+  if (targets)
+    __send_shootdown(targets, nr_targets, addrs, nr_addrs);
+#endif /* CONFIG_SMP */
+
+  interrupts_restore(irqstat);
+}
+
+void tlb_init_rpd(rpd_t *rpd)
+{
+  spinlock_lock(&tlb_ctx_lock);
+  rpd->tlb_ctx = tlb_next_ctx++;
+  spinlock_unlock(&tlb_ctx_lock);
+  atomic_set(&rpd->tlb_gen, 0);
+}
+
+static int __pcid_slot(struct tlb_pcids *pcids, rpd_t *rpd)
+{
+  int i;
+
+  if (rpd == KERNEL_ROOT_PDIR())
+    return 0;
+
+  for (i = 1; i < TLB_NR_PCIDS; i++) {
+    if (pcids->slots[i].ctx == rpd->tlb_ctx)
+      return i;
+  }
+
+  i = pcids->next + 1;
+  pcids->next = i % (TLB_NR_PCIDS - 1);
+  pcids->slots[i].ctx = 0;
+  return i;
+}
+
+void tlb_switch_rpd(rpd_t *rpd, uintptr_t cr3)
+{
+  struct tlb_pcids *pcids = percpu_get_var(tlb_pcids);
+  struct tlb_pcid_slot *slot;
+  ulong_t gen, kernel_gen;
+  int i;
+
+  /* Other CPUs must see it before TLB is filled by new %cr3 */
+  percpu_set_var(active_cr3, cr3);
+  if (!tlb_pcid_enabled) {
+    /* PCID 0 gets entries of any address space */
+    pcids->slots[0].ctx = 0;
+    if (read_cr3() != cr3)
+      write_cr3(cr3);
+
+    return;
+  }
+
+  /* Pairs with tlb_gen increment in tlb_shootdown() */
+  atomic_mb();
+  kernel_gen = atomic_get(&KERNEL_ROOT_PDIR()->tlb_gen);
+  if (pcids->kernel_gen != kernel_gen) {
+    for (i = 0; i < TLB_NR_PCIDS; i++)
+      pcids->slots[i].ctx = 0;
+
+    pcids->kernel_gen = kernel_gen;
+  }
+
+  /* Kernel threads have their own copy of kernel rpd */
+  if (cr3 == KVIRT_TO_PHYS((uintptr_t)KERNEL_ROOT_PDIR()->root_dir))
+    rpd = KERNEL_ROOT_PDIR();
+  else if (!rpd) {
+    pcids->slots[0].ctx = 0;
+    write_cr3(cr3);
+    return;
+  }
+
+  i = __pcid_slot(pcids, rpd);
+  slot = &pcids->slots[i];
+  gen = atomic_get(&rpd->tlb_gen);
+  if (slot->ctx == rpd->tlb_ctx) {
+    /*
+     * If the address space stays loaded, invalidations done since
+     * it was loaded were sent to this CPU by tlb_shootdown().
+     */
+    if (read_cr3() != (cr3 | i)) {
+      if (slot->gen == gen)
+        write_cr3(cr3 | i | CR3_NOFLUSH);
+      else
+        write_cr3(cr3 | i);
+    }
+  }
+  else
+    write_cr3(cr3 | i);
+
+  slot->ctx = rpd->tlb_ctx;
+  slot->gen = gen;
+}
+
+void load_rpd(rpd_t *rpd)
+{
+  int irqstat;
+
+  interrupts_save_and_disable(irqstat);
+  tlb_switch_rpd(rpd, KVIRT_TO_PHYS((uintptr_t)rpd->root_dir));
+  interrupts_restore(irqstat);
+}
+
+void tlb_use_rpd(rpd_t *rpd)
+{
+  task_t *task = current_task();
+  arch_context_t *ctx = (arch_context_t *)&task->arch_context[0];
+  int irqstat;
+
+  if (!rpd)
+    rpd = task_get_rpd(task);
+
+  interrupts_save_and_disable(irqstat);
+  ctx->rpd = rpd;
+  ctx->cr3 = KVIRT_TO_PHYS((uintptr_t)rpd->root_dir);
+  tlb_switch_rpd(rpd, ctx->cr3);
+  interrupts_restore(irqstat);
+}
+
+int tlb_set_pcid(bool on)
+{
+  if (on && !(read_cr4() & CR4_PCIDE))
+    return ERR(-ENOTSUP);
+
+  tlb_pcid_enabled = on;
+  return 0;
+}
+
+void tlb_batch_start(struct tlb_batch *batch, rpd_t *rpd)
+{
+  task_t *task = current_task();
+
+  batch->rpd = rpd;
+  batch->nr_addrs = 0;
+  list_init_head(&batch->frees);
+  if (!task->tlb_batch)
+    task->tlb_batch = batch;
+}
+
+void tlb_batch_finish(struct tlb_batch *batch)
+{
+  task_t *task = current_task();
+  list_node_t *n, *safe;
+
+  if (task->tlb_batch != batch)
+    return;
+
+  task->tlb_batch = NULL;
+  tlb_shootdown(batch->rpd, batch->addrs, batch->nr_addrs);
+
+  /* Nobody can access freed pages via stale TLB entries now */
+  list_for_each_safe(&batch->frees, n, safe) {
+    free_page(list_entry(n, page_frame_t, chain_node));
+  }
+}
+
+bool tlb_batch_defer_free(page_frame_t *page)
+{
+  task_t *task = current_task();
+  struct tlb_batch *batch;
+
+  /* Pages may be unpinned during boot, before any task exists */
+  if (unlikely(!task) || !task->tlb_batch)
+    return false;
+
+  /*
+   * Page is free, so its chain_node isn't used by anyone:
+   * the allocator initializes it when the page is freed.
+   */
+  batch = task->tlb_batch;
+  list_add2tail(&batch->frees, &page->chain_node);
+  return true;
+}
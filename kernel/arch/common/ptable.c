@@ -24,11 +24,23 @@
 #include <mm/mem.h>
 #include <arch/pt_defs.h>
 #include <arch/tlb.h>
+#include <ds/list.h>
+#include <sync/spinlock.h>
 #include <mstring/errno.h>
+#include <mstring/panic.h>
 #include <mstring/types.h>
 
 ptable_flags_t __ptbl_allowed_flags_mask;
 
+/*
+ * Unmapping a part of a large page splits it, and unmap path can't fail.
+ * So each large page mapped to user space deposits a page table here
+ * and its split takes one back. Kernel large pages are split rarely, they
+ * allocate page table on split.
+ */
+static LIST_DEFINE(deposited_pagedirs);
+static SPINLOCK_DEFINE(deposit_lock, "Deposited page tables");
+
 static int populate_pagedir(pde_t *pde, ptable_flags_t flags)
 {
   void *subdir;
@@ -50,6 +62,61 @@ static void depopulate_pagedir(pde_t *pde)
   pt_ops.free_pagedir(pde_get_current_dir(pde));
 }
 
+static int deposit_pagedir(void)
+{
+  void *dir = pt_ops.alloc_pagedir();
+
+  if (!dir)
+    return ERR(-ENOMEM);
+
+  spinlock_lock(&deposit_lock);
+  list_add2tail(&deposited_pagedirs, &virt_to_pframe(dir)->node);
+  spinlock_unlock(&deposit_lock);
+  return 0;
+}
+
+static void *withdraw_pagedir(rpd_t *rpd)
+{
+  page_frame_t *page = NULL;
+
+  if (rpd == KERNEL_ROOT_PDIR())
+    return pt_ops.alloc_pagedir();
+
+  spinlock_lock(&deposit_lock);
+  if (likely(!list_is_empty(&deposited_pagedirs))) {
+    page = list_entry(list_node_first(&deposited_pagedirs), page_frame_t, node);
+    list_del(&page->node);
+  }
+
+  spinlock_unlock(&deposit_lock);
+  return (page ? pframe_to_virt(page) : NULL);
+}
+
+/*
+ * Replace large page mapped by @a pde with a page table mapping
+ * the same pages with the same flags.
+ */
+static int split_large_page(rpd_t *rpd, pde_t *pde, uintptr_t addr)
+{
+  page_idx_t pidx = pde_fetch_page_idx(pde);
+  ptable_flags_t flags = pde_get_flags(pde) & ~PDE_PS;
+  void *subdir;
+  int i;
+
+  ASSERT(pde_is_large(pde));
+  subdir = withdraw_pagedir(rpd);
+  if (!subdir)
+    return ERR(-ENOMEM);
+
+  for (i = 0; i < PTABLE_DIR_ENTRIES; i++)
+    pde_save(pde_fetch(subdir, i), pidx + i, flags);
+
+  pde_save(pde, virt_to_pframe_id(subdir), PTABLE_DEF_PDIR_FLAGS);
+  pagedir_set_ref(pde, PTABLE_DIR_ENTRIES + 1);
+  tlb_flush_entry(rpd, addr & ~(uintptr_t)LARGE_PAGE_MASK);
+  return 0;
+}
+
 page_idx_t ptable_vaddr_to_pidx(rpd_t *rpd, uintptr_t vaddr,
                                 /* OUT */ pde_t **retpde)
 {
@@ -65,6 +132,13 @@ page_idx_t ptable_vaddr_to_pidx(rpd_t *rpd, uintptr_t vaddr,
     pde = pde_fetch(cur_dir, pde_offset2idx(va, level));
     if (!pde_is_present(pde))
       return PAGE_IDX_INVAL;
+    if (pde_is_large(pde)) {
+      if (retpde) {
+        *retpde = pde;
+      }
+
+      return pde_fetch_page_idx(pde) + pde_offset2idx(va, PTABLE_LEVEL_FIRST);
+    }
 
     cur_dir = pde_fetch_subdir(pde);
   }
@@ -100,6 +174,12 @@ int ptable_map_page(rpd_t *rpd, uintptr_t addr,
 
       pagedir_ref(pde);
     }
+    else if (pde_is_large(pde)) {
+      ret = split_large_page(rpd, pde, addr);
+      if (ret) {
+        return ret;
+      }
+    }
 
     parent_pde = pde;    
     cur_dir = pde_fetch_subdir(pde);
@@ -109,11 +189,68 @@ int ptable_map_page(rpd_t *rpd, uintptr_t addr,
   pde_was_present = pde_is_present(pde);
   pde_save(pde, pidx, flags);
 
+  /* Not present entries are never cached by TLB */
   if (!pde_was_present) {
     pagedir_ref(parent_pde);
   }
+  else {
+    tlb_flush_entry(rpd, addr);
+  }
+
+  return 0;
+}
+
+int ptable_map_large_page(rpd_t *rpd, uintptr_t addr,
+                          page_idx_t pidx, ptable_flags_t flags)
+{
+  void *cur_dir = ROOT_PDIR_PAGE(rpd), *subdir = NULL;
+  pde_t *pde;
+  int level, ret = 0;
+
+  ASSERT_DBG(!(addr & LARGE_PAGE_MASK));
+  ASSERT_DBG(!(pidx & (LARGE_PAGE_PAGES - 1)));
+  flags &= __ptbl_allowed_flags_mask;
+  for (level = PTABLE_LEVEL_LAST; level > PTABLE_LEVEL_LARGE; level--) {
+    pde = pde_fetch(cur_dir, pde_offset2idx(addr, level));
+    if (!pde_is_present(pde)) {
+      ret = populate_pagedir(pde, PTABLE_DEF_PDIR_FLAGS);
+      if (ret) {
+        return ret;
+      }
+
+      pagedir_ref(pde);
+    }
+
+    cur_dir = pde_fetch_subdir(pde);
+  }
+
+  /*
+   * Page table having no pages mapped is left after unmap,
+   * it's replaced by the large page and freed when no CPU
+   * may have it cached.
+   */
+  pde = pde_fetch(cur_dir, pde_offset2idx(addr, PTABLE_LEVEL_LARGE));
+  if (pde_is_present(pde)
+      && (pde_is_large(pde) || (pagedir_get_ref(pde) > 1))) {
+    return ERR(-EBUSY);
+  }
+  if (rpd != KERNEL_ROOT_PDIR()) {
+    ret = deposit_pagedir();
+    if (ret) {
+      return ret;
+    }
+  }
+  if (pde_is_present(pde)) {
+    subdir = pde_fetch_subdir(pde);
+  }
+
+  pde_save(pde, pidx, flags | PDE_PS);
+  pagedir_set_ref(pde, 0);
+  if (subdir) {
+    tlb_flush_entry(rpd, addr);
+    pt_ops.free_pagedir(subdir);
+  }
 
-  tlb_flush_entry(rpd, addr);
   return 0;
 }
 
@@ -128,6 +265,10 @@ void ptable_unmap_page(rpd_t *rpd, uintptr_t addr)
     pde = pde_fetch(cur_dir, pde_offset2idx(addr, level));
     if (!pde_is_present(pde))
       return;
+    if (pde_is_large(pde) && split_large_page(rpd, pde, addr)) {
+      panic("Failed to split large page mapped to %p: ENOMEM!",
+            addr & ~(uintptr_t)LARGE_PAGE_MASK);
+    }
 
     dirspath[level - 1] = pde;
     cur_dir = pde_fetch_subdir(pde);
@@ -32,6 +32,8 @@ page_idx_t ptable_vaddr_to_pidx(struct __rpd *rpd, uintptr_t vaddr,
                                 /* OUT */ pde_t **retpde);
 int ptable_map_page(struct __rpd *rpd, uintptr_t addr,
                     page_idx_t pidx, ptable_flags_t flags);
+int ptable_map_large_page(struct __rpd *rpd, uintptr_t addr,
+                          page_idx_t pidx, ptable_flags_t flags);
 void ptable_unmap_page(struct __rpd *rpd, uintptr_t addr);
 
 #endif /* __MSTRING_ARCH_PTABLE_H__ */
@@ -22,6 +22,7 @@
 #include <mm/mem.h>
 #include <arch/acpi.h>
 #include <arch/cpu.h>
+#include <mm/numa.h>
 #include <mstring/string.h>
 #include <mstring/kprintf.h>
 #include <mstring/panic.h>
@@ -33,6 +34,8 @@ static acpi_sdt_t *acpi_xsdt = NULL;
 static char *table_sigs[] = {
   "APIC", /* MADT_TABLE */
   "FACP", /* FADT_TABLE */
+  "SRAT", /* SRAT_TABLE */
+  "SLIT", /* SLIT_TABLE */
 };
 
 static uint8_t get_acpi_checksum(void *ptr, int size)
@@ -209,6 +212,11 @@ void *madt_find_table(acpi_madt_t *madt, madt_type_t type, int num)
 
 INITCODE int acpi_init(void)
 {
+  /* With NUMA enabled tables are already found by acpi_numa_init() */
+  if (acpi_rsdp) {
+    return 0;
+  }
+
   acpi_rsdp = acpi_rsdp_find();
   if (!acpi_rsdp) {
     return -1;
@@ -218,3 +226,127 @@ INITCODE int acpi_init(void)
   acpi_xsdt = acpi_get_xsdt();
   return 0;
 }
+
+#ifdef CONFIG_NUMA
+/* Nodes of xAPIC IDs found in SRAT, (node + 1) or 0 if unknown */
+static uint8_t apic_nodes[256];
+
+static INITCODE void srat_parse_cpu(srat_cpu_affinity_t *cpu)
+{
+  uint32_t domain;
+  int node;
+
+  if (!(cpu->flags & SRAT_ENABLED)) {
+    return;
+  }
+
+  domain = cpu->domain_lo | (cpu->domain_hi[0] << 8) |
+    (cpu->domain_hi[1] << 16) | (cpu->domain_hi[2] << 24);
+  node = numa_domain_to_node(domain);
+  if (node >= 0) {
+    apic_nodes[cpu->apic_id] = node + 1;
+  }
+}
+
+static INITCODE void srat_parse_x2apic(srat_x2apic_affinity_t *cpu)
+{
+  int node;
+
+  /* Only xAPIC IDs are used by the kernel */
+  if (!(cpu->flags & SRAT_ENABLED) || (cpu->x2apic_id >= 256)) {
+    return;
+  }
+
+  node = numa_domain_to_node(cpu->domain);
+  if (node >= 0) {
+    apic_nodes[cpu->x2apic_id] = node + 1;
+  }
+}
+
+static INITCODE void srat_parse_mem(srat_mem_affinity_t *mem)
+{
+  int node;
+
+  if (!(mem->flags & SRAT_ENABLED) || !mem->length) {
+    return;
+  }
+
+  node = numa_domain_to_node(mem->domain);
+  if (node >= 0) {
+    kprintf(KO_INFO "SRAT: node %d memory: [%#.10lx - %#.10lx]\n", node,
+            mem->base_addr, mem->base_addr + mem->length);
+    numa_add_memblock(node, mem->base_addr, mem->base_addr + mem->length);
+  }
+}
+
+static INITCODE void slit_parse(acpi_slit_t *slit)
+{
+  uint64_t i, j;
+  int from, to;
+
+  /* Localities of SLIT are proximity domains of SRAT */
+  for (i = 0; i < slit->num_localities; i++) {
+    from = numa_lookup_domain(i);
+    for (j = 0; (from >= 0) && (j < slit->num_localities); j++) {
+      to = numa_lookup_domain(j);
+      if (to >= 0) {
+        numa_set_distance(from, to,
+                          slit->distances[i * slit->num_localities + j]);
+      }
+    }
+  }
+}
+
+INITCODE int acpi_numa_init(void)
+{
+  acpi_srat_t *srat;
+  acpi_slit_t *slit;
+  srat_hdr_t *hdr, *srat_end;
+
+  if (acpi_init() < 0) {
+    return -1;
+  }
+
+  srat = acpi_find_table(SRAT_TABLE);
+  if (!srat) {
+    kprintf(KO_WARNING "ACPI doesn't provide SRAT, all memory "
+            "belongs to node 0\n");
+    return -1;
+  }
+
+  srat = acpi_getaddr((uintptr_t)srat, srat->hdr.length);
+  hdr = (srat_hdr_t *)srat->affinity_structs;
+  srat_end = (srat_hdr_t *)((char *)srat + srat->hdr.length);
+  while ((hdr < srat_end) && hdr->length) {
+    switch (hdr->type) {
+        case SRAT_CPU_AFFINITY:
+          srat_parse_cpu((srat_cpu_affinity_t *)hdr);
+          break;
+        case SRAT_MEM_AFFINITY:
+          srat_parse_mem((srat_mem_affinity_t *)hdr);
+          break;
+        case SRAT_X2APIC_AFFINITY:
+          srat_parse_x2apic((srat_x2apic_affinity_t *)hdr);
+          break;
+    }
+
+    hdr = (srat_hdr_t *)((char *)hdr + hdr->length);
+  }
+
+  slit = acpi_find_table(SLIT_TABLE);
+  if (slit) {
+    slit = acpi_getaddr((uintptr_t)slit, slit->hdr.length);
+    slit_parse(slit);
+  }
+
+  kprintf(KO_INFO "ACPI: %d NUMA node(s) found\n", numa_num_nodes);
+  return 0;
+}
+
+INITCODE void acpi_numa_bind_cpu(cpu_id_t cpu, uint32_t apic_id)
+{
+  if ((apic_id < 256) && apic_nodes[apic_id]) {
+    numa_set_cpu_node(cpu, apic_nodes[apic_id] - 1);
+  }
+}
+#endif /* CONFIG_NUMA */
@@ -21,6 +21,7 @@
 #ifndef __MSTRING_ARCH_ACPI_H__
 #define __MSTRING_ARCH_ACPI_H__
 
+#include <config.h>
 #include <mstring/types.h>
 
 typedef struct acpi_rsdp {
@@ -97,11 +98,72 @@ typedef struct madt_ioapic {
   uint32_t start_gsi;
 } __attribute__ ((packed)) madt_ioapic_t;
 
+/* System Resource Affinity Table */
+typedef struct acpi_srat {
+  acpi_table_hdr_t hdr;
+  uint32_t __res0;
+  uint64_t __res1;
+  uint8_t affinity_structs[];
+} __attribute__ ((packed)) acpi_srat_t;
+
+typedef struct srat_hdr {
+  uint8_t type;
+  uint8_t length;
+} __attribute__ ((packed)) srat_hdr_t;
+
+typedef struct srat_cpu_affinity {
+  srat_hdr_t hdr;
+  uint8_t domain_lo;
+  uint8_t apic_id;
+  uint32_t flags;
+  uint8_t sapic_eid;
+  uint8_t domain_hi[3];
+  uint32_t clock_domain;
+} __attribute__ ((packed)) srat_cpu_affinity_t;
+
+typedef struct srat_mem_affinity {
+  srat_hdr_t hdr;
+  uint32_t domain;
+  uint16_t __res0;
+  uint64_t base_addr;
+  uint64_t length;
+  uint32_t __res1;
+  uint32_t flags;
+  uint64_t __res2;
+} __attribute__ ((packed)) srat_mem_affinity_t;
+
+typedef struct srat_x2apic_affinity {
+  srat_hdr_t hdr;
+  uint16_t __res0;
+  uint32_t domain;
+  uint32_t x2apic_id;
+  uint32_t flags;
+  uint32_t clock_domain;
+  uint32_t __res1;
+} __attribute__ ((packed)) srat_x2apic_affinity_t;
+
+/* System Locality Information Table */
+typedef struct acpi_slit {
+  acpi_table_hdr_t hdr;
+  uint64_t num_localities;
+  uint8_t distances[]; /* num_localities x num_localities matrix */
+} __attribute__ ((packed)) acpi_slit_t;
+
 typedef enum acpi_tlbid {
   MADT_TABLE = 0,
   FADT_TABLE,
+  SRAT_TABLE,
+  SLIT_TABLE,
 } acpi_tlbid_t;
 
+typedef enum srat_type {
+  SRAT_CPU_AFFINITY = 0,
+  SRAT_MEM_AFFINITY,
+  SRAT_X2APIC_AFFINITY,
+} srat_type_t;
+
+#define SRAT_ENABLED 0x01
+
 typedef enum madt_type {
   MADT_LAPIC = 0,
   MADT_IO_APIC,
@@ -126,4 +188,13 @@ void *acpi_getaddr(uintptr_t phys_addr, size_t length);
 void *acpi_find_table(acpi_tlbid_t type);
 void *madt_find_table(acpi_madt_t *madt, madt_type_t type, int num);
 
+#ifdef CONFIG_NUMA
+/*
+ * SRAT is parsed before memory pools get their pages, so it must be
+ * called while early page allocator still can map ACPI tables.
+ */
+INITCODE int acpi_numa_init(void);
+INITCODE void acpi_numa_bind_cpu(cpu_id_t cpu, uint32_t apic_id);
+#endif /* CONFIG_NUMA */
+
 #endif /* __MSTRING_ARCH_ACPI_H__ */
@@ -24,6 +24,7 @@
 #include <mm/page_alloc.h>
 #include <arch/msr.h>
 #include <arch/apic.h>
+#include <arch/tlb.h>
 #include <mstring/smp.h>
 #include <mstring/interrupt.h>
 #include <mstring/time.h>
@@ -269,6 +270,13 @@ static struct irq_action lapic_spurious_irq = {
   .handler = lapic_spurious_handler,
 };
 
+#ifdef CONFIG_SMP
+static struct irq_action tlb_shootdown_irq = {
+  .name = "TLB shootdown IPI",
+  .handler = tlb_shootdown_interrupt,
+};
+#endif /* CONFIG_SMP */
+
 INITCODE void lapic_init(cpu_id_t cpuid)
 {
   int i, j, maxlvt;
@@ -406,6 +414,45 @@ int lapic_broadcast_ipi(uint8_t vector)
     return 0;
 }
 
+/* Only CPUs 0-7 have their bit in the flat logical destination */
+#define APIC_FLAT_CPUS 8
+
+/*
+ * Send IPI to each CPU in @a cpus. CPU n < 8 has bit n set in its logical
+ * destination (see setup_lapic_ldr_flat()), so they are reached by one IPI.
+ * Other CPUs get their own IPIs by physical APIC ID.
+ */
+int lapic_send_ipi(cpumask_t cpus, uint8_t vector)
+{
+  cpumask_t flat = cpus & ((1UL << APIC_FLAT_CPUS) - 1);
+  cpu_id_t c;
+  int ret = 0;
+
+  if (flat) {
+    apic_write(APIC_ICR_HIGH, (uint32_t)flat << APIC_LOGID_SHIFT);
+    apic_write(APIC_ICR_LOW, APIC_LVTL_ASSERT | APIC_LVTDM_FIXED |
+               APIC_DM_LOGIC | vector);
+    lapic_icr_wait();
+    if (apic_read(APIC_ICR_LOW) & APIC_LVTDS_SEND_PENDING)
+      ret = ERR(-1);
+  }
+
+  for (c = APIC_FLAT_CPUS; c < CONFIG_NRCPUS; c++) {
+    if (!(cpus & (1UL << c)))
+      continue;
+
+    apic_write(APIC_ICR_HIGH,
+               *raw_percpu_get_var(lapic_ids, c) << APIC_LOGID_SHIFT);
+    apic_write(APIC_ICR_LOW, APIC_LVTL_ASSERT | APIC_LVTDM_FIXED |
+               APIC_DM_PHYS | vector);
+    lapic_icr_wait();
+    if (apic_read(APIC_ICR_LOW) & APIC_LVTDS_SEND_PENDING)
+      ret = ERR(-1);
+  }
+
+  return ret;
+}
+
 INITCODE int lapic_init_ipi(uint32_t apic_id)
 {
   int i, maxlvts;
@@ -478,6 +525,17 @@ static INITCODE void install_lapic_irqs(void)
     goto error;
   }
 
+#ifdef CONFIG_SMP
+  ret = irq_register_line_and_action(TLB_SHOOTDOWN_IRQ,
+                                     &lapic_controller,
+                                     &tlb_shootdown_irq);
+  if (ret) {
+    irq = TLB_SHOOTDOWN_IRQ;
+    act = &tlb_shootdown_irq;
+    goto error;
+  }
+#endif /* CONFIG_SMP */
+
   return;
 
 error:
@@ -148,5 +148,6 @@ INITCODE void lapic_timer_init(cpu_id_t cpuid);
 
 void lapic_eoi(void);
 int lapic_broadcast_ipi(uint8_t vector);
+int lapic_send_ipi(cpumask_t cpus, uint8_t vector);
 
 #endif /* !__MSTRING_ARCH_APIC_H__ */
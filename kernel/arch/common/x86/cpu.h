@@ -45,6 +45,11 @@
 #define CR3_PWT 0x0008 /* Page-Level Writethrough */
 #define CR3_PCD 0x0010 /* Page-Level Cache Disable */
 
+#ifdef CONFIG_AMD64
+#define CR3_PCID_MASK 0xfffUL     /* Process-Context Identifier (CR4.PCIDE=1) */
+#define CR3_NOFLUSH   (1UL << 63) /* Keep TLB entries of the PCID on load */
+#endif /* CONFIG_AMD64 */
+
 #ifdef CONFIG_AMD64
 #define CR3_PTABLE_SHIFT 12
 #define CR3_PTABLE_MASK  0xffffffffffU
@@ -72,6 +77,7 @@
 #define CR4_PCE        0x0100 /* Performance-Monitoring Counter Enable */
 #define CR4_OSFXSR     0x0200 /* Operating System FXSAVE/FXRSTOR Support */
 #define CR4_OSXMMEXCPT 0x0400 /* Operating System Unmasked Exception Support */
+#define CR4_PCIDE      0x20000 /* Process-Context Identifiers Enable */
 
 /***************
  * rFLAGS register
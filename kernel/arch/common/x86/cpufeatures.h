@@ -53,6 +53,7 @@
 #define X86_FTR_CMPXCHG16   FTR_CNT(ECX, 32, 13) /* CMPXCHG16B instruction. */
 #define X86_FTR_xTPRUPDCNTL FTR_CNT(ECX, 32, 14) /* xTPR Update Control */
 #define X86_FTR_PDCM        FTR_CNT(ECX, 32, 15) /* Performance and Debug Capability */
+#define X86_FTR_PCID        FTR_CNT(ECX, 32, 17) /* Process-context identifiers */
 #define X86_FTR_DCA         FTR_CNT(ECX, 32, 18) /* Data prefetching from memory mapped device */
 #define X86_FTR_SSE41       FTR_CNT(ECX, 32, 19) /* SSE4.1 support */
 #define X86_FTR_SSE42       FTR_CNT(ECX, 32, 20) /* SSE4.2 support */
@@ -130,6 +131,7 @@ static inline bool cpu_has_feature(uint32_t feature)
 {
   uint32_t eax = GET_FTRS_CMD_32;
   uint32_t ebx, ecx, edx;
+  ulong_t word; /* bit_test() reads a whole ulong_t */
 
   if (feature >= ECX64_FTR_BASE) {
     eax = GET_FTRS_CMD_64;
@@ -137,17 +139,22 @@ static inline bool cpu_has_feature(uint32_t feature)
 
   cpuid(&eax, &ebx, &ecx, &edx);
   if (feature < EDX32_FTR_BASE) {
-    return bit_test(&ecx, feature);
+    word = ecx;
   }
   else if (feature < ECX64_FTR_BASE) {
-    return bit_test(&edx, feature - EDX32_FTR_BASE);
+    word = edx;
+    feature -= EDX32_FTR_BASE;
   }
   else if (feature < EDX64_FTR_BASE) {
-    return bit_test(&ecx, feature - ECX64_FTR_BASE);
+    word = ecx;
+    feature -= ECX64_FTR_BASE;
   }
   else {
-    return bit_test(&edx, feature - EDX64_FTR_BASE);
+    word = edx;
+    feature -= EDX64_FTR_BASE;
   }
+
+  return bit_test(&word, feature);
 }
 
 #endif /* __MSTRING_ARCH_CPUFEATURES_H__ */
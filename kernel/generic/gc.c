@@ -27,6 +27,7 @@
 #include <mstring/process.h>
 #include <mstring/gc.h>
 #include <mm/slab.h>
+#include <mm/page_alloc.h>
 #include <mstring/gc.h>
 #include <arch/spinlock.h>
 #include <mstring/task.h>
@@ -102,6 +103,7 @@ static actor_t __percpu_threads[NUM_PERCPU_THREADS] = {
   migration_thread,
 #endif
   __gc_thread_logic,
+  zeroing_thread,
 };
 
 void spawn_percpu_threads(void)
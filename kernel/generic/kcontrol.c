@@ -5,10 +5,16 @@
 #include <mstring/stddef.h>
 #include <mstring/kprintf.h>
 #include <mstring/swks.h>
+#include <ipc/port.h>
+#include <mm/shrinker.h>
+#include <mm/slab.h>
+#include <mm/mmpool.h>
 
 extern long initrd_start_page,initrd_num_pages;
 
 static long __simple_kernel_data_proxy(kcontrol_node_t *target,kcontrol_args_t *arg);
+static long __memcache_stats_proxy(kcontrol_node_t *target,kcontrol_args_t *arg);
+static long __mmpool_stats_proxy(kcontrol_node_t *target,kcontrol_args_t *arg);
 
 static kcontrol_node_t __kernel_boot_subdirs[] = {
   {
@@ -34,6 +40,58 @@ static kcontrol_node_t __kernel_system_subdirs[] = {
   }
 };
 
+static kcontrol_node_t __kernel_ipc_subdirs[] = {
+  {
+    .id=KCTRL_IPC_MSG_CACHE_HITS,
+    .type=KCTRL_DATA_CUSTOM,
+    .logic=__simple_kernel_data_proxy,
+    .private=(long)ipc_msg_cache_hits,
+  },
+  {
+    .id=KCTRL_IPC_MSG_CACHE_MISSES,
+    .type=KCTRL_DATA_CUSTOM,
+    .logic=__simple_kernel_data_proxy,
+    .private=(long)ipc_msg_cache_misses,
+  },
+};
+
+static kcontrol_node_t __kernel_mm_subdirs[] = {
+  {
+    .id=KCTRL_MM_RECLAIM_RUNS,
+    .type=KCTRL_DATA_CUSTOM,
+    .logic=__simple_kernel_data_proxy,
+    .private=(long)shrink_reclaim_runs,
+  },
+  {
+    .id=KCTRL_MM_RECLAIMED_PAGES,
+    .type=KCTRL_DATA_CUSTOM,
+    .logic=__simple_kernel_data_proxy,
+    .private=(long)shrink_reclaimed_pages,
+  },
+  {
+    .id=KCTRL_MM_ZEROED_HITS,
+    .type=KCTRL_DATA_CUSTOM,
+    .logic=__simple_kernel_data_proxy,
+    .private=(long)zeroed_pages_hits,
+  },
+  {
+    .id=KCTRL_MM_ZEROED_MISSES,
+    .type=KCTRL_DATA_CUSTOM,
+    .logic=__simple_kernel_data_proxy,
+    .private=(long)zeroed_pages_misses,
+  },
+  {
+    .id=KCTRL_MM_MEMCACHE_STATS,
+    .type=KCTRL_DATA_CUSTOM,
+    .logic=__memcache_stats_proxy,
+  },
+  {
+    .id=KCTRL_MM_MMPOOL_STATS,
+    .type=KCTRL_DATA_CUSTOM,
+    .logic=__mmpool_stats_proxy,
+  },
+};
+
 static kcontrol_node_t __kernel_subdirs[] = {
   {
     .id=KCTRL_BOOT_INFO,
@@ -45,6 +103,16 @@ static kcontrol_node_t __kernel_subdirs[] = {
     .num_subdirs=ARRAY_SIZE(__kernel_system_subdirs),
     .subdirs=__kernel_system_subdirs,
   },
+  {
+    .id=KCTRL_IPC_INFO,
+    .num_subdirs=ARRAY_SIZE(__kernel_ipc_subdirs),
+    .subdirs=__kernel_ipc_subdirs,
+  },
+  {
+    .id=KCTRL_MM_INFO,
+    .num_subdirs=ARRAY_SIZE(__kernel_mm_subdirs),
+    .subdirs=__kernel_mm_subdirs,
+  },
 };
 
 static long __transfer_data_to_user(kcontrol_args_t *arg,void *d,ulong_t size)
@@ -71,6 +139,89 @@ static long __simple_kernel_data_proxy(kcontrol_node_t *target,kcontrol_args_t *
   return __transfer_data_to_user(arg,&data,sizeof(data));
 }
 
+/* State of transferring an array of records to the user. */
+typedef struct __stat_records {
+  kcontrol_args_t *arg;
+  unsigned int capacity;
+  unsigned int size;
+} stat_records_t;
+
+static long __stat_records_begin(stat_records_t *r,kcontrol_args_t *arg)
+{
+  r->arg=arg;
+  r->capacity=r->size=0;
+  if( arg->old_data_size ) {
+    if( copy_from_user(&r->capacity,arg->old_data_size,sizeof(r->capacity)) ) {
+      return -EFAULT;
+    }
+  }
+  return 0;
+}
+
+/* Records that don't fit into user buffer are only counted. */
+static int __stat_records_put(stat_records_t *r,void *rec,unsigned int size)
+{
+  if( r->arg->old_data && r->size + size <= r->capacity ) {
+    if( copy_to_user((char *)r->arg->old_data + r->size,rec,size) ) {
+      return -EFAULT;
+    }
+  }
+
+  r->size+=size;
+  return 0;
+}
+
+static long __stat_records_end(stat_records_t *r)
+{
+  if( r->arg->old_data_size ) {
+    if( copy_to_user(r->arg->old_data_size,&r->size,sizeof(r->size)) ) {
+      return -EFAULT;
+    }
+  }
+  return 0;
+}
+
+static int __put_memcache_stat(kcontrol_memcache_stat_t *stat,void *ctx)
+{
+  return __stat_records_put(ctx,stat,sizeof(*stat));
+}
+
+static long __memcache_stats_proxy(kcontrol_node_t *target,kcontrol_args_t *arg)
+{
+  stat_records_t r;
+  long ret;
+
+  if( (ret=__stat_records_begin(&r,arg)) ) {
+    return ret;
+  }
+  if( (ret=memcaches_walk_stats(__put_memcache_stat,&r)) ) {
+    return ret;
+  }
+
+  return __stat_records_end(&r);
+}
+
+static long __mmpool_stats_proxy(kcontrol_node_t *target,kcontrol_args_t *arg)
+{
+  kcontrol_mmpool_stat_t stat;
+  stat_records_t r;
+  mmpool_t *pool;
+  long ret;
+
+  if( (ret=__stat_records_begin(&r,arg)) ) {
+    return ret;
+  }
+
+  for_each_active_mmpool(pool) {
+    mmpool_get_stat(pool,&stat);
+    if( (ret=__stat_records_put(&r,&stat,sizeof(stat))) ) {
+      return ret;
+    }
+  }
+
+  return __stat_records_end(&r);
+}
+
 static long __process_node(kcontrol_node_t *target,kcontrol_args_t *arg)
 {
   int copysize,newsize;
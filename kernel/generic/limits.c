@@ -26,6 +26,8 @@
 #include <mm/slab.h>
 #include <ipc/ipc.h>
 #include <sync/spinlock.h>
+#include <mstring/errno.h>
+#include <mstring/string.h>
 #include <config.h>
 
 static memcache_t *limits_memcache = NULL;
@@ -55,6 +57,7 @@ task_limits_t *allocate_task_limits(void)
   if( tl != NULL ) {
     atomic_set(&tl->use_count,1);
     rwsem_initialize(&tl->lock);
+    memset(tl->current_limits, 0, sizeof(tl->current_limits));
     return tl;
   } else
     return NULL;
@@ -101,6 +104,29 @@ ulong_t get_limit(task_limits_t *l, uint_t id)
   return lim;
 }
 
+int charge_limit(task_limits_t *l, uint_t id, ulong_t n)
+{
+  int r = 0;
+
+  if (id >= LIMIT_NUM_LIMITS)
+    return -EINVAL;
+  rwsem_down_write(&l->lock);
+  if (l->current_limits[id] + n > l->limits[id])
+    r = -ENOMEM;
+  else
+    l->current_limits[id] += n;
+  rwsem_up_write(&l->lock);
+  return r;
+}
+
+void uncharge_limit(task_limits_t *l, uint_t id, ulong_t n)
+{
+  if (id >= LIMIT_NUM_LIMITS)
+    return;
+  rwsem_down_write(&l->lock);
+  l->current_limits[id] -= n;
+  rwsem_up_write(&l->lock);
+}
 
 /* Top level functions */
 long sys_get_limit(uint8_t ns_id, pid_t pid, uint_t index)
@@ -42,6 +42,7 @@
 #include <mstring/limits.h>
 #include <mstring/domain.h>
 #include <security/security.h>
+#include <mm/shrinker.h>
 
 static void main_routine_stage1(void)
 {
@@ -70,6 +71,7 @@ static void main_routine_stage1(void)
   initialize_security();
   /* OK, we can proceed. */
   spawn_percpu_threads();
+  shrinkers_initialize();
   server_run_tasks();
 
   /* Enter idle loop. */
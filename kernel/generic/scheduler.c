@@ -202,6 +202,19 @@ int sched_add_cpu(cpu_id_t cpu)
   return ERR(-ENOTTY);
 }
 
+/* Ask the scheduler to run @target right after the current task leaves
+ * the CPU, donating the rest of current timeslice to it. Returns zero
+ * if the hint was accepted, or a negative error if target can't be
+ * switched to directly (i.e. it isn't runnable on the local CPU).
+ */
+int sched_yield_to(task_t *target)
+{
+  if( active_scheduler != NULL && active_scheduler->yield_to != NULL ) {
+    return active_scheduler->yield_to(target);
+  }
+  return ERR(-ENOTTY);
+}
+
 void update_idle_tick_statistics(scheduler_cpu_stats_t *stats)
 {
   stats->idle_ticks++;
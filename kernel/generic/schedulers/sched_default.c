@@ -66,6 +66,7 @@ static spinlock_t cpu_data_lock;
 #define CPU_SCHED_DATA() sched_cpu_data[cpu_id()]
 
 #define PRIO_TO_TIMESLICE(p) (p*3*1)
+#define MAX_TIMESLICE PRIO_TO_TIMESLICE(EZA_SCHED_PRIORITY_MAX)
 
 #define LOCK_EZA_SCHED_DATA(t)                  \
   spinlock_lock(&t->sched_lock)
@@ -141,6 +142,7 @@ static void __initialize_cpu_sched_data(mstring_sched_cpudata_t *cpudata, cpu_id
   bound_spinlock_initialize(&cpudata->__lock,cpu);
   cpudata->active_array = &cpudata->arrays[0];
   cpudata->expired_array = &cpudata->arrays[1];
+  cpudata->handoff_task = NULL;
 
   /* Initialize scheduler statistics for this CPU. */
   cpudata->stats = &swks.cpu_stat[cpu].sched_stats;
@@ -348,7 +350,7 @@ static void def_schedule(void)
 {
   mstring_sched_cpudata_t *sched_data = CPU_SCHED_DATA();
   task_t *current = current_task();
-  task_t *next;
+  task_t *next,*handoff;
   bool need_switch,ints_enabled,arrays_switched=false;
 
   /* From this moment we are in atomic context until 'arch_activate_task()'
@@ -363,6 +365,20 @@ static void def_schedule(void)
   __LOCK_CPU_SCHED_DATA(sched_data);
   sched_reset_current_need_resched();
 
+  /* Direct handoff requested by the previous task ? */
+  handoff = sched_data->handoff_task;
+  if( handoff != NULL ) {
+    sched_data->handoff_task = NULL;
+
+    if( handoff != current && handoff->state == TASK_STATE_RUNNABLE &&
+        handoff->cpu == sched_data->cpu_id &&
+        EZA_TASK_SCHED_DATA(handoff)->array == sched_data->active_array ) {
+      next = handoff;
+      sched_data->stats->handoff_switches++;
+      goto task_found;
+    }
+  }
+
 get_next_task:
   next = __get_most_prioritized_task(sched_data);
   if( next == NULL ) {
@@ -379,6 +395,8 @@ get_next_task:
       sched_data->stats->idle_switches++;
     }
   }
+
+task_found:
   sched_data->stats->task_switches++;
 
   if(current->state == TASK_STATE_RUNNING) {
@@ -404,6 +422,11 @@ get_next_task:
 
   __UNLOCK_CPU_SCHED_DATA(sched_data);
 
+  /* Drop the reference taken by 'def_yield_to()'. */
+  if( handoff != NULL ) {
+    release_task_struct(handoff);
+  }
+
   if( need_switch ) {
       arch_activate_task(next);
       update_deferred_actions();
@@ -442,6 +465,11 @@ static int def_del_task(task_t *task)
      LOCK_CPU_SCHED_DATA(sched_data);
     __remove_task_from_array(sdata->array,task);
     sched_data->stats->active_tasks--;
+    if( sched_data->handoff_task == task ) {
+      /* Not the last reference: the task isn't waited for yet. */
+      sched_data->handoff_task=NULL;
+      __release_task_struct(task);
+    }
     UNLOCK_CPU_SCHED_DATA(sched_data);
     __free_task_sched_data(sdata);
     gc_schedule_action(&action);
@@ -667,6 +695,64 @@ static int def_change_task_state_deferred(task_t *task, task_state_t state,
   return  __change_task_state(task,state,handler,data,mask);
 }
 
+/* NOTE: Target task must stay on the local CPU since we don't perform
+ * cross-CPU handoffs: in such case we just let the target be woken up
+ * in a usual way.
+ */
+static int def_yield_to(task_t *target)
+{
+  mstring_sched_cpudata_t *sched_data;
+  mstring_sched_taskdata_t *cdata,*tdata;
+  task_t *current=current_task(),*stale=NULL;
+  long is;
+  int r=-EAGAIN;
+
+  if( target == current || !current->pid ) {
+    return -EINVAL;
+  }
+
+  interrupts_save_and_disable(is);
+  sched_data=CPU_SCHED_DATA();
+  __LOCK_CPU_SCHED_DATA(sched_data);
+
+  tdata=EZA_TASK_SCHED_DATA(target);
+  if( target->cpu == sched_data->cpu_id &&
+      target->state == TASK_STATE_RUNNABLE &&
+      tdata->array == sched_data->active_array ) {
+    cdata=EZA_TASK_SCHED_DATA(current);
+
+    /* Move the rest of our timeslice to the target. The current tick
+     * stays with us, so the tick handler expires us in a usual way.
+     */
+    if( cdata->sched_discipline != SCHED_FIFO && cdata->time_slice > 1 ) {
+      time_slice_t limit=tdata->max_timeslice ? tdata->max_timeslice : MAX_TIMESLICE;
+      time_slice_t moved=0;
+
+      if( tdata->time_slice < limit ) {
+        moved=MIN(cdata->time_slice - 1,limit - tdata->time_slice);
+      }
+      tdata->time_slice += moved;
+      cdata->time_slice -= moved;
+    }
+
+    /* The target may exit or migrate before we schedule, so keep it
+     * referenced until 'def_schedule()' looks at it.
+     */
+    stale=sched_data->handoff_task;
+    grab_task_struct(target);
+    sched_data->handoff_task=target;
+    r=0;
+  }
+
+  __UNLOCK_CPU_SCHED_DATA(sched_data);
+  interrupts_restore(is);
+
+  if( stale != NULL ) {
+    release_task_struct(stale);
+  }
+  return r;
+}
+
 static struct __scheduler mstring_default_scheduler = {
   .id = "Eza default scheduler",
   .init = def_init,
@@ -681,6 +767,7 @@ static struct __scheduler mstring_default_scheduler = {
   .change_task_state_deferred = def_change_task_state_deferred,
   .setup_idle_task = def_setup_idle_task,
   .scheduler_control = def_scheduler_control,
+  .yield_to = def_yield_to,
 };
 
 scheduler_t *get_default_scheduler(void)
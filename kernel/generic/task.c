@@ -27,6 +27,7 @@
 #include <mstring/kstack.h>
 #include <mstring/errno.h>
 #include <mm/slab.h>
+#include <mm/scratch.h>
 #include <arch/task.h>
 #include <sync/spinlock.h>
 #include <mstring/limits.h>
@@ -699,6 +700,7 @@ void destroy_task_struct(struct __task_struct *task)
   __free_task_ipc(task);
   if(task->domain) destroy_dm_attrs(task->domain);
   if(task->limits) destroy_task_limits(task->limits);
+  scratch_arena_free(task);
 
   free_pages(virt_to_pframe((void*)task->kernel_stack.low_address), KERNEL_STACK_PAGES);
   __free_mm(task);
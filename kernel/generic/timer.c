@@ -27,6 +27,7 @@
 #include <ds/list.h>
 #include <arch/timer.h>
 #include <mm/slab.h>
+#include <mm/shrinker.h>
 #include <mstring/interrupt.h>
 #include <mstring/errno.h>
 #include <sync/spinlock.h>
@@ -130,6 +131,38 @@ static void __init_sw_timers(void)
   }
 }
 
+/* Release cached major ticks exceeding CONFIG_MIN_CACHED_MAJOR_TICKS. */
+static ulong_t __shrink_major_ticks(shrinker_t *shrinker)
+{
+  major_timer_tick_t *mt;
+  list_head_t victims;
+  ulong_t n=0;
+  long is;
+
+  list_init_head(&victims);
+  LOCK_SW_TIMERS(is);
+  while( __num_cached_major_ticks > CONFIG_MIN_CACHED_MAJOR_TICKS ) {
+    mt=container_of(list_node_first(&cached_major_ticks),
+                    major_timer_tick_t,list);
+    list_del(&mt->list);
+    list_add2tail(&victims,&mt->list);
+    __num_cached_major_ticks--;
+  }
+  UNLOCK_SW_TIMERS(is);
+
+  while( !list_is_empty(&victims) ) {
+    mt=container_of(list_node_first(&victims),major_timer_tick_t,list);
+    list_del(&mt->list);
+    memfree(mt);
+    n++;
+  }
+  return n;
+}
+
+static shrinker_t major_ticks_shrinker=
+  SHRINKER_INITIALIZE("major timer ticks",__shrink_major_ticks,
+                      SHRINK_PRIO_OBJECTS);
+
 INITCODE void hardware_timers_init(void)
 {
   arch_timer_init();
@@ -138,6 +171,7 @@ INITCODE void hardware_timers_init(void)
 INITCODE void software_timers_init(void)
 {
   __init_sw_timers();
+  register_shrinker(&major_ticks_shrinker);
   initialize_deffered_actions();
 }
 
@@ -11,6 +11,7 @@
 #include <ds/idx_allocator.h>
 #include <mstring/errno.h>
 #include <mm/page_alloc.h>
+#include <ipc/ring.h>
 #include <ipc/ipc.h>
 
 static ipc_channel_t *__allocate_channel(ipc_gen_port_t *port,ulong_t flags)
@@ -237,6 +238,31 @@ ipc_channel_t *ipc_clone_channel(ipc_channel_t *target,struct __task_ipc *newipc
   return c;
 }
 
+static int __channel_ring_control(ipc_channel_t *c,ulong_t cmd,ulong_t arg)
+{
+  ipc_gen_port_t *port;
+  int r=ipc_get_channel_port(c,&port);
+
+  if( r ) {
+    return r;
+  }
+
+  switch( cmd ) {
+    case IPC_CHANNEL_CTL_RING_MAP:
+      r=ipc_port_ring_map(port,true,(ipc_ring_info_t *)arg);
+      break;
+    case IPC_CHANNEL_CTL_RING_WAIT:
+      r=ipc_port_ring_wait(port,true,arg);
+      break;
+    default:
+      r=ipc_port_ring_notify(port,true);
+      break;
+  }
+
+  ipc_put_port(port);
+  return r;
+}
+
 int ipc_channel_control(task_t *caller,int channel,ulong_t cmd,ulong_t arg) {
   ipc_channel_t *c=ipc_get_channel(caller,channel);
   int r;
@@ -249,6 +275,11 @@ int ipc_channel_control(task_t *caller,int channel,ulong_t cmd,ulong_t arg) {
     case IPC_CHANNEL_CTL_GET_SYNC_MODE:
       r= c->flags & IPC_CHANNEL_FLAG_BLOCKED_MODE ? 1 : 0;
       break;
+    case IPC_CHANNEL_CTL_RING_MAP:
+    case IPC_CHANNEL_CTL_RING_WAIT:
+    case IPC_CHANNEL_CTL_RING_NOTIFY:
+      r=__channel_ring_control(c,cmd,arg);
+      break;
     default:
       r=-EINVAL;
       break;
@@ -1,5 +1,6 @@
 #include <arch/types.h>
 #include <ipc/ipc.h>
+#include <ipc/pollset.h>
 #include <mm/page_alloc.h>
 #include <mm/page.h>
 #include <ds/idx_allocator.h>
@@ -23,6 +24,8 @@ void initialize_ipc(void)
   if( !ipc_priv_data_cache ) {
     panic( "initialize_ipc(): Can't create the IPC private data memcache !" );
   }
+
+  ipc_msg_caches_initialize();
 }
 
 
@@ -30,6 +33,9 @@ static void __close_ipc_resources(task_ipc_t *ipc)
 {
   uint32_t i;
 
+  /* Pollsets hold references to ports, so release them first. */
+  ipc_close_pollsets(ipc);
+
   /* Close all open ports. */
   if( !hat_is_empty(&ipc->ports) ) {
     for( i = 0; i <= ipc->max_port_num; i++) {
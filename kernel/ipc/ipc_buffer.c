@@ -33,6 +33,8 @@
 #include <ipc/port.h>
 #include <ipc/channel.h>
 #include <mstring/usercopy.h>
+#include <mm/mem.h>
+#include <mm/memobj.h>
 
 /*
  * LOCK_TASK_VM and UNLOCK_TASK_VM macros are used for both kernel threads
@@ -143,6 +145,7 @@ int ipc_setup_task_buffer_pages(iovec_t *iovecs, uint32_t numvecs, page_idx_t *i
     buf->offset = (uintptr_t)iovs->iov_base - PAGE_ALIGN_DOWN(iovs->iov_base);
 
     buf->num_chunks = buf_data.chunk_num;
+    buf->base = (uintptr_t)iovs->iov_base;
     buf->length = iovs->iov_len;
     idx_array += buf_data.chunk_num;
   }
@@ -168,6 +171,144 @@ outerror:
   return ERR(r);
 }
 
+#define NON_REMAPPABLE_VMRS_MASK (VMR_PHYS | VMR_SHARED | VMR_GATE | VMR_NONE)
+
+static vmrange_t *__find_remappable_vmr(vmm_t *vmm, uintptr_t addr)
+{
+  vmrange_t *vmr = vmrange_find(vmm, addr, addr + 1, NULL);
+
+  if (!vmr || !memobj_is_generic(vmr->memobj) ||
+      (vmr->flags & NON_REMAPPABLE_VMRS_MASK) ||
+      (addr < vmr->bounds.space_start) || (addr >= vmr->bounds.space_end)) {
+    return NULL;
+  }
+
+  return vmr;
+}
+
+/*
+ * Move one page mapped by the caller at @src_addr to @dst_addr of @dst_vmr,
+ * replacing the page that was mapped there. Only private pages nobody else
+ * holds are moved: anything else must be copied.
+ */
+static int __remap_one_page(vmrange_t *src_vmr, uintptr_t src_addr,
+                            vmrange_t *dst_vmr, uintptr_t dst_addr,
+                            page_frame_t **out_page)
+{
+  vmm_t *src_vmm = src_vmr->parent_vmm, *dst_vmm = dst_vmr->parent_vmm;
+  page_frame_t *page, *old_page;
+  page_idx_t pidx;
+  int ret;
+
+  RPD_LOCK_WRITE(&src_vmm->rpd);
+  pidx = vaddr_to_pidx(&src_vmm->rpd, src_addr);
+  if (pidx == PAGE_IDX_INVAL) {
+    RPD_UNLOCK_WRITE(&src_vmm->rpd);
+    return -EFAULT;
+  }
+
+  page = pframe_by_id(pidx);
+  if ((page->flags & (PF_COW | PF_SHARED)) ||
+      (atomic_get(&page->refcount) != 1)) {
+    RPD_UNLOCK_WRITE(&src_vmm->rpd);
+    return -EBUSY;
+  }
+
+  ret = memobj_method_call(src_vmr->memobj, delete_page, src_vmr, page);
+  RPD_UNLOCK_WRITE(&src_vmm->rpd);
+  if (ret)
+    return ret;
+
+  RPD_LOCK_WRITE(&dst_vmm->rpd);
+  pidx = vaddr_to_pidx(&dst_vmm->rpd, dst_addr);
+  if (pidx != PAGE_IDX_INVAL) {
+    old_page = pframe_by_id(pidx);
+    ret = memobj_method_call(dst_vmr->memobj, delete_page, dst_vmr, old_page);
+    if (!ret)
+      unpin_page_frame(old_page);
+  }
+  if (!ret)
+    ret = memobj_method_call(dst_vmr->memobj, insert_page, dst_vmr, page,
+                             dst_addr, dst_vmr->flags);
+  RPD_UNLOCK_WRITE(&dst_vmm->rpd);
+
+  if (ret) {
+    /* Give the page back to its owner. */
+    RPD_LOCK_WRITE(&src_vmm->rpd);
+    memobj_method_call(src_vmr->memobj, insert_page, src_vmr, page,
+                       src_addr, src_vmr->flags);
+    RPD_UNLOCK_WRITE(&src_vmm->rpd);
+    return ret;
+  }
+
+  *out_page = page;
+  return 0;
+}
+
+/*
+ * Instead of copying, move whole pages of the caller's @iovec to the
+ * buffer @buf that belongs to @owner. Both the buffer and the I/O vector
+ * must be page-aligned, and like sys_grant_pages() the buffer must lie in
+ * a range mapped with VMR_CANRECPAGES. Moved pages disappear from the
+ * caller's address space (next access to them faults in a zeroed page).
+ * Returns the number of bytes moved from the head of @iovec: the rest (if
+ * any) must be copied in usual way.
+ */
+long ipc_remap_buffer_pages(ipc_buffer_t *buf, iovec_t *iovec, ulong_t len,
+                            struct __task_struct *owner)
+{
+  task_t *current = current_task();
+  vmrange_t *src_vmr, *dst_vmr;
+  uintptr_t src_addr, dst_addr;
+  page_frame_t *page;
+  ulong_t i, npages;
+
+  src_addr = (uintptr_t)iovec->iov_base;
+  dst_addr = buf->base;
+  len = MIN(len, MIN(iovec->iov_len, buf->length));
+  npages = len >> PAGE_WIDTH;
+
+  if (!npages || buf->offset || (src_addr & PAGE_MASK) ||
+      is_kernel_thread(owner) || is_kernel_thread(current) ||
+      (owner->task_mm == current->task_mm) ||
+      !valid_user_address_range(dst_addr, len) ||
+      !valid_user_address_range(src_addr, len)) {
+    return 0;
+  }
+
+  /*
+   * Two tasks may remap pages toward each other at the same time, so
+   * both address spaces are always locked in the same order.
+   */
+  if (owner->task_mm < current->task_mm) {
+    rwsem_down_read(&owner->task_mm->rwsem);
+    rwsem_down_read(&current->task_mm->rwsem);
+  }
+  else {
+    rwsem_down_read(&current->task_mm->rwsem);
+    rwsem_down_read(&owner->task_mm->rwsem);
+  }
+
+  for (i = 0; i < npages; i++, src_addr += PAGE_SIZE, dst_addr += PAGE_SIZE) {
+    src_vmr = __find_remappable_vmr(current->task_mm, src_addr);
+    dst_vmr = __find_remappable_vmr(owner->task_mm, dst_addr);
+    if (!src_vmr || !dst_vmr || !(dst_vmr->flags & VMR_WRITE) ||
+        !(dst_vmr->flags & VMR_CANRECPAGES) ||
+        __remap_one_page(src_vmr, src_addr, dst_vmr, dst_addr, &page)) {
+      break;
+    }
+
+    /* Buffer must refer to the page that is mapped now. */
+    pin_page_frame(page);
+    unpin_page_frame(pframe_by_id(buf->chunks[i]));
+    buf->chunks[i] = pframe_number(page);
+  }
+  rwsem_up_read(&current->task_mm->rwsem);
+  rwsem_up_read(&owner->task_mm->rwsem);
+
+  return i << PAGE_WIDTH;
+}
+
 /* TODO DK: unpin pages after transferring is end */
 long ipc_transfer_buffer_data_iov(ipc_buffer_t *bufs, uint32_t numbufs, iovec_t *iovecs,
                                  uint32_t numvecs, ulong_t offset, bool to_buffer)
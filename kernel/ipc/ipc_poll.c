@@ -29,6 +29,7 @@
 #include <ipc/poll.h>
 #include <mstring/time.h>
 #include <mm/slab.h>
+#include <mm/scratch.h>
 #include <mstring/errno.h>
 #include <mm/page_alloc.h>
 #include <mstring/waitqueue.h>
@@ -62,7 +63,7 @@ long sys_ipc_port_poll(pollfd_t *pfds,ulong_t nfds,timeval_t *timeout)
   task_t *caller=current_task();
   ulong_t size=nfds*sizeof(poll_kitem_t);
   poll_kitem_t *pkitems;
-  bool use_slab=(size<=512);
+  bool use_scratch;
   ulong_t i;
   struct __plazy_data ldata;
 
@@ -71,8 +72,10 @@ long sys_ipc_port_poll(pollfd_t *pfds,ulong_t nfds,timeval_t *timeout)
   }
 
   /* TODO: [mt] Add process memory limit check. [R] */
-  if( use_slab ) {
-    pkitems=memalloc(size);
+  /* Scratch memory is released on return from the syscall. */
+  pkitems=scratch_alloc(size);
+  use_scratch=(pkitems != NULL);
+  if( use_scratch ) {
     memset(pkitems,0,size);
   } else {
     pkitems=alloc_pages_addr((size>>PAGE_WIDTH)+1,MMPOOL_KERN | AF_ZERO | AF_CONTIG);
@@ -153,9 +156,7 @@ put_ports:
   }
 
   /* Free buffers. */
-  if( use_slab ) {
-    memfree(pkitems);
-  } else {
+  if( !use_scratch ) {
     free_pages_addr(pkitems, (size>>PAGE_WIDTH)+1);
   }
   return nevents;
@@ -0,0 +1,179 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * (c) Copyright 2006,2007,2008 MString Core Team <http://mstring.jarios.org>
+ *
+ * ipc/mpsc_port.c: Implementation of non-blocking IPC ports whose senders
+ *                  enqueue messages without taking the port lock.
+ *
+ */
+
+#include <arch/types.h>
+#include <arch/atomic.h>
+#include <arch/preempt.h>
+#include <arch/scheduler.h>
+#include <ipc/port.h>
+#include <ipc/ipc.h>
+#include <mstring/errno.h>
+#include <ds/mpsc.h>
+#include <mm/slab.h>
+
+/* Senders append messages via 'mpsc_push()' and then increment
+ * 'avail_messages' atomically. All other operations are performed by
+ * the receiver with the port locked, so the port lock is never taken
+ * by senders unless they have somebody to wake up.
+ * Messages the receiver puts back are kept in 'requeued' list which is
+ * drained before the queue.
+ */
+typedef struct __mpsc_port_data_storage {
+  mpsc_queue_t queue;
+  list_head_t requeued;
+} mpsc_port_data_storage_t;
+
+#define __mpsc_queue(port)                                              \
+  (&((mpsc_port_data_storage_t *)(port)->data_storage)->queue)
+#define __mpsc_requeued(port)                                           \
+  (&((mpsc_port_data_storage_t *)(port)->data_storage)->requeued)
+
+static int mpsc_init_data_storage(struct __ipc_gen_port *port,
+                                  task_t *owner,ulong_t queue_size)
+{
+  mpsc_port_data_storage_t *ds;
+
+  if( port->data_storage ) {
+    return -EBUSY;
+  }
+
+  ds=memalloc(sizeof(*ds));
+  if( !ds ) {
+    return -ENOMEM;
+  }
+
+  mpsc_init(&ds->queue);
+  list_init_head(&ds->requeued);
+  port->data_storage=ds;
+  port->capacity=queue_size;
+  ipc_msg_cache_resize(queue_size);
+  return 0;
+}
+
+/* NOTE: Port needn't be locked. */
+static int mpsc_insert_message(struct __ipc_gen_port *port,
+                               ipc_port_message_t *msg)
+{
+  msg->id=WAITQUEUE_MSG_ID;
+
+  preempt_disable();
+  mpsc_push(__mpsc_queue(port),&msg->mpsc_node);
+  preempt_enable();
+
+  /* Locked increment also orders our push before the following check
+   * of the port's waitqueue made by the caller.
+   */
+  atomic_inc(&port->avail_messages);
+  return 0;
+}
+
+/* NOTE: Port must be locked ! */
+static ipc_port_message_t *mpsc_extract_message(ipc_gen_port_t *port,
+                                                ulong_t flags)
+{
+  mpsc_node_t *n;
+
+  if( !atomic_get(&port->avail_messages) ) {
+    return NULL;
+  }
+
+  if( !list_is_empty(__mpsc_requeued(port)) ) {
+    ipc_port_message_t *msg=container_of(list_node_first(__mpsc_requeued(port)),
+                                         ipc_port_message_t,l);
+
+    list_del(&msg->l);
+    atomic_dec(&port->avail_messages);
+    return msg;
+  }
+
+  /* The counter is incremented after the message was pushed, so we can
+   * only meet a node whose producer is a few instructions from linking it.
+   */
+  while( !(n=mpsc_pop(__mpsc_queue(port))) ) {
+    arch_cpu_relax();
+  }
+
+  atomic_dec(&port->avail_messages);
+  return container_of(n,ipc_port_message_t,mpsc_node);
+}
+
+/* NOTE: Port must be locked ! */
+static void mpsc_requeue_message(struct __ipc_gen_port *port,
+                                 ipc_port_message_t *msg)
+{
+  list_add2head(__mpsc_requeued(port),&msg->l);
+  atomic_inc(&port->avail_messages);
+}
+
+static int mpsc_remove_message(struct __ipc_gen_port *port,
+                               ipc_port_message_t *msg)
+{
+  /* Messages leave the queue when they are extracted. */
+  return 0;
+}
+
+static ipc_port_message_t *mpsc_remove_head_message(struct __ipc_gen_port *port)
+{
+  return mpsc_extract_message(port,0);
+}
+
+static ipc_port_message_t *mpsc_lookup_message(struct __ipc_gen_port *port,
+                                               ulong_t msg_id)
+{
+  return NULL;
+}
+
+static void mpsc_destructor(ipc_gen_port_t *port)
+{
+  mpsc_queue_t *q=__mpsc_queue(port);
+  mpsc_node_t *n;
+
+  /* Nobody can send to the port anymore: release late messages. */
+  while( !list_is_empty(__mpsc_requeued(port)) ) {
+    ipc_port_message_t *msg=container_of(list_node_first(__mpsc_requeued(port)),
+                                         ipc_port_message_t,l);
+
+    list_del(&msg->l);
+    put_ipc_port_message(msg);
+  }
+  while( (n=mpsc_pop(q)) != NULL ) {
+    put_ipc_port_message(container_of(n,ipc_port_message_t,mpsc_node));
+  }
+
+  memfree(port->data_storage);
+  ipc_msg_cache_resize(-(long)port->capacity);
+}
+
+ipc_port_msg_ops_t mpsc_port_msg_ops = {
+  .init_data_storage=mpsc_init_data_storage,
+  .insert_message=mpsc_insert_message,
+  .extract_message=mpsc_extract_message,
+  .remove_message=mpsc_remove_message,
+  .remove_head_message=mpsc_remove_head_message,
+  .requeue_message=mpsc_requeue_message,
+  .lookup_message=mpsc_lookup_message,
+};
+
+ipc_port_ops_t mpsc_port_ops = {
+  .destructor=mpsc_destructor,
+};
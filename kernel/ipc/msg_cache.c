@@ -0,0 +1,218 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * (c) Copyright 2006,2007,2008 MString Core Team <http://mstring.jarios.org>
+ *
+ * ipc/msg_cache.c: per-CPU caches of free non-blocking port messages.
+ *
+ */
+
+#include <arch/types.h>
+#include <arch/atomic.h>
+#include <ipc/port.h>
+#include <mstring/smp.h>
+#include <mstring/stddef.h>
+#include <mstring/string.h>
+#include <mstring/event.h>
+#include <sync/spinlock.h>
+#include <ds/list.h>
+#include <mm/slab.h>
+#include <mm/shrinker.h>
+
+typedef struct __ipc_msg_cache {
+  spinlock_t lock;
+  list_head_t msgs;
+  ulong_t nr_msgs;
+  ulong_t hits,misses;
+} ipc_msg_cache_t;
+
+static ipc_msg_cache_t PER_CPU_VAR(ipc_msg_caches);
+
+/* Total capacity of all non-blocking ports in the system: there is no sense
+ * to keep more free messages than all such ports can hold.
+ */
+static atomic_t ipc_msg_cache_limit;
+
+static ulong_t __shrink_msg_caches(shrinker_t *shrinker)
+{
+  return ipc_msg_caches_drain();
+}
+
+static shrinker_t ipc_msg_caches_shrinker=
+  SHRINKER_INITIALIZE("IPC message caches",__shrink_msg_caches,
+                      SHRINK_PRIO_OBJECTS);
+
+void ipc_msg_caches_initialize(void)
+{
+  ipc_msg_cache_t *c;
+
+  for_each_percpu_var(c,ipc_msg_caches) {
+    spinlock_initialize(&c->lock, "IPC message cache");
+    list_init_head(&c->msgs);
+    c->nr_msgs=c->hits=c->misses=0;
+  }
+  atomic_set(&ipc_msg_cache_limit,0);
+  register_shrinker(&ipc_msg_caches_shrinker);
+}
+
+/* Cached messages are kept constructed: lists, event and the inline send
+ * buffer are set up once, when a message is taken from the slab.
+ */
+static void __construct_nb_message(ipc_port_message_t *msg)
+{
+  memset(msg,0,sizeof(*msg));
+  list_init_node(&msg->l);
+  list_init_node(&msg->messages_list);
+  event_initialize(&msg->event);
+  msg->send_buffer=(void *)((char *)msg+sizeof(*msg));
+  msg->state=MSG_STATE_NOT_PROCESSED;
+}
+
+/* Brings a released message back to the constructed state. Only fields
+ * that non-blocking messages may change during their lifetime are reset:
+ * 'data_size', 'sender', 'prio' and 'creds' are always set by senders, and
+ * blocking-only fields are never touched.
+ */
+static void __recycle_nb_message(ipc_port_message_t *msg)
+{
+  list_init_node(&msg->l);
+  list_init_node(&msg->messages_list);
+  event_initialize(&msg->event);
+  msg->id=msg->flags=0;
+  msg->reply_size=0;
+  msg->replied_size=0;
+  msg->receive_buffer=NULL;
+  msg->extra_data=NULL;
+  msg->extra_data_tail=0;
+  msg->rcv_kiovecs=NULL;
+  msg->rcv_knumvecs=0;
+  msg->state=MSG_STATE_NOT_PROCESSED;
+}
+
+/* Returns a constructed message: callers only have to fill in per-message
+ * fields.
+ */
+ipc_port_message_t *ipc_alloc_nb_message(void)
+{
+  ipc_msg_cache_t *c=percpu_get_var(ipc_msg_caches);
+  ipc_port_message_t *msg=NULL;
+
+  spinlock_lock(&c->lock);
+  if( c->nr_msgs ) {
+    msg=container_of(list_node_first(&c->msgs),ipc_port_message_t,l);
+    list_del(&msg->l);
+    c->nr_msgs--;
+    c->hits++;
+  } else {
+    c->misses++;
+  }
+  spinlock_unlock(&c->lock);
+
+  if( msg ) {
+    list_init_node(&msg->l);
+  } else {
+    msg=memalloc(IPC_NB_MESSAGE_SIZE);
+    if( msg ) {
+      __construct_nb_message(msg);
+    }
+  }
+  return msg;
+}
+
+void ipc_free_nb_message(ipc_port_message_t *msg)
+{
+  ipc_msg_cache_t *c=percpu_get_var(ipc_msg_caches);
+  ulong_t limit=MIN(IPC_MSG_CACHE_MAX,(ulong_t)atomic_get(&ipc_msg_cache_limit));
+
+  if( c->nr_msgs >= limit ) {
+    memfree(msg);
+    return;
+  }
+
+  __recycle_nb_message(msg);
+  spinlock_lock(&c->lock);
+  if( c->nr_msgs < limit ) {
+    list_add2head(&c->msgs,&msg->l);
+    c->nr_msgs++;
+    msg=NULL;
+  }
+  spinlock_unlock(&c->lock);
+
+  if( msg ) {
+    memfree(msg);
+  }
+}
+
+/* Called when a non-blocking port of @delta slots appears (or disappears,
+ * if @delta is negative).
+ */
+void ipc_msg_cache_resize(long delta)
+{
+  atomic_add(&ipc_msg_cache_limit,delta);
+}
+
+/* Releases all cached messages back to the slab. Returns the number of
+ * messages released.
+ */
+ulong_t ipc_msg_caches_drain(void)
+{
+  ipc_msg_cache_t *c;
+  ipc_port_message_t *msg;
+  list_head_t msgs;
+  ulong_t n=0;
+
+  for_each_percpu_var(c,ipc_msg_caches) {
+    list_init_head(&msgs);
+
+    spinlock_lock(&c->lock);
+    if( c->nr_msgs ) {
+      list_move2head(&msgs,&c->msgs);
+      c->nr_msgs=0;
+    }
+    spinlock_unlock(&c->lock);
+
+    while( !list_is_empty(&msgs) ) {
+      msg=container_of(list_node_first(&msgs),ipc_port_message_t,l);
+      list_del(&msg->l);
+      memfree(msg);
+      n++;
+    }
+  }
+
+  return n;
+}
+
+long ipc_msg_cache_hits(void)
+{
+  ipc_msg_cache_t *c;
+  long n=0;
+
+  for_each_percpu_var(c,ipc_msg_caches) {
+    n += c->hits;
+  }
+  return n;
+}
+
+long ipc_msg_cache_misses(void)
+{
+  ipc_msg_cache_t *c;
+  long n=0;
+
+  for_each_percpu_var(c,ipc_msg_caches) {
+    n += c->misses;
+  }
+  return n;
+}
@@ -0,0 +1,448 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * (c) Copyright 2006,2007,2008 MString Core Team <http://mstring.jarios.org>
+ *
+ * ipc/pollset.c: implementation of persistent sets of polled IPC ports.
+ *
+ */
+
+#include <arch/types.h>
+#include <kernel/syscalls.h>
+#include <ipc/ipc.h>
+#include <ipc/port.h>
+#include <ipc/pollset.h>
+#include <mstring/task.h>
+#include <mstring/errno.h>
+#include <mstring/stddef.h>
+#include <mstring/time.h>
+#include <mstring/usercopy.h>
+#include <mstring/waitqueue.h>
+#include <mm/slab.h>
+
+static ipc_pollset_t *__get_pollset(ulong_t id)
+{
+  task_ipc_t *ipc;
+  ipc_pollset_t *s=NULL;
+
+  if( id >= IPC_TASK_POLLSETS || !(ipc=get_task_ipc(current_task())) ) {
+    return NULL;
+  }
+
+  LOCK_IPC(ipc);
+  s=ipc->pollsets[id];
+  if( s ) {
+    atomic_inc(&s->use_count);
+  }
+  UNLOCK_IPC(ipc);
+
+  release_task_ipc(ipc);
+  return s;
+}
+
+static void __put_pollset(ipc_pollset_t *s)
+{
+  if( atomic_dec_and_test(&s->use_count) ) {
+    ASSERT(list_is_empty(&s->entries));
+    memfree(s);
+  }
+}
+
+/* NOTE: Port must be locked ! */
+static void __signal_entry(ipc_poll_entry_t *e)
+{
+  ipc_pollset_t *s=e->set;
+
+  spinlock_lock(&s->lock);
+  e->signaled=true;
+  if( !e->queued ) {
+    e->queued=true;
+    list_add2tail(&s->ready,&e->ready_node);
+  }
+  waitqueue_pop(&s->waitqueue,NULL);
+  spinlock_unlock(&s->lock);
+}
+
+/* NOTE: Port must be locked ! */
+void ipc_port_signal_pollsets(ipc_gen_port_t *port)
+{
+  list_node_t *n;
+
+  list_for_each(&port->pollsets,n) {
+    __signal_entry(container_of(n,ipc_poll_entry_t,port_node));
+  }
+}
+
+/* NOTE: Pollset's mutex must be held ! */
+static ipc_poll_entry_t *__find_entry(ipc_pollset_t *s,ulong_t fd)
+{
+  list_node_t *n;
+
+  list_for_each(&s->entries,n) {
+    ipc_poll_entry_t *e=container_of(n,ipc_poll_entry_t,set_node);
+
+    if( e->fd == fd ) {
+      return e;
+    }
+  }
+  return NULL;
+}
+
+/* NOTE: Pollset's mutex must be held ! */
+static long __add_entry(ipc_pollset_t *s,ulong_t fd,poll_event_t events)
+{
+  ipc_poll_entry_t *e;
+  ipc_gen_port_t *port;
+  long r=-EINVAL;
+
+  if( s->num_entries >= MAX_POLL_OBJECTS ) {
+    return -ENOSPC;
+  }
+
+  if( !(port=ipc_get_port(current_task(),fd,&r)) ) {
+    return r;
+  }
+
+  e=memalloc(sizeof(*e));
+  if( !e ) {
+    ipc_put_port(port);
+    return -ENOMEM;
+  }
+
+  e->set=s;
+  e->port=port;
+  e->fd=fd;
+  e->events=events;
+  e->revents=0;
+  e->queued=e->signaled=false;
+  list_init_node(&e->set_node);
+  list_init_node(&e->ready_node);
+  list_init_node(&e->port_node);
+
+  list_add2tail(&s->entries,&e->set_node);
+  s->num_entries++;
+
+  /* Let the next scan check events that are already pending. */
+  IPC_LOCK_PORT_W(port);
+  list_add2tail(&port->pollsets,&e->port_node);
+  __signal_entry(e);
+  IPC_UNLOCK_PORT_W(port);
+
+  return 0;
+}
+
+/* NOTE: Pollset's mutex must be held ! */
+static void __remove_entry(ipc_pollset_t *s,ipc_poll_entry_t *e)
+{
+  IPC_LOCK_PORT_W(e->port);
+  list_del(&e->port_node);
+  IPC_UNLOCK_PORT_W(e->port);
+
+  /* Since we hold the mutex, nobody is scanning this entry right now. */
+  spinlock_lock(&s->lock);
+  if( e->queued ) {
+    list_del(&e->ready_node);
+  }
+  spinlock_unlock(&s->lock);
+
+  list_del(&e->set_node);
+  s->num_entries--;
+  ipc_put_port(e->port);
+  memfree(e);
+}
+
+static void __shutdown_pollset(ipc_pollset_t *s)
+{
+  mutex_lock(&s->mutex);
+  while( !list_is_empty(&s->entries) ) {
+    __remove_entry(s,container_of(list_node_first(&s->entries),
+                                  ipc_poll_entry_t,set_node));
+  }
+
+  spinlock_lock(&s->lock);
+  s->closed=true;
+  while( !waitqueue_pop(&s->waitqueue,NULL) );
+  spinlock_unlock(&s->lock);
+  mutex_unlock(&s->mutex);
+}
+
+static poll_event_t __entry_events(ipc_poll_entry_t *e)
+{
+  if( e->port->flags & IPC_PORT_SHUTDOWN ) {
+    return POLLERR;
+  }
+  return ipc_port_arm_events(e->port,e->events);
+}
+
+/* Checks at most @max entries from the ready list and reports ones that
+ * really have pending events. Such entries stay on the ready list (the
+ * set is level-triggered), the rest leave it until their ports are
+ * signaled again.
+ */
+static ulong_t __scan_ready(ipc_pollset_t *s,pollfd_t *kevents,ulong_t max)
+{
+  list_head_t batch;
+  list_node_t *n;
+  ipc_poll_entry_t *e;
+  ulong_t i=0;
+
+  list_init_head(&batch);
+
+  mutex_lock(&s->mutex);
+  spinlock_lock(&s->lock);
+  while( i < max && !list_is_empty(&s->ready) ) {
+    e=container_of(list_node_first(&s->ready),ipc_poll_entry_t,ready_node);
+    list_del(&e->ready_node);
+    e->signaled=false;
+    list_add2tail(&batch,&e->ready_node);
+    i++;
+  }
+  spinlock_unlock(&s->lock);
+
+  i=0;
+  list_for_each(&batch,n) {
+    e=container_of(n,ipc_poll_entry_t,ready_node);
+    e->revents=__entry_events(e);
+    if( e->revents ) {
+      kevents[i].fd=e->fd;
+      kevents[i].events=e->events;
+      kevents[i].revents=e->revents;
+      i++;
+    }
+  }
+
+  /* Entries signaled during the check must be checked once more. */
+  spinlock_lock(&s->lock);
+  while( !list_is_empty(&batch) ) {
+    e=container_of(list_node_first(&batch),ipc_poll_entry_t,ready_node);
+    list_del(&e->ready_node);
+    if( e->revents || e->signaled ) {
+      list_add2tail(&s->ready,&e->ready_node);
+    } else {
+      e->queued=false;
+    }
+  }
+  spinlock_unlock(&s->lock);
+  mutex_unlock(&s->mutex);
+
+  return i;
+}
+
+static long __pollset_wait(ipc_pollset_t *s,pollfd_t *kevents,ulong_t max,
+                           bool block)
+{
+  task_t *caller=current_task();
+  wqueue_task_t w;
+  ulong_t n;
+  long r;
+
+  for(;;) {
+    n=__scan_ready(s,kevents,max);
+    if( n || !block ) {
+      return n;
+    }
+
+    spinlock_lock(&s->lock);
+    if( s->closed ) {
+      spinlock_unlock(&s->lock);
+      return -EPIPE;
+    }
+
+    if( list_is_empty(&s->ready) ) {
+      waitqueue_prepare_task(&w,caller);
+      r=waitqueue_push_intr(&s->waitqueue,&w);
+      spinlock_unlock(&s->lock);
+
+      if( task_was_interrupted(caller) ) {
+        waitqueue_delete(&w,WQ_DELETE_SIMPLE);
+        return -EINTR;
+      }
+      if( r ) {
+        return r;
+      }
+    } else {
+      spinlock_unlock(&s->lock);
+    }
+  }
+}
+
+void ipc_close_pollsets(task_ipc_t *ipc)
+{
+  ipc_pollset_t *s;
+  ulong_t i;
+
+  for( i=0; i<IPC_TASK_POLLSETS; i++ ) {
+    s=ipc->pollsets[i];
+    if( s ) {
+      ipc->pollsets[i]=NULL;
+      __shutdown_pollset(s);
+      __put_pollset(s);
+    }
+  }
+}
+
+long sys_ipc_pollset_create(void)
+{
+  task_ipc_t *ipc=get_task_ipc(current_task());
+  ipc_pollset_t *s;
+  long r;
+  ulong_t i;
+
+  if( !ipc ) {
+    return ERR(-EINVAL);
+  }
+
+  s=memalloc(sizeof(*s));
+  if( !s ) {
+    r=-ENOMEM;
+    goto out;
+  }
+
+  mutex_initialize(&s->mutex);
+  spinlock_initialize(&s->lock, "Pollset");
+  atomic_set(&s->use_count,1);
+  list_init_head(&s->entries);
+  list_init_head(&s->ready);
+  s->num_entries=0;
+  waitqueue_initialize(&s->waitqueue);
+  s->closed=false;
+
+  r=-EMFILE;
+  LOCK_IPC(ipc);
+  for( i=0; i<IPC_TASK_POLLSETS; i++ ) {
+    if( !ipc->pollsets[i] ) {
+      ipc->pollsets[i]=s;
+      r=i;
+      break;
+    }
+  }
+  UNLOCK_IPC(ipc);
+
+  if( r < 0 ) {
+    memfree(s);
+  }
+out:
+  release_task_ipc(ipc);
+  return ERR(r);
+}
+
+long sys_ipc_pollset_control(ulong_t set,ulong_t cmd,ulong_t port,
+                             poll_event_t events)
+{
+  ipc_pollset_t *s=__get_pollset(set);
+  ipc_poll_entry_t *e;
+  long r;
+
+  if( !s ) {
+    return ERR(-EINVAL);
+  }
+
+  mutex_lock(&s->mutex);
+  if( s->closed ) {
+    r=-EINVAL;
+    goto out_unlock;
+  }
+
+  e=__find_entry(s,port);
+  switch( cmd ) {
+    case IPC_POLLSET_CTL_ADD:
+      r=e ? -EEXIST : __add_entry(s,port,events);
+      break;
+    case IPC_POLLSET_CTL_MOD:
+      if( e ) {
+        IPC_LOCK_PORT_W(e->port);
+        e->events=events;
+        __signal_entry(e);
+        IPC_UNLOCK_PORT_W(e->port);
+        r=0;
+      } else {
+        r=-ENOENT;
+      }
+      break;
+    case IPC_POLLSET_CTL_DEL:
+      if( e ) {
+        __remove_entry(s,e);
+        r=0;
+      } else {
+        r=-ENOENT;
+      }
+      break;
+    default:
+      r=-EINVAL;
+      break;
+  }
+out_unlock:
+  mutex_unlock(&s->mutex);
+  __put_pollset(s);
+  return ERR(r);
+}
+
+long sys_ipc_pollset_wait(ulong_t set,pollfd_t *events,ulong_t nevents,
+                          timeval_t *timeout)
+{
+  pollfd_t kevents[IPC_POLLSET_WAIT_MAX];
+  ipc_pollset_t *s;
+  bool block=true;
+  timeval_t t;
+  long r;
+
+  if( !events || !nevents ) {
+    return ERR(-EINVAL);
+  }
+
+  if( timeout ) {
+    if( copy_from_user(&t,timeout,sizeof(t)) ) {
+      return ERR(-EFAULT);
+    }
+    block=(t.tv_sec || t.tv_nsec);
+  }
+
+  if( !(s=__get_pollset(set)) ) {
+    return ERR(-EINVAL);
+  }
+
+  r=__pollset_wait(s,kevents,MIN(nevents,IPC_POLLSET_WAIT_MAX),block);
+  __put_pollset(s);
+
+  if( r > 0 && copy_to_user(events,kevents,r*sizeof(pollfd_t)) ) {
+    r=-EFAULT;
+  }
+  return ERR(r);
+}
+
+long sys_ipc_pollset_close(ulong_t set)
+{
+  task_ipc_t *ipc;
+  ipc_pollset_t *s;
+
+  if( set >= IPC_TASK_POLLSETS || !(ipc=get_task_ipc(current_task())) ) {
+    return ERR(-EINVAL);
+  }
+
+  LOCK_IPC(ipc);
+  s=ipc->pollsets[set];
+  ipc->pollsets[set]=NULL;
+  UNLOCK_IPC(ipc);
+  release_task_ipc(ipc);
+
+  if( !s ) {
+    return ERR(-EINVAL);
+  }
+
+  __shutdown_pollset(s);
+  __put_pollset(s);
+  return 0;
+}
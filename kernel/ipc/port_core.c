@@ -25,6 +25,7 @@
 
 #include <mstring/types.h>
 #include <ipc/port.h>
+#include <ipc/pollset.h>
 #include <mstring/task.h>
 #include <mstring/errno.h>
 #include <sync/mutex.h>
@@ -33,10 +34,12 @@
 #include <ds/idx_allocator.h>
 #include <ipc/ipc.h>
 #include <ipc/buffer.h>
+#include <ipc/ring.h>
 #include <mstring/stddef.h>
 #include <arch/preempt.h>
 #include <mstring/kconsole.h>
 #include <mm/slab.h>
+#include <mm/scratch.h>
 #include <ipc/port.h>
 #include <mstring/event.h>
 #include <mstring/signal.h>
@@ -68,8 +71,67 @@
   spinlock_initialize(&(p)->lock, "Port");      \
   (p)->avail_messages=(p)->total_messages=0;    \
   list_init_head(&(p)->channels);               \
+  list_init_head(&(p)->pollsets);               \
   waitqueue_initialize(&(p)->waitqueue)
 
+/* NOTE: Port must be locked !
+ * Senders of MPSC ports don't take the lock to enqueue a message, so after
+ * a receiver got into the waitqueue it has to check for messages once more.
+ * Senders check the waitqueue after enqueueing, so one of the sides always
+ * sees the other one. Returns true if the receiver was removed from the
+ * waitqueue since there are messages.
+ */
+static bool __mpsc_recheck_messages(ipc_gen_port_t *port,wqueue_task_t *w,
+                                    wqueue_delop_t dop)
+{
+  if( !(port->flags & IPC_MPSC_ACCESS) ) {
+    return false;
+  }
+
+  atomic_mb();
+  if( atomic_get(&port->avail_messages) && w->wq ) {
+    waitqueue_delete(w,dop);
+    return true;
+  }
+  return false;
+}
+
+/* Enqueues a message to an MPSC port: the port is locked only if there are
+ * receivers or pollsets to notify.
+ * Shutdown may race with the unlocked enqueue, so the flag is checked once
+ * more after the message was queued: such a message belongs to the port
+ * from now on and will be released by its destructor, but the sender must
+ * see -EPIPE.
+ */
+static long __mpsc_send_message(ipc_gen_port_t *port,ipc_port_message_t *msg)
+{
+  size_t msg_size=msg->data_size;
+  long r;
+
+  if( port->flags & IPC_PORT_SHUTDOWN ) {
+    return -EPIPE;
+  }
+
+  r=port->msg_ops->insert_message(port,msg);
+  if( r ) {
+    return r;
+  }
+
+  /* insert_message() orders the push before this load. */
+  if( port->flags & IPC_PORT_SHUTDOWN ) {
+    return -EPIPE;
+  }
+
+  if( !waitqueue_is_empty(&port->waitqueue) || !list_is_empty(&port->pollsets) ) {
+    IPC_LOCK_PORT_W(port);
+    waitqueue_pop(&port->waitqueue,NULL);
+    ipc_port_signal_pollsets(port);
+    IPC_UNLOCK_PORT_W(port);
+  }
+
+  return msg_size;
+}
+
 static int __calc_msg_length(iovec_t iovecs[], ulong_t num_iovecs, ulong_t *size)
 {
   ulong_t i, msg_size;
@@ -89,22 +151,20 @@ static ipc_port_message_t *__ipc_create_nb_port_message(ipc_channel_t *channel,u
                                                  ulong_t snd_size,bool copy_data)
 {
   if( snd_size <= IPC_NB_MESSAGE_MAXLEN && snd_size ) {
-    ipc_port_message_t *msg=memalloc(sizeof(*msg)+snd_size);
+    ipc_port_message_t *msg=ipc_alloc_nb_message();
     if( msg ) {
-      memset(msg,0,sizeof(*msg));
-
-      IPC_RESET_MESSAGE(msg,current_task());
-      msg->send_buffer=(void *)((char *)msg+sizeof(*msg));
+      /* Messages come constructed from the cache, so only set what
+       * differs between messages.
+       */
+      event_set_task(&msg->event,current_task());
       msg->data_size=snd_size;
-      msg->reply_size=0;
       msg->sender=current_task();
-      msg->blocked_mode = false;
 
       if( copy_data ) {
         if( !copy_from_user(msg->send_buffer,(void *)snd_buf,snd_size) ) {
           return msg;
         } else {
-          memfree(msg);
+          ipc_free_nb_message(msg);
         }
       } else {
         return msg;
@@ -143,7 +203,7 @@ void put_ipc_port_message(ipc_port_message_t *msg)
     }
   }
   else {
-    memfree(msg);
+    ipc_free_nb_message(msg);
   }
 
   if( extra_data ) {
@@ -278,8 +338,20 @@ static int __allocate_port(ipc_gen_port_t **out_port, ulong_t flags,
 
   IPC_INIT_PORT(p);
 
-  p->msg_ops = &prio_port_msg_ops;
-  p->port_ops = &prio_port_ops;
+  if( flags & IPC_MPSC_ACCESS ) {
+    if( flags & (IPC_BLOCKED_ACCESS | IPC_HANDOFF_ACCESS | IPC_RING_ACCESS) ) {
+      r=-EINVAL;
+      goto out_free_port;
+    }
+    p->msg_ops = &mpsc_port_msg_ops;
+    p->port_ops = &mpsc_port_ops;
+  } else if( flags & IPC_RING_ACCESS ) {
+    p->msg_ops = &ring_port_msg_ops;
+    p->port_ops = &ring_port_ops;
+  } else {
+    p->msg_ops = &prio_port_msg_ops;
+    p->port_ops = &prio_port_ops;
+  }
   p->flags = (flags & IPC_PORT_DIRECT_FLAGS);
   r=p->msg_ops->init_data_storage(p,owner,queue_size);
   if( r ) {
@@ -334,17 +406,23 @@ repeat:
     IPC_UNLOCK_PORT_W(port);
     goto repeat;
   }
+  ipc_port_signal_pollsets(port);
   IPC_UNLOCK_PORT_W(port);
+
+  if( port->ring ) {
+    ipc_port_ring_shutdown(port);
+  }
 }
 
 static long __transfer_reply_data_iov(ipc_port_message_t *msg,
                                       iovec_t *reply_iov,ulong_t numvecs,
                                       bool from_server,ulong_t reply_len,
-                                      ulong_t offset)
+                                      ulong_t offset,bool remap)
 {
   long r=0,processed=0;
   ulong_t i,to_copy,rlen;
   char *rcv_buf;
+  iovec_t tail;
 
   if( from_server ) {
     reply_len=MIN(reply_len,msg->reply_size-offset);
@@ -380,10 +458,23 @@ static long __transfer_reply_data_iov(ipc_port_message_t *msg,
     } else {
       /* Long message - process it via buffer. */
       if( from_server ) {
-        r=ipc_transfer_buffer_data_iov(msg->rcv_buf,msg->num_recv_buffers,
-                                       reply_iov,numvecs,offset,true);
-        processed = r;
+        /* Try to move whole pages first, then copy what remains. */
+        if( remap && !offset && numvecs == 1 && msg->num_recv_buffers == 1 ) {
+          processed=ipc_remap_buffer_pages(msg->rcv_buf,reply_iov,reply_len,
+                                           msg->sender);
+        }
+
+        if( !processed ) {
+          r=ipc_transfer_buffer_data_iov(msg->rcv_buf,msg->num_recv_buffers,
+                                         reply_iov,numvecs,offset,true);
+        } else if( processed < MIN(reply_len,reply_iov->iov_len) ) {
+          tail.iov_base=(char *)reply_iov->iov_base + processed;
+          tail.iov_len=MIN(reply_len,reply_iov->iov_len) - processed;
+          r=ipc_transfer_buffer_data_iov(msg->rcv_buf,1,&tail,1,processed,true);
+        }
+
         if( r >= 0 ) {
+          processed += r;
           r=0;
         }
       } else {
@@ -660,8 +751,14 @@ static long __map_and_write_indirect_message(ipc_port_message_t *msg,
                                              struct __iovec *iovecs,ulong_t numvecs,
                                              ulong_t offset)
 {
+  scratch_mark_t mark = scratch_mark();
+  ipc_buffer_t *bufs;
   long r;
-  ipc_buffer_t bufs[MAX_IOVECS];
+
+  bufs = scratch_alloc(MAX_IOVECS * sizeof(ipc_buffer_t));
+  if (!bufs) {
+    return ERR(-ENOMEM);
+  }
 
   r = ipc_setup_task_buffer_pages(msg->rcv_kiovecs,msg->rcv_knumvecs,
                                   ((page_idx_t *)msg->sender->ipc_priv->cached_data.cached_page2),
@@ -671,17 +768,21 @@ static long __map_and_write_indirect_message(ipc_port_message_t *msg,
     r = ipc_transfer_buffer_data_iov(bufs,msg->rcv_knumvecs,iovecs,
                                      numvecs,offset,true);
   }
+
+  scratch_release(mark);
   return ERR(r);
 }
 
-long ipc_port_msg_write(struct __ipc_gen_port *port,ulong_t msg_id,
-                        struct __iovec *iovecs,ulong_t numvecs,off_t *poffset,
-                        long len, bool wakeup,long msg_size,bool map_rcv_buffer)
+/* Looks up message @msg_id to be written and marks it accordingly.
+ * NOTE: Port must be locked !
+ */
+static long __start_msg_write(ipc_gen_port_t *port,ulong_t msg_id,
+                              off_t *poffset,bool wakeup,bool *map_rcv_buffer,
+                              ipc_port_message_t **pmsg)
 {
   ipc_port_message_t *msg;
   long r = -EINVAL;
 
-  IPC_LOCK_PORT_W(port);
   if( (msg = __ipc_port_lookup_message(port,msg_id,&r)) ) {
     if( message_writable(msg) ) {
       if( !poffset || (*poffset < msg->reply_size) ) {
@@ -698,54 +799,163 @@ long ipc_port_msg_write(struct __ipc_gen_port *port,ulong_t msg_id,
       mark_message_waccess(msg);
     }
 
-    if (map_rcv_buffer && msg->reply_size <= IPC_BUFFERED_PORT_LENGTH) {
+    if (*map_rcv_buffer && msg->reply_size <= IPC_BUFFERED_PORT_LENGTH) {
       bit_set(&msg->flags,MSG_SMALL_RCV_BUF_MAPPED);
     } else {
-      map_rcv_buffer = false;
+      *map_rcv_buffer = false;
     }
   }
-  IPC_UNLOCK_PORT_W(port);
 
-  if( !r ) {
-    if( iovecs ) {
-      if (map_rcv_buffer) {
-        r = __map_and_write_indirect_message(msg,iovecs,numvecs,*poffset);
-      } else {
-        r=__transfer_reply_data_iov(msg,iovecs,numvecs,true,len,*poffset);
-      }
+  *pmsg=msg;
+  return r;
+}
+
+/* Transfers data of a message prepared by '__start_msg_write()' and wakes
+ * up its sender if requested.
+ */
+static long __finish_msg_write(ipc_gen_port_t *port,ipc_port_message_t *msg,
+                               struct __iovec *iovecs,ulong_t numvecs,
+                               off_t *poffset,long len,bool wakeup,
+                               long msg_size,bool map_rcv_buffer)
+{
+  long r=0;
+
+  if( iovecs ) {
+    if (map_rcv_buffer) {
+      r = __map_and_write_indirect_message(msg,iovecs,numvecs,*poffset);
+    } else {
+      r=__transfer_reply_data_iov(msg,iovecs,numvecs,true,len,*poffset,
+                                  port->flags & IPC_REMAP_ACCESS);
     }
+  }
 
+  /* Message being replied is no longer reachable via the port, so
+   * there is no need to relock the port just to change its state.
+   */
+  if( !wakeup ) {
     IPC_LOCK_PORT_W(port);
     unmark_message_waccess(msg);
     IPC_UNLOCK_PORT_W(port);
+  }
 
-    if( r > 0 && poffset ) {
-      *poffset +=r;
+  if( r > 0 && poffset ) {
+    *poffset +=r;
+  }
+
+  if( wakeup ) {
+    if( (port->flags & IPC_AUTOREF) && msg->sender ) {
+      release_task_struct(msg->sender);
     }
 
-    if( wakeup ) {
-      if( (port->flags & IPC_AUTOREF) && msg->sender ) {
-        release_task_struct(msg->sender);
-      }
+    /* Message was removed from the port queue, so we don't need
+     * any locks when accessing it in case when reply was requested.
+     */
+    msg->replied_size=(r >= 0) ? msg_size + r : r;
+    msg->state=MSG_STATE_REPLIED;
+    event_raise(&msg->event);
+  }
 
-      /* Message was removed from the port queue, so we don't need
-       * any locks when accessing it in case when reply was requested.
-       */
-      msg->replied_size=(r >= 0) ? msg_size + r : r;
-      msg->state=MSG_STATE_REPLIED;
-      event_raise(&msg->event);
-    }
+  return r;
+}
+
+long ipc_port_msg_write(struct __ipc_gen_port *port,ulong_t msg_id,
+                        struct __iovec *iovecs,ulong_t numvecs,off_t *poffset,
+                        long len, bool wakeup,long msg_size,bool map_rcv_buffer)
+{
+  ipc_port_message_t *msg;
+  long r;
+
+  IPC_LOCK_PORT_W(port);
+  r=__start_msg_write(port,msg_id,poffset,wakeup,&map_rcv_buffer,&msg);
+  IPC_UNLOCK_PORT_W(port);
+
+  if( !r ) {
+    r=__finish_msg_write(port,msg,iovecs,numvecs,poffset,len,wakeup,
+                         msg_size,map_rcv_buffer);
   }
 
   return ERR(r);
 }
 
+/* NOTE: Port must be locked ! */
+static ipc_port_message_t *__extract_received_message(ipc_gen_port_t *port,
+                                                      ulong_t flags)
+{
+  ipc_port_message_t *msg=port->msg_ops->extract_message(port,flags);
+
+  if( msg ) {
+    msg->state=MSG_STATE_RECEIVED;
+
+    if( (port->flags & IPC_AUTOREF) && msg->sender ) {
+      grab_task_struct(msg->sender);
+    }
+  }
+  return msg;
+}
+
+/* Puts a message extracted by '__extract_received_message()' back to
+ * the port, so that the next receive gets it.
+ */
+static void __requeue_received_message(ipc_gen_port_t *port,
+                                       ipc_port_message_t *msg)
+{
+  task_t *sender=msg->sender;
+  bool requeued=false;
+
+  IPC_LOCK_PORT_W(port);
+  if( !(port->flags & IPC_PORT_SHUTDOWN) ) {
+    msg->state=MSG_STATE_NOT_PROCESSED;
+    port->msg_ops->requeue_message(port,msg);
+    if( !waitqueue_is_empty(&port->waitqueue) ) {
+      waitqueue_pop(&port->waitqueue,NULL);
+    }
+    requeued=true;
+  }
+  IPC_UNLOCK_PORT_W(port);
+
+  /* Message may be already received by somebody else. */
+  if( requeued ) {
+    if( (port->flags & IPC_AUTOREF) && sender ) {
+      release_task_struct(sender);
+    }
+  } else if( !msg->blocked_mode ) {
+    put_ipc_port_message(msg);
+  }
+}
+
+/* Transfers data of message extracted from the port to the receiver. */
+static long __finish_receive(ipc_gen_port_t *port,ipc_port_message_t *msg,
+                             iovec_t *iovec,uint32_t numvec,
+                             port_msg_info_t *msg_info)
+{
+  ulong_t sz;
+  long r;
+
+  r=__transfer_message_data_to_receiver(msg,iovec,numvec,msg_info,0, &sz);
+
+  /* OK, message was successfully transferred, so remove it from the port
+   * in case it is a non-blocking transfer.
+   */
+  IPC_LOCK_PORT_W(port);
+  if( !(port->flags & IPC_PORT_SHUTDOWN) &&
+      !(port->flags & IPC_BLOCKED_ACCESS) ) {
+    port->msg_ops->remove_message(port,msg);
+  }
+  IPC_UNLOCK_PORT_W(port);
+
+  if (msg->blocked_mode) {
+    POST_MESSAGE_DATA_ACCESS_STEP(port,msg,r,true);
+  } else {
+    put_ipc_port_message(msg);
+  }
+  return r;
+}
+
 long ipc_port_receive(ipc_gen_port_t *port, ulong_t flags,
                       iovec_t *iovec, uint32_t numvec,
                       port_msg_info_t *msg_info)
 {
   long r=-EINVAL;
-  ulong_t sz;
   ipc_port_message_t *msg;
   task_t *owner=current_task();
 
@@ -767,13 +977,19 @@ recv_cycle:
       /* No incoming messages: sleep (if requested). */
       if( flags & IPC_BLOCKED_ACCESS ) {
         wqueue_task_t w;
+        ipc_port_handoff_t ho;
 
       /* No luck: need to sleep. We don't unlock the port right now
        * since it will be unlocked after putting the receiver in the
        * port's waitqueue.
        */
         waitqueue_prepare_task(&w,owner);
+        if( port->flags & IPC_HANDOFF_ACCESS ) {
+          ho.msg=NULL;
+          w.private=&ho;
+        }
         r=waitqueue_push_intr(&port->waitqueue,&w);
+        __mpsc_recheck_messages(port,&w,WQ_DELETE_WAKEUP);
 
         IPC_UNLOCK_PORT_W(port);
 
@@ -781,6 +997,17 @@ recv_cycle:
           waitqueue_delete(&w, WQ_DELETE_SIMPLE);
           r = -EINTR;
         }
+
+        /* Sender could have already extracted a message on our behalf
+         * (see '__handoff_message()'). Since we were removed from the
+         * waitqueue by the sender, the message belongs to us even if
+         * we were interrupted.
+         */
+        if( w.private && ho.msg ) {
+          msg=ho.msg;
+          r=0;
+          goto out;
+        }
         if( !r ) {
           goto recv_cycle;
         } else {
@@ -790,38 +1017,214 @@ recv_cycle:
         r = -EWOULDBLOCK;
       }
     } else {
-      msg=port->msg_ops->extract_message(port,flags);
-      if( msg ) {
-        msg->state=MSG_STATE_RECEIVED;
+      msg=__extract_received_message(port,flags);
+    }
+  }
+  IPC_UNLOCK_PORT_W(port);
+
+out:
+  if( msg != NULL ) {
+    r=__finish_receive(port,msg,iovec,numvec,msg_info);
+  }
+  return ERR(r);
+}
+
+/* Replies to message @msg_id and receives the next message. If there is
+ * a pending message, it's extracted under the same port lock hold the
+ * reply message is taken under. Otherwise the caller sleeps in
+ * 'ipc_port_receive()' waiting for one.
+ * Returns the same as 'ipc_port_receive()' or a negative error of the
+ * reply, in which case no message is received.
+ */
+long ipc_port_reply_and_receive(ipc_gen_port_t *port,ulong_t msg_id,
+                                iovec_t *reply_iovecs,ulong_t numvecs,
+                                long reply_len,iovec_t *recv_iovec,
+                                port_msg_info_t *msg_info)
+{
+  ipc_port_message_t *msg,*next=NULL;
+  off_t offset=0,*poffset=numvecs ? &offset : NULL;
+  bool map_rcv_buffer=false;
+  long r;
+
+  if( !msg_info ) {
+    return ERR(-EINVAL);
+  }
+
+  IPC_LOCK_PORT_W(port);
+  r=__start_msg_write(port,msg_id,poffset,true,&map_rcv_buffer,&msg);
+  if( !r && !(port->flags & IPC_PORT_SHUTDOWN) &&
+      port->avail_messages ) {
+    next=__extract_received_message(port,IPC_BLOCKED_ACCESS);
+  }
+  IPC_UNLOCK_PORT_W(port);
+
+  if( r ) {
+    return ERR(r);
+  }
+
+  r=__finish_msg_write(port,msg,numvecs ? reply_iovecs : NULL,numvecs,
+                       poffset,reply_len,true,0,false);
+  if( r < 0 ) {
+    /* Reply failed, so the caller won't look at the next message. */
+    if( next ) {
+      __requeue_received_message(port,next);
+    }
+    return ERR(r);
+  }
+
+  if( next ) {
+    return ERR(__finish_receive(port,next,recv_iovec,1,msg_info));
+  }
+  return ipc_port_receive(port,IPC_BLOCKED_ACCESS,recv_iovec,1,msg_info);
+}
 
+/* Receives up to @nmsgs pending messages in one call. Messages are extracted
+ * under a single port lock hold and, after their data are transferred, are
+ * released under one more lock hold, so the per-message locking cost of
+ * 'ipc_port_receive()' is paid only once per batch.
+ * Each message is copied to its own I/O vector from @iovecs and described by
+ * the corresponding element of @msg_info.
+ * Returns the number of messages received before the first failed one, or
+ * a negative error if the very first message couldn't be received.
+ * Messages extracted after the failed one are put back to the port.
+ */
+static long __receive_batch(ipc_gen_port_t *port, ulong_t flags,
+                            iovec_t *iovecs, port_msg_info_t *msg_info,
+                            ulong_t nmsgs, ipc_port_message_t **msgs,
+                            long *rets)
+{
+  ulong_t i,f,n=0,sz;
+  long r=-EINVAL;
+  task_t *owner=current_task();
+
+recv_cycle:
+  IPC_LOCK_PORT_W(port);
+  if( task_was_interrupted(owner) ) {
+    IPC_UNLOCK_PORT_W(port);
+    return ERR(-EINTR);
+  }
+
+  if( !(port->flags & IPC_PORT_SHUTDOWN) ) {
+    if( !port->avail_messages ) {
+      if( flags & IPC_BLOCKED_ACCESS ) {
+        wqueue_task_t w;
+
+        waitqueue_prepare_task(&w,owner);
+        r=waitqueue_push_intr(&port->waitqueue,&w);
+        __mpsc_recheck_messages(port,&w,WQ_DELETE_WAKEUP);
+        IPC_UNLOCK_PORT_W(port);
+
+        if (task_was_interrupted(owner)) {
+          waitqueue_delete(&w, WQ_DELETE_SIMPLE);
+          r = -EINTR;
+        }
+        if( !r ) {
+          goto recv_cycle;
+        }
+        return ERR(r);
+      } else {
+        r = -EWOULDBLOCK;
+      }
+    } else {
+      while( n < nmsgs && port->avail_messages ) {
+        ipc_port_message_t *msg=port->msg_ops->extract_message(port,flags);
+
+        if( !msg ) {
+          break;
+        }
+
+        msg->state=MSG_STATE_RECEIVED;
         if( (port->flags & IPC_AUTOREF) && msg->sender ) {
           grab_task_struct(msg->sender);
         }
+        msgs[n++]=msg;
       }
     }
   }
   IPC_UNLOCK_PORT_W(port);
 
-out:
-  if( msg != NULL ) {
-    r=__transfer_message_data_to_receiver(msg,iovec,numvec,msg_info,0, &sz);
+  if( !n ) {
+    return ERR(r);
+  }
 
-    /* OK, message was successfully transferred, so remove it from the port
-     * in case it is a non-blocking transfer.
-     */
-    IPC_LOCK_PORT_W(port);
-    if( !(port->flags & IPC_PORT_SHUTDOWN) &&
-        !(port->flags & IPC_BLOCKED_ACCESS) ) {
-      port->msg_ops->remove_message(port,msg);
+  for(f=0;f<n;f++) {
+    rets[f]=__transfer_message_data_to_receiver(msgs[f],iovecs ? &iovecs[f] : NULL,
+                                                1,&msg_info[f],0,&sz);
+    if( rets[f] ) {
+      break;
     }
-    IPC_UNLOCK_PORT_W(port);
+  }
 
-    if (msg->blocked_mode) {
-      POST_MESSAGE_DATA_ACCESS_STEP(port,msg,r,true);
+  IPC_LOCK_PORT_W(port);
+  for(i=0;i<n && i<=f;i++) {
+    ipc_port_message_t *msg=msgs[i];
+
+    if( !msg->blocked_mode ) {
+      if( !(port->flags & IPC_PORT_SHUTDOWN) &&
+          !(port->flags & IPC_BLOCKED_ACCESS) ) {
+        port->msg_ops->remove_message(port,msg);
+      }
     } else {
-      put_ipc_port_message(msg);
+      msg->state=MSG_STATE_DATA_TRANSFERRED;
+      if( task_was_interrupted(msg->sender) ) {
+        rets[i]=-EPIPE;
+      }
+      if( rets[i] && !(port->flags & IPC_PORT_SHUTDOWN) ) {
+        port->msg_ops->remove_message(port,msg);
+        msg->replied_size=rets[i];
+        event_raise(&msg->event);
+      }
     }
+
+    if( rets[i] ) {
+      f=i;
+      break;
+    }
+  }
+
+  IPC_UNLOCK_PORT_W(port);
+
+  for(i=0;i<n && i<=f;i++) {
+    if( !msgs[i]->blocked_mode ) {
+      put_ipc_port_message(msgs[i]);
+    }
+  }
+
+  /* Messages behind the failed one are put back backwards, each one in
+   * front of the messages that followed it, so the next receive gets
+   * them in the same order.
+   */
+  for(i=n;i > f + 1;i--) {
+    __requeue_received_message(port,msgs[i-1]);
   }
+
+  /* Report messages received before the first failed one. */
+  return f ? f : ERR(rets[0]);
+}
+
+long ipc_port_receive_batch(ipc_gen_port_t *port, ulong_t flags,
+                            iovec_t *iovecs, port_msg_info_t *msg_info,
+                            ulong_t nmsgs)
+{
+  scratch_mark_t mark;
+  ipc_port_message_t **msgs;
+  long *rets, r;
+
+  if( !msg_info || !nmsgs ) {
+    return ERR(-EINVAL);
+  }
+  nmsgs=MIN(nmsgs,IPC_RECV_BATCH_MAX);
+
+  mark=scratch_mark();
+  msgs=scratch_alloc(nmsgs*sizeof(*msgs));
+  rets=scratch_alloc(nmsgs*sizeof(*rets));
+  if( !msgs || !rets ) {
+    r=-ENOMEM;
+  } else {
+    r=__receive_batch(port,flags,iovecs,msg_info,nmsgs,msgs,rets);
+  }
+
+  scratch_release(mark);
   return ERR(r);
 }
 
@@ -876,7 +1279,8 @@ long ipc_port_send_iov(ipc_channel_t *channel, iovec_t snd_kiovecs[], ulong_t sn
 {
   ipc_gen_port_t *port = NULL;
   ipc_port_message_t *msg;
-  ipc_buffer_t snd_bufs[MAX_IOVECS], rcv_bufs[MAX_IOVECS];
+  ipc_buffer_t *snd_bufs, *rcv_bufs;
+  scratch_mark_t mark;
   ulong_t msg_size = 0, rcv_size = 0;
   long ret = 0;
 
@@ -896,6 +1300,18 @@ long ipc_port_send_iov(ipc_channel_t *channel, iovec_t snd_kiovecs[], ulong_t sn
       return ERR(-EINVAL);
   }
 
+  /*
+   * Buffers are used until the reply comes. Kernel threads send
+   * messages too, so release them explicitly.
+   */
+  mark = scratch_mark();
+  snd_bufs = scratch_alloc(2 * MAX_IOVECS * sizeof(ipc_buffer_t));
+  if (!snd_bufs) {
+    ret = -ENOMEM;
+    goto out;
+  }
+
+  rcv_bufs = snd_bufs + MAX_IOVECS;
   msg = ipc_create_port_message_iov_v(channel, snd_kiovecs, snd_numvecs, msg_size,
                                       rcv_kiovecs, rcv_numvecs, snd_bufs, rcv_bufs, rcv_size,
                                       (int *)&ret);
@@ -909,6 +1325,7 @@ long ipc_port_send_iov(ipc_channel_t *channel, iovec_t snd_kiovecs[], ulong_t sn
                                rcv_kiovecs, rcv_numvecs, rcv_size);
 
 out:
+  scratch_release(mark);
   if (port) {
     ipc_put_port(port);
   }
@@ -916,6 +1333,145 @@ out:
   return ERR(ret);
 }
 
+/* Sends a batch of non-blocking messages over target channel. All messages
+ * are created first and then enqueued under a single port lock hold, waking up
+ * receivers only after the whole batch has been inserted.
+ * Per-message results (message size or a negative error) are stored in
+ * @statuses. Returns the number of enqueued messages.
+ */
+long ipc_port_send_iov_batch(ipc_channel_t *channel, iovec_group_t *groups,
+                             ulong_t ngroups, long *statuses)
+{
+  ipc_gen_port_t *port = NULL;
+  ipc_port_message_t **msgs;
+  iovec_t *kiovecs;
+  scratch_mark_t mark;
+  ulong_t i,msg_size,sent=0,wakeups=0;
+  long ret;
+  int err;
+
+  if( channel_in_blocked_mode(channel) || ngroups > IPC_SEND_BATCH_MAX ) {
+    return ERR(-EINVAL);
+  }
+
+  ret = ipc_get_channel_port(channel, &port);
+  if (ret) {
+    return ERR(-EINVAL);
+  }
+
+  mark = scratch_mark();
+  msgs = scratch_alloc(ngroups * sizeof(*msgs));
+  kiovecs = scratch_alloc(MAX_IOVECS * sizeof(iovec_t));
+  if( !msgs || !kiovecs ) {
+    scratch_release(mark);
+    ipc_put_port(port);
+    return ERR(-ENOMEM);
+  }
+
+  for(i=0;i<ngroups;i++) {
+    msgs[i]=NULL;
+
+    if( !groups[i].numvecs || groups[i].numvecs > MAX_IOVECS ) {
+      statuses[i]=-EINVAL;
+      continue;
+    }
+
+    if( copy_from_user(kiovecs,groups[i].iovecs,groups[i].numvecs*sizeof(iovec_t)) ||
+        !valid_iovecs(kiovecs,groups[i].numvecs,NULL) ) {
+      statuses[i]=-EFAULT;
+      continue;
+    }
+
+    statuses[i]=__calc_msg_length(kiovecs,groups[i].numvecs,&msg_size);
+    if( statuses[i] ) {
+      continue;
+    }
+
+    msgs[i]=ipc_create_port_message_iov_v(channel,kiovecs,groups[i].numvecs,msg_size,
+                                          NULL,0,NULL,NULL,0,&err);
+    if( !msgs[i] ) {
+      statuses[i]=err;
+    } else {
+      event_set_task(&msgs[i]->event,current_task());
+      statuses[i]=msg_size;
+    }
+  }
+
+  IPC_LOCK_PORT_W(port);
+  for(i=0;i<ngroups;i++) {
+    if( !msgs[i] ) {
+      continue;
+    }
+
+    if( (port->flags & (IPC_PORT_SHUTDOWN | IPC_BLOCKED_ACCESS)) ) {
+      statuses[i]=(port->flags & IPC_PORT_SHUTDOWN) ? -EPIPE : -EINVAL;
+    } else {
+      ret=port->msg_ops->insert_message(port,msgs[i]);
+      if( !ret ) {
+        msgs[i]=NULL;
+        sent++;
+      } else {
+        statuses[i]=ret;
+      }
+    }
+  }
+
+  /* Wake up as many receivers as we have new messages for. */
+  while( wakeups < sent && !waitqueue_pop(&port->waitqueue,NULL) ) {
+    wakeups++;
+  }
+  if( sent && (port->flags & IPC_MPSC_ACCESS) ) {
+    ipc_port_signal_pollsets(port);
+  }
+  IPC_UNLOCK_PORT_W(port);
+
+  /* Release messages that weren't enqueued. */
+  for(i=0;i<ngroups;i++) {
+    if( msgs[i] ) {
+      put_ipc_port_message(msgs[i]);
+    }
+  }
+
+  scratch_release(mark);
+  ipc_put_port(port);
+  return sent;
+}
+
+/* NOTE: Port must be locked. Passes the most prioritized message directly
+ * to the first receiver sleeping on the port (if it is in handoff mode)
+ * and wakes it up. Returns referenced receiver or NULL if no receivers
+ * were ready to accept the message.
+ */
+static task_t *__handoff_message(ipc_gen_port_t *port)
+{
+  wqueue_t *wq=&port->waitqueue;
+  wqueue_task_t *w;
+  ipc_port_handoff_t *ho;
+  ipc_port_message_t *msg;
+  task_t *receiver=NULL;
+
+  __wqueue_lock(wq);
+  w=waitqueue_first_task_core(wq);
+  if( w && (ho=(ipc_port_handoff_t *)w->private) != NULL ) {
+    msg=port->msg_ops->extract_message(port,0);
+    if( msg ) {
+      msg->state=MSG_STATE_RECEIVED;
+
+      if( (port->flags & IPC_AUTOREF) && msg->sender ) {
+        grab_task_struct(msg->sender);
+      }
+
+      ho->msg=msg;
+      receiver=w->task;
+      grab_task_struct(receiver);
+      waitqueue_delete_core(w,WQ_DELETE_WAKEUP);
+    }
+  }
+  __wqueue_unlock(wq);
+
+  return receiver;
+}
+
 long ipc_port_send_iov_core(ipc_gen_port_t *port,
                             ipc_port_message_t *msg,bool sync_send,
                             iovec_t *iovecs,ulong_t numvecs,
@@ -925,6 +1481,7 @@ long ipc_port_send_iov_core(ipc_gen_port_t *port,
   size_t msg_size=0;
   long r = 0;
   task_t *sender=current_task();
+  task_t *receiver=NULL;
 
   if( !msg_ops->insert_message ||
       (sync_send && !msg_ops->dequeue_message) ) {
@@ -933,6 +1490,10 @@ long ipc_port_send_iov_core(ipc_gen_port_t *port,
 
   event_set_task(&msg->event,sender);
 
+  if( port->flags & IPC_MPSC_ACCESS ) {
+    return ERR(sync_send ? -EINVAL : __mpsc_send_message(port,msg));
+  }
+
   IPC_LOCK_PORT_W(port);
   r = (port->flags & IPC_BLOCKED_ACCESS) | sync_send;
   if( r ) {
@@ -951,7 +1512,12 @@ long ipc_port_send_iov_core(ipc_gen_port_t *port,
   if( !r ) {
     if( !(port->flags & IPC_PORT_SHUTDOWN ) ) {
       r=msg_ops->insert_message(port,msg);
-      waitqueue_pop(&port->waitqueue,NULL);
+      if( !r && sync_send && (port->flags & IPC_HANDOFF_ACCESS) ) {
+        receiver=__handoff_message(port);
+      }
+      if( !receiver ) {
+        waitqueue_pop(&port->waitqueue,NULL);
+      }
     } else {
       r=-EPIPE;
     }
@@ -962,6 +1528,12 @@ long ipc_port_send_iov_core(ipc_gen_port_t *port,
     return ERR(r);
   }
 
+  /* Let the receiver run right after we fall asleep waiting for reply. */
+  if( receiver ) {
+    sched_yield_to(receiver);
+    release_task_struct(receiver);
+  }
+
   /* Sender should wait for the reply, so put it into sleep here. */
   if( sync_send ) {
     bool b;
@@ -1023,7 +1595,7 @@ long ipc_port_send_iov_core(ipc_gen_port_t *port,
     } else {
       r=msg->replied_size;
       if( r > 0 ) {
-        r=__transfer_reply_data_iov(msg,iovecs,numvecs,false,reply_len,0);
+        r=__transfer_reply_data_iov(msg,iovecs,numvecs,false,reply_len,0,false);
         if( r >= 0 ) {
           r=msg->replied_size;
         }
@@ -1047,6 +1619,21 @@ void ipc_port_remove_poller(ipc_gen_port_t *port,wqueue_task_t *w)
   }
 }
 
+/* NOTE: port must be locked ! */
+static poll_event_t __port_events(ipc_gen_port_t *port,bool arm)
+{
+  if( port->avail_messages ) {
+    return POLLIN | POLLRDNORM;
+  }
+  if( arm && port->msg_ops->arm_events ) {
+    return port->msg_ops->arm_events(port);
+  }
+  if( port->msg_ops->check_events ) {
+    return port->msg_ops->check_events(port);
+  }
+  return 0;
+}
+
 /* NOTE: Caller must initialized waitque task before calling this function.
  */
 poll_event_t ipc_port_check_events(ipc_gen_port_t *port,wqueue_task_t *w,
@@ -1055,15 +1642,28 @@ poll_event_t ipc_port_check_events(ipc_gen_port_t *port,wqueue_task_t *w,
   volatile poll_event_t e=0;
 
   IPC_LOCK_PORT_W(port);
-  if( port->avail_messages ) {
-    e=POLLIN | POLLRDNORM;
-  }
-
-  e &= evmask;
+  e=__port_events(port,w != NULL) & evmask;
   if (!e && (w != NULL)) {
     /* No pending events, so add target task to port's waitqueue. */
     waitqueue_insert(&port->waitqueue,w,WQ_INSERT_SIMPLE);
+    if( __mpsc_recheck_messages(port,w,WQ_DELETE_SIMPLE) ) {
+      e=(POLLIN | POLLRDNORM) & evmask;
+    }
   }
   IPC_UNLOCK_PORT_W(port);
   return e;
 }
+
+/* Same as ipc_port_check_events(), but for callers that wait for events
+ * of the port on their own waitqueue (i.e. pollsets): the port is asked
+ * to signal its pollsets once new events arrive.
+ */
+poll_event_t ipc_port_arm_events(ipc_gen_port_t *port,poll_event_t evmask)
+{
+  poll_event_t e;
+
+  IPC_LOCK_PORT_W(port);
+  e=__port_events(port,true);
+  IPC_UNLOCK_PORT_W(port);
+  return e & evmask;
+}
@@ -40,6 +40,7 @@
 #include <mstring/signal.h>
 #include <mstring/usercopy.h>
 #include <ipc/port_ctl.h>
+#include <ipc/ring.h>
 
 static long __port_ctl_forward_message(ipc_gen_port_t *port,
                                        ipc_port_ctl_msg_ch_descr_t *uarg)
@@ -60,7 +61,7 @@ static long __port_ctl_forward_message(ipc_gen_port_t *port,
 
   /* To avoid deadlocks we don't allow forwarding to the same port. */
   dest_port = c->server_port;
-  if( dest_port == port ) {
+  if( dest_port == port || (dest_port->flags & IPC_MPSC_ACCESS) ) {
     return ERR(-EINVAL);
   }
 
@@ -249,6 +250,12 @@ long ipc_port_control(ipc_gen_port_t *p, ulong_t cmd, ulong_t arg)
       return __port_ctl_cut_from_message(p,(port_ctl_msg_extra_data_t *)arg);
     case IPC_PORT_CTL_MSG_REPLY_RETCODE:
       return __port_ctl_reply_retcode(p,(port_ctl_msg_extra_data_t *)arg);
+    case IPC_PORT_CTL_RING_MAP:
+      return ipc_port_ring_map(p,false,(ipc_ring_info_t *)arg);
+    case IPC_PORT_CTL_RING_WAIT:
+      return ipc_port_ring_wait(p,false,0);
+    case IPC_PORT_CTL_RING_NOTIFY:
+      return ipc_port_ring_notify(p,false);
     default:
       break;
   }
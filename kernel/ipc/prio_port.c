@@ -34,16 +34,132 @@
 #include <mm/slab.h>
 #include <ipc/port.h>
 #include <ds/list.h>
-#include <ds/skiplist.h>
+#include <mstring/bits.h>
+#include <arch/bits.h>
+#include <ipc/ring.h>
+#include <ipc/pollset.h>
+
+/* Messages are kept in one list sorted by priority (FIFO within the same
+ * priority). A bitmap of present priorities and the slot of the last
+ * message of each one allow to find the insertion point in constant time
+ * (like the runqueues of the default scheduler do), while the storage
+ * still fits a slab object.
+ */
+#define PRIO_QUEUE_WIDTH  2
+#define PRIO_QUEUE_PRIOS  (PRIO_QUEUE_WIDTH*64)
+
+typedef struct __prio_msg_queue {
+  uint64_t bitmap[PRIO_QUEUE_WIDTH];
+  list_head_t head;
+  uint16_t tails[PRIO_QUEUE_PRIOS];  /* Slot of the last message. */
+} prio_msg_queue_t;
 
 typedef struct __prio_port_data_storage {
-  list_head_t prio_head,all_messages,id_waiters;
+  prio_msg_queue_t messages;
+  list_head_t all_messages,id_waiters;
   ipc_port_message_t **message_ptrs;
   idx_allocator_t msg_array;
   ulong_t num_waiters;
 } prio_port_data_storage_t;
 
-#define __remove_message(msg)  skiplist_del((msg),ipc_port_message_t,h,l)
+static void __init_queue(prio_msg_queue_t *q)
+{
+  ulong_t i;
+
+  for( i=0; i<PRIO_QUEUE_WIDTH; i++ ) {
+    q->bitmap[i]=0;
+  }
+  list_init_head(&q->head);
+}
+
+#define __prio_is_queued(q,prio)                        \
+  ((q)->bitmap[(prio) >> 6] & (1UL << ((prio) & 63)))
+
+/* Returns the closest queued priority that is more important than @prio
+ * (i.e. numerically lower), or -1.
+ */
+static long __prev_queued_prio(prio_msg_queue_t *q,ulong_t prio)
+{
+  long i=prio >> 6;
+  uint64_t mask=(1UL << (prio & 63))-1;
+
+  for( ; i>=0; i-- ) {
+    if( q->bitmap[i] & mask ) {
+      return (i << 6) + bit_find_msf(q->bitmap[i] & mask);
+    }
+    mask=~0UL;
+  }
+  return -1;
+}
+
+/* Sender's priority is remembered since it may change while the message
+ * is queued.
+ * NOTE: Message must already own its slot !
+ */
+static void __add_one_message(prio_port_data_storage_t *ds,
+                              ipc_port_message_t *msg)
+{
+  prio_msg_queue_t *q=&ds->messages;
+  ulong_t prio=MIN(msg->sender->static_priority,PRIO_QUEUE_PRIOS-1);
+  long p=prio;
+
+  msg->prio=prio;
+  if( !__prio_is_queued(q,prio) ) {
+    p=__prev_queued_prio(q,prio);
+  }
+
+  if( p >= 0 ) {
+    list_add_after(&ds->message_ptrs[q->tails[p]]->l,&msg->l);
+  } else {
+    list_add2head(&q->head,&msg->l);
+  }
+
+  q->bitmap[prio >> 6] |= (1UL << (prio & 63));
+  q->tails[prio]=msg->id;
+}
+
+static void __remove_message(prio_port_data_storage_t *ds,
+                             ipc_port_message_t *msg)
+{
+  prio_msg_queue_t *q=&ds->messages;
+  ulong_t prio=msg->prio;
+
+  if( q->tails[prio] == msg->id ) {
+    ipc_port_message_t *prev=container_of(msg->l.prev,ipc_port_message_t,l);
+
+    if( msg->l.prev != list_head(&q->head) && prev->prio == prio ) {
+      q->tails[prio]=prev->id;
+    } else {
+      q->bitmap[prio >> 6] &= ~(1UL << (prio & 63));
+    }
+  }
+  list_del(&msg->l);
+}
+
+static ipc_port_message_t *__first_message(prio_msg_queue_t *q)
+{
+  if( list_is_empty(&q->head) ) {
+    return NULL;
+  }
+  return container_of(list_node_first(&q->head),ipc_port_message_t,l);
+}
+
+/* Senders wait for a free slot rarely, so their list is just kept sorted. */
+static void __add_waiter(list_head_t *list,ipc_port_message_t *msg)
+{
+  list_node_t *n;
+
+  msg->prio=MIN(msg->sender->static_priority,PRIO_QUEUE_PRIOS-1);
+  list_for_each(list,n) {
+    ipc_port_message_t *m=container_of(n,ipc_port_message_t,l);
+
+    if( m->prio > msg->prio ) {
+      list_add_before(n,&msg->l);
+      return;
+    }
+  }
+  list_add2tail(list,&msg->l);
+}
 
 static int prio_init_data_storage(struct __ipc_gen_port *port,
                                   task_t *owner,ulong_t queue_size)
@@ -51,6 +167,7 @@ static int prio_init_data_storage(struct __ipc_gen_port *port,
   prio_port_data_storage_t *ds;
   int r;
 
+  CT_ASSERT(IPC_MAX_PORT_MESSAGES <= 65536);
   if( port->data_storage ) {
     return -EBUSY;
   }
@@ -70,12 +187,15 @@ static int prio_init_data_storage(struct __ipc_gen_port *port,
     goto free_messages;
   }
 
-  list_init_head(&ds->prio_head);
-  list_init_head(&ds->all_messages);
+  __init_queue(&ds->messages);
   list_init_head(&ds->id_waiters);
+  list_init_head(&ds->all_messages);
   ds->num_waiters=0;
   port->data_storage=ds;
   port->capacity=queue_size;
+  if( !(port->flags & IPC_BLOCKED_ACCESS) ) {
+    ipc_msg_cache_resize(queue_size);
+  }
   return 0;
 free_messages:
   free_ipc_memory(ds->message_ptrs,queue_size*sizeof(ipc_port_message_t*));  
@@ -84,31 +204,6 @@ free_ds:
   return -ENOMEM;
 }
 
-static void __add_one_message(list_head_t *list,
-                              ipc_port_message_t *msg)
-{
-  if( list_is_empty(list) ) {
-    list_add2head(list,&msg->l);
-  } else {
-    list_node_t *n;
-    ulong_t p2=msg->sender->static_priority;
-
-    list_for_each(list,n) {
-      ipc_port_message_t *m=container_of(n,ipc_port_message_t,l);
-      ulong_t p1=m->sender->static_priority;
-
-      if( p1 > p2 ) {
-        list_add_before(&m->l, &msg->l);
-        return;
-      } else if( p1 == p2 ) {
-        list_add2tail(&m->h,&msg->l);
-        return;
-      }
-    }
-    list_add2tail(list,&msg->l);
-  }
-}
-
 static int prio_insert_message(struct __ipc_gen_port *port,
                                    ipc_port_message_t *msg)
 {
@@ -117,20 +212,20 @@ static int prio_insert_message(struct __ipc_gen_port *port,
 
   port->avail_messages++;
   port->total_messages++;
-  list_init_head(&msg->h);
   list_init_node(&msg->l);
   list_add2tail(&ds->all_messages,&msg->messages_list);
 
   if( id != IDX_INVAL ) { /* Insert this message in the array directly. */
+    msg->id=id;
     ds->message_ptrs[id]=msg;
-    __add_one_message(&ds->prio_head,msg);
+    __add_one_message(ds,msg);
   } else { /* No free slots - put this message to the waitlist. */
-    id=WAITQUEUE_MSG_ID;
+    msg->id=WAITQUEUE_MSG_ID;
     ds->num_waiters++;
-    __add_one_message(&ds->id_waiters,msg);
+    __add_waiter(&ds->id_waiters,msg);
   }
-  msg->id=id;
 
+  ipc_port_signal_pollsets(port);
   return 0;
 }
 
@@ -138,14 +233,37 @@ static ipc_port_message_t *prio_extract_message(ipc_gen_port_t *p,ulong_t flags)
 {
   prio_port_data_storage_t *ds=(prio_port_data_storage_t*)p->data_storage;
 
-  if( !list_is_empty(&ds->prio_head) ) {
-    ipc_port_message_t *msg=container_of(list_node_first(&ds->prio_head),
-                                         ipc_port_message_t,l);
-    __remove_message(msg);
+  ipc_port_message_t *msg=__first_message(&ds->messages);
+
+  if( msg ) {
+    __remove_message(ds,msg);
     p->avail_messages--;
-    return msg;
   }
-  return NULL;
+  return msg;
+}
+
+/* Message keeps its slot while it's extracted, so it only has to precede
+ * other messages of its priority again.
+ */
+static void prio_requeue_message(struct __ipc_gen_port *port,
+                                 ipc_port_message_t *msg)
+{
+  prio_port_data_storage_t *ds=(prio_port_data_storage_t*)port->data_storage;
+  prio_msg_queue_t *q=&ds->messages;
+  ulong_t prio=msg->prio;
+  long p=__prev_queued_prio(q,prio);
+
+  if( p >= 0 ) {
+    list_add_after(&ds->message_ptrs[q->tails[p]]->l,&msg->l);
+  } else {
+    list_add2head(&q->head,&msg->l);
+  }
+
+  if( !__prio_is_queued(q,prio) ) {
+    q->bitmap[prio >> 6] |= (1UL << (prio & 63));
+    q->tails[prio]=msg->id;
+  }
+  port->avail_messages++;
 }
 
 static int prio_remove_message(struct __ipc_gen_port *port,
@@ -158,7 +276,9 @@ static int prio_remove_message(struct __ipc_gen_port *port,
   }
 
   if( msg->id < port->capacity ) {
+    /* Leave the queue before the slot is given to somebody else. */
     if( list_node_is_bound(&msg->l) ) {
+      __remove_message(ds,msg);
       port->avail_messages--;
     }
 
@@ -166,11 +286,11 @@ static int prio_remove_message(struct __ipc_gen_port *port,
     if( ds->num_waiters ) {
       ipc_port_message_t *m=container_of(list_node_first(&ds->id_waiters),
                                          ipc_port_message_t,l);
+
+      list_del(&m->l);
       m->id=msg->id;
       ds->message_ptrs[m->id]=m;
-
-      __remove_message(m);
-      __add_one_message(&ds->prio_head,m);
+      __add_one_message(ds,m);
       ds->num_waiters--;
     } else {
       idx_free(&ds->msg_array,msg->id);
@@ -179,6 +299,9 @@ static int prio_remove_message(struct __ipc_gen_port *port,
   } else if( msg->id == WAITQUEUE_MSG_ID ) {
     ds->num_waiters--;
     port->avail_messages--;
+    if( list_node_is_bound(&msg->l) ) {
+      list_del(&msg->l);
+    }
   } else {
     return -EINVAL;
   }
@@ -186,10 +309,6 @@ static int prio_remove_message(struct __ipc_gen_port *port,
   port->total_messages--;
   list_del(&msg->messages_list);
 
-  if( list_node_is_bound(&msg->l) ) {
-    __remove_message(msg);
-  }
-
   return 0;
 }
 
@@ -217,7 +336,7 @@ static void prio_dequeue_message(struct __ipc_gen_port *port,
 
   if( msg->id < port->capacity ) {
     if( list_node_is_bound(&msg->l) ) {
-      list_del(&msg->l);
+      __remove_message(ds,msg);
       port->avail_messages--;
     }
     ds->message_ptrs[msg->id]=__MSG_WAS_DEQUEUED;
@@ -258,6 +377,9 @@ static void prio_destructor(ipc_gen_port_t *port)
   free_ipc_memory(ds->message_ptrs,port->capacity*sizeof(ipc_port_message_t*));
   idx_allocator_destroy(&ds->msg_array);
   memfree(ds);
+  if( !(port->flags & IPC_BLOCKED_ACCESS) ) {
+    ipc_msg_cache_resize(-(long)port->capacity);
+  }
 }
 
 ipc_port_msg_ops_t prio_port_msg_ops = {
@@ -266,6 +388,7 @@ ipc_port_msg_ops_t prio_port_msg_ops = {
   .extract_message=prio_extract_message,
   .remove_message=prio_remove_message,
   .remove_head_message=prio_remove_head_message,
+  .requeue_message=prio_requeue_message,
   .dequeue_message=prio_dequeue_message,
   .lookup_message=prio_lookup_message,
 };
@@ -273,3 +396,17 @@ ipc_port_msg_ops_t prio_port_msg_ops = {
 ipc_port_ops_t prio_port_ops = {
   .destructor=prio_destructor,
 };
+
+/* Ring ports keep a prioritized queue for regular messages as well. */
+ipc_port_msg_ops_t ring_port_msg_ops = {
+  .init_data_storage=ring_init_data_storage,
+  .insert_message=prio_insert_message,
+  .extract_message=prio_extract_message,
+  .remove_message=prio_remove_message,
+  .remove_head_message=prio_remove_head_message,
+  .requeue_message=prio_requeue_message,
+  .dequeue_message=prio_dequeue_message,
+  .lookup_message=prio_lookup_message,
+  .check_events=ring_check_events,
+  .arm_events=ring_arm_events,
+};
@@ -0,0 +1,299 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * (c) Copyright 2006,2007,2008 MString Core Team <http://mstring.jarios.org>
+ *
+ * ipc/ring_port.c: Implementation of IPC ports that carry a shared-memory
+ *                  single-producer/single-consumer ring.
+ *
+ */
+
+#include <arch/types.h>
+#include <arch/atomic.h>
+#include <ipc/port.h>
+#include <ipc/ipc.h>
+#include <ipc/ring.h>
+#include <ipc/pollset.h>
+#include <mstring/task.h>
+#include <mstring/limits.h>
+#include <mstring/errno.h>
+#include <mstring/signal.h>
+#include <mstring/usercopy.h>
+#include <mstring/waitqueue.h>
+#include <mm/page_alloc.h>
+#include <mm/page.h>
+#include <mm/mem.h>
+#include <mm/memobj.h>
+#include <mm/vmm.h>
+#include <mm/slab.h>
+
+#define __ring_ready(hdr,producer,space)                                \
+  ((producer) ? (IPC_RING_DATA_SIZE - ipc_ring_used(hdr) >= (space)) :  \
+   (ipc_ring_used(hdr) != 0))
+
+/* NOTE: port must be locked ! */
+static void __ring_wakeup_all(wqueue_t *wq)
+{
+  while( !waitqueue_pop(wq,NULL) );
+}
+
+int ring_init_data_storage(ipc_gen_port_t *port,task_t *owner,
+                           ulong_t queue_size)
+{
+  ipc_port_ring_t *ring;
+  memobj_t *memobj;
+  page_frame_t *page;
+  pgoff_t i;
+  int r;
+
+  r=prio_port_msg_ops.init_data_storage(port,owner,queue_size);
+  if( r ) {
+    return r;
+  }
+
+  ring=memalloc(sizeof(*ring));
+  if( !ring ) {
+    r=-ENOMEM;
+    goto out_destroy_queue;
+  }
+
+  r=charge_limit(owner->limits,LIMIT_MEMORY,IPC_RING_PAGES);
+  if( r ) {
+    goto out_free_ring;
+  }
+
+  r=memobj_create(MMO_NTR_PCACHE,MMO_FLG_SHARED,IPC_RING_PAGES,&memobj);
+  if( r ) {
+    goto out_uncharge;
+  }
+  pin_memobj(memobj);
+
+  /* Populate the whole ring in advance: both sides will share the pages
+   * via the page cache, and the kernel needs the header for wakeups.
+   */
+  for( i=0; i<IPC_RING_PAGES; i++ ) {
+    page=alloc_page(MMPOOL_USER | AF_ZERO);
+    if( !page ) {
+      r=-ENOMEM;
+      goto out_put_memobj;
+    }
+
+    atomic_set(&page->refcount,1);
+    r=pagecache_memobj_insert_page(memobj,i,page);
+    if( r ) {
+      unpin_page_frame(page);
+      goto out_put_memobj;
+    }
+    if( !i ) {
+      ring->hdr=pframe_to_virt(page);
+    }
+  }
+
+  ring->hdr->size=IPC_RING_DATA_SIZE;
+  ring->hdr->data_offset=IPC_RING_HDR_PAGES << PAGE_WIDTH;
+  ring->memobj=memobj;
+  ring->producer=NULL;
+  ring->owner=owner;
+  grab_task_struct(owner);
+  waitqueue_initialize(&ring->producers);
+  port->ring=ring;
+  return 0;
+out_put_memobj:
+  unpin_memobj(memobj);
+out_uncharge:
+  uncharge_limit(owner->limits,LIMIT_MEMORY,IPC_RING_PAGES);
+out_free_ring:
+  memfree(ring);
+out_destroy_queue:
+  prio_port_ops.destructor(port);
+  port->data_storage=NULL;
+  return r;
+}
+
+/* NOTE: port must be locked ! */
+poll_event_t ring_check_events(ipc_gen_port_t *port)
+{
+  return ipc_ring_used(port->ring->hdr) ? POLLIN | POLLRDNORM : 0;
+}
+
+/* NOTE: port must be locked ! */
+poll_event_t ring_arm_events(ipc_gen_port_t *port)
+{
+  /* Ask the producer to notify us when it puts something into the ring. */
+  port->ring->hdr->cons_waiting=1;
+  atomic_mb();
+  return ring_check_events(port);
+}
+
+void ipc_port_ring_shutdown(ipc_gen_port_t *port)
+{
+  IPC_LOCK_PORT_W(port);
+  __ring_wakeup_all(&port->ring->producers);
+  IPC_UNLOCK_PORT_W(port);
+}
+
+/* The ring has a single producer, so only the first task that maps it via
+ * a channel may produce into it.
+ */
+static long __ring_claim_producer(ipc_gen_port_t *port,task_t *task)
+{
+  long r=0;
+
+  IPC_LOCK_PORT_W(port);
+  if( !port->ring->producer ) {
+    grab_task_struct(task);
+    port->ring->producer=task;
+  } else if( port->ring->producer != task ) {
+    r=-EBUSY;
+  }
+  IPC_UNLOCK_PORT_W(port);
+  return r;
+}
+
+long ipc_port_ring_map(ipc_gen_port_t *port,bool producer,
+                       ipc_ring_info_t *uinfo)
+{
+  vmm_t *vmm=current_task()->task_mm;
+  ipc_ring_info_t info;
+  long r;
+
+  if( !port->ring ) {
+    return ERR(-EINVAL);
+  }
+  if( producer && (r=__ring_claim_producer(port,current_task())) ) {
+    return ERR(r);
+  }
+
+  rwsem_down_write(&vmm->rwsem);
+  r=vmrange_map(port->ring->memobj,vmm,0,IPC_RING_PAGES,
+                VMR_READ | VMR_WRITE | VMR_SHARED,0);
+  rwsem_up_write(&vmm->rwsem);
+  if( r < 0 ) {
+    return ERR(r);
+  }
+
+  info.addr=r;
+  info.size=IPC_RING_PAGES << PAGE_WIDTH;
+  if( copy_to_user(uinfo,&info,sizeof(info)) ) {
+    rwsem_down_write(&vmm->rwsem);
+    unmap_vmranges(vmm,info.addr,IPC_RING_PAGES);
+    rwsem_up_write(&vmm->rwsem);
+    return ERR(-EFAULT);
+  }
+
+  return 0;
+}
+
+/* Puts the caller to sleep until the ring becomes non-empty (consumer) or
+ * gets at least @space free bytes (producer). The 'waiting' flag is raised
+ * before the final check, so the other side can't miss it after updating
+ * its counter.
+ */
+long ipc_port_ring_wait(ipc_gen_port_t *port,bool producer,ulong_t space)
+{
+  ipc_port_ring_t *ring=port->ring;
+  task_t *caller=current_task();
+  ipc_ring_hdr_t *hdr;
+  wqueue_task_t w;
+  long r;
+
+  if( !ring || (producer && (!space || space > IPC_RING_DATA_SIZE)) ) {
+    return ERR(-EINVAL);
+  }
+
+  hdr=ring->hdr;
+  for(;;) {
+    IPC_LOCK_PORT_W(port);
+    if( port->flags & IPC_PORT_SHUTDOWN ) {
+      r=-EPIPE;
+      break;
+    }
+
+    if( producer ) {
+      hdr->prod_waiting=1;
+    } else {
+      hdr->cons_waiting=1;
+    }
+    atomic_mb();
+
+    if( __ring_ready(hdr,producer,space) ) {
+      r=0;
+      break;
+    }
+
+    waitqueue_prepare_task(&w,caller);
+    r=waitqueue_push_intr(producer ? &ring->producers : &port->waitqueue,&w);
+    IPC_UNLOCK_PORT_W(port);
+
+    if( task_was_interrupted(caller) ) {
+      waitqueue_delete(&w,WQ_DELETE_SIMPLE);
+      return ERR(-EINTR);
+    }
+    if( r ) {
+      return ERR(r);
+    }
+  }
+  IPC_UNLOCK_PORT_W(port);
+
+  return ERR(r);
+}
+
+/* Wakes up the other side of the ring: the consumer (and pollers of the
+ * port) if called by the producer, and the producer otherwise.
+ */
+long ipc_port_ring_notify(ipc_gen_port_t *port,bool producer)
+{
+  ipc_port_ring_t *ring=port->ring;
+
+  if( !ring ) {
+    return ERR(-EINVAL);
+  }
+
+  IPC_LOCK_PORT_W(port);
+  if( producer ) {
+    ring->hdr->cons_waiting=0;
+    __ring_wakeup_all(&port->waitqueue);
+    ipc_port_signal_pollsets(port);
+  } else {
+    ring->hdr->prod_waiting=0;
+    __ring_wakeup_all(&ring->producers);
+  }
+  IPC_UNLOCK_PORT_W(port);
+
+  return 0;
+}
+
+static void ring_destructor(ipc_gen_port_t *port)
+{
+  ipc_port_ring_t *ring=port->ring;
+
+  /* Pages stay alive until the last task unmaps the ring. */
+  if( ring ) {
+    port->ring=NULL;
+    unpin_memobj(ring->memobj);
+    uncharge_limit(ring->owner->limits,LIMIT_MEMORY,IPC_RING_PAGES);
+    release_task_struct(ring->owner);
+    if( ring->producer ) {
+      release_task_struct(ring->producer);
+    }
+    memfree(ring);
+  }
+  prio_port_ops.destructor(port);
+}
+
+ipc_port_ops_t ring_port_ops = {
+  .destructor=ring_destructor,
+};
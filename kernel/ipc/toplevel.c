@@ -33,53 +33,63 @@
 #include <mstring/usercopy.h>
 #include <ipc/port.h>
 #include <ipc/channel.h>
+#include <mm/scratch.h>
 #include <security/security.h>
 #include <config.h>
 
+static long __ipc_port_msg_write_core(ipc_gen_port_t *p, ulong_t msg_id,
+                                      iovec_t *iovecs, ulong_t numvecs,
+                                      off_t offset, bool wakeup,
+                                      bool map_rcv_buffer)
+{
+  long r;
+  iovec_t kiovecs[MAX_IOVECS];
+  long size,processed = 0;
+  off_t koffset = offset;
+
+  while( numvecs ) {
+    ulong_t nc = MIN(numvecs,MAX_IOVECS);
+
+    if( copy_from_user(kiovecs,iovecs,nc*sizeof(iovec_t)) ||
+        !valid_iovecs(kiovecs,nc,&size) ) {
+      return ERR(-EFAULT);
+    }
+
+    /* Wake up sender only when processing the last set of I/O vecs. */
+    r=ipc_port_msg_write(p,msg_id,kiovecs,nc,&koffset,size,
+                         (numvecs <= MAX_IOVECS && wakeup), processed,
+                         map_rcv_buffer);
+    if( r < 0 ) {
+      return ERR(r);
+    }
+
+    processed += r;
+    numvecs -= nc;
+    iovecs += nc;
+  }
+
+  return processed;
+}
+
 static long __ipc_port_msg_write(ulong_t port, ulong_t msg_id, iovec_t *iovecs,
                                  ulong_t numvecs,off_t offset, bool wakeup,
                                  bool map_rcv_buffer)
 {
   ipc_gen_port_t *p;
   long r;
-  iovec_t kiovecs[MAX_IOVECS];
-  long size,processed = 0;
-  off_t koffset;
 
   if( !numvecs || numvecs > IPC_ABS_IOVEC_LIM ) {
     return ERR(-EINVAL);
   }
 
-  if( (p=ipc_get_port(current_task(), port,&r)) ) {
-    processed = 0;
-    koffset = offset;
-
-    while( numvecs ) {
-      ulong_t nc = MIN(numvecs,MAX_IOVECS);
-
-      if( copy_from_user(kiovecs,iovecs,nc*sizeof(iovec_t)) ||
-          !valid_iovecs(kiovecs,nc,&size) ) {
-        r=-EFAULT;
-        break;
-      }
-
-      /* Wake up sender only when processing the last set of I/O vecs. */
-      r=ipc_port_msg_write(p,msg_id,kiovecs,nc,&koffset,size,
-                           (numvecs <= MAX_IOVECS && wakeup), processed,
-                           map_rcv_buffer);
-      if( r < 0 ) {
-        processed = r;
-        break;
-      }
-
-      processed += r;
-      numvecs -= nc;
-      iovecs += nc;
-    }
+  if( !(p=ipc_get_port(current_task(), port,&r)) ) {
+    return ERR(r);
   }
 
+  r=__ipc_port_msg_write_core(p,msg_id,iovecs,numvecs,offset,wakeup,
+                              map_rcv_buffer);
   ipc_put_port(p);
-  return ERR(processed);
+  return ERR(r);
 }
 
 bool valid_iovecs(iovec_t *iovecs, uint32_t num_vecs,long *size)
@@ -164,6 +174,67 @@ long sys_port_reply_iov(ulong_t port, ulong_t msg_id,
   return r > 0 ? 0 : ERR(r);
 }
 
+long sys_port_reply_and_receive(ulong_t port, ulong_t msg_id,
+                                iovec_t reply_iov[], uint32_t numvecs,
+                                iovec_t *recv_iov, port_msg_info_t *msg_info)
+{
+  ipc_gen_port_t *p;
+  long r,size = 0;
+  iovec_t iovec,*piovec = NULL;
+  iovec_t kiovecs[MAX_IOVECS];
+  port_msg_info_t kinfo;
+
+  if( numvecs > IPC_ABS_IOVEC_LIM || (numvecs && !reply_iov) || !msg_info ) {
+    return ERR(-EINVAL);
+  }
+
+  /* The reply can't be taken back, so make sure the next message can be
+   * described to the caller before sending it.
+   */
+  memset(&kinfo,0,sizeof(kinfo));
+  if( copy_to_user(msg_info,&kinfo,sizeof(kinfo)) ) {
+    return ERR(-EFAULT);
+  }
+
+  if( recv_iov ) {
+    if( copy_from_user(&iovec,recv_iov,sizeof(iovec)) ) {
+      return ERR(-EFAULT);
+    }
+    if( iovec.iov_base || iovec.iov_len ) {
+      if( !valid_iovecs(&iovec,1,NULL) ) {
+        return ERR(-EFAULT);
+      }
+      piovec = &iovec;
+    }
+  }
+
+  /* Short replies are taken in one go, so the reply and the next message
+   * are looked up under one port lock hold.
+   */
+  if( numvecs && numvecs <= MAX_IOVECS ) {
+    if( copy_from_user(kiovecs,reply_iov,numvecs*sizeof(iovec_t)) ||
+        !valid_iovecs(kiovecs,numvecs,&size) ) {
+      return ERR(-EFAULT);
+    }
+  }
+
+  if( !(p=ipc_get_port(current_task(), port, &r)) ) {
+    return ERR(r);
+  }
+
+  if( numvecs <= MAX_IOVECS ) {
+    r=ipc_port_reply_and_receive(p,msg_id,kiovecs,numvecs,size,piovec,msg_info);
+  } else {
+    r=__ipc_port_msg_write_core(p,msg_id,reply_iov,numvecs,0,true,false);
+    if( r >= 0 ) {
+      r=ipc_port_receive(p, IPC_BLOCKED_ACCESS, piovec, 1, msg_info);
+    }
+  }
+
+  ipc_put_port(p);
+  return ERR(r);
+}
+
 long sys_port_receive(ulong_t port, ulong_t flags, ulong_t recv_buf,
                       size_t recv_len, port_msg_info_t *msg_info)
 {
@@ -191,6 +262,42 @@ long sys_port_receive(ulong_t port, ulong_t flags, ulong_t recv_buf,
   return ERR(r);
 }
 
+long sys_port_receive_batch(ulong_t port, ulong_t flags, iovec_t *recv_iovs,
+                            port_msg_info_t *msg_info, ulong_t nmsgs)
+{
+  scratch_mark_t mark=scratch_mark();
+  ipc_gen_port_t *p;
+  long r;
+  iovec_t *piovecs=NULL;
+
+  if( !nmsgs || !msg_info ) {
+    return ERR(-EINVAL);
+  }
+  nmsgs=MIN(nmsgs,IPC_RECV_BATCH_MAX);
+
+  if( recv_iovs ) {
+    piovecs=scratch_alloc(nmsgs*sizeof(iovec_t));
+    if( !piovecs ) {
+      r=-ENOMEM;
+      goto out;
+    }
+    if( copy_from_user(piovecs,recv_iovs,nmsgs*sizeof(iovec_t)) ||
+        !valid_iovecs(piovecs,nmsgs,NULL) ) {
+      r=-EFAULT;
+      goto out;
+    }
+  }
+
+  if ( (p=ipc_get_port(current_task(), port, &r)) ) {
+    r=ipc_port_receive_batch(p, flags, piovecs, msg_info, nmsgs);
+    ipc_put_port(p);
+  }
+
+out:
+  scratch_release(mark);
+  return ERR(r);
+}
+
 long sys_port_send_iov_v(ulong_t channel,
                          iovec_t snd_iov[],ulong_t snd_numvecs,
                          iovec_t rcv_iov[],ulong_t rcv_numvecs)
@@ -229,6 +336,53 @@ long sys_port_send_iov_v(ulong_t channel,
   return ERR(ret);
 }
 
+long sys_port_send_iov_batch(ulong_t channel, iovec_group_t *groups,
+                             ulong_t ngroups, long *statuses)
+{
+  scratch_mark_t mark = scratch_mark();
+  iovec_group_t *kgroups;
+  long *kstatuses;
+  ipc_channel_t *c;
+  long ret;
+
+  if (!groups || !statuses || !ngroups || ngroups > IPC_SEND_BATCH_MAX) {
+    return ERR(-EINVAL);
+  }
+
+  kgroups = scratch_alloc(ngroups * sizeof(iovec_group_t));
+  kstatuses = scratch_alloc(ngroups * sizeof(long));
+  if (!kgroups || !kstatuses) {
+    ret = -ENOMEM;
+    goto out;
+  }
+
+  if (copy_from_user(kgroups, groups, ngroups * sizeof(iovec_group_t))) {
+    ret = -EFAULT;
+    goto out;
+  }
+
+  c = ipc_get_channel(current_task(), channel);
+  if (!c) {
+    ret = -EINVAL;
+    goto out;
+  }
+
+  ret = ipc_port_send_iov_batch(c, kgroups, ngroups, kstatuses);
+  ipc_put_channel(c);
+
+  /* Messages that were sent can't be taken back, so they must be reported
+   * even if their statuses are lost.
+   */
+  if (ret >= 0 && copy_to_user(statuses, kstatuses, ngroups * sizeof(long)) &&
+      !ret) {
+    ret = -EFAULT;
+  }
+
+out:
+  scratch_release(mark);
+  return ERR(ret);
+}
+
 long sys_control_channel(ulong_t channel, ulong_t cmd, ulong_t arg)
 {
   long r=ipc_channel_control(current_task(),channel,cmd,arg);
@@ -154,6 +154,8 @@ void mm_initialize(void)
   if (!nonempty_pools)
     panic("No one memory pool was activated!");
 
+  mmpools_configure_nodes();
+
   for_each_mmpool(pool) {
     kprintf("[MM] Pages statistics of pool \"%s\":\n", pool->name);
     kprintf(" | %-8s %-8s %-8s |\n", "Total", "Free", "Reserved");
@@ -163,6 +165,7 @@ void mm_initialize(void)
 
   kprintf("[MM] All pages were successfully remapped.\n");
   __validate_mmpools_dbg();
+  zeroed_pages_initialize();
 }
 
 void vmm_initialize(void)
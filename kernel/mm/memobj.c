@@ -372,6 +372,19 @@ int sys_memobj_control(memobj_id_t memobj_id, int cmd, long uarg)
       case MEMOBJ_CTL_GET_BACKEND:
         ret = -ENOTSUP;
         goto out;
+      case MEMOBJ_CTL_SET_FAULT_AROUND:
+        /*
+         * Generic memory object backs all anonymous mappings, their
+         * windows are set per VM range.
+         */
+        if (memobj_is_generic(memobj) || (uarg < 0)) {
+          ret = -EINVAL;
+          goto out;
+        }
+
+        /* Takes effect for VM ranges mapped after this call */
+        memobj->fault_around = fault_around_window(uarg);
+        goto out;
       default:
         ret = -EINVAL;
   }
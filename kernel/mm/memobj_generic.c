@@ -70,6 +70,7 @@ static int __mmap_one_phys_page(vmm_t *vmm, page_idx_t pidx,
   return ret;
 }
 
+/* Page is freed if it can't be mapped */
 static int __mmap_one_anon_page(vmm_t *vmm, page_frame_t *page,
                                 uintptr_t addr, vmrange_flags_t flags)
 {
@@ -89,6 +90,7 @@ static int __mmap_one_anon_page(vmm_t *vmm, page_frame_t *page,
     GMO_DBG("(pid %ld) Failed to mmap one anonymous page "
             "%#x to address %p. [RET = %d]\n", vmm->owner->pid,
             pframe_number(page), addr, ret);
+    free_page(page);
     return ret;
   }
 
@@ -109,6 +111,38 @@ static int __mmap_one_anon_page(vmm_t *vmm, page_frame_t *page,
   return ret;
 }
 
+/*
+ * Anonymous memory has nothing resident to map around a fault, so the
+ * window is filled with new zeroed pages. It costs memory the task may
+ * never touch, hence generic memory object has no default window and
+ * VM ranges opt in with vmrange_set_fault_around().
+ * Called with RPD write lock held.
+ */
+static void __fault_around_anon(vmrange_t *vmr, uintptr_t addr,
+                                vmrange_flags_t mmap_flags)
+{
+  vmm_t *vmm = vmr->parent_vmm;
+  uintptr_t a, from, to;
+  page_frame_t *pf;
+
+  if (!vmrange_fault_around(vmr, addr, &from, &to))
+    return;
+
+  for (a = from; a < to; a += PAGE_SIZE) {
+    if ((a == addr) || page_is_mapped(&vmm->rpd, a))
+      continue;
+
+    pf = alloc_page(MMPOOL_USER | AF_ZERO);
+    if (!pf)
+      break;
+
+    atomic_set(&pf->refcount, 0);
+    pf->offset = addr2pgoff(vmr, a);
+    if (__mmap_one_anon_page(vmm, pf, a, mmap_flags))
+      break;
+  }
+}
+
 static int generic_handle_page_fault(vmrange_t *vmr, uintptr_t addr,
                                      uint32_t pfmask)
 {
@@ -153,9 +187,10 @@ static int generic_handle_page_fault(vmrange_t *vmr, uintptr_t addr,
         ret = 0;
       }
 
-      free_page(pf);
       goto out_unlock;
     }
+
+    __fault_around_anon(vmr, addr, mmap_flags);
   }
   else  {
     pde_t *pde;
@@ -221,60 +256,230 @@ out_unlock:
   return ERR(ret);
 }
 
-static int generic_populate_pages(vmrange_t *vmr, uintptr_t addr,
-                                  page_idx_t npages)
+/*
+ * Allocate naturally aligned block of LARGE_PAGE_PAGES zeroed pages.
+ * Allocator doesn't align blocks, so a twice bigger one is allocated
+ * and trimmed.
+ */
+static page_frame_t *__alloc_large_block(void)
+{
+  page_idx_t n = (LARGE_PAGE_PAGES << 1) - 1, head, tail;
+  page_frame_t *pages;
+
+  pages = alloc_pages(n, MMPOOL_USER | AF_CONTIG);
+  if (!pages) {
+    return NULL;
+  }
+
+  head = round_up(pframe_number(pages), LARGE_PAGE_PAGES) - pframe_number(pages);
+  tail = n - head - LARGE_PAGE_PAGES;
+  if (head) {
+    free_pages(pages, head);
+  }
+  if (tail) {
+    free_pages(pages + head + LARGE_PAGE_PAGES, tail);
+  }
+
+  pages += head;
+  pframes_memnull(pages, LARGE_PAGE_PAGES);
+  return pages;
+}
+
+/*
+ * Each page of anonymous large page keeps its own reference and reverse
+ * mapping, so its pages are unmapped and freed one by one as usual.
+ * Called with RPD write lock held.
+ */
+static int __mmap_large_anon_block(vmrange_t *vmr, page_frame_t *pages,
+                                   uintptr_t addr)
 {
-  int ret = 0;
   vmm_t *vmm = vmr->parent_vmm;
-  page_frame_t *p, *pages = NULL;
+  page_idx_t i, registered;
+  uintptr_t a;
+  int ret;
 
-  if (likely(!(vmr->flags & VMR_PHYS))) {
-    list_head_t chain_head;
+  ret = mmap_large_page(&vmm->rpd, addr, pframe_number(pages), vmr->flags);
+  if (ret) {
+    free_pages(pages, LARGE_PAGE_PAGES);
+    return ret;
+  }
 
-    list_init_head(&chain_head);
-    pages = alloc_pages(npages, AF_ZERO | MMPOOL_USER);
-    if (!pages) {
-      return ERR(-ENOMEM);
+  for (i = 0; i < LARGE_PAGE_PAGES; i++) {
+    atomic_set(&pages[i].refcount, 1);
+    pages[i].offset = addr2pgoff(vmr, addr + ((uintptr_t)i << PAGE_WIDTH));
+  }
+  for (i = 0; i < LARGE_PAGE_PAGES; i++) {
+    a = addr + ((uintptr_t)i << PAGE_WIDTH);
+    lock_page_frame(&pages[i], PF_LOCK);
+    ret = rmap_register_anon(&pages[i], vmm, a);
+    unlock_page_frame(&pages[i], PF_LOCK);
+    if (unlikely(ret)) {
+      GMO_DBG("(pid %ld) Failed to register anonymous rmap for "
+              "page %#x of large page mapped to %p. [RET = %d]\n",
+              vmm->owner->pid, pframe_number(&pages[i]), a, ret);
+      break;
     }
+  }
+  if (likely(!ret))
+    return 0;
+
+  /*
+   * Unmap the whole block, so that the caller can populate the range
+   * with normal pages.
+   */
+  for (registered = i, i = 0; i < LARGE_PAGE_PAGES; i++) {
+    a = addr + ((uintptr_t)i << PAGE_WIDTH);
+    if (i < registered)
+      rmap_unregister_mapping(&pages[i], vmm, a);
+
+    munmap_page(&vmm->rpd, a);
+    unpin_page_frame(&pages[i]);
+  }
 
-    list_set_head(&chain_head, &pages->chain_node);
-    RPD_LOCK_WRITE(&vmm->rpd);
-    list_for_each_entry(&chain_head, p, chain_node) {
-      ret = __mmap_one_anon_page(vmm, p, addr, vmr->flags);
-      if (unlikely(ret)) {
-        GMO_DBG("(pid %ld): Failed to mmap anonymous page %#x to address %p. "
-                "[RET = %d]\n", vmm->owner->pid, pframe_number(p), addr, ret);
+  return ret;
+}
 
-        RPD_UNLOCK_WRITE(&vmm->rpd);
-        return ERR(ret);
-      }
+/* Called with RPD write lock held. */
+static int __mmap_large_phys_block(vmrange_t *vmr, page_idx_t pidx,
+                                   uintptr_t addr)
+{
+  page_frame_t *p;
+  page_idx_t i;
+  int ret;
+
+  ret = mmap_large_page(&vmr->parent_vmm->rpd, addr, pidx, vmr->flags);
+  if (ret) {
+    return ret;
+  }
 
-      p->offset = addr2pgoff(vmr, addr);
-      addr += PAGE_SIZE;
+  for (i = pidx; i < (pidx + LARGE_PAGE_PAGES); i++) {
+    if (likely(page_idx_is_present(i))) {
+      p = pframe_by_id(i);
+      pin_page_frame(p);
+      p->offset = i;
     }
+  }
+
+  return 0;
+}
 
+static int __populate_large_page(vmrange_t *vmr, uintptr_t addr)
+{
+  vmm_t *vmm = vmr->parent_vmm;
+  page_frame_t *pages;
+  int ret;
+
+  if (vmr->flags & VMR_PHYS) {
+    if (addr2pgoff(vmr, addr) & (LARGE_PAGE_PAGES - 1)) {
+      return -EINVAL;
+    }
+
+    RPD_LOCK_WRITE(&vmm->rpd);
+    ret = __mmap_large_phys_block(vmr, addr2pgoff(vmr, addr), addr);
     RPD_UNLOCK_WRITE(&vmm->rpd);
+    return ret;
   }
-  else {
-    page_idx_t idx, i;
 
-    idx = addr2pgoff(vmr, addr);
-    RPD_LOCK_WRITE(&vmm->rpd);
-    for (i = 0; i < npages; i++, addr += PAGE_SIZE) {
-      ret = __mmap_one_phys_page(vmm, idx + i, addr, vmr->flags);
-      if (ret) {
-        GMO_DBG("(pid %ld): Failed to mmap physical page %#x to address %p. "
-                "[RET = %d]\n", i, addr, ret);
+  pages = __alloc_large_block();
+  if (!pages) {
+    return -ENOMEM;
+  }
+
+  RPD_LOCK_WRITE(&vmm->rpd);
+  ret = __mmap_large_anon_block(vmr, pages, addr);
+  RPD_UNLOCK_WRITE(&vmm->rpd);
+  return ret;
+}
+
+static int __populate_anon_pages(vmrange_t *vmr, uintptr_t addr,
+                                 page_idx_t npages)
+{
+  int ret = 0;
+  vmm_t *vmm = vmr->parent_vmm;
+  page_frame_t *p, *pages = NULL;
+  list_head_t chain_head;
+
+  list_init_head(&chain_head);
+  pages = alloc_pages(npages, AF_ZERO | MMPOOL_USER);
+  if (!pages) {
+    return ERR(-ENOMEM);
+  }
+
+  list_set_head(&chain_head, &pages->chain_node);
+  RPD_LOCK_WRITE(&vmm->rpd);
+  list_for_each_entry(&chain_head, p, chain_node) {
+    ret = __mmap_one_anon_page(vmm, p, addr, vmr->flags);
+    if (unlikely(ret)) {
+      GMO_DBG("(pid %ld): Failed to mmap anonymous page %#x to address %p. "
+              "[RET = %d]\n", vmm->owner->pid, pframe_number(p), addr, ret);
+
+      RPD_UNLOCK_WRITE(&vmm->rpd);
+      return ERR(ret);
+    }
+
+    p->offset = addr2pgoff(vmr, addr);
+    addr += PAGE_SIZE;
+  }
+
+  RPD_UNLOCK_WRITE(&vmm->rpd);
+  return 0;
+}
 
-        RPD_UNLOCK_WRITE(&vmm->rpd);
+static int __populate_phys_pages(vmrange_t *vmr, uintptr_t addr,
+                                 page_idx_t npages)
+{
+  int ret = 0;
+  vmm_t *vmm = vmr->parent_vmm;
+  page_idx_t idx, i;
+
+  idx = addr2pgoff(vmr, addr);
+  RPD_LOCK_WRITE(&vmm->rpd);
+  for (i = 0; i < npages; i++, addr += PAGE_SIZE) {
+    ret = __mmap_one_phys_page(vmm, idx + i, addr, vmr->flags);
+    if (ret) {
+      GMO_DBG("(pid %ld): Failed to mmap physical page %#x to address %p. "
+              "[RET = %d]\n", i, addr, ret);
+
+      RPD_UNLOCK_WRITE(&vmm->rpd);
+      return ERR(ret);
+    }
+  }
+
+  RPD_UNLOCK_WRITE(&vmm->rpd);
+  return 0;
+}
+
+/*
+ * Parts of the range aligned to the large page size are mapped with
+ * large pages if physical pages can be contiguous and aligned as well.
+ * Everything else is mapped with normal pages.
+ */
+static int generic_populate_pages(vmrange_t *vmr, uintptr_t addr,
+                                  page_idx_t npages)
+{
+  page_idx_t n;
+  int ret = 0;
+
+  while (npages) {
+    n = LARGE_PAGE_PAGES - ((addr >> PAGE_WIDTH) & (LARGE_PAGE_PAGES - 1));
+    n = MIN(n, npages);
+    if ((n < LARGE_PAGE_PAGES) || __populate_large_page(vmr, addr)) {
+      if (likely(!(vmr->flags & VMR_PHYS))) {
+        ret = __populate_anon_pages(vmr, addr, n);
+      }
+      else {
+        ret = __populate_phys_pages(vmr, addr, n);
+      }
+      if (ret) {
         return ERR(ret);
       }
     }
 
-    RPD_UNLOCK_WRITE(&vmm->rpd);
+    addr += (uintptr_t)n << PAGE_WIDTH;
+    npages -= n;
   }
 
-  return ERR(ret);
+  return 0;
 }
 
 static int generic_insert_page(vmrange_t *vmr, page_frame_t *page,
@@ -33,7 +33,7 @@
 #include <sync/spinlock.h>
 #include <mstring/types.h>
 
-#ifndef CONFIG_DEBUG_PCACHE
+#ifdef CONFIG_DEBUG_PCACHE
 #define PCACHE_DBG(fmt, args...)                        \
   do {                                                  \
     kprintf("[PCACHE_DBG (fn: %s) ", __FUNCTION__);     \
@@ -49,6 +49,7 @@ struct pcache {
   rwsem_t rwlock;
   list_head_t dirty_pages;
   uint32_t num_dirty_pages;
+  bool owns_pages; /* Pages were put by pagecache_memobj_insert_page */
 };
 
 static memcache_t *pcache_memcache = NULL;
@@ -71,9 +72,61 @@ static inline void __add_dirty_page(vmrange_t *vmr, page_frame_t *page)
 #endif
 }
 
-static inline int __mmap_page_paranoic(memobj_t *memobj, vmm_t *vmm, page_frame_t *page,
-                                       uintptr_t addr, vmrange_flags_t mmap_flags)
+/*
+ * Map pages the cache already has around "addr", so sequential access
+ * doesn't fault on each of them. Pages of private mappings are mapped
+ * read-only: writes to them go through the usual #PF path which copies
+ * them. Shared pages are mapped with access of their range. Called with
+ * RPD write lock and pagecache lock held.
+ */
+static void __fault_around(vmrange_t *vmr, uintptr_t addr,
+                           vmrange_flags_t mmap_flags)
+{
+  memobj_t *memobj = vmr->memobj;
+  struct pcache *pcache = memobj->private;
+  vmm_t *vmm = vmr->parent_vmm;
+  uintptr_t a, from, to;
+  page_frame_t *page;
+  pgoff_t offset;
+
+  if (!vmrange_fault_around(vmr, addr, &from, &to))
+    return;
+
+  if (vmr->flags & VMR_PRIVATE)
+    mmap_flags &= ~VMR_WRITE;
+  else
+    mmap_flags = vmr->flags;
+
+  for (a = from; a < to; a += PAGE_SIZE) {
+    offset = addr2pgoff(vmr, a);
+    if (offset >= memobj->size)
+      break;
+    if ((a == addr) || page_is_mapped(&vmm->rpd, a))
+      continue;
+
+    page = hat_lookup(&pcache->pagecache, offset);
+    if (!page)
+      continue;
+
+    pin_page_frame(page);
+    if (mmap_page(&vmm->rpd, a, pframe_number(page), mmap_flags)) {
+      unpin_page_frame(page);
+      break;
+    }
+    if (rmap_register_mapping(memobj, page, vmm, a)) {
+      munmap_page(&vmm->rpd, a);
+      unpin_page_frame(page);
+      break;
+    }
+  }
+}
+
+static inline int __mmap_page_paranoic(vmrange_t *vmr, page_frame_t *page,
+                                       uintptr_t addr, vmrange_flags_t mmap_flags,
+                                       bool fault_around)
 {
+  memobj_t *memobj = vmr->memobj;
+  vmm_t *vmm = vmr->parent_vmm;
   int ret = 0;
 
   RPD_LOCK_WRITE(&vmm->rpd);
@@ -90,6 +143,8 @@ static inline int __mmap_page_paranoic(memobj_t *memobj, vmm_t *vmm, page_frame_
     ret = rmap_register_mapping(memobj, page, vmm, addr);
     if (ret)
       unpin_page_frame(page);
+    else if (fault_around)
+      __fault_around(vmr, addr, mmap_flags);
   }
 
 out:
@@ -97,12 +152,13 @@ out:
   return ret;
 }
 
-/* This function expects that page is already pinned */
+/*
+ * This function expects that page is already pinned and
+ * pagecache lock is held.
+ */
 static int __mmap_cached_page(vmrange_t *vmr, uintptr_t addr,
                               page_frame_t *page, vmrange_flags_t mmap_flags)
 {
-  vmm_t *vmm = vmr->parent_vmm;
-
   if (mmap_flags & VMR_WRITE) {
     /*
      * Write fault in private mapping caused #PF.
@@ -128,7 +184,7 @@ static int __mmap_cached_page(vmrange_t *vmr, uintptr_t addr,
     mmap_flags &= ~VMR_WRITE;
   }
 
-  return __mmap_page_paranoic(vmr->memobj, vmm, page, addr, mmap_flags);
+  return __mmap_page_paranoic(vmr, page, addr, mmap_flags, true);
 }
 
 #if 0
@@ -206,7 +262,6 @@ out:
 
 static int handle_not_present_fault(vmrange_t *vmr, uintptr_t addr, uint32_t pfmask)
 {
-  vmm_t *vmm = vmr->parent_vmm;
   memobj_t *memobj = vmr->memobj;
   vmrange_flags_t mmap_flags = vmr->flags;
   pgoff_t offset = addr2pgoff(vmr, addr);
@@ -265,7 +320,7 @@ static int handle_not_present_fault(vmrange_t *vmr, uintptr_t addr, uint32_t pfm
          * of the page in page cache.
          */
 
-        ret = __mmap_page_paranoic(memobj, vmm, page, addr, vmr->flags);
+        ret = __mmap_page_paranoic(vmr, page, addr, vmr->flags, false);
         PCACHE_DBG("Handled #PF on write in private mapping: [offs = %#x, page = #%x, addr = %p]/\n",
                    offset, pframe_number(page), addr);
         /* TODO DK: page *must* be marked as dirty */
@@ -304,7 +359,7 @@ static int handle_not_present_fault(vmrange_t *vmr, uintptr_t addr, uint32_t pfm
           copy_page_frame(new_page, page);
         }
       }
-      else {
+      else if (ret) {
         PCACHE_DBG("#PF. Failed to insert page %#x in cache by offset %#x. [RET = %d]\n",
                    pframe_number(page), offset, ret);
         rwsem_up_write(&pcache->rwlock);
@@ -313,8 +368,12 @@ static int handle_not_present_fault(vmrange_t *vmr, uintptr_t addr, uint32_t pfm
 
       PCACHE_DBG("#PF. New page %#x was inserted in a cache by offset %#x\n",
                  pframe_number(page), offset);
-      ret = __mmap_page_paranoic(memobj, vmm, page, addr, mmap_flags);
+      /* Cache keeps its own reference to the page */
+      pin_page_frame(page);
+      ret = __mmap_page_paranoic(vmr, page, addr, mmap_flags, true);
       rwsem_up_write(&pcache->rwlock);
+      if (ret)
+        unpin_page_frame(page);
     }
     else {
       rwsem_down_write(&pcache->rwlock);
@@ -393,12 +452,13 @@ static int pcache_handle_page_fault(vmrange_t *vmr,
         rwsem_down_read(&pcache->rwlock);
         ASSERT_DBG(hat_lookup(&pcache->pagecache, offset) != NULL);
 
+        /*
+         * The page is present, so it was registered in rmap by whoever
+         * mapped it: __mmap_page_paranoic() on #PF or __fault_around()
+         * for its neighbours. vmm_clone() can't map pagecache pages, the
+         * object has no insert_page method. Just grant write access.
+         */
         ret = mmap_page(&vmm->rpd, addr, pframe_number(page), vmr->flags);
-        if (!ret) {
-          lock_page_frame(page, PF_LOCK);
-          ret = rmap_register_shared(memobj, page, vmm, addr);
-          unlock_page_frame(page, PF_LOCK);
-        }
 
         PCACHE_DBG("#PF on write: Remap shared page %#x(offs = %#x) to address %p. [RET = %d]\n",
                    pframe_number(page), page->offset, addr, ret);
@@ -443,13 +503,91 @@ static int pcache_handle_page_fault(vmrange_t *vmr,
   return ret;
 }
 
+/* Unmap pages of the range, the cache keeps its own references to them */
+static int pcache_depopulate_pages(vmrange_t *vmr, uintptr_t va_from,
+                                   uintptr_t va_to)
+{
+  vmm_t *vmm = vmr->parent_vmm;
+  page_frame_t *page;
+  page_idx_t pidx;
+  int ret = 0;
+
+  RPD_LOCK_WRITE(&vmm->rpd);
+  for (; va_from < va_to; va_from += PAGE_SIZE) {
+    pidx = vaddr_to_pidx(&vmm->rpd, va_from);
+    if (pidx == PAGE_IDX_INVAL)
+      continue;
+
+    page = pframe_by_id(pidx);
+    munmap_page(&vmm->rpd, va_from);
+    ret = rmap_unregister_mapping(page, vmm, va_from);
+    if (ret)
+      break;
+
+    unpin_page_frame(page);
+  }
+
+  RPD_UNLOCK_WRITE(&vmm->rpd);
+  return ret;
+}
+
+/*
+ * Only caches filled by pagecache_memobj_insert_page (IPC rings) are
+ * destroyed so far: nobody else holds references to their pages.
+ */
+static void pcache_cleanup(memobj_t *memobj)
+{
+  struct pcache *pcache = memobj->private;
+  page_frame_t *page;
+  pgoff_t offset;
+
+  if (!pcache->owns_pages)
+    return;
+
+  for (offset = 0; offset < memobj->size; offset++) {
+    page = hat_lookup(&pcache->pagecache, offset);
+    if (page) {
+      hat_delete(&pcache->pagecache, offset);
+      unpin_page_frame(page);
+    }
+  }
+
+  hat_clear(&pcache->pagecache);
+  free_to_memcache(pcache_memcache, pcache);
+}
+
 static memobj_ops_t pcache_ops = {
   .handle_page_fault = pcache_handle_page_fault,
   .populate_pages = NULL,
+  .depopulate_pages = pcache_depopulate_pages,
   .truncate = NULL,
-  .cleanup = NULL,
+  .cleanup = pcache_cleanup,
 };
 
+/*
+ * Insert a page into the cache of non-backended memory object by given
+ * offset. The cache takes over caller's reference to the page.
+ */
+int pagecache_memobj_insert_page(memobj_t *memobj, pgoff_t offset,
+                                 page_frame_t *page)
+{
+  struct pcache *pcache = memobj->private;
+  int ret;
+
+  if ((memobj->flags & MMO_FLG_BACKENDED) || (offset >= memobj->size))
+    return -EINVAL;
+
+  page->offset = offset;
+  page->flags |= PF_SHARED;
+  rwsem_down_write(&pcache->rwlock);
+  ret = hat_insert(&pcache->pagecache, offset, page);
+  if (!ret)
+    pcache->owns_pages = true;
+  rwsem_up_write(&pcache->rwlock);
+
+  return ret;
+}
+
 int pagecache_memobj_initialize(memobj_t *memobj, uint32_t flags)
 {
   struct pcache *pcache;
@@ -468,9 +606,11 @@ int pagecache_memobj_initialize(memobj_t *memobj, uint32_t flags)
     return -ENOMEM;
   list_init_head(&pcache->dirty_pages);
   pcache->num_dirty_pages = 0;
+  pcache->owns_pages = false;
   rwsem_initialize(&pcache->rwlock);
   memobj->private = pcache;
   memobj->mops = &pcache_ops;
+  memobj->fault_around = FAULT_AROUND_PAGES;
 
   return 0;
 }
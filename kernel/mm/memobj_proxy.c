@@ -33,25 +33,191 @@
 #include <mm/memobj.h>
 #include <mm/backend.h>
 #include <mm/rmap.h>
+#include <mm/scratch.h>
 #include <mm/page_alloc.h>
 #include <ipc/channel.h>
 #include <ipc/ipc.h>
+#include <mstring/string.h>
 #include <mstring/types.h>
 
-static int proxy_page_fault(vmrange_t *vmr, uintptr_t addr, uint32_t pfmask)
+/* Read-ahead window of the first sequential fault */
+#define PROXY_RA_MIN_PAGES 4
+
+/*
+ * Get number of pages to request from the backend for a fault on
+ * "addr". Window doubles while faults hit the page right after the
+ * previous window and drops to one page on random access. It never
+ * covers pages already mapped in the range. The state is updated
+ * without locking: racing faults can only make the guess worse.
+ */
+static page_idx_t __readahead_window(vmrange_t *vmr, uintptr_t addr)
+{
+  memobj_t *memobj = vmr->memobj;
+  vmm_t *vmm = vmr->parent_vmm;
+  pgoff_t offset = addr2pgoff(vmr, addr);
+  page_idx_t window, i;
+
+  if (!(memobj->flags & MMO_FLG_READAHEAD))
+    return 1;
+  if (offset == vmr->ra_next) {
+    window = MAX(vmr->ra_window << 1, PROXY_RA_MIN_PAGES);
+    window = MIN(window, MMEV_RANGE_MAX_PAGES);
+  }
+  else {
+    window = 1;
+  }
+
+  window = MIN(window, memobj->size - offset);
+  window = MIN(window, (vmr->bounds.space_end - addr) >> PAGE_WIDTH);
+  RPD_LOCK_READ(&vmm->rpd);
+  for (i = 1; i < window; i++) {
+    if (page_is_mapped(&vmm->rpd, addr + ((uintptr_t)i << PAGE_WIDTH)))
+      break;
+  }
+
+  RPD_UNLOCK_READ(&vmm->rpd);
+  vmr->ra_window = i;
+  vmr->ra_next = offset + i;
+  return i;
+}
+
+/*
+ * Ask the backend for "npages" pages starting from the faulting one.
+ * Their addresses in server's address space are stored in "srv_addrs",
+ * zero address means server didn't provide the page.
+ */
+static int __request_pages(vmrange_t *vmr, ipc_channel_t *chan, uintptr_t addr,
+                           uint32_t pfmask, uintptr_t *srv_addrs, page_idx_t npages)
 {
   memobj_t *memobj = vmr->memobj;
-  struct mmev_fault msg;
   iovec_t snd_iovec, rcv_iovec;
   int ret;
-  uintptr_t rcvaddr;
-  vmm_t *serv_vmm;
+
+  if (!(memobj->flags & MMO_FLG_READAHEAD)) {
+    struct mmev_fault msg;
+    uintptr_t rcvaddr;
+
+    msg.hdr.event = MMEV_PAGE_FAULT;
+    msg.hdr.private = (long)memobj->private;
+    msg.hdr.memobj_id = memobj->id;
+    msg.pfmask = pfmask;
+    msg.offset = addr2pgoff(vmr, addr);
+
+    snd_iovec.iov_base = (void *)&msg;
+    snd_iovec.iov_len = sizeof(msg);
+    rcv_iovec.iov_base = (void *)&rcvaddr;
+    rcv_iovec.iov_len = sizeof(uintptr_t);
+
+    ret = ipc_port_send_iov(chan, &snd_iovec, 1, &rcv_iovec, 1);
+    if (ret < 0)
+      return ret;
+    if (rcvaddr & PAGE_MASK)
+      return (int)rcvaddr;
+
+    srv_addrs[0] = rcvaddr;
+  }
+  else {
+    struct mmev_fault_range msg;
+    struct mmev_fault_range_reply *reply;
+    scratch_mark_t mark = scratch_mark();
+
+    msg.hdr.event = MMEV_FAULT_RANGE;
+    msg.hdr.private = (long)memobj->private;
+    msg.hdr.memobj_id = memobj->id;
+    msg.pfmask = pfmask;
+    msg.offset = addr2pgoff(vmr, addr);
+    msg.npages = npages;
+
+    reply = scratch_alloc(sizeof(*reply));
+    if (!reply)
+      return -ENOMEM;
+
+    memset(reply, 0, sizeof(*reply));
+    snd_iovec.iov_base = (void *)&msg;
+    snd_iovec.iov_len = sizeof(msg);
+    rcv_iovec.iov_base = (void *)reply;
+    rcv_iovec.iov_len = sizeof(*reply);
+
+    ret = ipc_port_send_iov(chan, &snd_iovec, 1, &rcv_iovec, 1);
+    if (ret >= 0) {
+      ret = 0;
+      if (reply->status < 0)
+        ret = reply->status;
+      else
+        memcpy(srv_addrs, reply->addrs, npages * sizeof(uintptr_t));
+    }
+
+    scratch_release(mark);
+    return ret;
+  }
+
+  return 0;
+}
+
+/*
+ * Find and pin pages the server provided. Read-ahead pages that can't
+ * be found are skipped, but the faulting one is mandatory.
+ */
+static int __pin_server_pages(vmrange_t *vmr, vmm_t *serv_vmm, uintptr_t *srv_addrs,
+                              page_frame_t **pages, page_idx_t npages)
+{
+  vmrange_t *serv_vmr = NULL;
+  page_idx_t pidx, i;
+  uintptr_t a;
+  int ret = 0;
+
+  rwsem_down_read(&serv_vmm->rwsem);
+  RPD_LOCK_READ(&serv_vmm->rpd);
+  for (i = 0; i < npages; i++) {
+    pages[i] = NULL;
+    a = srv_addrs[i];
+    if (!serv_vmr || (a < serv_vmr->bounds.space_start) ||
+        (a >= serv_vmr->bounds.space_end)) {
+      serv_vmr = vmrange_find(serv_vmm, a, a + 1, NULL);
+    }
+    if (!a || (a & PAGE_MASK) || !serv_vmr) {
+      ret = -EFAULT;
+      goto skip;
+    }
+    if (serv_vmr->memobj != vmr->memobj) {
+      ret = -EINVAL;
+      goto skip;
+    }
+
+    pidx = vaddr_to_pidx(&serv_vmm->rpd, a);
+    if (pidx == PAGE_IDX_INVAL) {
+      ret = -EFAULT;
+      goto skip;
+    }
+
+    pages[i] = pframe_by_id(pidx);
+    pin_page_frame(pages[i]);
+    continue;
+
+skip:
+    if (!i)
+      break;
+
+    ret = 0;
+  }
+
+  RPD_UNLOCK_READ(&serv_vmm->rpd);
+  rwsem_up_read(&serv_vmm->rwsem);
+  return ret;
+}
+
+static int proxy_page_fault(vmrange_t *vmr, uintptr_t addr, uint32_t pfmask)
+{
+  memobj_t *memobj = vmr->memobj;
+  uintptr_t *srv_addrs;
+  page_frame_t **pages;
+  scratch_mark_t mark;
   vmm_t *cli_vmm = vmr->parent_vmm;
-  vmrange_t *serv_vmr;
-  page_idx_t pidx;
-  page_frame_t *page;
   task_t *server = NULL;
   ipc_channel_t *chan = NULL;
+  page_idx_t npages, i;
+  uintptr_t a;
+  int ret, err;
 
   ret = 0;
   spinlock_lock_read(&memobj->members_rwlock);
@@ -72,78 +238,73 @@ static int proxy_page_fault(vmrange_t *vmr, uintptr_t addr, uint32_t pfmask)
   if (ret)
     return ret;
   if (!server || !chan) {
-    if (server)
-      release_task_struct(server);
-    if (chan)
-      ipc_unpin_channel(chan);
-
-    return -ENOENT;
-  }
-
-  serv_vmm = server->task_mm;
-  msg.hdr.event = MMEV_PAGE_FAULT;
-  msg.hdr.private = (long)memobj->private;
-  msg.hdr.memobj_id = memobj->id;
-  msg.pfmask = pfmask;
-  msg.offset = addr2pgoff(vmr, addr);
-
-  snd_iovec.iov_base = (void *)&msg;
-  snd_iovec.iov_len = sizeof(msg);
-  rcv_iovec.iov_base = (void *)&rcvaddr;
-  rcv_iovec.iov_len = sizeof(uintptr_t);
-
-  ret = ipc_port_send_iov(chan, &snd_iovec, 1, &rcv_iovec, 1);
-  if (ret < 0) {
-    return ret;
+    ret = -ENOENT;
+    goto out;
   }
 
-  if (rcvaddr & PAGE_MASK) {
-    return (int)rcvaddr;
+  /* Keep read-ahead arrays off the page fault stack */
+  mark = scratch_mark();
+  srv_addrs = scratch_alloc(MMEV_RANGE_MAX_PAGES * sizeof(*srv_addrs));
+  pages = scratch_alloc(MMEV_RANGE_MAX_PAGES * sizeof(*pages));
+  if (!srv_addrs || !pages) {
+    ret = -ENOMEM;
+    goto out_release;
   }
 
-  rwsem_down_read(&serv_vmm->rwsem);
-  serv_vmr = vmrange_find(serv_vmm, rcvaddr, rcvaddr + 1, NULL);
-  if (!serv_vmr) {
-    ret = -EFAULT;
-    goto out_unlock_srv;
-  }
-  if (serv_vmr->memobj != memobj) {
-    ret = -EINVAL;
-    goto out_unlock_srv;
-  }
+  npages = __readahead_window(vmr, addr);
+  ret = __request_pages(vmr, chan, addr, pfmask, srv_addrs, npages);
+  if (ret)
+    goto out_release;
 
-  RPD_LOCK_READ(&serv_vmm->rpd);
-  pidx = vaddr_to_pidx(&serv_vmm->rpd, rcvaddr);
-  if (pidx == PAGE_IDX_INVAL) {
-    ret = -EFAULT;
-    RPD_UNLOCK_READ(&serv_vmm->rpd);
-    goto out_unlock_srv;
-  }
+  ret = __pin_server_pages(vmr, server->task_mm, srv_addrs, pages, npages);
+  if (ret)
+    goto out_release;
 
-  page = pframe_by_id(pidx);
-  pin_page_frame(page);
-  RPD_UNLOCK_READ(&serv_vmm->rpd);
+  /* Map the faulting page and the read-ahead ones under one lock */
   RPD_LOCK_WRITE(&cli_vmm->rpd);
-  ret = mmap_page(&cli_vmm->rpd, addr, pframe_number(page), vmr->flags);
-  if (ret) {
-    unpin_page_frame(page);
-    RPD_UNLOCK_WRITE(&cli_vmm->rpd);
-    goto out_unlock_srv;
-  }
+  for (i = 0; i < npages; i++) {
+    if (!pages[i])
+      continue;
+    if (ret) {
+      unpin_page_frame(pages[i]);
+      continue;
+    }
 
-  ret = rmap_register_mapping(vmr->memobj, page, cli_vmm, addr);
-  if (ret) {
-    unpin_page_frame(page);
-    RPD_UNLOCK_WRITE(&cli_vmm->rpd);
-    goto out_unlock_srv;
+    /*
+     * Window was chosen without the lock held: another fault could
+     * have mapped some of its pages since then.
+     */
+    a = addr + ((uintptr_t)i << PAGE_WIDTH);
+    if (page_is_mapped(&cli_vmm->rpd, a)) {
+      unpin_page_frame(pages[i]);
+      continue;
+    }
+
+    err = mmap_page(&cli_vmm->rpd, a, pframe_number(pages[i]), vmr->flags);
+    if (!err) {
+      err = rmap_register_mapping(memobj, pages[i], cli_vmm, a);
+      if (err)
+        munmap_page(&cli_vmm->rpd, a);
+    }
+    if (err) {
+      unpin_page_frame(pages[i]);
+
+      /* Read-ahead pages are optional */
+      if (!i)
+        ret = err;
+    }
   }
 
   RPD_UNLOCK_WRITE(&cli_vmm->rpd);
 
-out_unlock_srv:
-  rwsem_up_read(&serv_vmm->rwsem);
-  release_task_struct(server);
-  ipc_unpin_channel(chan);
+out_release:
+  scratch_release(mark);
+out:
+  if (server)
+    release_task_struct(server);
+  if (chan)
+    ipc_unpin_channel(chan);
+
   return ret;
 }
 
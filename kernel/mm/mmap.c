@@ -42,6 +42,7 @@
 #include <security/security.h>
 #include <security/util.h>
 #include <mstring/task.h>
+#include <arch/tlb.h>
 #include <config.h>
 
 #define INVALID_ADDRESS (~0UL)
@@ -143,6 +144,9 @@ static vmrange_t *create_vmrange(vmm_t *parent_vmm, memobj_t *memobj,
   vmr->memobj = memobj;
   vmr->hole_size = 0;
   vmr->offset = offset;
+  vmr->fault_around = memobj->fault_around;
+  vmr->ra_next = offset;
+  vmr->ra_window = 0;
 
   parent_vmm->num_vmrs++;
   pin_memobj(memobj);
@@ -219,6 +223,7 @@ static vmrange_t *split_vmrange(vmrange_t *vmrange,
               va_from, va_to, vmrange->bounds.space_end);
 
   vmrange->bounds.space_end = va_from;
+  new_vmr->fault_around = vmrange->fault_around;
 
   /* fix holes size regarding the changes */
   new_vmr->hole_size = vmrange->hole_size;
@@ -369,6 +374,7 @@ void __clear_vmranges_tree(vmm_t *vmm)
   int i;
   vmrange_t *vmr;
   memobj_t *memobj;
+  struct tlb_batch batch;
 
   tnode = ttree_tnode_leftmost(vmm->vmranges_tree.root);
   if (!tnode) {
@@ -376,6 +382,7 @@ void __clear_vmranges_tree(vmm_t *vmm)
     return;
   }
 
+  tlb_batch_start(&batch, &vmm->rpd);
   while (tnode) {
     tnode_for_each_index(tnode, i) {
       vmr = ttree_key2item(&vmm->vmranges_tree, tnode_key(tnode, i));
@@ -394,6 +401,7 @@ void __clear_vmranges_tree(vmm_t *vmm)
     tnode = tnode->successor;
   }
 
+  tlb_batch_finish(&batch);
   ASSERT(vmm->num_vmrs == 0);
   ttree_destroy(&vmm->vmranges_tree);
 }
@@ -425,6 +433,7 @@ int vmm_clone(vmm_t *dst, vmm_t *src, int flags)
   page_idx_t pidx;
   vmrange_flags_t mmap_flags;
   page_frame_t *page;
+  struct tlb_batch batch;
 
   ASSERT(dst != src);
   ASSERT((flags & (VMM_CLONE_POPULATE | VMM_CLONE_COW))
@@ -439,6 +448,9 @@ int vmm_clone(vmm_t *dst, vmm_t *src, int flags)
   tnode = ttree_tnode_leftmost(src->vmranges_tree.root);
   ASSERT(tnode != NULL);
 
+  /* Pages of src remapped read-only for COW are invalidated at once */
+  tlb_batch_start(&batch, &src->rpd);
+
   /*
    * Browse throug each VM range in src and
    * copy its content into the dst's VM ranges tree
@@ -482,6 +494,7 @@ int vmm_clone(vmm_t *dst, vmm_t *src, int flags)
       }
 
       new_vmr->hole_size = vmr->hole_size;
+      new_vmr->fault_around = vmr->fault_around;
       ASSERT(!ttree_insert(&dst->vmranges_tree, new_vmr));
 
       /*
@@ -581,11 +594,12 @@ int vmm_clone(vmm_t *dst, vmm_t *src, int flags)
     tnode = tnode->successor;
   }
 
-
+  tlb_batch_finish(&batch);
   rwsem_up_write(&src->rwsem);
   return ret;
 
 clone_failed:
+  tlb_batch_finish(&batch);
   rwsem_up_write(&src->rwsem);
   __clear_vmranges_tree(dst);
 
@@ -774,7 +788,21 @@ long vmrange_map(memobj_t *memobj, vmm_t *vmm, uintptr_t addr,
    * satisfying requested length.
    */
   allocate_address:
-  addr = find_free_vmrange(vmm, (npages << PAGE_WIDTH), &cursor);
+  addr = INVALID_ADDRESS;
+  if ((flags & (VMR_PHYS | VMR_POPULATE)) && (npages >= LARGE_PAGE_PAGES)) {
+    /*
+     * Leave a room to align populated range, so that it can be mapped
+     * with large pages. Physical range is aligned like its pages are.
+     */
+    addr = find_free_vmrange(vmm, ((uintptr_t)npages << PAGE_WIDTH)
+                             + LARGE_PAGE_SIZE - PAGE_SIZE, &cursor);
+    if (addr != INVALID_ADDRESS) {
+      addr += (((flags & VMR_PHYS) ? ((uintptr_t)offset << PAGE_WIDTH) : 0)
+               - addr) & LARGE_PAGE_MASK;
+    }
+  }
+  if (addr == INVALID_ADDRESS)
+    addr = find_free_vmrange(vmm, (npages << PAGE_WIDTH), &cursor);
   if (addr == INVALID_ADDRESS) {
     err = -ENOMEM;
     goto err;
@@ -889,8 +917,7 @@ err:
   return err;
 }
 
-/* Munmap all VM ranges starting from va_from continuing for npages pages. */
-int unmap_vmranges(vmm_t *vmm, uintptr_t va_from, page_idx_t npages)
+static int __unmap_vmranges(vmm_t *vmm, uintptr_t va_from, page_idx_t npages)
 {
   ttree_cursor_t cursor;
   uintptr_t va_to = va_from + ((uintptr_t)npages << PAGE_WIDTH);
@@ -1025,6 +1052,42 @@ int unmap_vmranges(vmm_t *vmm, uintptr_t va_from, page_idx_t npages)
   return 0;
 }
 
+/*
+ * Munmap all VM ranges starting from va_from continuing for npages pages.
+ * TLB entries of all unmapped pages are invalidated at once at the end.
+ */
+int unmap_vmranges(vmm_t *vmm, uintptr_t va_from, page_idx_t npages)
+{
+  struct tlb_batch batch;
+  int ret;
+
+  tlb_batch_start(&batch, &vmm->rpd);
+  ret = __unmap_vmranges(vmm, va_from, npages);
+  tlb_batch_finish(&batch);
+  return ret;
+}
+
+/*
+ * Set fault-around window of VM range containing "addr". The window is
+ * rounded down to a power of two, zero or one page disables fault-around.
+ */
+int vmrange_set_fault_around(vmm_t *vmm, uintptr_t addr, page_idx_t npages)
+{
+  vmrange_t *vmr;
+  int ret = 0;
+
+  rwsem_down_write(&vmm->rwsem);
+  vmr = vmrange_find(vmm, PAGE_ALIGN_DOWN(addr),
+                     PAGE_ALIGN_DOWN(addr) + 1, NULL);
+  if (vmr)
+    vmr->fault_around = fault_around_window(npages);
+  else
+    ret = -EFAULT;
+
+  rwsem_up_write(&vmm->rwsem);
+  return ret;
+}
+
 int __fault_in_user_page(vmrange_t *vmrange, uintptr_t addr,
                          uint32_t pfmask, page_idx_t *out_pidx,
 			 bool resolve_faults)
@@ -22,21 +22,31 @@
 #include <config.h>
 #include <arch/atomic.h>
 #include <arch/mem.h>
+#include <arch/interrupt.h>
 #include <ds/list.h>
 #include <mm/mmpool.h>
 #include <mm/page.h>
+#include <mm/numa.h>
+#include <mstring/smp.h>
+#include <mstring/kprintf.h>
 #include <mstring/panic.h>
 #include <mstring/assert.h>
+#include <mstring/bitwise.h>
 #include <mstring/string.h>
 #include <mstring/types.h>
 
 mmpool_t *mmpools[ARCH_NUM_MMPOOLS];
 mmpool_t *preferred_mmpools[NUM_PREFERRED_MMPOOLS];
-LIST_DEFINE(mmpools_list);
+mmpool_t *node_mmpools[NUMA_MAX_NODES][NUM_PREFERRED_MMPOOLS];
+mmpool_t *mmpools_fallback[NUMA_MAX_NODES][ARCH_NUM_MMPOOLS + 1];
+LIST_DEFINE(mmpools_list); /* Sorted by bound addresses in ascending order */
 static INITDATA mmpool_type_t mmpool_ids = MMPOOL_FIRST_TYPE;
 
 static void mmpool_add_page(mmpool_t *mmpool, page_frame_t *pframe)
 {
+  if (!mmpool->num_pages)
+    mmpool->first_pidx = pframe_number(pframe);
+
   ASSERT(pframe_number(pframe) >= mmpool->first_pidx);
   mmpool->num_pages++;
   if (pframe->flags & PF_RESERVED) {
@@ -53,27 +63,26 @@ INITCODE void mmpool_register(mmpool_t *mmpool)
 {
   mmpool_type_t type;
   mmpool_t *p;
-  list_node_t *n, *ins;
-  
+  list_node_t *n;
+
   ASSERT(mmpool != NULL);
-  ins = list_node_last(&mmpools_list);
   list_for_each(&mmpools_list, n) {
     p = list_entry(n, mmpool_t, pool_node);
     if (p->bound_addr == mmpool->bound_addr) {
       panic("Memory pools \"%s\" and \"%s\" has the same "
-            "bound address = %p!\n", mmpool->bound_addr);
+            "bound address = %p!\n", p->name, mmpool->name, mmpool->bound_addr);
     }
-    if (mmpool->bound_addr > p->bound_addr) {
-      ins = &p->pool_node;
+    if (mmpool->bound_addr < p->bound_addr) {
       break;
     }
   }
-  
+
   type = mmpool_ids++;
   ASSERT(type < MMPOOLS_MAX);
+  ASSERT(type <= ARCH_NUM_MMPOOLS);
   mmpool->type = type;
   mmpools[type - 1] = mmpool;
-  list_add_after(ins, &mmpool->pool_node);
+  list_add_before(n, &mmpool->pool_node);
 }
 
 INITCODE void mmpool_set_preferred(int mmpool_id, mmpool_t *pref_mmpool)
@@ -89,18 +98,115 @@ INITCODE void mmpool_set_preferred(int mmpool_id, mmpool_t *pref_mmpool)
 void mmpools_register_page(page_frame_t *pframe)
 {
   uintptr_t addr = (uintptr_t)pframe_to_phys(pframe);
-  bool added = false;
   mmpool_t *p;
 
-  for_each_mmpool(p) {
+  list_for_each_entry(&mmpools_list, p, pool_node) {
     if (addr < p->bound_addr) {
       mmpool_add_page(p, pframe);
-      added = true;
-      break;
+      return;
+    }
+  }
+
+  panic("Can not determine memory pool for page with "
+        "physical address %p!\n", addr);
+}
+
+/*
+ * Among active pools of the node having given nature prefer the
+ * globally preferred one, otherwise take the pool having most free pages.
+ */
+static INITCODE mmpool_t *__choose_node_preferred(int node, int mmpool_id)
+{
+  mmpool_t *p, *best = NULL;
+
+  for_each_active_mmpool(p) {
+    if ((p->node != node) || !(p->flags & (1 << mmpool_id)))
+      continue;
+    if (p == preferred_mmpools[mmpool_id])
+      return p;
+    if (!best || (atomic_get(&p->num_free_pages) >
+                  atomic_get(&best->num_free_pages))) {
+      best = p;
+    }
+  }
+
+  return best;
+}
+
+static INITCODE void __build_fallback_list(int node)
+{
+  mmpool_t **list = mmpools_fallback[node], *p;
+  int i, n = 0;
+
+  /* Insertion sort by distance keeps pools of equal distance in type order */
+  for_each_mmpool(p) {
+    for (i = n; i > 0; i--) {
+      if (numa_distance(node, list[i - 1]->node) <= numa_distance(node, p->node))
+        break;
+
+      list[i] = list[i - 1];
     }
+
+    list[i] = p;
+    n++;
+  }
+
+  list[n] = NULL;
+}
+
+INITCODE void mmpools_configure_nodes(void)
+{
+  uintptr_t start = 0;
+  mmpool_t *p;
+  int node, i;
+
+  list_for_each_entry(&mmpools_list, p, pool_node) {
+    p->node = numa_range_to_node(start, p->bound_addr);
+    start = p->bound_addr;
+#ifdef CONFIG_NUMA
+    kprintf(KO_INFO "[MM] Memory pool \"%s\" belongs to node %d\n",
+            p->name, p->node);
+#endif /* CONFIG_NUMA */
+  }
+  for (node = 0; node < numa_num_nodes; node++) {
+    for (i = 0; i < NUM_PREFERRED_MMPOOLS; i++)
+      node_mmpools[node][i] = __choose_node_preferred(node, i);
+
+    __build_fallback_list(node);
   }
-  if (unlikely(!added)) {
-    panic("Can not determine memory pool for page with "
-          "physical address %p!\n", addr);
+}
+
+mmpool_t *mmpool_get_local(int mmpool_id)
+{
+  return mmpool_get_node_preferred(cpu_to_node(cpu_id()), mmpool_id);
+}
+
+void mmpool_account_latency(mmpool_t *mmpool, uint64_t cycles)
+{
+  int bucket = 0, irqstat;
+
+  if (cycles >> KCTRL_LATENCY_FIRST_SHIFT) {
+    bucket = bit_find_msf(cycles) - KCTRL_LATENCY_FIRST_SHIFT + 1;
+    bucket = MIN(bucket, KCTRL_LATENCY_BUCKETS - 1);
+  }
+
+  interrupts_save_and_disable(irqstat);
+  mmpool->alloc_latency[cpu_id()][bucket]++;
+  interrupts_restore(irqstat);
+}
+
+void mmpool_get_stat(mmpool_t *mmpool, kcontrol_mmpool_stat_t *stat)
+{
+  int c, i;
+
+  memset(stat, 0, sizeof(*stat));
+  strncpy(stat->name, mmpool->name, KCTRL_STAT_NAME_LEN - 1);
+  stat->type = mmpool->type;
+  stat->node = mmpool->node;
+  stat->num_pages = mmpool->num_pages;
+  stat->num_free_pages = atomic_get(&mmpool->num_free_pages);
+  for_each_cpu(c) {
+    for (i = 0; i < KCTRL_LATENCY_BUCKETS; i++)
+      stat->alloc_latency[i] += mmpool->alloc_latency[c][i];
   }
 }
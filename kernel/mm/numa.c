@@ -0,0 +1,154 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * (c) Copyright 2006,2007,2008 MString Core Team <http://mstring.jarios.org>
+ *
+ * mm/numa.c: NUMA topology reported by firmware.
+ *
+ */
+
+#include <config.h>
+#include <mm/numa.h>
+#include <mstring/kprintf.h>
+#include <mstring/assert.h>
+#include <mstring/string.h>
+#include <mstring/types.h>
+
+/*
+ * Topology is filled by arch code during boot and never changes
+ * after that, so it's read without any locking.
+ */
+numa_memblock_t numa_memblocks[NUMA_MAX_MEMBLOCKS];
+int numa_num_memblocks = 0;
+int numa_num_nodes = 1;
+
+static INITDATA uint32_t node_domains[NUMA_MAX_NODES];
+static INITDATA int num_domains = 0;
+static uint8_t numa_distances[NUMA_MAX_NODES][NUMA_MAX_NODES];
+static int cpu_nodes[CONFIG_NRCPUS];
+
+INITCODE int numa_lookup_domain(uint32_t domain)
+{
+  int i;
+
+  for (i = 0; i < num_domains; i++) {
+    if (node_domains[i] == domain)
+      return i;
+  }
+
+  return -1;
+}
+
+INITCODE int numa_domain_to_node(uint32_t domain)
+{
+  int i = numa_lookup_domain(domain);
+
+  if (i >= 0)
+    return i;
+  if (num_domains == NUMA_MAX_NODES) {
+    kprintf(KO_WARNING "NUMA: proximity domain %d exceeds limit "
+            "of %d nodes\n", domain, NUMA_MAX_NODES);
+    return -1;
+  }
+
+  i = num_domains++;
+  node_domains[i] = domain;
+  numa_num_nodes = num_domains;
+  return i;
+}
+
+/* Merge neighbouring blocks of the same node */
+static INITCODE void __merge_memblocks(void)
+{
+  int i = 1;
+
+  while (i < numa_num_memblocks) {
+    if (numa_memblocks[i - 1].node != numa_memblocks[i].node) {
+      i++;
+      continue;
+    }
+
+    numa_memblocks[i - 1].end = numa_memblocks[i].end;
+    numa_num_memblocks--;
+    memmove(&numa_memblocks[i], &numa_memblocks[i + 1],
+            (numa_num_memblocks - i) * sizeof(numa_memblock_t));
+  }
+}
+
+INITCODE void numa_add_memblock(int node, uintptr_t start, uintptr_t end)
+{
+  int i;
+
+  ASSERT((node >= 0) && (node < NUMA_MAX_NODES));
+  if (numa_num_memblocks == NUMA_MAX_MEMBLOCKS) {
+    kprintf(KO_WARNING "NUMA: too many memory ranges, [%p, %p) "
+            "of node %d is ignored\n", start, end, node);
+    return;
+  }
+
+  /* Keep blocks sorted by their start addresses */
+  for (i = numa_num_memblocks; i > 0; i--) {
+    if (numa_memblocks[i - 1].start < start)
+      break;
+
+    numa_memblocks[i] = numa_memblocks[i - 1];
+  }
+
+  numa_memblocks[i].start = start;
+  numa_memblocks[i].end = end;
+  numa_memblocks[i].node = node;
+  numa_num_memblocks++;
+  __merge_memblocks();
+}
+
+INITCODE void numa_set_distance(int from, int to, int distance)
+{
+  ASSERT((from >= 0) && (from < NUMA_MAX_NODES));
+  ASSERT((to >= 0) && (to < NUMA_MAX_NODES));
+  numa_distances[from][to] = distance;
+}
+
+INITCODE void numa_set_cpu_node(cpu_id_t cpu, int node)
+{
+  ASSERT((node >= 0) && (node < NUMA_MAX_NODES));
+  cpu_nodes[cpu] = node;
+}
+
+int numa_distance(int from, int to)
+{
+  /* Firmware may not provide SLIT */
+  if (!numa_distances[from][to])
+    return (from == to) ? NUMA_LOCAL_DISTANCE : NUMA_REMOTE_DISTANCE;
+
+  return numa_distances[from][to];
+}
+
+int cpu_to_node(cpu_id_t cpu)
+{
+  return cpu_nodes[cpu];
+}
+
+int numa_range_to_node(uintptr_t start, uintptr_t end)
+{
+  int i;
+
+  for (i = 0; i < numa_num_memblocks; i++) {
+    if ((numa_memblocks[i].end > start) && (numa_memblocks[i].start < end))
+      return numa_memblocks[i].node;
+  }
+
+  return 0;
+}
@@ -22,7 +22,9 @@
 #include <mm/page.h>
 #include <mm/mmpool.h>
 #include <mm/page_alloc.h>
+#include <mm/shrinker.h>
 #include <mm/vmm.h>
+#include <arch/timer.h>
 #include <mstring/errno.h>
 #include <mstring/types.h>
 
@@ -36,6 +38,7 @@ static page_frame_t *alloc_pages_notcont(mmpool_t *mmpool,
   page_idx_t granularity, n;
   page_frame_t *pages = NULL, *pg;
   mmpool_t *p = mmpool;
+  int i = 0;
 
   ASSERT(is_powerof2(mmpool_nature));
   n = num_pages;
@@ -73,20 +76,14 @@ config_granularity:
       /*
        * It seems that target memory pool hasn't any free pages
        * at all. But we can try to find out another pool conforming
-       * the nature given by user.
+       * the nature given by user. Pools are tried starting from the
+       * nearest to the node of the target one.
        */
-      if (p == mmpool) {
-        p = get_mmpool_by_type(MMPOOL_FIRST_TYPE);
-      }
-      else {
-        p = mmpool_next_active(p);
-      }
-      while (p) {
-        if ((p != mmpool) && (p->flags & mmpool_nature)) {
+      while ((p = mmpools_fallback[mmpool->node][i++]) != NULL) {
+        if ((p != mmpool) && (p->flags & MMPOOL_ACTIVE) &&
+            (p->flags & mmpool_nature)) {
           goto config_granularity;
         }
-
-        p = mmpool_next_active(p);
       }
 
       goto failed;
@@ -122,14 +119,16 @@ static page_frame_t *alloc_pages_cont(mmpool_t *mmpool,
   mmpool_t *p;
   page_frame_t *pages = NULL;
   mmpool_flags_t mmpool_nature = PAFLAGS_MMPOOL_TYPE(flags);
+  int i;
 
   pages = mmpool_alloc_pages(mmpool, num_pages);
   if (pages) {
     p = mmpool;
     goto out_ok;
   }
-  for_each_active_mmpool(p) {
-    if ((p == mmpool) || !(p->flags & mmpool_nature)) {
+  for_each_fallback_mmpool(p, mmpool->node, i) {
+    if ((p == mmpool) || !(p->flags & MMPOOL_ACTIVE) ||
+        !(p->flags & mmpool_nature)) {
       continue;
     }
 
@@ -156,6 +155,7 @@ page_frame_t *alloc_pages(page_idx_t num_pages, palloc_flags_t flags)
   mmpool_flags_t mmpool_nature;
   page_frame_t *pages;
   mmpool_t *mmpool;
+  uint64_t start = arch_cycles();
 
   ASSERT(num_pages > 0);
   if (!flags) {
@@ -183,13 +183,27 @@ page_frame_t *alloc_pages(page_idx_t num_pages, palloc_flags_t flags)
    *  2) If AF_CONTIG flag is not set, we'll try to allocate needful
    *     number of pages by non-continuous chunks from pools supporting
    *     the nature of preferred one.
+   * On NUMA systems preferred pool is the one of current CPU's node and
+   * other pools are tried in order of their distance from it.
    */
-  mmpool = mmpool_get_preferred(BITNUM(mmpool_nature));
+  mmpool = mmpool_get_local(BITNUM(mmpool_nature));
+  if ((flags & AF_ZERO) && (num_pages == 1)) {
+    pages = get_zeroed_page(mmpool);
+    if (pages)
+      goto out;
+  }
+
   pages = alloc_pages_cont(mmpool, num_pages, flags);
   if (!pages && !(flags & AF_CONTIG)) {
     pages = alloc_pages_notcont(mmpool, num_pages, flags);
   }
+  if (pages && (flags & AF_ZERO)) {
+    zeroed_pages_count_misses(num_pages);
+  }
 
+out:
+  mmpool_account_latency(mmpool, arch_cycles() - start);
+  shrinkers_check_watermark(mmpool);
   return pages;
 }
 
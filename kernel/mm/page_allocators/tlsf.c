@@ -35,6 +35,7 @@
 #include <mm/page_alloc.h>
 #include <mm/ealloc.h>
 #include <mm/tlsf.h>
+#include <mm/shrinker.h>
 #include <sync/spinlock.h>
 #include <mstring/string.h>
 #include <mstring/assert.h>
@@ -428,7 +429,7 @@ static inline page_frame_t *__right_neighbour(page_frame_t *block_head)
 
   page = block_head + pages_block_size_get(block_head);
   if (!bit_test(&page->_private, TLSF_PB_HEAD) ||
-      ((PF_MMPOOL_TYPE(page->flags) == PF_MMPOOL_TYPE(block_head->flags))) ||
+      (PF_MMPOOL_TYPE(page->flags) != PF_MMPOOL_TYPE(block_head->flags)) ||
       (page->flags & PF_RESERVED)) {
     return NULL;
   }
@@ -565,51 +566,239 @@ static page_frame_t *find_suitable_block(tlsf_t *tlsf, tlsf_uint_t size)
   return block;
 }
 
+/*
+ * Take a block of exactly "n" pages from the TLSF map.
+ * Small blocks are carved from the beginning of a free block and
+ * large ones from its end, so they don't interleave and long-lived
+ * small allocations don't pin the middle of big free ranges.
+ * NOTE: tlsf->lock must be held.
+ */
+static page_frame_t *__tlsf_take_block(tlsf_t *tlsf, tlsf_uint_t n)
+{
+  page_frame_t *block_head, *block;
+  tlsf_uint_t size;
+
+  block_head = find_suitable_block(tlsf, n);
+  if (!block_head)
+    return NULL;
+
+  size = pages_block_size_get(block_head);
+  ASSERT(size > 0);
+  pages_block_remove(tlsf, block_head);
+  if (size == n) {
+    block = block_head;
+  }
+  else if (n >= TLSF_LARGE_BLOCK) {
+    block = pages_block_split(tlsf, block_head, n);
+    pages_block_insert(tlsf, block_head);
+  }
+  else {
+    block = block_head;
+    pages_block_insert(tlsf, pages_block_split(tlsf, block_head, size - n));
+  }
+
+  pages_block_destroy(block);
+  return block;
+}
+
+/*
+ * Return a block of "n" free pages to the TLSF map merging it
+ * with its neighbours.
+ * NOTE: tlsf->lock must be held.
+ */
+static void __tlsf_put_block(tlsf_t *tlsf, page_frame_t *pages, tlsf_uint_t n)
+{
+  page_frame_t *merged_block;
+
+  pages_block_create(pages, n - 1);
+  merged_block = try_merge_left(tlsf, pages);
+  merged_block = try_merge_right(tlsf, merged_block);
+  pages_block_insert(tlsf, merged_block);
+}
+
 #ifdef CONFIG_SMP
-static int __put_page_to_cache(tlsf_t *tlsf, page_frame_t *page)
+/* Get per-CPU cache order of blocks of "n" pages or -1 if they aren't cached */
+static inline int __cpucache_order(page_idx_t n)
+{
+  if (!is_powerof2(n) || (n > (1 << (TLSF_CPUCACHE_ORDERS - 1))))
+    return -1;
+
+  return bit_find_msf(n);
+}
+
+/*
+ * Move "nblocks" least recently used blocks of given order from
+ * per-CPU cache "pcpu" back to the TLSF map under one lock acquisition.
+ * Blocks are sorted by their frame numbers first, so physically
+ * adjacent ones are returned as a single run and merged only once.
+ * NOTE: cache lock must be held with local interrupts disabled.
+ */
+static void __drain_cpucache(tlsf_t *tlsf, tlsf_percpu_cache_t *pcpu,
+                             int order, int nblocks)
+{
+  list_head_t *blocks = &pcpu->orders[order].blocks;
+  page_frame_t *batch[TLSF_CPUCACHE_PAGES + 1], *block;
+  int i, j;
+
+  ASSERT(nblocks <= ARRAY_SIZE(batch));
+  for (i = 0; i < nblocks; i++) {
+    block = list_entry(list_node_last(blocks), page_frame_t, node);
+    list_del(&block->node);
+    for (j = i; (j > 0) && (batch[j - 1] > block); j--)
+      batch[j] = batch[j - 1];
+
+    batch[j] = block;
+  }
+
+  spinlock_lock(&tlsf->lock);
+  for (i = 0; i < nblocks; i = j) {
+    for (j = i + 1; j < nblocks; j++) {
+      if (batch[j] != (batch[j - 1] + (1 << order)))
+        break;
+    }
+
+    __tlsf_put_block(tlsf, batch[i], (j - i) << order);
+  }
+
+  spinlock_unlock(&tlsf->lock);
+  pcpu->orders[order].noc_blocks -= nblocks;
+  pcpu->noc_pages -= nblocks << order;
+}
+
+/*
+ * Move up to "nblocks" blocks of given order from the TLSF map to
+ * per-CPU cache "pcpu" under one lock acquisition. The whole batch
+ * is carved from one block if there is such, otherwise blocks are
+ * taken one by one. Return number of blocks were moved.
+ * NOTE: cache lock must be held with local interrupts disabled.
+ */
+static int __refill_cpucache(tlsf_t *tlsf, tlsf_percpu_cache_t *pcpu,
+                             int order, int nblocks)
+{
+  list_head_t *blocks = &pcpu->orders[order].blocks;
+  page_frame_t *block;
+  int i;
+
+  spinlock_lock(&tlsf->lock);
+  block = __tlsf_take_block(tlsf, nblocks << order);
+  if (block) {
+    for (i = 0; i < nblocks; i++, block += (1 << order))
+      list_add2tail(blocks, &block->node);
+  }
+  else {
+    for (i = 0; i < nblocks; i++) {
+      block = __tlsf_take_block(tlsf, 1 << order);
+      if (!block)
+        break;
+
+      list_add2tail(blocks, &block->node);
+    }
+  }
+
+  spinlock_unlock(&tlsf->lock);
+  pcpu->orders[order].noc_blocks += i;
+  pcpu->noc_pages += i << order;
+  return i;
+}
+
+static int __put_block_to_cache(tlsf_t *tlsf, page_frame_t *block, page_idx_t n)
 {
-  tlsf_percpu_cache_t *pcpu = &tlsf->percpu[cpu_id()];
+  tlsf_percpu_cache_t *pcpu;
+  int order = __cpucache_order(n), irqstat;
 
-  if (unlikely(!pcpu->ready) ||
-      pcpu->noc_pages >= TLSF_CPUCACHE_PAGES) {
+  if (order < 0)
+    return -1;
+
+  interrupts_save_and_disable(irqstat);
+  pcpu = &tlsf->percpu[cpu_id()];
+  if (unlikely(!pcpu->ready)) {
+    interrupts_restore(irqstat);
     return -1;
   }
 
-  preempt_disable();
-  list_add2head(&pcpu->pages, &page->node);
-  pcpu->noc_pages++;  
-  preempt_enable();
+  spinlock_lock(&pcpu->lock);
+  list_add2head(&pcpu->orders[order].blocks, &block->node);
+  pcpu->orders[order].noc_blocks++;
+  pcpu->noc_pages += n;
+
+  /* Return half of the cache, so that following frees won't drain again */
+  if (pcpu->orders[order].noc_blocks > TLSF_CPUCACHE_HIGH(order)) {
+    __drain_cpucache(tlsf, pcpu, order,
+                     pcpu->orders[order].noc_blocks - TLSF_CPUCACHE_LOW(order));
+  }
 
+  spinlock_unlock(&pcpu->lock);
+  interrupts_restore(irqstat);
   return 0;
 }
 
-static page_frame_t *__get_page_from_cache(tlsf_t *tlsf)
+static page_frame_t *__get_block_from_cache(tlsf_t *tlsf, page_idx_t n)
 {
-  page_frame_t *page;
-  tlsf_percpu_cache_t *pcpu = &tlsf->percpu[cpu_id()];
-  int irqstat;
+  page_frame_t *block = NULL;
+  tlsf_percpu_cache_t *pcpu;
+  int order = __cpucache_order(n), irqstat;
 
-  if (unlikely(!pcpu->ready) || !pcpu->noc_pages) {
+  if (order < 0)
     return NULL;
-  }
 
   interrupts_save_and_disable(irqstat);
-  page = list_entry(list_node_first(&pcpu->pages), page_frame_t, node);
-  list_del(&page->node);
-  pcpu->noc_pages--;
+  pcpu = &tlsf->percpu[cpu_id()];
+  if (unlikely(!pcpu->ready))
+    goto out;
+
+  spinlock_lock(&pcpu->lock);
+  if (pcpu->orders[order].noc_blocks ||
+      __refill_cpucache(tlsf, pcpu, order, TLSF_CPUCACHE_LOW(order))) {
+    block = list_entry(list_node_first(&pcpu->orders[order].blocks),
+                       page_frame_t, node);
+    list_del(&block->node);
+    pcpu->orders[order].noc_blocks--;
+    pcpu->noc_pages -= n;
+  }
+
+  spinlock_unlock(&pcpu->lock);
+out:
   interrupts_restore(irqstat);
+  return block;
+}
 
-  return page;
+/*
+ * Return blocks cached by all CPUs to the TLSF map, so that they can
+ * be merged with their neighbours. Return number of returned pages.
+ */
+static page_idx_t __drain_all_cpucaches(tlsf_t *tlsf)
+{
+  tlsf_percpu_cache_t *pcpu;
+  page_idx_t pages = 0;
+  int order, irqstat;
+  cpu_id_t cpu;
+
+  for_each_cpu(cpu) {
+    pcpu = &tlsf->percpu[cpu];
+    if (!pcpu->ready || !pcpu->noc_pages)
+      continue;
+
+    spinlock_lock_irqsave(&pcpu->lock, irqstat);
+    pages += pcpu->noc_pages;
+    for (order = 0; order < TLSF_CPUCACHE_ORDERS; order++) {
+      if (pcpu->orders[order].noc_blocks)
+        __drain_cpucache(tlsf, pcpu, order, pcpu->orders[order].noc_blocks);
+    }
+
+    spinlock_unlock_irqrestore(&pcpu->lock, irqstat);
+  }
+
+  return pages;
 }
 #else /* CONFIG_SMP */
-#define __put_page_to_cache(tlsf, page) -1
-#define __get_page_from_cache(tlsf) NULL
+#define __put_block_to_cache(tlsf, block, n) -1
+#define __get_block_from_cache(tlsf, n) NULL
+#define __drain_all_cpucaches(tlsf) 0
 #endif /* !CONFIG_SMP */
 
 static void tlsf_free_pages(page_frame_t *pages, page_idx_t num_pages, void *data)
 {
   tlsf_t *tlsf = data;
-  page_frame_t *merged_block;
   page_idx_t page_idx = pframe_number(pages);
   int i, irqstat;
 
@@ -646,14 +835,11 @@ static void tlsf_free_pages(page_frame_t *pages, page_idx_t num_pages, void *dat
     clear_page_frame(&pages[i]);
     list_init_node(&pages[i].chain_node);
   }
-  if ((num_pages == 1) && !__put_page_to_cache(tlsf, pages))
+  if (!__put_block_to_cache(tlsf, pages, num_pages))
     return;
 
-  pages_block_create(pages, num_pages - 1);
   spinlock_lock_irqsave(&tlsf->lock, irqstat);
-  merged_block = try_merge_left(tlsf, pages);
-  merged_block = try_merge_right(tlsf, merged_block);
-  pages_block_insert(tlsf, merged_block);
+  __tlsf_put_block(tlsf, pages, num_pages);
   spinlock_unlock_irqrestore(&tlsf->lock, irqstat);
 }
 
@@ -661,31 +847,29 @@ static page_frame_t *tlsf_alloc_pages(page_idx_t n, void *data)
 {
   tlsf_t *tlsf = data;
   page_frame_t *block_head = NULL;
-  tlsf_uint_t size;
   int i, irqstat;
 
   if ((n >= MAX_BLOCK_SIZE) || (n > atomic_get(&tlsf->owner->num_free_pages))) {
     goto out;
   }
-  if ((n == 1) && ((block_head = __get_page_from_cache(tlsf)) != NULL)) {
+  if ((block_head = __get_block_from_cache(tlsf, n)) != NULL) {
     goto init_block;
   }
 
+  /*
+   * Free pages may sit in per-CPU caches, in small blocks which
+   * aren't merged with their neighbours. Return them and try once more.
+   */
   spinlock_lock_irqsave(&tlsf->lock, irqstat);
-  block_head = find_suitable_block(tlsf, n);
-  if (!block_head) {
+  block_head = __tlsf_take_block(tlsf, n);
+  spinlock_unlock_irqrestore(&tlsf->lock, irqstat);
+  if (!block_head && __drain_all_cpucaches(tlsf)) {
+    spinlock_lock_irqsave(&tlsf->lock, irqstat);
+    block_head = __tlsf_take_block(tlsf, n);
     spinlock_unlock_irqrestore(&tlsf->lock, irqstat);
-    goto out;
   }
-
-  size = pages_block_size_get(block_head);
-  ASSERT(size > 0);
-  pages_block_remove(tlsf, block_head);
-  if (size > n) /* split block if necessary */
-    pages_block_insert(tlsf, pages_block_split(tlsf, block_head, size - n));
-
-  pages_block_destroy(block_head);
-  spinlock_unlock_irqrestore(&tlsf->lock, irqstat);
+  if (!block_head)
+    goto out;
 
 init_block:
   list_init_head(list_node2head(&block_head->chain_node));
@@ -791,27 +975,14 @@ static INITCODE int initialize_percpu_cache(cpu_id_t cpuid, void *_tlsf)
 {
   tlsf_t *tlsf = _tlsf;
   tlsf_percpu_cache_t *cache = &tlsf->percpu[cpuid];
-  page_frame_t *pages, *p;
-  list_head_t h;
-  list_node_t *iter, *safe;
+  int i;
 
+  /* Caches are filled on demand by the first allocations */
   memset(cache, 0, sizeof(*cache));
-  list_init_head(&cache->pages);
-  list_init_head(&h);
-  pages = tlsf_alloc_pages(TLSF_CPUCACHE_PAGES, tlsf);
-  if (!pages) {
-    return ERR(-ENOMEM);
-  }
+  for (i = 0; i < TLSF_CPUCACHE_ORDERS; i++)
+    list_init_head(&cache->orders[i].blocks);
 
-  list_set_head(&h, &pages->chain_node);
-  list_for_each_safe(&h, iter, safe) {
-    p = list_entry(iter, page_frame_t, chain_node);
-    list_del(&p->chain_node);
-    PF_MARK_FREE(p);
-    list_add2tail(&cache->pages, &p->node);
-  }
-
-  cache->noc_pages = TLSF_CPUCACHE_PAGES;
+  spinlock_initialize(&cache->lock, "TLSF CPU cache");
   cache->ready = true;
   return 0;
 }
@@ -823,7 +994,10 @@ static inline void check_tlsf_defs(void)
 {
   CT_ASSERT(TLSF_CPUCACHE_PAGES < MAX_BLOCK_SIZE);
   CT_ASSERT(TLSF_CPUCACHE_PAGES > 0);
+  CT_ASSERT(TLSF_CPUCACHE_LOW(TLSF_CPUCACHE_ORDERS - 1) > 0);
   CT_ASSERT(TLSF_FLD_SIZE < TLSF_FLDS_MAX);
+  CT_ASSERT(TLSF_FLD_SIZE <= (sizeof(((tlsf_t *)0)->fld_bitmap) << 3));
+  CT_ASSERT(TLSF_LARGE_BLOCK > (1 << (TLSF_CPUCACHE_ORDERS - 1)));
   CT_ASSERT(TLSF_FIRST_OFFSET > 0);
   CT_ASSERT(TLSF_SLD_BITMAP_SIZE < (sizeof(long) << 3));
   CT_ASSERT((FLD_FPOW2 + TLSF_FIRST_OFFSET) < (sizeof(long) << 3));
@@ -832,6 +1006,23 @@ static inline void check_tlsf_defs(void)
             (TLSF_SLD_SIZE >= TLSF_SLDS_MIN));
 }
 
+static ulong_t tlsf_shrink(shrinker_t *shrinker)
+{
+  ulong_t pages = 0;
+  mmpool_t *p;
+
+  for_each_active_mmpool(p) {
+    if (p->allocator && (p->allocator->alloc_pages == tlsf_alloc_pages))
+      pages += __drain_all_cpucaches(p->alloc_ctx);
+  }
+
+  return pages;
+}
+
+static shrinker_t tlsf_shrinker =
+  SHRINKER_INITIALIZE("TLSF CPU caches", tlsf_shrink, SHRINK_PRIO_ALLOCATOR);
+static bool tlsf_shrinker_registered = false;
+
 static void tlsf_initialize(mmpool_t *pool)
 {
   tlsf_t *tlsf;
@@ -858,6 +1049,12 @@ static void tlsf_initialize(mmpool_t *pool)
     initialize_percpu_cache(cpu, tlsf);
   }
 
+  /* One shrinker serves pools of all TLSF allocators */
+  if (!tlsf_shrinker_registered) {
+    register_shrinker(&tlsf_shrinker);
+    tlsf_shrinker_registered = true;
+  }
+
   kprintf("[MM] Pool \"%s\" initialized TLSF O(1) allocator\n", pool->name);
 }
 
@@ -0,0 +1,60 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * (c) Copyright 2006,2007,2008 MString Core Team <http://mstring.jarios.org>
+ *
+ * mm/scratch.c: Per-task arena of short-lived kernel buffers.
+ *
+ */
+
+#include <config.h>
+#include <mm/page.h>
+#include <mm/page_alloc.h>
+#include <mm/scratch.h>
+#include <mstring/stddef.h>
+#include <mstring/task.h>
+#include <mstring/types.h>
+
+void *scratch_alloc(size_t size)
+{
+  task_t *task = current_task();
+  uintptr_t top;
+
+  if (unlikely(size > SCRATCH_ARENA_SIZE))
+    return NULL;
+  if (unlikely(!task->scratch_arena)) {
+    task->scratch_arena = alloc_pages_addr(SCRATCH_ARENA_PAGES,
+                                           MMPOOL_KERN | AF_CONTIG);
+    if (!task->scratch_arena)
+      return NULL;
+  }
+
+  size = align_up(size, sizeof(long));
+  top = task_scratch_top(task);
+  if (unlikely(size > (SCRATCH_ARENA_SIZE - top)))
+    return NULL;
+
+  task_scratch_top(task) = top + size;
+  return (char *)task->scratch_arena + top;
+}
+
+void scratch_arena_free(task_t *task)
+{
+  if (task->scratch_arena) {
+    free_pages_addr(task->scratch_arena, SCRATCH_ARENA_PAGES);
+    task->scratch_arena = NULL;
+  }
+}
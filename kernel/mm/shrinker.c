@@ -0,0 +1,199 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * (c) Copyright 2006,2007,2008 MString Core Team <http://mstring.jarios.org>
+ *
+ * mm/shrinker.c: Reclaiming memory cached by kernel subsystems when
+ *                free pages are running low.
+ *
+ */
+
+#include <config.h>
+#include <arch/atomic.h>
+#include <arch/interrupt.h>
+#include <ds/list.h>
+#include <mm/mmpool.h>
+#include <mm/shrinker.h>
+#include <sync/spinlock.h>
+#include <sync/mutex.h>
+#include <mstring/event.h>
+#include <mstring/panic.h>
+#include <mstring/scheduler.h>
+#include <mstring/task.h>
+#include <mstring/types.h>
+
+/*
+ * Registration is protected by a spinlock only, so caches may register
+ * their shrinkers during early initialization. Shrinkers are run by
+ * one task at a time, "shrink_mutex" also protects the shrinker being
+ * called from being unregistered.
+ */
+static LIST_DEFINE(shrinkers);
+static SPINLOCK_DEFINE(shrinkers_lock, "Shrinkers");
+static MUTEX_DEFINE(shrink_mutex);
+
+static task_t *reclaim_thread = NULL;
+static event_t reclaim_event;
+static ulong_t reclaim_pending = 0;
+
+static atomic_t reclaim_runs = 0;
+static atomic_t reclaimed_pages = 0;
+
+/* Minimal interval between two reclaim runs. */
+#define RECLAIM_INTERVAL  (HZ / 10)
+
+void register_shrinker(shrinker_t *shrinker)
+{
+  shrinker_t *s;
+
+  shrinker->nr_calls = shrinker->nr_freed = 0;
+  list_init_node(&shrinker->node);
+
+  /* Keep shrinkers sorted by their priorities. */
+  spinlock_lock(&shrinkers_lock);
+  list_for_each_entry(&shrinkers, s, node) {
+    if (s->prio > shrinker->prio) {
+      list_add_before(&s->node, &shrinker->node);
+      goto out;
+    }
+  }
+
+  list_add2tail(&shrinkers, &shrinker->node);
+out:
+  spinlock_unlock(&shrinkers_lock);
+}
+
+void unregister_shrinker(shrinker_t *shrinker)
+{
+  mutex_lock(&shrink_mutex);
+  spinlock_lock(&shrinkers_lock);
+  list_del(&shrinker->node);
+  spinlock_unlock(&shrinkers_lock);
+  mutex_unlock(&shrink_mutex);
+}
+
+static shrinker_t *__next_shrinker(shrinker_t *prev)
+{
+  shrinker_t *s = NULL;
+  list_node_t *n;
+
+  spinlock_lock(&shrinkers_lock);
+  n = prev ? prev->node.next : list_node_first(&shrinkers);
+  if (n != list_head(&shrinkers))
+    s = list_entry(n, shrinker_t, node);
+
+  spinlock_unlock(&shrinkers_lock);
+  return s;
+}
+
+static page_idx_t __total_free_pages(void)
+{
+  page_idx_t total = 0;
+  mmpool_t *p;
+
+  for_each_active_mmpool(p)
+    total += atomic_get(&p->num_free_pages);
+
+  return total;
+}
+
+static bool __under_watermark(void)
+{
+  mmpool_t *p;
+
+  for_each_active_mmpool(p) {
+    if (atomic_get(&p->num_free_pages) < SHRINK_WATERMARK(p))
+      return true;
+  }
+
+  return false;
+}
+
+page_idx_t shrink_memory(void)
+{
+  page_idx_t before, after;
+  shrinker_t *s;
+  ulong_t freed;
+
+  mutex_lock(&shrink_mutex);
+  before = __total_free_pages();
+  for (s = __next_shrinker(NULL); s; s = __next_shrinker(s)) {
+    freed = s->shrink(s);
+    s->nr_calls++;
+    s->nr_freed += freed;
+  }
+
+  /*
+   * Pages may be allocated by other CPUs meanwhile, so this is the
+   * lower bound of the number of pages shrinkers have freed.
+   */
+  after = __total_free_pages();
+  mutex_unlock(&shrink_mutex);
+
+  atomic_inc(&reclaim_runs);
+  if (after <= before)
+    return 0;
+
+  atomic_add(&reclaimed_pages, after - before);
+  return after - before;
+}
+
+void shrinkers_check_watermark(mmpool_t *pool)
+{
+  if (likely(atomic_get(&pool->num_free_pages) >= SHRINK_WATERMARK(pool)))
+    return;
+  if (!reclaim_thread || atomic_test_and_set_bit(&reclaim_pending, 0))
+    return;
+
+  event_raise(&reclaim_event);
+}
+
+static void __reclaim_thread_logic(void *unused)
+{
+  event_set_task(&reclaim_event, current_task());
+  for (;;) {
+    /*
+     * Allocations dropping below the watermark after this point
+     * raise the event again, so the wakeup can't be lost. If nothing
+     * could be reclaimed, we'll wait for the next allocation instead
+     * of spinning.
+     */
+    atomic_bit_clear(&reclaim_pending, 0);
+    if (__under_watermark()) {
+      shrink_memory();
+      sleep(RECLAIM_INTERVAL);
+    }
+
+    event_yield(&reclaim_event);
+  }
+}
+
+void shrinkers_initialize(void)
+{
+  event_initialize(&reclaim_event);
+  if (kernel_thread(__reclaim_thread_logic, NULL, &reclaim_thread) || !reclaim_thread)
+    panic("Can't create memory reclaim thread!\n");
+}
+
+long shrink_reclaimed_pages(void)
+{
+  return atomic_get(&reclaimed_pages);
+}
+
+long shrink_reclaim_runs(void)
+{
+  return atomic_get(&reclaim_runs);
+}
@@ -27,20 +27,40 @@
 #include <mm/page.h>
 #include <mm/page_alloc.h>
 #include <mm/slab.h>
+#include <mm/shrinker.h>
 #include <sync/spinlock.h>
 #include <sync/rwsem.h>
 #include <mstring/errno.h>
 #include <mstring/types.h>
 
-/* POW2 generic memory caches(memalloc allocates memory from them) */
+/* Generic memory caches(memalloc allocates memory from them) */
 static memcache_t *generic_memcaches[SLAB_GENERIC_CACHES];
 
+/* Object sizes of generic memory caches */
+static const int generic_sizes[SLAB_GENERIC_CACHES] = {
+  8, 16, 32, 48, 64, 80, 96, 128, 160, 192, 256,
+  320, 384, 512, 640, 768, 1024,
+};
+
+/*
+ * Index of the smallest generic cache fitting given size. Indexed by size
+ * rounded up to SLAB_OBJECT_MIN_SIZE, so memalloc finds its cache with one
+ * lookup.
+ */
+static uint8_t generic_size_index[(SLAB_OBJECT_MAX_SIZE >> FIRST_GENSLABS_POW2) + 1];
+
+#define __generic_size_index(size)                                      \
+  (generic_size_index[((size) + SLAB_OBJECT_MIN_SIZE - 1) >> FIRST_GENSLABS_POW2])
+
 /* memory cache for memcache_t structures */
 static memcache_t caches_memcache;
 
 /* memory cache for slab_t structures */
 static memcache_t slabs_memcache;
 
+/* Statistics of "heart" caches can't be allocated dynamically */
+static memcache_cpu_stat_t heart_cpu_stats[2][CONFIG_NRCPUS];
+
 /* RW semaphore for protection of memcaches_list */
 static RWSEM_DEFINE(memcaches_rwlock);
 
@@ -55,9 +75,27 @@ static void free_slab_object(slab_t *slab, void *obj);
  * >>> LOCAL LOCKING FUNCTIONS
  */
 
-/* memory cache locking API */
-#define memcache_lock(cache)                            \
-  spinlock_lock_bit(&(cache)->flags, BITNUM(__SMCF_BIT_LOCK))
+#define __memcache_cpu_stat(cache)              \
+  (&(cache)->cpu_stat[cpu_id()])
+
+/* Per-CPU statistics of memory cache take whole pages */
+#define CPU_STAT_PAGES                                                  \
+  (PAGE_ALIGN(sizeof(memcache_cpu_stat_t) * CONFIG_NRCPUS) >> PAGE_WIDTH)
+
+/*
+ * memory cache locking API
+ * The lock bit found already set is counted as contention. Counter is
+ * updated after the lock is taken, so we can't be moved to another CPU.
+ * NOTE: Local interrupts must be disabled !
+ */
+#define memcache_lock(cache)                                            \
+  do {                                                                  \
+    bool __contended = bit_test(&(cache)->flags,                        \
+                                BITNUM(__SMCF_BIT_LOCK));               \
+    spinlock_lock_bit(&(cache)->flags, BITNUM(__SMCF_BIT_LOCK));        \
+    if (unlikely(__contended))                                          \
+      __memcache_cpu_stat(cache)->lock_contentions++;                   \
+  } while (0)
 #define memcache_unlock(cache)                              \
   spinlock_unlock_bit(&(cache)->flags, BITNUM(__SMCF_BIT_LOCK))
 
@@ -290,9 +328,6 @@ inval:
     kprintf("\n");                                          \
   } while (0)
 
-#define memcache_dbg_set_name(memcache, name)   \
-  strncpy((memcache)->name, name, MEMCACHE_DBG_NAME_MAX)
-
 /* display cache statistics */
 #if 0
 static inline void __display_statistics(memcache_t *cache)
@@ -309,7 +344,6 @@ static inline void __display_statistics(memcache_t *cache)
 #define SLAB_DBG_ASSERT(cond)
 #define SLAB_VERBOSE(memcache, fmt, args...)
 #define SLAB_PRINT_ERROR(fmt, args...)
-#define memcache_dbg_set_name(memcache, name)
 #endif /* CONFIG_DEBUG_SLAB */
 
 
@@ -331,6 +365,45 @@ static inline void __display_statistics(memcache_t *cache)
   list_del(&(slab)->pages->node)
 
 
+/***************************************************************
+ * >>> Memory cache statistics
+ */
+
+static long __memcache_objects(memcache_t *memcache)
+{
+  long objects = 0;
+  int c;
+
+  for_each_cpu(c) {
+    objects += memcache->cpu_stat[c].allocs;
+    objects -= memcache->cpu_stat[c].frees;
+  }
+
+  return objects;
+}
+
+/*
+ * High watermark of objects is sampled every time memory cache runs
+ * out of objects of active slab and when statistics are read.
+ * NOTE: memcache must be locked !
+ */
+static inline void __update_max_objects(memcache_t *memcache)
+{
+  long objects = __memcache_objects(memcache);
+
+  if (objects > memcache->stat.max_objects)
+    memcache->stat.max_objects = objects;
+}
+
+static inline void __count_free(memcache_t *memcache)
+{
+  int irqstat;
+
+  interrupts_save_and_disable(irqstat);
+  __memcache_cpu_stat(memcache)->frees++;
+  interrupts_restore(irqstat);
+}
+
 /***************************************************************
  * >>> Miscellaeous slab functions
  */
@@ -560,6 +633,7 @@ static void destroy_slab(slab_t *slab)
     slabs_slab = __slab_get_by_addr(slab);
     slab_dbg_check_page(slabs_slab,
                         (void *)PAGE_ALIGN_DOWN((uintptr_t)slab));    
+    __count_free(&slabs_memcache);
     free_slab_object(slabs_slab, slab);
   }
 
@@ -592,6 +666,7 @@ static void free_slab_object(slab_t *slab, void *obj)
        */
       if (likely(slab->state == SLAB_ACTIVE)) {
         slab_add_free_obj_lazy(slab, obj);
+        __memcache_cpu_stat(memcache)->remote_frees++;
         SLAB_VERBOSE(memcache, ">> (%s) free object %p into lazy freelist of "
                      "percpu slab %p (CPU №%d)\n", memcache->name,
                      obj, slab, cpu_id());
@@ -613,7 +688,7 @@ static void free_slab_object(slab_t *slab, void *obj)
   slab_lock(slab);
   if (unlikely(slab->state == SLAB_ACTIVE)) {
     slab_add_free_obj_lazy(slab, obj);
-    
+    __memcache_cpu_stat(memcache)->remote_frees++;
     SLAB_VERBOSE(memcache, ">> free object %p into lazy freelist of "
                  "percpu slab %p (CPU №%d)\n", obj, slab, cpu_id());
     
@@ -705,14 +780,380 @@ out:
   interrupts_restore(irqstat);
 }
 
+/***************************************************************
+ * >>> Per-CPU magazines and memory cache depot
+ */
+
+/* Set after generic caches are created: magazines are allocated from them. */
+static bool magazines_enabled = false;
+
+#define __get_percpu_mags(memcache)             \
+  (&(memcache)->mags[cpu_id()])
+
+/* Array of per-CPU magazines takes whole pages: it may exceed max slab object */
+#define MAGS_PAGES                                                      \
+  (PAGE_ALIGN(sizeof(memcache_mags_t) * CONFIG_NRCPUS) >> PAGE_WIDTH)
+
+/* NOTE: local interrupts must be disabled */
+#define mags_lock(m)   spinlock_lock(&(m)->lock)
+#define mags_unlock(m) spinlock_unlock(&(m)->lock)
+
+/* NOTE: depot must be locked with local interrupts disabled. */
+#define depot_lock(memcache)                                      \
+  do {                                                            \
+    if (unlikely(!spinlock_trylock(&(memcache)->depot.lock))) {  \
+      __memcache_cpu_stat(memcache)->lock_contentions++;          \
+      spinlock_lock(&(memcache)->depot.lock);                     \
+    }                                                             \
+  } while (0)
+#define depot_unlock(memcache)                  \
+  spinlock_unlock(&(memcache)->depot.lock)
+
+/*
+ * Magazines of small objects hold more rounds. Capacities are chosen
+ * so that a magazine exactly fills an object of a generic cache.
+ */
+static int __default_magazine_size(memcache_t *memcache)
+{
+  size_t bytes;
+
+  if (memcache->object_size <= 128)
+    bytes = 512;
+  else if (memcache->object_size <= 512)
+    bytes = 256;
+  else
+    bytes = 128;
+
+  return (bytes - sizeof(slab_magazine_t)) / sizeof(void *);
+}
+
+static slab_magazine_t *alloc_magazine(int size)
+{
+  slab_magazine_t *mag;
+
+  mag = __memalloc(sizeof(*mag) + size * sizeof(void *), SAF_ATOMIC);
+  if (mag) {
+    mag->rounds = 0;
+    mag->size = size;
+  }
+
+  return mag;
+}
+
+/* Return all objects cached in magazine "mag" to their slabs. */
+static int flush_magazine(slab_magazine_t *mag)
+{
+  int n = mag->rounds;
+  void *obj;
+
+  while (mag->rounds) {
+    obj = mag->objs[--mag->rounds];
+    free_slab_object(__slab_get_by_addr(obj), obj);
+  }
+
+  return n;
+}
+
+/*
+ * Take an object from magazines of current CPU. If both of them are
+ * empty, the previous one is exchanged for a full magazine from the depot.
+ * Returns NULL if depot has no full magazines.
+ * NOTE: Local interrupts must be disabled !
+ */
+static void *magazine_alloc(memcache_t *memcache)
+{
+  memcache_mags_t *m = __get_percpu_mags(memcache);
+  slab_magazine_t *mag, *stale = NULL;
+  void *obj = NULL;
+
+  mags_lock(m);
+  if (likely(m->loaded && m->loaded->rounds))
+    goto pop;
+  if (m->prev && m->prev->rounds) {
+    mag = m->loaded;
+    m->loaded = m->prev;
+    m->prev = mag;
+    goto pop;
+  }
+  if (!memcache->depot.nfull)
+    goto out;
+
+  depot_lock(memcache);
+  if (list_is_empty(&memcache->depot.full)) {
+    depot_unlock(memcache);
+    goto out;
+  }
+
+  mag = list_entry(list_node_first(&memcache->depot.full),
+                   slab_magazine_t, node);
+  list_del(&mag->node);
+  memcache->depot.nfull--;
+  if (m->prev) {
+    /* Magazines of outdated capacity are dropped once they're empty */
+    if (m->prev->size == memcache->mag_size) {
+      list_add2tail(&memcache->depot.empty, &m->prev->node);
+      memcache->depot.nempty++;
+    }
+    else {
+      stale = m->prev;
+    }
+  }
+
+  depot_unlock(memcache);
+  m->prev = m->loaded;
+  m->loaded = mag;
+
+pop:
+  obj = m->loaded->objs[--m->loaded->rounds];
+out:
+  mags_unlock(m);
+  if (unlikely(stale != NULL))
+    memfree(stale);
+
+  return obj;
+}
+
+/*
+ * Put freed object "obj" into magazines of current CPU. When both of them
+ * are full, the previous one goes to the depot and is replaced by an empty
+ * magazine. If the depot already has enough full magazines, objects of the
+ * previous one are returned to their slabs instead.
+ * Returns false if object must be fried to its slab.
+ */
+static bool magazine_free(memcache_t *memcache, void *obj)
+{
+  memcache_mags_t *m;
+  slab_magazine_t *mag;
+  int irqstat, size;
+  bool ret = false;
+
+  if (!memcache->mags || !memcache->mag_size)
+    return false;
+
+  interrupts_save_and_disable(irqstat);
+  m = __get_percpu_mags(memcache);
+  mags_lock(m);
+  for (;;) {
+    if (likely(m->loaded && (m->loaded->rounds < m->loaded->size)))
+      break;
+    if (m->prev && (m->prev->rounds < m->prev->size)) {
+      mag = m->loaded;
+      m->loaded = m->prev;
+      m->prev = mag;
+      break;
+    }
+
+    size = memcache->mag_size;
+    if (!size)
+      goto out;
+
+    if (m->prev) {
+      depot_lock(memcache);
+      if (memcache->depot.nfull < MEMCACHE_DEPOT_FULL_MAX) {
+        list_add2tail(&memcache->depot.full, &m->prev->node);
+        memcache->depot.nfull++;
+        m->prev = NULL;
+      }
+
+      depot_unlock(memcache);
+      if (m->prev) {
+        flush_magazine(m->prev);
+        continue;
+      }
+    }
+
+    mag = NULL;
+    depot_lock(memcache);
+    if (!list_is_empty(&memcache->depot.empty)) {
+      mag = list_entry(list_node_first(&memcache->depot.empty),
+                       slab_magazine_t, node);
+      list_del(&mag->node);
+      memcache->depot.nempty--;
+    }
+
+    depot_unlock(memcache);
+    if (!mag) {
+      mags_unlock(m);
+      interrupts_restore(irqstat);
+      mag = alloc_magazine(size);
+      interrupts_save_and_disable(irqstat);
+
+      /* We might be moved to another CPU meanwhile */
+      m = __get_percpu_mags(memcache);
+      mags_lock(m);
+      if (!mag)
+        goto out;
+    }
+    if (!m->prev) {
+      m->prev = m->loaded;
+      m->loaded = mag;
+    }
+    else {
+      depot_lock(memcache);
+      list_add2tail(&memcache->depot.empty, &mag->node);
+      memcache->depot.nempty++;
+      depot_unlock(memcache);
+    }
+  }
+
+  m->loaded->objs[m->loaded->rounds++] = obj;
+  ret = true;
+
+out:
+  mags_unlock(m);
+  interrupts_restore(irqstat);
+  return ret;
+}
+
+int memcache_set_magazine_size(memcache_t *memcache, int size)
+{
+  memcache_mags_t *mags = NULL;
+  list_head_t stale;
+  slab_magazine_t *mag;
+  int irqstat, c;
+
+  if ((size < 0) || (size > SLAB_MAGAZINE_MAX))
+    return -EINVAL;
+  if (!memcache->mags && size) {
+    mags = alloc_pages_addr(MAGS_PAGES, MMPOOL_KERN | AF_CONTIG | AF_ZERO);
+    if (!mags)
+      return -ENOMEM;
+
+    for (c = 0; c < CONFIG_NRCPUS; c++)
+      spinlock_initialize(&mags[c].lock, "Memcache magazines");
+  }
+
+  list_init_head(&stale);
+  interrupts_save_and_disable(irqstat);
+  depot_lock(memcache);
+  memcache->mag_size = size;
+  if (mags && !memcache->mags) {
+    memcache->mags = mags;
+    mags = NULL;
+  }
+
+  /* Empty magazines of old capacity aren't needed anymore */
+  if (!list_is_empty(&memcache->depot.empty)) {
+    list_move2tail(&stale, &memcache->depot.empty);
+    memcache->depot.nempty = 0;
+  }
+
+  depot_unlock(memcache);
+  interrupts_restore(irqstat);
+
+  while (!list_is_empty(&stale)) {
+    mag = list_entry(list_node_first(&stale), slab_magazine_t, node);
+    list_del(&mag->node);
+    memfree(mag);
+  }
+  if (mags)
+    free_pages_addr(mags, MAGS_PAGES);
+
+  return 0;
+}
+
+int memcache_drain_magazines(memcache_t *memcache)
+{
+  list_head_t full, empty;
+  slab_magazine_t *mag;
+  memcache_mags_t *m;
+  int irqstat, c, n = 0;
+
+  if (!memcache->mags)
+    return 0;
+
+  list_init_head(&full);
+  list_init_head(&empty);
+  /* Take the magazines of all CPUs, they get new ones on demand. */
+  for_each_cpu(c) {
+    m = &memcache->mags[c];
+    interrupts_save_and_disable(irqstat);
+    mags_lock(m);
+    if (m->loaded)
+      list_add2tail(&full, &m->loaded->node);
+    if (m->prev)
+      list_add2tail(&full, &m->prev->node);
+
+    m->loaded = m->prev = NULL;
+    mags_unlock(m);
+    interrupts_restore(irqstat);
+  }
+
+  interrupts_save_and_disable(irqstat);
+  depot_lock(memcache);
+  if (!list_is_empty(&memcache->depot.full)) {
+    list_move2tail(&full, &memcache->depot.full);
+    memcache->depot.nfull = 0;
+  }
+  if (!list_is_empty(&memcache->depot.empty)) {
+    list_move2tail(&empty, &memcache->depot.empty);
+    memcache->depot.nempty = 0;
+  }
+
+  depot_unlock(memcache);
+  interrupts_restore(irqstat);
+
+  while (!list_is_empty(&full)) {
+    mag = list_entry(list_node_first(&full), slab_magazine_t, node);
+    list_del(&mag->node);
+    n += flush_magazine(mag);
+    memfree(mag);
+  }
+  while (!list_is_empty(&empty)) {
+    mag = list_entry(list_node_first(&empty), slab_magazine_t, node);
+    list_del(&mag->node);
+    memfree(mag);
+  }
+
+  return n;
+}
+
+/*
+ * Free magazines of memory cache that is being destroyed. Cached objects
+ * needn't be returned: their slabs are destroyed anyway.
+ */
+static void destroy_magazines(memcache_t *memcache)
+{
+  slab_magazine_t *mag;
+  list_node_t *n, *safe;
+  int c;
+
+  if (!memcache->mags)
+    return;
+
+  for_each_cpu(c) {
+    if (memcache->mags[c].loaded)
+      memfree(memcache->mags[c].loaded);
+    if (memcache->mags[c].prev)
+      memfree(memcache->mags[c].prev);
+  }
+
+  list_for_each_safe(&memcache->depot.full, n, safe) {
+    mag = list_entry(n, slab_magazine_t, node);
+    memfree(mag);
+  }
+  list_for_each_safe(&memcache->depot.empty, n, safe) {
+    mag = list_entry(n, slab_magazine_t, node);
+    memfree(mag);
+  }
+
+  free_pages_addr(memcache->mags, MAGS_PAGES);
+  memcache->mags = NULL;
+}
+
 static void prepare_memcache(memcache_t *cache, size_t object_size,
-                             int pages_per_slab)
+                             int pages_per_slab, memcache_cpu_stat_t *cpu_stat)
 {
   memset(cache, 0, sizeof(*cache));
+  memset(cpu_stat, 0, sizeof(*cpu_stat) * CONFIG_NRCPUS);
+  cache->cpu_stat = cpu_stat;
   cache->object_size = object_size;
   cache->pages_per_slab = pages_per_slab;
   list_init_head(&cache->avail_slabs);
   list_init_head(&cache->full_slabs);
+  list_init_head(&cache->depot.full);
+  list_init_head(&cache->depot.empty);
+  spinlock_initialize(&cache->depot.lock, "Memory cache depot");
   cache->usecount = 1;
 }
 
@@ -725,7 +1166,7 @@ static void register_memcache(memcache_t *memcache, const char *name)
   memcache_t *c;
   bool added = false;
   
-  memcache_dbg_set_name(memcache, name);
+  strncpy(memcache->name, name, MEMCACHE_NAME_MAX - 1);
   memcache_dbg_set_version(memcache);
   rwsem_down_write(&memcaches_rwlock);
   list_for_each_entry(&memcaches_list, c, memcache_node) {
@@ -795,7 +1236,7 @@ static inline slab_t *try_get_avail_slab(memcache_t *memcache)
  * one for slab_t strcures.
  */
 static void __create_heart_cache(memcache_t *cache, size_t size,
-                                 const char *name)
+                                 const char *name, memcache_cpu_stat_t *cpu_stat)
 {
   int ret, i;
 
@@ -806,7 +1247,7 @@ static void __create_heart_cache(memcache_t *cache, size_t size,
    * All "heart" caches are predefined, so we don't need to allocate
    * them dynamically.
    */
-  prepare_memcache(cache, size, GENERIC_SLAB_PAGES);
+  prepare_memcache(cache, size, GENERIC_SLAB_PAGES, cpu_stat);
   cache->flags = MMPOOL_KERN | SMCF_IMMORTAL | SMCF_UNIQUE;
   bit_clear(&cache->flags, BITNUM(__SMCF_BIT_LOCK));
   
@@ -857,43 +1298,108 @@ err:
 }
 
 /*
- * Generic memory caches are a set of caches with sizes equal to
- * multiple of power of 2. These caches are used by memalloc function,
- * which tries to find out generic memory cache of size greater or equal
- * to requested one.
- * There is constant number of generic caches in a system equals to number
- * of all power of 2 in a range [SLAB_OBJECT_MIN_SIZE, SLAB_OBJECT_MAX_SIZE].
+ * Generic memory caches are a set of caches with sizes from generic_sizes
+ * table. These caches are used by memalloc function, which takes the
+ * smallest generic cache fitting requested size. Intermediate size classes
+ * between powers of 2 bound internal fragmentation by 25%
+ * (50% with power of 2 caches only).
  */
 static void __create_generic_caches(void)
 {
-  size_t size = SLAB_OBJECT_MIN_SIZE;
-  int i = 0;
-  char cache_name[16] = "size ";
+  size_t size, slot = 0;
+  int i;
+  char cache_name[16];
 
-  ASSERT(is_powerof2(SLAB_OBJECT_MAX_SIZE));
+  CT_ASSERT(ARRAY_SIZE(generic_sizes) == SLAB_GENERIC_CACHES);
   memset(generic_memcaches, 0, sizeof(*generic_memcaches) *
          SLAB_GENERIC_CACHES);
-  while (size <= SLAB_OBJECT_MAX_SIZE) {
+  for (i = 0; i < SLAB_GENERIC_CACHES; i++) {
+    size = generic_sizes[i];
     ASSERT((size >= SLAB_OBJECT_MIN_SIZE) &&
            (size <= SLAB_OBJECT_MAX_SIZE));
+    ASSERT(!(size & (SLAB_OBJECT_MIN_SIZE - 1)));
 
-    sprintf(cache_name + 5, "%3d", size);
-    *(cache_name + 9) = '\0';
-
+    sprintf(cache_name, "size %zd", size);
     generic_memcaches[i] = create_memcache(cache_name, size, 1,
                                            MMPOOL_KERN | SMCF_IMMORTAL);
     if (!generic_memcaches[i])
       panic("Can't greate generic cache for size %zd: (ENOMEM)", size);
 
-    size <<= 1;
-    i++;
+    while ((slot << FIRST_GENSLABS_POW2) <= size)
+      generic_size_index[slot++] = i;
   }
 
-  return;
+  ASSERT(generic_sizes[SLAB_GENERIC_CACHES - 1] == SLAB_OBJECT_MAX_SIZE);
+}
+
+/*
+ * Detach one empty slab from avail_slabs list of memory cache "memcache".
+ * Empty slabs are always placed at the tail of the list.
+ */
+static slab_t *try_get_empty_slab(memcache_t *memcache)
+{
+  slab_t *slab = NULL;
+  page_frame_t *p;
+  int irqstat;
+
+  interrupts_save_and_disable(irqstat);
+  memcache_lock(memcache);
+  if (list_is_empty(&memcache->avail_slabs))
+    goto out;
+
+  p = list_entry(list_node_last(&memcache->avail_slabs),
+                 page_frame_t, node);
+  slab = __page2slab(p);
+  slab_lock(slab);
+  if (slab->state != SLAB_EMPTY) {
+    slab_unlock(slab);
+    slab = NULL;
+    goto out;
+  }
+
+  slab_unregister_empty(slab);
+  memcache->stat.nempty_slabs--;
+  memcache->stat.nslabs--;
+  SLAB_VERBOSE(memcache, ">> (%s) reclaim empty slab %p. "
+               "%d empty slabs rest.\n", memcache->name, slab,
+               memcache->stat.nempty_slabs);
+  slab_unlock(slab);
+out:
+  memcache_unlock(memcache);
+  interrupts_restore(irqstat);
+  return slab;
+}
+
+/*
+ * Return objects cached in magazines back to their slabs and free
+ * all empty slabs of all memory caches.
+ */
+static ulong_t slab_shrink(shrinker_t *shrinker)
+{
+  memcache_t *memcache;
+  slab_t *slab;
+  ulong_t pages = 0;
+
+  rwsem_down_read(&memcaches_rwlock);
+  list_for_each_entry(&memcaches_list, memcache, memcache_node) {
+    memcache_drain_magazines(memcache);
+    while ((slab = try_get_empty_slab(memcache)) != NULL) {
+      destroy_slab(slab);
+      pages += memcache->pages_per_slab;
+    }
+  }
+
+  rwsem_up_read(&memcaches_rwlock);
+  return pages;
 }
 
+static shrinker_t slab_shrinker =
+  SHRINKER_INITIALIZE("slab", slab_shrink, SHRINK_PRIO_PAGES);
+
 void slab_allocator_init(void)
 {
+  int i;
+
   kprintf("[MM] Initializing slab allocator\n");
 
   CT_ASSERT(sizeof(atomic_t) >= sizeof(uintptr_t));
@@ -901,11 +1407,22 @@ void slab_allocator_init(void)
   CT_ASSERT((1 << LAST_GENSLABS_POW2) == SLAB_OBJECT_MAX_SIZE);
 
   /* create default cache for slab_t structures */  
-  __create_heart_cache(&slabs_memcache, sizeof(slab_t), "slab_t");
+  __create_heart_cache(&slabs_memcache, sizeof(slab_t), "slab_t",
+                       heart_cpu_stats[0]);
   
   /* create default cache for memcache_t structures */
-  __create_heart_cache(&caches_memcache, sizeof(memcache_t), "memcache_t");  
+  __create_heart_cache(&caches_memcache, sizeof(memcache_t), "memcache_t",
+                       heart_cpu_stats[1]);
   __create_generic_caches();
+
+  /* Now magazines may be allocated from generic caches */
+  magazines_enabled = true;
+  for (i = 0; i < SLAB_GENERIC_CACHES; i++) {
+    memcache_set_magazine_size(generic_memcaches[i],
+                               __default_magazine_size(generic_memcaches[i]));
+  }
+
+  register_shrinker(&slab_shrinker);
 }
 
 int destroy_memcache(memcache_t *memcache)
@@ -928,6 +1445,8 @@ int destroy_memcache(memcache_t *memcache)
   }
   
   rwsem_up_write(&memcaches_rwlock);
+  destroy_magazines(memcache);
+
   /* Drop per-cpu slabs */
   for_each_cpu(c) {
     if (memcache->active_slabs[c])
@@ -947,6 +1466,7 @@ int destroy_memcache(memcache_t *memcache)
   }
 
   /* Finally, destroy the memcache itself */
+  free_pages_addr(memcache->cpu_stat, CPU_STAT_PAGES);
   memfree(memcache);  
   return 0;
 }
@@ -956,6 +1476,7 @@ memcache_t *create_memcache(const char *name, size_t size,
                             int pages, memcache_flags_t flags)
 {
   memcache_t *memcache = NULL;
+  memcache_cpu_stat_t *cpu_stat;
 
   flags &= SMCF_MASK;
   if (size < SLAB_OBJECT_MIN_SIZE) {
@@ -1000,13 +1521,20 @@ memcache_t *create_memcache(const char *name, size_t size,
 
   
   memcache = alloc_from_memcache(&caches_memcache, 0);
-  if (!memcache) {
+  cpu_stat = alloc_pages_addr(CPU_STAT_PAGES, MMPOOL_KERN | AF_CONTIG);
+  if (!memcache || !cpu_stat) {
     SLAB_PRINT_ERROR("Failed to allocate memory cache \"%s\" of size %zd. "
                      "ENOMEM\n", name, size);
+    if (memcache)
+      memfree(memcache);
+    if (cpu_stat)
+      free_pages_addr(cpu_stat, CPU_STAT_PAGES);
+
+    memcache = NULL;
     goto out;
   }
 
-  prepare_memcache(memcache, size, pages);
+  prepare_memcache(memcache, size, pages, cpu_stat);
   memcache->flags = flags;
   bit_clear(&memcache->flags, BITNUM(__SMCF_BIT_LOCK));
   register_memcache(memcache, name);
@@ -1033,6 +1561,10 @@ memcache_t *create_memcache(const char *name, size_t size,
       memcache->active_slabs[c] = slab;
     }
   }
+
+  /* Caching of freed objects is an optimization: failure isn't fatal */
+  if (magazines_enabled)
+    memcache_set_magazine_size(memcache, __default_magazine_size(memcache));
     
 out:
   return memcache;
@@ -1042,6 +1574,46 @@ error:
   return NULL;
 }
 
+int memcaches_walk_stats(int (*fn)(kcontrol_memcache_stat_t *stat, void *ctx),
+                         void *ctx)
+{
+  kcontrol_memcache_stat_t stat;
+  memcache_t *memcache;
+  int c, irqstat, ret = 0;
+
+  rwsem_down_read(&memcaches_rwlock);
+  list_for_each_entry(&memcaches_list, memcache, memcache_node) {
+    memset(&stat, 0, sizeof(stat));
+    strncpy(stat.name, memcache->name, KCTRL_STAT_NAME_LEN - 1);
+    stat.object_size = memcache->object_size;
+    for_each_cpu(c) {
+      stat.allocs += memcache->cpu_stat[c].allocs;
+      stat.frees += memcache->cpu_stat[c].frees;
+      stat.remote_frees += memcache->cpu_stat[c].remote_frees;
+      stat.lock_contentions += memcache->cpu_stat[c].lock_contentions;
+    }
+
+    interrupts_save_and_disable(irqstat);
+    memcache_lock(memcache);
+    __update_max_objects(memcache);
+    stat.max_objects = memcache->stat.max_objects;
+    stat.nslabs = memcache->stat.nslabs;
+    memcache_unlock(memcache);
+    interrupts_restore(irqstat);
+
+    /* Counters of other CPUs are read without locking */
+    if (stat.allocs > stat.frees)
+      stat.objects = stat.allocs - stat.frees;
+
+    ret = fn(&stat, ctx);
+    if (ret)
+      break;
+  }
+
+  rwsem_up_read(&memcaches_rwlock);
+  return ret;
+}
+
 void *alloc_from_memcache(memcache_t *memcache, int alloc_flags)
 {
   slab_t *slab, *slab_tmp;
@@ -1050,6 +1622,15 @@ void *alloc_from_memcache(memcache_t *memcache, int alloc_flags)
 
   SLAB_DBG_ASSERT(memcache != NULL);
   interrupts_save_and_disable(irqstat);
+  if (memcache->mags) {
+    obj = magazine_alloc(memcache);
+    if (likely(obj != NULL)) {
+      __memcache_cpu_stat(memcache)->allocs++;
+      interrupts_restore(irqstat);
+      goto out;
+    }
+  }
+
   slab = __get_percpu_slab(memcache);
   if (unlikely(slab == NULL)) {
     memcache_lock(memcache);
@@ -1084,6 +1665,7 @@ void *alloc_from_memcache(memcache_t *memcache, int alloc_flags)
                __slab_state_to_string(SLAB_FULL));
 
 take_new_slab:
+  __update_max_objects(memcache);
   slab = try_get_avail_slab(memcache);
   if (slab) {
     memcache_unlock(memcache);
@@ -1147,6 +1729,7 @@ take_new_slab:
 
 alloc_obj:
   obj = slab_get_free_obj(slab);
+  __memcache_cpu_stat(memcache)->allocs++;
   interrupts_restore(irqstat);
 
   /*SLAB_VERBOSE(memcache, ">> (%s) Allocated object %p from slab %p "
@@ -1154,7 +1737,8 @@ alloc_obj:
   
   slab_dbg_check_page(slab, (void *)PAGE_ALIGN_DOWN((uintptr_t)obj));
   slab_dbg_check_object(slab, obj);
-  
+
+out:
   if (alloc_flags & SAF_MEMNULL) {
     memset(obj, 0, memcache->object_size);
   }
@@ -1164,25 +1748,14 @@ alloc_obj:
 
 void *__memalloc(size_t size, int alloc_flags)
 {
-  int idx = bit_find_msf(size);
-
-  if (!is_powerof2(size))
-    idx++;
-  if ((idx < 0) || (idx > LAST_GENSLABS_POW2)) {
-    SLAB_PRINT_ERROR(NULL, ">> Failed to allocate object of size %zd.\n"
-                     "  --> ((idx < 0) || (idx > LAST_GENSLABS_POW2))\n",
-                     size);
+  if (unlikely(size > SLAB_OBJECT_MAX_SIZE)) {
+    SLAB_PRINT_ERROR(">> Failed to allocate object of size %zd.\n"
+                     "  --> (size > SLAB_OBJECT_MAX_SIZE)\n", size);
     return NULL;
   }
 
-  if (idx > FIRST_GENSLABS_POW2) {
-    idx -= FIRST_GENSLABS_POW2;
-  }
-  else {
-    idx = 0;
-  }
-
-  return alloc_from_memcache(generic_memcaches[idx], alloc_flags);
+  return alloc_from_memcache(generic_memcaches[__generic_size_index(size)],
+                             alloc_flags);
 }
 
 void *memalloc(size_t size)
@@ -1197,7 +1770,15 @@ void memfree(void *mem)
   slab_dbg_check_address(mem);
   slab = __slab_get_by_addr(mem);
   slab_dbg_check_page(slab, (void *)PAGE_ALIGN_DOWN((uintptr_t)mem));
-  free_slab_object(slab, mem);
+  __count_free(slab->memcache);
+  if (!magazine_free(slab->memcache, mem))
+    free_slab_object(slab, mem);
+}
+
+void free_to_memcache(memcache_t *cache, void *obj)
+{
+  ASSERT(__slab_get_by_addr(obj)->memcache == cache);
+  memfree(obj);
 }
 
 #if 0 /* TODO DK! */
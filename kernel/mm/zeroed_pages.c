@@ -0,0 +1,224 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * (c) Copyright 2006,2007,2008 MString Core Team <http://mstring.jarios.org>
+ *
+ * mm/zeroed_pages.c: Per-CPU caches of pages zeroed in advance for
+ *                    AF_ZERO allocations.
+ *
+ */
+
+#include <config.h>
+#include <arch/atomic.h>
+#include <arch/interrupt.h>
+#include <ds/list.h>
+#include <mm/page.h>
+#include <mm/mmpool.h>
+#include <mm/page_alloc.h>
+#include <mm/shrinker.h>
+#include <sync/spinlock.h>
+#include <mstring/smp.h>
+#include <mstring/panic.h>
+#include <mstring/string.h>
+#include <mstring/scheduler.h>
+#include <mstring/sched_default.h>
+#include <mstring/task.h>
+#include <mstring/types.h>
+
+/*
+ * Each CPU has a low-priority thread which keeps ZEROED_PAGES_PERCPU
+ * pages of preferred kernel and user pools zeroed in advance. Pages
+ * are zeroed with non-temporal stores, so filling the caches doesn't
+ * evict useful data from CPU caches.
+ */
+#define ZEROED_PAGES_PERCPU 32
+#define ZEROING_INTERVAL    (HZ / 10)
+
+typedef struct zeroed_pages_cache {
+  spinlock_t lock;
+  list_head_t pages[ARCH_NUM_MMPOOLS]; /* Zeroed pages linked via "node" */
+  int nr_pages[ARCH_NUM_MMPOOLS];
+  ulong_t hits;                        /* AF_ZERO pages taken pre-zeroed */
+  ulong_t misses;                      /* AF_ZERO pages zeroed on demand */
+} zeroed_pages_cache_t;
+
+static zeroed_pages_cache_t PER_CPU_VAR(zeroed_caches);
+static bool zeroed_caches_ready = false;
+
+#define __pool_idx(pool) ((pool)->type - MMPOOL_FIRST_TYPE)
+
+page_frame_t *get_zeroed_page(mmpool_t *pool)
+{
+  zeroed_pages_cache_t *zc;
+  page_frame_t *page = NULL;
+  int idx = __pool_idx(pool), irqstat;
+
+  if (unlikely(!zeroed_caches_ready))
+    return NULL;
+
+  zc = percpu_get_var(zeroed_caches);
+  spinlock_lock_irqsave(&zc->lock, irqstat);
+  if (zc->nr_pages[idx]) {
+    page = list_entry(list_node_first(&zc->pages[idx]), page_frame_t, node);
+    list_del(&page->node);
+    zc->nr_pages[idx]--;
+    zc->hits++;
+  }
+
+  spinlock_unlock_irqrestore(&zc->lock, irqstat);
+  return page;
+}
+
+void zeroed_pages_count_misses(page_idx_t num_pages)
+{
+  zeroed_pages_cache_t *zc;
+  int irqstat;
+
+  if (unlikely(!zeroed_caches_ready))
+    return;
+
+  zc = percpu_get_var(zeroed_caches);
+  spinlock_lock_irqsave(&zc->lock, irqstat);
+  zc->misses += num_pages;
+  spinlock_unlock_irqrestore(&zc->lock, irqstat);
+}
+
+/* Zeroing threads are bound to their CPUs, so local pools never change */
+static bool __is_zeroed_pool(mmpool_t *pool)
+{
+  return ((pool == mmpool_get_local(PREF_MMPOOL_KERN)) ||
+          (pool == mmpool_get_local(PREF_MMPOOL_USER)));
+}
+
+static void __fill_zeroed_cache(zeroed_pages_cache_t *zc, mmpool_t *pool)
+{
+  int idx = __pool_idx(pool), irqstat;
+  page_frame_t *page;
+
+  while (zc->nr_pages[idx] < ZEROED_PAGES_PERCPU) {
+    /* Don't hold pages back when memory is running low */
+    if (atomic_get(&pool->num_free_pages) < (SHRINK_WATERMARK(pool) << 1))
+      break;
+
+    page = mmpool_alloc_pages(pool, 1);
+    if (!page)
+      break;
+
+    atomic_sub(&pool->num_free_pages, 1);
+    memset_nt(pframe_to_virt(page), 0, PAGE_SIZE);
+
+    spinlock_lock_irqsave(&zc->lock, irqstat);
+    list_add2tail(&zc->pages[idx], &page->node);
+    zc->nr_pages[idx]++;
+    spinlock_unlock_irqrestore(&zc->lock, irqstat);
+  }
+}
+
+void zeroing_thread(void *data)
+{
+  zeroed_pages_cache_t *zc = percpu_get_var(zeroed_caches);
+  mmpool_t *pool;
+
+  /* Zero pages only when CPU has nothing better to do. */
+  if (do_scheduler_control(current_task(), SYS_SCHED_CTL_SET_PRIORITY,
+                           EZA_SCHED_PRIORITY_MAX)) {
+    panic("CPU #%d: zeroing_thread can't set its priority!\n", cpu_id());
+  }
+
+  for (;;) {
+    for_each_active_mmpool(pool) {
+      if (__is_zeroed_pool(pool))
+        __fill_zeroed_cache(zc, pool);
+    }
+
+    sleep(ZEROING_INTERVAL);
+  }
+}
+
+/* Return all pre-zeroed pages to their pools */
+static ulong_t zeroed_pages_shrink(shrinker_t *shrinker)
+{
+  zeroed_pages_cache_t *zc;
+  page_frame_t *page;
+  list_head_t pages;
+  ulong_t n = 0;
+  int i, irqstat;
+
+  for_each_percpu_var(zc, zeroed_caches) {
+    for (i = 0; i < ARCH_NUM_MMPOOLS; i++) {
+      list_init_head(&pages);
+      spinlock_lock_irqsave(&zc->lock, irqstat);
+      if (zc->nr_pages[i]) {
+        list_move2head(&pages, &zc->pages[i]);
+        zc->nr_pages[i] = 0;
+      }
+
+      spinlock_unlock_irqrestore(&zc->lock, irqstat);
+      while (!list_is_empty(&pages)) {
+        page = list_entry(list_node_first(&pages), page_frame_t, node);
+        list_del(&page->node);
+        free_page(page);
+        n++;
+      }
+    }
+  }
+
+  return n;
+}
+
+static shrinker_t zeroed_pages_shrinker =
+  SHRINKER_INITIALIZE("zeroed pages", zeroed_pages_shrink, SHRINK_PRIO_PAGES);
+
+void zeroed_pages_initialize(void)
+{
+  zeroed_pages_cache_t *zc;
+  int i;
+
+  for_each_percpu_var(zc, zeroed_caches) {
+    spinlock_initialize(&zc->lock, "Zeroed pages");
+    for (i = 0; i < ARCH_NUM_MMPOOLS; i++) {
+      list_init_head(&zc->pages[i]);
+      zc->nr_pages[i] = 0;
+    }
+
+    zc->hits = zc->misses = 0;
+  }
+
+  register_shrinker(&zeroed_pages_shrinker);
+  zeroed_caches_ready = true;
+}
+
+long zeroed_pages_hits(void)
+{
+  zeroed_pages_cache_t *zc;
+  long n = 0;
+
+  for_each_percpu_var(zc, zeroed_caches)
+    n += zc->hits;
+
+  return n;
+}
+
+long zeroed_pages_misses(void)
+{
+  zeroed_pages_cache_t *zc;
+  long n = 0;
+
+  for_each_percpu_var(zc, zeroed_caches)
+    n += zc->misses;
+
+  return n;
+}
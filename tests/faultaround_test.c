@@ -0,0 +1,348 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * (c) Copyright 2006,2007,2008 MString Core Team <http://mstring.jarios.org>
+ *
+ * tests/faultaround_test.c: Number of page faults and time of sequential
+ *                           scan of a mapping with and without fault-around.
+ */
+
+#include <config.h>
+#include <test.h>
+#include <mm/page.h>
+#include <mm/mem.h>
+#include <mm/vmm.h>
+#include <mm/memobj.h>
+#include <mm/rmap.h>
+#include <mstring/task.h>
+#include <mstring/time.h>
+#include <kernel/syscalls.h>
+#include <mstring/types.h>
+
+#define FAULTAROUND_TEST_ID "Fault-around test"
+
+#define SCAN_PAGES (MB2B(64UL) >> PAGE_WIDTH)
+#define SHARED_PAGES 16
+
+static bool finished = false;
+
+typedef struct __scan_result {
+  ulong_t faults;
+  uint64_t ticks;
+} scan_result_t;
+
+/*
+ * Touch each page of [addr, addr + SCAN_PAGES) like a sequential scan does:
+ * the fault handler is called only for pages which aren't mapped yet.
+ */
+static void __scan(test_framework_t *tf, vmm_t *vmm, uintptr_t addr,
+                   uint32_t pfmask, scan_result_t *res)
+{
+  uint64_t start = system_ticks;
+  page_idx_t i, pidx;
+  volatile long *p;
+  uintptr_t a;
+  int ret;
+
+  res->faults = 0;
+  for (i = 0; i < SCAN_PAGES; i++) {
+    a = addr + ((uintptr_t)i << PAGE_WIDTH);
+    RPD_LOCK_READ(&vmm->rpd);
+    pidx = vaddr_to_pidx(&vmm->rpd, a);
+    RPD_UNLOCK_READ(&vmm->rpd);
+    if (pidx == PAGE_IDX_INVAL) {
+      ret = vmm_handle_page_fault(vmm, a, PFLT_NOT_PRESENT | pfmask);
+      if (ret) {
+        tf->printf("Failed to handle #PF on %p: %d\n", a, ret);
+        tf->failed();
+        break;
+      }
+
+      res->faults++;
+      RPD_LOCK_READ(&vmm->rpd);
+      pidx = vaddr_to_pidx(&vmm->rpd, a);
+      RPD_UNLOCK_READ(&vmm->rpd);
+      if (pidx == PAGE_IDX_INVAL) {
+        tf->printf("Page on %p isn't mapped after #PF\n", a);
+        tf->failed();
+        break;
+      }
+    }
+
+    p = pframe_to_virt(pframe_by_id(pidx));
+    if (pfmask & PFLT_WRITE)
+      *p = i;
+    else
+      (void)*p;
+  }
+
+  res->ticks = system_ticks - start;
+}
+
+static long __map(test_framework_t *tf, vmm_t *vmm, memobj_t *memobj,
+                  vmrange_flags_t flags)
+{
+  long addr;
+
+  rwsem_down_write(&vmm->rwsem);
+  addr = vmrange_map(memobj, vmm, 0, SCAN_PAGES, flags, 0);
+  rwsem_up_write(&vmm->rwsem);
+  if (addr < 0) {
+    tf->printf("Can't map %d pages: %d\n", SCAN_PAGES, addr);
+    tf->abort();
+  }
+
+  return addr;
+}
+
+static void __unmap(vmm_t *vmm, uintptr_t addr)
+{
+  rwsem_down_write(&vmm->rwsem);
+  unmap_vmranges(vmm, addr, SCAN_PAGES);
+  rwsem_up_write(&vmm->rwsem);
+}
+
+static void __report(test_framework_t *tf, const char *what,
+                     page_idx_t window, scan_result_t *res)
+{
+  tf->printf("%s, window %d: %d faults, %d ms\n", what, window,
+             res->faults, (res->ticks * 1000) / HZ);
+}
+
+static void __check_faults(test_framework_t *tf, page_idx_t window,
+                           scan_result_t *res)
+{
+  /* Mapping may be not aligned to the window */
+  if (res->faults > (SCAN_PAGES / window) + 1) {
+    tf->printf("%d faults with window of %d pages, expected at most %d\n",
+               res->faults, window, (SCAN_PAGES / window) + 1);
+    tf->failed();
+  }
+}
+
+static void tc_pagecache(test_framework_t *tf, vmm_t *vmm)
+{
+  scan_result_t res;
+  memobj_t *memobj;
+  long addr;
+  int ret;
+
+  ret = memobj_create(MMO_NTR_PCACHE, MMO_FLG_SHARED, SCAN_PAGES, &memobj);
+  if (ret) {
+    tf->printf("Can't create pagecache memory object: %d\n", ret);
+    tf->abort();
+  }
+
+  /* Keep the object and its cache while it's remapped */
+  pin_memobj(memobj);
+
+  /* Cache is empty, each page is allocated on its own fault */
+  addr = __map(tf, vmm, memobj, VMR_READ | VMR_SHARED);
+  __scan(tf, vmm, addr, PFLT_READ, &res);
+  __report(tf, "Cold pagecache", memobj->fault_around, &res);
+  if (res.faults != SCAN_PAGES) {
+    tf->printf("Expected %d faults on cold cache, got %d\n",
+               SCAN_PAGES, res.faults);
+    tf->failed();
+  }
+
+  __unmap(vmm, addr);
+  addr = __map(tf, vmm, memobj, VMR_READ | VMR_SHARED);
+  vmrange_set_fault_around(vmm, addr, 0);
+  __scan(tf, vmm, addr, PFLT_READ, &res);
+  __report(tf, "Warm pagecache", 0, &res);
+  __check_faults(tf, 1, &res);
+
+  __unmap(vmm, addr);
+  addr = __map(tf, vmm, memobj, VMR_READ | VMR_SHARED);
+  __scan(tf, vmm, addr, PFLT_READ, &res);
+  __report(tf, "Warm pagecache", memobj->fault_around, &res);
+  __check_faults(tf, memobj->fault_around, &res);
+
+  __unmap(vmm, addr);
+  unpin_memobj(memobj);
+}
+
+/* Returns number of rmap entries of the page mapped on @addr */
+static int __rmap_locations(vmm_t *vmm, uintptr_t addr, bool *writable)
+{
+  page_frame_t *page;
+  page_idx_t pidx;
+  pde_t *pde;
+  int n = -1;
+
+  RPD_LOCK_READ(&vmm->rpd);
+  pidx = __vaddr_to_pidx(&vmm->rpd, addr, &pde);
+  if (pidx != PAGE_IDX_INVAL) {
+    page = pframe_by_id(pidx);
+    *writable = !!(ptable_to_kmap_flags(pde_get_flags(pde)) & KMAP_WRITE);
+    n = page->rmap_shared ? page->rmap_shared->num_locations : 0;
+  }
+  RPD_UNLOCK_READ(&vmm->rpd);
+  return n;
+}
+
+static void __check_shared_page(test_framework_t *tf, vmm_t *vmm,
+                                uintptr_t addr, bool writable)
+{
+  bool w = false;
+  int n;
+
+  n = __rmap_locations(vmm, addr, &w);
+  if (n != 1) {
+    tf->printf("Shared page on %p has %d rmap entries, expected 1\n", addr, n);
+    tf->failed();
+  }
+  if (w != writable) {
+    tf->printf("Shared page on %p is mapped %s\n", addr,
+               w ? "writable" : "read-only");
+    tf->failed();
+  }
+}
+
+/*
+ * Write faults on present pages of shared ranges must only grant write
+ * access: the mapping is already in rmap.
+ */
+static void tc_shared_write(test_framework_t *tf, vmm_t *vmm)
+{
+  vmrange_flags_t flags = VMR_READ | VMR_WRITE | VMR_SHARED;
+  memobj_t *memobj;
+  uintptr_t a;
+  long addr;
+  int ret;
+
+  ret = memobj_create(MMO_NTR_PCACHE, MMO_FLG_SHARED, SHARED_PAGES, &memobj);
+  if (ret) {
+    tf->printf("Can't create pagecache memory object: %d\n", ret);
+    tf->abort();
+  }
+
+  pin_memobj(memobj);
+
+  /* Fill the cache, so the next read fault maps the neighbours too */
+  rwsem_down_write(&vmm->rwsem);
+  addr = vmrange_map(memobj, vmm, 0, SHARED_PAGES, flags, 0);
+  rwsem_up_write(&vmm->rwsem);
+  if (addr < 0) {
+    tf->printf("Can't map %d pages: %d\n", SHARED_PAGES, addr);
+    tf->abort();
+  }
+  for (a = addr; a < addr + (SHARED_PAGES << PAGE_WIDTH); a += PAGE_SIZE) {
+    if (!page_is_mapped(&vmm->rpd, a))
+      vmm_handle_page_fault(vmm, a, PFLT_NOT_PRESENT | PFLT_READ);
+  }
+
+  rwsem_down_write(&vmm->rwsem);
+  unmap_vmranges(vmm, addr, SHARED_PAGES);
+  addr = vmrange_map(memobj, vmm, 0, SHARED_PAGES, flags, 0);
+  rwsem_up_write(&vmm->rwsem);
+  if (addr < 0) {
+    tf->printf("Can't map %d pages: %d\n", SHARED_PAGES, addr);
+    tf->abort();
+  }
+
+  ret = vmm_handle_page_fault(vmm, addr, PFLT_NOT_PRESENT | PFLT_READ);
+  if (ret) {
+    tf->printf("Failed to handle read #PF on %p: %d\n", addr, ret);
+    tf->failed();
+  }
+  __check_shared_page(tf, vmm, addr, false);
+  if ((memobj->fault_around > 1) && page_is_mapped(&vmm->rpd, addr + PAGE_SIZE))
+    __check_shared_page(tf, vmm, addr + PAGE_SIZE, true);
+
+  ret = vmm_handle_page_fault(vmm, addr, PFLT_WRITE);
+  if (ret) {
+    tf->printf("Failed to handle write #PF on %p: %d\n", addr, ret);
+    tf->failed();
+  }
+  __check_shared_page(tf, vmm, addr, true);
+
+  rwsem_down_write(&vmm->rwsem);
+  unmap_vmranges(vmm, addr, SHARED_PAGES);
+  rwsem_up_write(&vmm->rwsem);
+  unpin_memobj(memobj);
+}
+
+static void tc_anon(test_framework_t *tf, vmm_t *vmm)
+{
+  vmrange_flags_t flags = VMR_READ | VMR_WRITE | VMR_PRIVATE | VMR_ANON;
+  scan_result_t res;
+  long addr;
+
+  addr = __map(tf, vmm, generic_memobj, flags);
+  __scan(tf, vmm, addr, PFLT_WRITE, &res);
+  __report(tf, "Anonymous", 0, &res);
+  __check_faults(tf, 1, &res);
+  __unmap(vmm, addr);
+
+  addr = __map(tf, vmm, generic_memobj, flags);
+  vmrange_set_fault_around(vmm, addr, FAULT_AROUND_PAGES);
+  __scan(tf, vmm, addr, PFLT_WRITE, &res);
+  __report(tf, "Anonymous", FAULT_AROUND_PAGES, &res);
+  __check_faults(tf, FAULT_AROUND_PAGES, &res);
+  __unmap(vmm, addr);
+}
+
+static void faultaround_tests_runner(void *ctx)
+{
+  test_framework_t *tf = ctx;
+  vmm_t *vmm;
+
+  vmm = vmm_create(current_task());
+  if (!vmm) {
+    tf->printf("Can't create VMM!\n");
+    tf->abort();
+  }
+
+  tf->printf("Scan %dM pagecache mapping.\n", MB2B(64UL) >> 20);
+  tc_pagecache(tf, vmm);
+  tf->printf("Write to shared pagecache mapping.\n");
+  tc_shared_write(tf, vmm);
+  tf->printf("Scan %dM anonymous mapping.\n", MB2B(64UL) >> 20);
+  tc_anon(tf, vmm);
+
+  vmm_destroy(vmm);
+  finished = true;
+  sys_exit(0);
+}
+
+static void faultaround_test_run(test_framework_t *tf, void *ctx)
+{
+  if (kernel_thread(faultaround_tests_runner, tf, NULL)) {
+    tf->printf("Can't create kernel thread!");
+    tf->abort();
+  }
+
+  tf->test_completion_loop(FAULTAROUND_TEST_ID, &finished);
+}
+
+static bool faultaround_test_init(void **ctx)
+{
+  finished = false;
+  return true;
+}
+
+static void faultaround_test_deinit(void *unused)
+{
+}
+
+testcase_t faultaround_testcase = {
+  .id = FAULTAROUND_TEST_ID,
+  .initialize = faultaround_test_init,
+  .deinitialize = faultaround_test_deinit,
+  .run = faultaround_test_run,
+};
@@ -14,6 +14,14 @@ extern testcase_t tlsf_testcase;
 extern testcase_t mapunmap_tc;
 extern testcase_t vma_testcase;
 extern testcase_t rws_testcase;
+extern testcase_t slab_testcase;
+extern testcase_t numa_testcase;
+extern testcase_t scratch_testcase;
+extern testcase_t faultaround_testcase;
+extern testcase_t largepage_testcase;
+extern testcase_t tlbshootdown_testcase;
+extern testcase_t pcid_testcase;
+extern testcase_t ipcremap_testcase;
 
 static testcase_t *known_testcases[] = {
 #ifdef CONFIG_TEST_IPC
@@ -43,6 +51,30 @@ static testcase_t *known_testcases[] = {
 #ifdef CONFIG_TEST_RWSEM
   &rws_testcase,
 #endif /* CONFIG_TEST_RWSEM */
+#ifdef CONFIG_TEST_SLAB
+  &slab_testcase,
+#endif /* CONFIG_TEST_SLAB */
+#ifdef CONFIG_TEST_NUMA
+  &numa_testcase,
+#endif /* CONFIG_TEST_NUMA */
+#ifdef CONFIG_TEST_SCRATCH
+  &scratch_testcase,
+#endif /* CONFIG_TEST_SCRATCH */
+#ifdef CONFIG_TEST_FAULTAROUND
+  &faultaround_testcase,
+#endif /* CONFIG_TEST_FAULTAROUND */
+#ifdef CONFIG_TEST_LARGEPAGE
+  &largepage_testcase,
+#endif /* CONFIG_TEST_LARGEPAGE */
+#ifdef CONFIG_TEST_TLBSHOOTDOWN
+  &tlbshootdown_testcase,
+#endif /* CONFIG_TEST_TLBSHOOTDOWN */
+#ifdef CONFIG_TEST_PCID
+  &pcid_testcase,
+#endif /* CONFIG_TEST_PCID */
+#ifdef CONFIG_TEST_IPCREMAP
+  &ipcremap_testcase,
+#endif /* CONFIG_TEST_IPCREMAP */
   NULL,
 };
 
@@ -19,11 +19,14 @@
 #include <mstring/gc.h>
 #include <ipc/port.h>
 #include <ipc/channel.h>
+#include <ipc/ring.h>
+#include <ipc/pollset.h>
 #include <test.h>
 #include <mm/slab.h>
 #include <mstring/errno.h>
 #include <mstring/process.h>
 #include <mstring/usercopy.h>
+#include <mm/vmm.h>
 #include <config.h>
 
 #define TEST_ID  "IPC subsystem test"
@@ -1722,6 +1725,723 @@ static void __prioritized_port_test(void *ctx)
   sys_close_port(__prio_port);
 }
 
+#define HANDOFF_ID "[HANDOFF] "
+#define HANDOFF_ROUNDS  2000
+#define HANDOFF_MSG_SIZE  64
+
+typedef struct __handoff_data {
+  test_framework_t *tf;
+  ulong_t port;
+  cpu_id_t cpu;
+  bool finished;
+} handoff_data_t;
+
+static uint8_t __handoff_client_buf[HANDOFF_MSG_SIZE];
+static uint8_t __handoff_server_buf[HANDOFF_MSG_SIZE];
+
+static void __handoff_client(void *data)
+{
+  handoff_data_t *hd=(handoff_data_t *)data;
+  test_framework_t *tf=hd->tf;
+  iovec_t snd_iovec,rcv_iovec;
+  long channel,r;
+  int i;
+
+  /* Handoff only occurs between tasks that share the same CPU. */
+  if( sched_move_task_to_cpu(current_task(),hd->cpu) ) {
+    tf->printf(HANDOFF_ID"Can't move client to CPU %d !\n",hd->cpu);
+    tf->abort();
+  }
+
+  channel=sys_open_channel(__server_pid,hd->port,IPC_BLOCKED_ACCESS);
+  if( channel < 0 ) {
+    tf->printf(HANDOFF_ID"Can't open a channel !\n" );
+    tf->abort();
+  }
+
+  for(i=0;i<HANDOFF_ROUNDS;i++) {
+    *(int *)__handoff_client_buf=i;
+    snd_iovec.iov_base=__handoff_client_buf;
+    snd_iovec.iov_len=HANDOFF_MSG_SIZE;
+    rcv_iovec.iov_base=__handoff_client_buf;
+    rcv_iovec.iov_len=HANDOFF_MSG_SIZE;
+
+    r=sys_port_send_iov_v(channel,&snd_iovec,1,&rcv_iovec,1);
+    if( r != HANDOFF_MSG_SIZE || *(int *)__handoff_client_buf != ~i ) {
+      tf->printf(HANDOFF_ID"Bad reply in round %d: r=%d\n",i,r);
+      tf->failed();
+      break;
+    }
+  }
+
+  sys_close_channel(channel);
+  hd->finished=true;
+  sys_exit(0);
+}
+
+/* Returns number of ticks spent for 'HANDOFF_ROUNDS' round trips. */
+static uint64_t __handoff_ping_pong(test_framework_t *tf,ulong_t flags)
+{
+  handoff_data_t hd;
+  port_msg_info_t msg_info;
+  iovec_t reply_iovec;
+  uint64_t start;
+  long port,r;
+  int i;
+
+  port=sys_create_port(flags,0);
+  if( port < 0 ) {
+    tf->printf(HANDOFF_ID"Can't create a port: %d\n",port);
+    tf->abort();
+  }
+
+  hd.tf=tf;
+  hd.port=port;
+  hd.cpu=cpu_id();
+  hd.finished=false;
+  if( kernel_thread(__handoff_client,&hd,NULL) ) {
+    tf->printf(HANDOFF_ID"Can't create a client !\n");
+    tf->abort();
+  }
+
+  start=system_ticks;
+  for(i=0;i<HANDOFF_ROUNDS;i++) {
+    r=sys_port_receive(port,IPC_BLOCKED_ACCESS,(ulong_t)__handoff_server_buf,
+                       HANDOFF_MSG_SIZE,&msg_info);
+    if( r || *(int *)__handoff_server_buf != i ) {
+      tf->printf(HANDOFF_ID"Bad message in round %d: r=%d\n",i,r);
+      tf->failed();
+      break;
+    }
+
+    *(int *)__handoff_server_buf=~i;
+    reply_iovec.iov_base=__handoff_server_buf;
+    reply_iovec.iov_len=HANDOFF_MSG_SIZE;
+    r=sys_port_reply_iov(port,msg_info.msg_id,&reply_iovec,1);
+    if( r ) {
+      tf->printf(HANDOFF_ID"Can't reply in round %d: r=%d\n",i,r);
+      tf->failed();
+      break;
+    }
+  }
+  start=system_ticks-start;
+
+  while( !hd.finished ) {
+    sleep(HZ/10);
+  }
+  sys_close_port(port);
+  return start;
+}
+
+static void __handoff_latency_test(void *ctx)
+{
+  DECLARE_TEST_CONTEXT;
+  uint64_t queued,direct;
+  uint64_t switches=swks.cpu_stat[cpu_id()].sched_stats.handoff_switches;
+
+  queued=__handoff_ping_pong(tf,IPC_BLOCKED_ACCESS);
+  direct=__handoff_ping_pong(tf,IPC_BLOCKED_ACCESS | IPC_HANDOFF_ACCESS);
+  switches=swks.cpu_stat[cpu_id()].sched_stats.handoff_switches-switches;
+
+  tf->printf(SERVER_THREAD"%d round trips: %d ticks via queue, %d ticks via handoff (%d direct switches)\n",
+             HANDOFF_ROUNDS,queued,direct,switches);
+  if( !switches ) {
+    tf->printf(SERVER_THREAD"No direct switches occured in handoff mode !\n");
+    tf->failed();
+  } else {
+    tf->passed();
+  }
+}
+
+/* Single-threaded echo server: returns number of requests served per second. */
+static uint64_t __echo_server(test_framework_t *tf,bool combined)
+{
+  handoff_data_t hd;
+  port_msg_info_t msg_info;
+  iovec_t reply_iovec,recv_iovec;
+  uint64_t ticks;
+  long port,r;
+  int i;
+
+  port=sys_create_port(IPC_BLOCKED_ACCESS,0);
+  if( port < 0 ) {
+    tf->printf(SERVER_THREAD"[ECHO] Can't create a port: %d\n",port);
+    tf->abort();
+  }
+
+  hd.tf=tf;
+  hd.port=port;
+  hd.cpu=cpu_id();
+  hd.finished=false;
+  if( kernel_thread(__handoff_client,&hd,NULL) ) {
+    tf->printf(SERVER_THREAD"[ECHO] Can't create a client !\n");
+    tf->abort();
+  }
+
+  recv_iovec.iov_base=__handoff_server_buf;
+  recv_iovec.iov_len=HANDOFF_MSG_SIZE;
+  reply_iovec=recv_iovec;
+
+  r=sys_port_receive(port,IPC_BLOCKED_ACCESS,(ulong_t)__handoff_server_buf,
+                     HANDOFF_MSG_SIZE,&msg_info);
+  ticks=system_ticks;
+  for(i=0;!r && i<HANDOFF_ROUNDS;i++) {
+    if( *(int *)__handoff_server_buf != i ) {
+      tf->printf(SERVER_THREAD"[ECHO] Bad message in round %d\n",i);
+      tf->failed();
+      break;
+    }
+
+    *(int *)__handoff_server_buf=~i;
+    if( i == HANDOFF_ROUNDS-1 ) {
+      r=sys_port_reply_iov(port,msg_info.msg_id,&reply_iovec,1);
+    } else if( combined ) {
+      r=sys_port_reply_and_receive(port,msg_info.msg_id,&reply_iovec,1,
+                                   &recv_iovec,&msg_info);
+    } else {
+      r=sys_port_reply_iov(port,msg_info.msg_id,&reply_iovec,1);
+      if( !r ) {
+        r=sys_port_receive(port,IPC_BLOCKED_ACCESS,(ulong_t)__handoff_server_buf,
+                           HANDOFF_MSG_SIZE,&msg_info);
+      }
+    }
+  }
+  ticks=system_ticks-ticks;
+
+  if( r ) {
+    tf->printf(SERVER_THREAD"[ECHO] Request %d failed: r=%d\n",i,r);
+    tf->failed();
+  }
+
+  while( !hd.finished ) {
+    sleep(HZ/10);
+  }
+  sys_close_port(port);
+  return ticks ? (HANDOFF_ROUNDS*HZ)/ticks : HANDOFF_ROUNDS*HZ;
+}
+
+static void __reply_and_receive_test(void *ctx)
+{
+  DECLARE_TEST_CONTEXT;
+  uint64_t separate,combined;
+
+  separate=__echo_server(tf,false);
+  combined=__echo_server(tf,true);
+
+  tf->printf(SERVER_THREAD"[ECHO] %d requests/sec via reply+receive, %d requests/sec via 'sys_port_reply_and_receive()'\n",
+             separate,combined);
+  tf->passed();
+}
+
+#define BATCH_ID  "[BATCH] "
+#define BATCH_MESSAGES  256
+#define BATCH_ROUNDS  32
+#define BATCH_MSG_SIZE  32
+
+static uint8_t __batch_rcv_bufs[IPC_RECV_BATCH_MAX][BATCH_MSG_SIZE];
+static port_msg_info_t __batch_infos[IPC_RECV_BATCH_MAX];
+
+static void __batch_fill_port(test_framework_t *tf,long channel)
+{
+  iovec_t snd_iovec,rcv_iovec;
+  uint8_t snd_buf[BATCH_MSG_SIZE];
+  long r;
+  int i;
+
+  for(i=0;i<BATCH_MESSAGES;i++) {
+    memset(snd_buf,i & 0xff,sizeof(snd_buf));
+    snd_iovec.iov_base=snd_buf;
+    snd_iovec.iov_len=sizeof(snd_buf);
+    rcv_iovec=snd_iovec;
+
+    r=sys_port_send_iov_v(channel,&snd_iovec,1,&rcv_iovec,1);
+    if( r != sizeof(snd_buf) ) {
+      tf->printf(BATCH_ID"Can't send message %d: r=%d\n",i,r);
+      tf->abort();
+    }
+  }
+}
+
+static bool __batch_check_message(uint8_t *buf,int idx)
+{
+  int i;
+
+  for(i=0;i<BATCH_MSG_SIZE;i++) {
+    if( buf[i] != (idx & 0xff) ) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void __batch_receive_test(void *ctx)
+{
+  DECLARE_TEST_CONTEXT;
+  iovec_t iovecs[IPC_RECV_BATCH_MAX];
+  uint64_t single_ticks=0,batch_ticks=0,t;
+  long port,channel,r;
+  int i,j,k,received;
+
+  port=sys_create_port(0,0);
+  if( port < 0 ) {
+    tf->printf(BATCH_ID"Can't create a port: %d\n",port);
+    tf->abort();
+  }
+
+  channel=sys_open_channel(current_task()->pid,port,0);
+  if( channel < 0 ) {
+    tf->printf(BATCH_ID"Can't open a channel: %d\n",channel);
+    tf->abort();
+  }
+
+  for(k=0;k<BATCH_ROUNDS;k++) {
+    /* Single-message receive loop. */
+    __batch_fill_port(tf,channel);
+    t=system_ticks;
+    for(i=0;i<BATCH_MESSAGES;i++) {
+      r=sys_port_receive(port,0,(ulong_t)__batch_rcv_bufs[0],BATCH_MSG_SIZE,
+                         &__batch_infos[0]);
+      if( r || !__batch_check_message(__batch_rcv_bufs[0],i) ) {
+        tf->printf(BATCH_ID"Single receive of message %d failed: r=%d\n",i,r);
+        tf->failed();
+        goto out;
+      }
+    }
+    single_ticks += system_ticks-t;
+
+    /* Batched receive loop. */
+    __batch_fill_port(tf,channel);
+    for(j=0;j<IPC_RECV_BATCH_MAX;j++) {
+      iovecs[j].iov_base=__batch_rcv_bufs[j];
+      iovecs[j].iov_len=BATCH_MSG_SIZE;
+    }
+
+    t=system_ticks;
+    for(received=0;received<BATCH_MESSAGES;received += r) {
+      r=sys_port_receive_batch(port,0,iovecs,__batch_infos,IPC_RECV_BATCH_MAX);
+      if( r <= 0 ) {
+        tf->printf(BATCH_ID"Batched receive failed after %d messages: r=%d\n",
+                   received,r);
+        tf->failed();
+        goto out;
+      }
+
+      for(j=0;j<r;j++) {
+        if( __batch_infos[j].msg_len != BATCH_MSG_SIZE ||
+            !__batch_check_message(__batch_rcv_bufs[j],received+j) ) {
+          tf->printf(BATCH_ID"Message %d mismatch !\n",received+j);
+          tf->failed();
+          goto out;
+        }
+      }
+    }
+    batch_ticks += system_ticks-t;
+  }
+
+  r=sys_port_receive_batch(port,0,iovecs,__batch_infos,IPC_RECV_BATCH_MAX);
+  if( r != -EWOULDBLOCK ) {
+    tf->printf(BATCH_ID"Empty port returned %d instead of %d\n",r,-EWOULDBLOCK);
+    tf->failed();
+    goto out;
+  }
+
+  tf->printf(BATCH_ID"%d messages: %d ticks via single receive, %d ticks via batched receive\n",
+             BATCH_MESSAGES*BATCH_ROUNDS,single_ticks,batch_ticks);
+  tf->passed();
+out:
+  sys_close_channel(channel);
+  sys_close_port(port);
+}
+
+#define RING_ID  "[RING] "
+#define RING_RECORDS  4096
+#define RING_RECORD_SIZE  64
+
+static void __ring_port_test(void *ctx)
+{
+  DECLARE_TEST_CONTEXT;
+  ipc_ring_info_t sinfo,cinfo;
+  ipc_ring_hdr_t *shdr,*chdr;
+  uint8_t *sdata,*cdata,*rec;
+  ipc_gen_port_t *p;
+  pollfd_t pfd;
+  long port,channel,r;
+  int produced,consumed,i;
+
+  port=sys_create_port(IPC_RING_ACCESS,0);
+  if( port < 0 ) {
+    tf->printf(RING_ID"Can't create a ring port: %d\n",port);
+    tf->abort();
+  }
+
+  channel=sys_open_channel(current_task()->pid,port,0);
+  if( channel < 0 ) {
+    tf->printf(RING_ID"Can't open a channel: %d\n",channel);
+    tf->abort();
+  }
+
+  p=ipc_get_port(current_task(),port,&r);
+  if( !p ) {
+    tf->printf(RING_ID"Can't get the ring port: %d\n",r);
+    tf->abort();
+  }
+
+  /* Map the ring twice: as the consumer and as the producer. */
+  r=ipc_port_ring_map(p,&sinfo);
+  if( r ) {
+    tf->printf(RING_ID"Can't map the ring via port: %d\n",r);
+    tf->abort();
+  }
+  r=sys_control_channel(channel,IPC_CHANNEL_CTL_RING_MAP,(ulong_t)&cinfo);
+  if( r ) {
+    tf->printf(RING_ID"Can't map the ring via channel: %d\n",r);
+    tf->abort();
+  }
+
+  shdr=(ipc_ring_hdr_t *)sinfo.addr;
+  chdr=(ipc_ring_hdr_t *)cinfo.addr;
+  if( shdr == chdr || shdr->size != IPC_RING_DATA_SIZE ||
+      chdr->data_offset != (IPC_RING_HDR_PAGES << PAGE_WIDTH) ) {
+    tf->printf(RING_ID"Invalid ring mappings: %p, %p\n",shdr,chdr);
+    tf->failed();
+    goto out;
+  }
+  sdata=(uint8_t *)shdr + shdr->data_offset;
+  cdata=(uint8_t *)chdr + chdr->data_offset;
+
+  /* Empty ring: no events, and a mere check doesn't mark the consumer
+   * as waiting.
+   */
+  if( ipc_port_check_events(p,NULL,POLLIN) || chdr->cons_waiting ) {
+    tf->printf(RING_ID"Empty ring reports pending events !\n");
+    tf->failed();
+    goto out;
+  }
+
+  for(produced=consumed=0;consumed<RING_RECORDS;) {
+    /* Producer: fill the ring up via its own mapping. */
+    while( produced < RING_RECORDS &&
+           IPC_RING_DATA_SIZE - ipc_ring_used(chdr) >= RING_RECORD_SIZE ) {
+      rec=cdata + (chdr->head & (IPC_RING_DATA_SIZE-1));
+      memset(rec,produced & 0xff,RING_RECORD_SIZE);
+      chdr->head += RING_RECORD_SIZE;
+      produced++;
+    }
+    if( chdr->cons_waiting ) {
+      sys_control_channel(channel,IPC_CHANNEL_CTL_RING_NOTIFY,0);
+    }
+
+    pfd.fd=port;
+    pfd.events=POLLIN;
+    pfd.revents=0;
+    r=sys_ipc_port_poll(&pfd,1,NULL);
+    if( r != 1 || !(pfd.revents & POLLIN) ||
+        ipc_port_ring_wait(p,false,0) ) {
+      tf->printf(RING_ID"Non-empty ring isn't reported: r=%d\n",r);
+      tf->failed();
+      goto out;
+    }
+
+    /* Consumer: drain the ring via the other mapping. */
+    while( ipc_ring_used(shdr) ) {
+      rec=sdata + (shdr->tail & (IPC_RING_DATA_SIZE-1));
+      for(i=0;i<RING_RECORD_SIZE;i++) {
+        if( rec[i] != (consumed & 0xff) ) {
+          tf->printf(RING_ID"Record %d mismatch !\n",consumed);
+          tf->failed();
+          goto out;
+        }
+      }
+      shdr->tail += RING_RECORD_SIZE;
+      consumed++;
+    }
+    if( shdr->prod_waiting ) {
+      ipc_port_ring_notify(p,false);
+    }
+  }
+
+  r=sys_control_channel(channel,IPC_CHANNEL_CTL_RING_WAIT,RING_RECORD_SIZE);
+  if( r ) {
+    tf->printf(RING_ID"Producer can't wait on empty ring: %d\n",r);
+    tf->failed();
+    goto out;
+  }
+
+  tf->printf(RING_ID"%d records passed through the ring.\n",consumed);
+  tf->passed();
+out:
+  sys_munmap(0,sinfo.addr,sinfo.size);
+  sys_munmap(0,cinfo.addr,cinfo.size);
+  ipc_put_port(p);
+  sys_close_channel(channel);
+  sys_close_port(port);
+}
+
+#define PSET_ID  "[POLLSET] "
+#define PSET_PORTS  64
+#define PSET_MSG_SIZE  16
+
+static bool __pollset_ready(pollfd_t *ev,long n,long *ports,int port_idx)
+{
+  long i;
+
+  for(i=0;i<n;i++) {
+    if( ev[i].fd == ports[port_idx] && (ev[i].revents & POLLIN) ) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static void __pollset_test(void *ctx)
+{
+  DECLARE_TEST_CONTEXT;
+  long ports[PSET_PORTS],channels[PSET_PORTS];
+  pollfd_t events[IPC_POLLSET_WAIT_MAX];
+  uint8_t buf[PSET_MSG_SIZE];
+  port_msg_info_t info;
+  timeval_t nowait={0,0};
+  iovec_t iov;
+  long set,r;
+  int i;
+
+  for(i=0;i<PSET_PORTS;i++) {
+    ports[i]=sys_create_port(0,0);
+    if( ports[i] < 0 ) {
+      tf->printf(PSET_ID"Can't create port %d: %d\n",i,ports[i]);
+      tf->abort();
+    }
+    channels[i]=sys_open_channel(current_task()->pid,ports[i],0);
+    if( channels[i] < 0 ) {
+      tf->printf(PSET_ID"Can't open channel %d: %d\n",i,channels[i]);
+      tf->abort();
+    }
+  }
+
+  set=sys_ipc_pollset_create();
+  if( set < 0 ) {
+    tf->printf(PSET_ID"Can't create a pollset: %d\n",set);
+    tf->abort();
+  }
+
+  for(i=0;i<PSET_PORTS;i++) {
+    r=sys_ipc_pollset_control(set,IPC_POLLSET_CTL_ADD,ports[i],POLLIN);
+    if( r ) {
+      tf->printf(PSET_ID"Can't add port %d: %d\n",i,r);
+      tf->failed();
+      goto out;
+    }
+  }
+
+  r=sys_ipc_pollset_control(set,IPC_POLLSET_CTL_ADD,ports[0],POLLIN);
+  if( r != -EEXIST ) {
+    tf->printf(PSET_ID"Port was added twice: %d\n",r);
+    tf->failed();
+    goto out;
+  }
+
+  r=sys_ipc_pollset_wait(set,events,IPC_POLLSET_WAIT_MAX,&nowait);
+  if( r ) {
+    tf->printf(PSET_ID"Idle ports are reported as ready: %d\n",r);
+    tf->failed();
+    goto out;
+  }
+
+  /* Make two ports ready: only they must be reported. */
+  memset(buf,0x5a,sizeof(buf));
+  iov.iov_base=buf;
+  iov.iov_len=sizeof(buf);
+  if( sys_port_send_iov_v(channels[3],&iov,1,&iov,1) != sizeof(buf) ||
+      sys_port_send_iov_v(channels[PSET_PORTS-1],&iov,1,&iov,1) != sizeof(buf) ) {
+    tf->printf(PSET_ID"Can't send messages !\n");
+    tf->failed();
+    goto out;
+  }
+
+  r=sys_ipc_pollset_wait(set,events,IPC_POLLSET_WAIT_MAX,NULL);
+  if( r != 2 || !__pollset_ready(events,r,ports,3) ||
+      !__pollset_ready(events,r,ports,PSET_PORTS-1) ) {
+    tf->printf(PSET_ID"Ready ports aren't reported: r=%d\n",r);
+    tf->failed();
+    goto out;
+  }
+
+  /* The set is level-triggered: port 3 stays ready until it's drained. */
+  r=sys_port_receive(ports[PSET_PORTS-1],0,(ulong_t)buf,sizeof(buf),&info);
+  if( r ) {
+    tf->printf(PSET_ID"Can't receive a message: %d\n",r);
+    tf->failed();
+    goto out;
+  }
+  r=sys_ipc_pollset_wait(set,events,IPC_POLLSET_WAIT_MAX,&nowait);
+  if( r != 1 || !__pollset_ready(events,r,ports,3) ) {
+    tf->printf(PSET_ID"Pending port isn't reported again: r=%d\n",r);
+    tf->failed();
+    goto out;
+  }
+
+  r=sys_ipc_pollset_control(set,IPC_POLLSET_CTL_DEL,ports[3],0);
+  if( r ) {
+    tf->printf(PSET_ID"Can't remove a port: %d\n",r);
+    tf->failed();
+    goto out;
+  }
+  r=sys_ipc_pollset_wait(set,events,IPC_POLLSET_WAIT_MAX,&nowait);
+  if( r ) {
+    tf->printf(PSET_ID"Removed port is still reported: %d\n",r);
+    tf->failed();
+    goto out;
+  }
+  sys_port_receive(ports[3],0,(ulong_t)buf,sizeof(buf),&info);
+
+  tf->printf(PSET_ID"Only ready ports out of %d were reported.\n",PSET_PORTS);
+  tf->passed();
+out:
+  sys_ipc_pollset_close(set);
+  for(i=0;i<PSET_PORTS;i++) {
+    sys_close_channel(channels[i]);
+    sys_close_port(ports[i]);
+  }
+}
+
+#define MPSC_ID  "[MPSC] "
+#define MPSC_MAX_SENDERS  8
+#define MPSC_MESSAGES  2048
+
+typedef struct __mpsc_sender {
+  test_framework_t *tf;
+  long port;
+  int idx;
+  cpu_id_t cpu;
+  volatile bool finished;
+} mpsc_sender_t;
+
+static mpsc_sender_t __mpsc_senders[MPSC_MAX_SENDERS];
+
+static void __mpsc_sender_thread(void *data)
+{
+  mpsc_sender_t *sd=(mpsc_sender_t *)data;
+  test_framework_t *tf=sd->tf;
+  uint32_t buf[2];
+  iovec_t iov;
+  long channel,r;
+  int i;
+
+  if( sched_move_task_to_cpu(current_task(),sd->cpu) ) {
+    tf->printf(MPSC_ID"Can't move sender %d to CPU %d !\n",sd->idx,sd->cpu);
+    tf->abort();
+  }
+
+  channel=sys_open_channel(__server_pid,sd->port,0);
+  if( channel < 0 ) {
+    tf->printf(MPSC_ID"Sender %d can't open a channel: %d\n",sd->idx,channel);
+    tf->abort();
+  }
+
+  for(i=0;i<MPSC_MESSAGES;i++) {
+    buf[0]=sd->idx;
+    buf[1]=i;
+    iov.iov_base=buf;
+    iov.iov_len=sizeof(buf);
+
+    r=sys_port_send_iov_v(channel,&iov,1,&iov,1);
+    if( r != sizeof(buf) ) {
+      tf->printf(MPSC_ID"Sender %d failed at message %d: r=%d\n",sd->idx,i,r);
+      tf->failed();
+      break;
+    }
+  }
+
+  sys_close_channel(channel);
+  sd->finished=true;
+  sys_exit(0);
+}
+
+/* Returns number of ticks the receiver spent to get all messages from
+ * @nsenders concurrent senders, or zero on failure.
+ */
+static uint64_t __mpsc_run(test_framework_t *tf,ulong_t flags,int nsenders,
+                           int ncpus)
+{
+  uint32_t next_seq[MPSC_MAX_SENDERS];
+  port_msg_info_t msg_info;
+  uint32_t buf[2];
+  uint64_t start;
+  long port,r;
+  int i,total=nsenders*MPSC_MESSAGES;
+  bool ok=true;
+
+  port=sys_create_port(flags,0);
+  if( port < 0 ) {
+    tf->printf(MPSC_ID"Can't create a port: %d\n",port);
+    tf->abort();
+  }
+
+  for(i=0;i<nsenders;i++) {
+    next_seq[i]=0;
+    __mpsc_senders[i].tf=tf;
+    __mpsc_senders[i].port=port;
+    __mpsc_senders[i].idx=i;
+    __mpsc_senders[i].cpu=i % ncpus;
+    __mpsc_senders[i].finished=false;
+    if( kernel_thread(__mpsc_sender_thread,&__mpsc_senders[i],NULL) ) {
+      tf->printf(MPSC_ID"Can't create a sender !\n");
+      tf->abort();
+    }
+  }
+
+  start=system_ticks;
+  for(i=0;i<total;i++) {
+    r=sys_port_receive(port,IPC_BLOCKED_ACCESS,(ulong_t)buf,sizeof(buf),&msg_info);
+    if( r || buf[0] >= nsenders || buf[1] != next_seq[buf[0]] ) {
+      tf->printf(MPSC_ID"Bad message %d: r=%d, sender=%d, seq=%d\n",
+                 i,r,buf[0],buf[1]);
+      tf->failed();
+      ok=false;
+      break;
+    }
+    next_seq[buf[0]]++;
+  }
+  start=system_ticks-start;
+
+  for(i=0;i<nsenders;i++) {
+    while( !__mpsc_senders[i].finished ) {
+      sleep(HZ/10);
+    }
+  }
+  sys_close_port(port);
+  return ok ? start : 0;
+}
+
+/* Measures how the throughput of a single receiver scales with the number
+ * of concurrent senders for both locked and lock-free ports.
+ */
+static void __mpsc_stress_test(void *ctx)
+{
+  DECLARE_TEST_CONTEXT;
+  uint64_t locked,lockfree;
+  int nsenders,ncpus=0;
+  cpu_id_t c;
+
+  for_each_cpu(c) {
+    if( is_cpu_online(c) ) {
+      ncpus++;
+    }
+  }
+
+  for(nsenders=1;nsenders<=MPSC_MAX_SENDERS;nsenders <<= 1) {
+    locked=__mpsc_run(tf,0,nsenders,ncpus);
+    lockfree=__mpsc_run(tf,IPC_MPSC_ACCESS,nsenders,ncpus);
+    if( !locked || !lockfree ) {
+      return;
+    }
+
+    tf->printf(MPSC_ID"%d senders on %d CPUs, %d messages: %d ticks via locked port, %d ticks via MPSC port\n",
+               nsenders,ncpus,nsenders*MPSC_MESSAGES,locked,lockfree);
+  }
+  tf->passed();
+}
+
 static void __server_thread(void *ctx)
 {
   DECLARE_TEST_CONTEXT;
@@ -1747,6 +2467,18 @@ static void __server_thread(void *ctx)
   sleep(HZ);
   __prioritized_port_test(ctx);
   sleep(HZ);
+  __handoff_latency_test(ctx);
+  sleep(HZ);
+  __reply_and_receive_test(ctx);
+  sleep(HZ);
+  __batch_receive_test(ctx);
+  sleep(HZ);
+  __ring_port_test(ctx);
+  sleep(HZ);
+  __pollset_test(ctx);
+  sleep(HZ);
+  __mpsc_stress_test(ctx);
+  sleep(HZ);
   __vectored_messages_test(ctx);
   sleep(HZ);
 
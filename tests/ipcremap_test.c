@@ -0,0 +1,263 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * (c) Copyright 2006,2007,2008 MString Core Team <http://mstring.jarios.org>
+ *
+ * tests/ipcremap_test.c: Moving pages of long replies between address
+ *                        spaces of IPC_REMAP_ACCESS ports.
+ */
+
+#include <config.h>
+#include <test.h>
+#include <mm/page.h>
+#include <mm/mem.h>
+#include <mm/vmm.h>
+#include <ipc/ipc.h>
+#include <ipc/port.h>
+#include <ipc/buffer.h>
+#include <mstring/task.h>
+#include <mstring/string.h>
+#include <kernel/syscalls.h>
+#include <mstring/types.h>
+
+#define IPCREMAP_TEST_ID "IPC remap test"
+
+#define REMAP_PAGES 8
+#define PATTERN(i)  (0x5a5a0000UL | (i))
+
+static bool finished = false;
+
+/* Client whose receive buffer gets server's pages */
+static task_t client;
+
+static long __map(test_framework_t *tf, vmm_t *vmm, vmrange_flags_t extra)
+{
+  vmrange_flags_t flags = VMR_READ | VMR_WRITE | VMR_PRIVATE |
+    VMR_ANON | VMR_POPULATE | extra;
+  long addr;
+
+  rwsem_down_write(&vmm->rwsem);
+  addr = vmrange_map(generic_memobj, vmm, 0, REMAP_PAGES, flags, 0);
+  rwsem_up_write(&vmm->rwsem);
+  if (addr < 0) {
+    tf->printf("Can't map %d pages: %d\n", REMAP_PAGES, addr);
+    tf->abort();
+  }
+
+  return addr;
+}
+
+static void __unmap(vmm_t *vmm, uintptr_t addr)
+{
+  rwsem_down_write(&vmm->rwsem);
+  unmap_vmranges(vmm, addr, REMAP_PAGES);
+  rwsem_up_write(&vmm->rwsem);
+}
+
+static page_idx_t __lookup(vmm_t *vmm, uintptr_t addr)
+{
+  page_idx_t pidx;
+
+  RPD_LOCK_READ(&vmm->rpd);
+  pidx = vaddr_to_pidx(&vmm->rpd, addr);
+  RPD_UNLOCK_READ(&vmm->rpd);
+  return pidx;
+}
+
+/* Port must keep IPC_REMAP_ACCESS, otherwise replies are always copied */
+static void tc_port_flags(test_framework_t *tf)
+{
+  ipc_gen_port_t *p;
+  long port, r;
+
+  port = ipc_create_port(current_task(), IPC_BLOCKED_ACCESS | IPC_REMAP_ACCESS, 0);
+  if (port < 0) {
+    tf->printf("Can't create a port: %d\n", port);
+    tf->abort();
+  }
+
+  p = ipc_get_port(current_task(), port, &r);
+  if (!p) {
+    tf->printf("Can't get port %d: %d\n", port, r);
+    tf->abort();
+  }
+  if (!(p->flags & IPC_REMAP_ACCESS)) {
+    tf->printf("Port %d lost IPC_REMAP_ACCESS: flags %#x\n", port, p->flags);
+    tf->failed();
+  }
+
+  ipc_put_port(p);
+  ipc_close_port(current_task()->ipc, port);
+}
+
+/*
+ * Current task plays the server replying from its @server vmm, and
+ * @client owns the receive buffer.
+ */
+static void tc_remap(test_framework_t *tf, vmm_t *server)
+{
+  page_idx_t chunks[REMAP_PAGES], src_pidx[REMAP_PAGES];
+  uintptr_t src_addr, dst_addr;
+  ipc_buffer_t buf;
+  iovec_t iov;
+  page_idx_t i, pidx;
+  long r;
+
+  src_addr = __map(tf, server, 0);
+  dst_addr = __map(tf, client.task_mm, VMR_CANRECPAGES);
+  for (i = 0; i < REMAP_PAGES; i++) {
+    src_pidx[i] = __lookup(server, src_addr + ((uintptr_t)i << PAGE_WIDTH));
+    *(ulong_t *)pframe_id_to_virt(src_pidx[i]) = PATTERN(i);
+  }
+
+  iov.iov_base = (void *)dst_addr;
+  iov.iov_len = REMAP_PAGES << PAGE_WIDTH;
+  r = ipc_setup_task_buffer_pages(&iov, 1, chunks, &buf, false, &client);
+  if (r) {
+    tf->printf("Can't set up receive buffer: %d\n", r);
+    tf->abort();
+  }
+
+  iov.iov_base = (void *)src_addr;
+  r = ipc_remap_buffer_pages(&buf, &iov, iov.iov_len, &client);
+  if (r != iov.iov_len) {
+    tf->printf("Moved %d bytes instead of %d\n", r, iov.iov_len);
+    tf->failed();
+  }
+
+  for (i = 0; i < (r >> PAGE_WIDTH); i++) {
+    pidx = __lookup(client.task_mm, dst_addr + ((uintptr_t)i << PAGE_WIDTH));
+    if ((pidx != src_pidx[i]) || (buf.chunks[i] != pidx)) {
+      tf->printf("Page %d wasn't moved: %#x mapped, %#x in buffer, "
+                 "%#x expected\n", i, pidx, buf.chunks[i], src_pidx[i]);
+      tf->failed();
+      continue;
+    }
+    if (*(ulong_t *)pframe_id_to_virt(pidx) != PATTERN(i)) {
+      tf->printf("Page %d has wrong data\n", i);
+      tf->failed();
+    }
+    if (__lookup(server, src_addr + ((uintptr_t)i << PAGE_WIDTH)) !=
+        PAGE_IDX_INVAL) {
+      tf->printf("Page %d is still mapped by server\n", i);
+      tf->failed();
+    }
+  }
+
+  ipc_release_buffer_pages(&buf, 1);
+  __unmap(client.task_mm, dst_addr);
+  __unmap(server, src_addr);
+}
+
+/* Buffers that can't receive pages must get a copy of the data */
+static void tc_no_canrecpages(test_framework_t *tf, vmm_t *server)
+{
+  page_idx_t chunks[REMAP_PAGES], src_pidx;
+  uintptr_t src_addr, dst_addr;
+  ipc_buffer_t buf;
+  iovec_t iov;
+  long r;
+
+  src_addr = __map(tf, server, 0);
+  dst_addr = __map(tf, client.task_mm, 0);
+  src_pidx = __lookup(server, src_addr);
+
+  iov.iov_base = (void *)dst_addr;
+  iov.iov_len = REMAP_PAGES << PAGE_WIDTH;
+  r = ipc_setup_task_buffer_pages(&iov, 1, chunks, &buf, false, &client);
+  if (r) {
+    tf->printf("Can't set up receive buffer: %d\n", r);
+    tf->abort();
+  }
+
+  iov.iov_base = (void *)src_addr;
+  r = ipc_remap_buffer_pages(&buf, &iov, iov.iov_len, &client);
+  if (r) {
+    tf->printf("Moved %d bytes to a range without VMR_CANRECPAGES\n", r);
+    tf->failed();
+  }
+  if (__lookup(server, src_addr) != src_pidx) {
+    tf->printf("Server lost its page\n");
+    tf->failed();
+  }
+
+  ipc_release_buffer_pages(&buf, 1);
+  __unmap(client.task_mm, dst_addr);
+  __unmap(server, src_addr);
+}
+
+static void ipcremap_tests_runner(void *ctx)
+{
+  test_framework_t *tf = ctx;
+  task_t *task = current_task();
+  task_privelege_t priv = task->priv;
+  vmm_t *task_mm = task->task_mm, *server;
+
+  tc_port_flags(tf);
+
+  /*
+   * Pages are moved only between user tasks, so the runner pretends to
+   * be one while it does the remap. Its page tables stay loaded, both
+   * address spaces are touched only through the page tables.
+   */
+  memset(&client, 0, sizeof(client));
+  client.priv = TPL_USER;
+  client.task_mm = vmm_create(task);
+  server = vmm_create(task);
+  if (!client.task_mm || !server) {
+    tf->printf("Can't create VMM!\n");
+    tf->abort();
+  }
+
+  task->priv = TPL_USER;
+  task->task_mm = server;
+  tc_remap(tf, server);
+  tc_no_canrecpages(tf, server);
+  task->task_mm = task_mm;
+  task->priv = priv;
+
+  vmm_destroy(server);
+  vmm_destroy(client.task_mm);
+  finished = true;
+  sys_exit(0);
+}
+
+static void ipcremap_test_run(test_framework_t *tf, void *ctx)
+{
+  if (kernel_thread(ipcremap_tests_runner, tf, NULL)) {
+    tf->printf("Can't create kernel thread!");
+    tf->abort();
+  }
+
+  tf->test_completion_loop(IPCREMAP_TEST_ID, &finished);
+}
+
+static bool ipcremap_test_init(void **ctx)
+{
+  finished = false;
+  return true;
+}
+
+static void ipcremap_test_deinit(void *unused)
+{
+}
+
+testcase_t ipcremap_testcase = {
+  .id = IPCREMAP_TEST_ID,
+  .initialize = ipcremap_test_init,
+  .deinitialize = ipcremap_test_deinit,
+  .run = ipcremap_test_run,
+};
@@ -0,0 +1,256 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * (c) Copyright 2006,2007,2008 MString Core Team <http://mstring.jarios.org>
+ *
+ * tests/largepage_test.c: Large page mappings and splitting test and
+ *                         random access benchmark of 4K versus 2M pages.
+ */
+
+#include <config.h>
+#include <test.h>
+#include <mm/page.h>
+#include <mm/mem.h>
+#include <mm/vmm.h>
+#include <arch/cpu.h>
+#include <arch/mem.h>
+#include <arch/tlb.h>
+#include <arch/interrupt.h>
+#include <arch/timer.h>
+#include <mstring/task.h>
+#include <kernel/syscalls.h>
+#include <mstring/types.h>
+
+#define LARGEPAGE_TEST_ID "Large page test"
+
+#define AREA_PAGES     (MB2B(64UL) >> PAGE_WIDTH)
+#define ACCESS_ROUNDS  64
+#define ROUND_ACCESSES 16384
+
+static bool finished = false;
+
+static long __map(test_framework_t *tf, vmm_t *vmm, vmrange_flags_t flags)
+{
+  long addr;
+
+  rwsem_down_write(&vmm->rwsem);
+  addr = vmrange_map(generic_memobj, vmm, 0, AREA_PAGES, flags, 0);
+  rwsem_up_write(&vmm->rwsem);
+  if (addr < 0) {
+    tf->printf("Can't map %d pages: %d\n", AREA_PAGES, addr);
+    tf->abort();
+  }
+
+  return addr;
+}
+
+static void __unmap(vmm_t *vmm, uintptr_t addr, page_idx_t npages)
+{
+  rwsem_down_write(&vmm->rwsem);
+  unmap_vmranges(vmm, addr, npages);
+  rwsem_up_write(&vmm->rwsem);
+}
+
+static page_idx_t __lookup(vmm_t *vmm, uintptr_t addr, bool *large)
+{
+  page_idx_t pidx;
+  pde_t *pde;
+
+  RPD_LOCK_READ(&vmm->rpd);
+  pidx = __vaddr_to_pidx(&vmm->rpd, addr, &pde);
+  if (large)
+    *large = ((pidx != PAGE_IDX_INVAL) && pde_is_large(pde));
+
+  RPD_UNLOCK_READ(&vmm->rpd);
+  return pidx;
+}
+
+static int __count_large_pages(vmm_t *vmm, uintptr_t addr)
+{
+  uintptr_t a, end = addr + ((uintptr_t)AREA_PAGES << PAGE_WIDTH);
+  bool large;
+  int n = 0;
+
+  for (a = addr; a < end; a += LARGE_PAGE_SIZE) {
+    __lookup(vmm, a, &large);
+    if (large)
+      n++;
+  }
+
+  return n;
+}
+
+/*
+ * Read words by random addresses of the area through its mapping.
+ * Address space of the VMM is loaded for each round with interrupts
+ * disabled, so it's not switched under our feet.
+ */
+static uint64_t __random_access(vmm_t *vmm, uintptr_t addr)
+{
+  uint64_t start, cycles = 0;
+  ulong_t seed = 1;
+  int r, i, irqstat;
+
+  for (r = 0; r < ACCESS_ROUNDS; r++) {
+    interrupts_save_and_disable(irqstat);
+    load_rpd(&vmm->rpd);
+    start = arch_cycles();
+    for (i = 0; i < ROUND_ACCESSES; i++) {
+      seed = seed * 6364136223846793005UL + 1442695040888963407UL;
+      (void)*(volatile ulong_t *)
+        (addr + (((seed >> 16) % (AREA_PAGES << PAGE_WIDTH)) & ~7UL));
+    }
+
+    cycles += arch_cycles() - start;
+    load_rpd(task_get_rpd(current_task()));
+    interrupts_restore(irqstat);
+  }
+
+  return cycles;
+}
+
+static void tc_mapping(test_framework_t *tf, vmm_t *vmm)
+{
+  vmrange_flags_t flags = VMR_READ | VMR_WRITE | VMR_PRIVATE |
+    VMR_ANON | VMR_POPULATE;
+  page_idx_t pidx;
+  uintptr_t addr, a;
+  int n;
+  bool large;
+
+  addr = __map(tf, vmm, flags);
+  if (addr & LARGE_PAGE_MASK) {
+    tf->printf("Populated range %p isn't aligned to large page\n", addr);
+    tf->failed();
+  }
+
+  n = __count_large_pages(vmm, addr);
+  tf->printf("%d of %d blocks are mapped with large pages\n",
+             n, AREA_PAGES / LARGE_PAGE_PAGES);
+  if (!n) {
+    tf->failed();
+    __unmap(vmm, addr, AREA_PAGES);
+    return;
+  }
+
+  /* Find a large page and unmap a page in its middle */
+  for (a = addr; ; a += LARGE_PAGE_SIZE) {
+    __lookup(vmm, a, &large);
+    if (large)
+      break;
+  }
+
+  pidx = __lookup(vmm, a, NULL);
+  __unmap(vmm, a + (PAGE_SIZE << 4), 1);
+  if (__lookup(vmm, a + (PAGE_SIZE << 4), NULL) != PAGE_IDX_INVAL) {
+    tf->printf("Page %p is mapped after unmap\n", a + (PAGE_SIZE << 4));
+    tf->failed();
+  }
+  if ((__lookup(vmm, a + (PAGE_SIZE << 4) - PAGE_SIZE, &large) != (pidx + 15))
+      || large || (__lookup(vmm, a + (PAGE_SIZE << 4) + PAGE_SIZE, NULL)
+                   != (pidx + 17))) {
+    tf->printf("Neighbours of %p are broken by split\n", a + (PAGE_SIZE << 4));
+    tf->failed();
+  }
+
+  __unmap(vmm, addr, AREA_PAGES);
+  tf->printf("ok\n");
+}
+
+static void tc_random_access(test_framework_t *tf, vmm_t *vmm)
+{
+  vmrange_flags_t flags = VMR_READ | VMR_WRITE | VMR_PRIVATE | VMR_ANON;
+  uint64_t cycles_4k, cycles_2m, accesses;
+  uintptr_t addr;
+  page_idx_t i;
+  int ret;
+
+  /* Pages faulted in one by one are always mapped with 4K pages */
+  addr = __map(tf, vmm, flags);
+  for (i = 0; i < AREA_PAGES; i++) {
+    ret = vmm_handle_page_fault(vmm, addr + ((uintptr_t)i << PAGE_WIDTH),
+                                PFLT_NOT_PRESENT | PFLT_WRITE);
+    if (ret) {
+      tf->printf("Failed to handle #PF on %p: %d\n",
+                 addr + ((uintptr_t)i << PAGE_WIDTH), ret);
+      tf->abort();
+    }
+  }
+
+  cycles_4k = __random_access(vmm, addr);
+  __unmap(vmm, addr, AREA_PAGES);
+
+  addr = __map(tf, vmm, flags | VMR_POPULATE);
+  tf->printf("%d of %d blocks are mapped with large pages\n",
+             __count_large_pages(vmm, addr), AREA_PAGES / LARGE_PAGE_PAGES);
+  cycles_2m = __random_access(vmm, addr);
+  __unmap(vmm, addr, AREA_PAGES);
+
+  accesses = (uint64_t)ACCESS_ROUNDS * ROUND_ACCESSES;
+  tf->printf("%dM, %d random reads: 4K pages %d cycles/read, "
+             "2M pages %d cycles/read\n", MB2B(64UL) >> 20, accesses,
+             cycles_4k / accesses, cycles_2m / accesses);
+}
+
+static void largepage_tests_runner(void *ctx)
+{
+  test_framework_t *tf = ctx;
+  vmm_t *vmm;
+
+  vmm = vmm_create(current_task());
+  if (!vmm) {
+    tf->printf("Can't create VMM!\n");
+    tf->abort();
+  }
+
+  /* Accesses are done with address space of the VMM loaded */
+  map_kernel_area(vmm);
+  tf->printf("Map and split large pages.\n");
+  tc_mapping(tf, vmm);
+  tf->printf("Random access to %dM anonymous mapping.\n", MB2B(64UL) >> 20);
+  tc_random_access(tf, vmm);
+
+  vmm_destroy(vmm);
+  finished = true;
+  sys_exit(0);
+}
+
+static void largepage_test_run(test_framework_t *tf, void *ctx)
+{
+  if (kernel_thread(largepage_tests_runner, tf, NULL)) {
+    tf->printf("Can't create kernel thread!");
+    tf->abort();
+  }
+
+  tf->test_completion_loop(LARGEPAGE_TEST_ID, &finished);
+}
+
+static bool largepage_test_init(void **ctx)
+{
+  finished = false;
+  return true;
+}
+
+static void largepage_test_deinit(void *unused)
+{
+}
+
+testcase_t largepage_testcase = {
+  .id = LARGEPAGE_TEST_ID,
+  .initialize = largepage_test_init,
+  .deinitialize = largepage_test_deinit,
+  .run = largepage_test_run,
+};
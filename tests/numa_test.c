@@ -0,0 +1,240 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * (c) Copyright 2006,2007,2008 MString Core Team <http://mstring.jarios.org>
+ *
+ * tests/numa_test.c: Node-local page allocation test and local versus
+ *                    remote page fault-in bandwidth benchmark.
+ */
+
+#include <config.h>
+#include <test.h>
+#include <mm/page.h>
+#include <mm/page_alloc.h>
+#include <mm/mmpool.h>
+#include <mm/numa.h>
+#include <mstring/task.h>
+#include <mstring/scheduler.h>
+#include <mstring/smp.h>
+#include <mstring/string.h>
+#include <mstring/time.h>
+#include <kernel/syscalls.h>
+#include <arch/atomic.h>
+#include <mstring/types.h>
+
+#define NUMA_TEST_ID "NUMA test"
+
+#define BENCH_PAGES   256   /* 1M with 4K pages */
+#define BENCH_ROUNDS  64
+
+static bool finished = false;
+
+typedef struct __bench_args {
+  test_framework_t *tf;
+  cpu_id_t cpu;
+  mmpool_t *pool;
+  uint64_t ticks;
+  bool done;
+} bench_args_t;
+
+static page_frame_t *bench_pages[BENCH_PAGES];
+
+static cpu_id_t __node_cpu(int node)
+{
+  cpu_id_t c;
+
+  for_each_cpu(c) {
+    if (is_cpu_online(c) && (cpu_to_node(c) == node))
+      return c;
+  }
+
+  return -1;
+}
+
+/*
+ * Do what page fault handler does for anonymous memory: allocate
+ * a page, zero it and touch it, then release all pages.
+ */
+static void bench_thread(void *arg)
+{
+  bench_args_t *ba = arg;
+  uint64_t start;
+  long *p;
+  int i, r;
+
+  if (sched_move_task_to_cpu(current_task(), ba->cpu)) {
+    ba->tf->printf("Can't move benchmark thread to CPU #%d\n", ba->cpu);
+    ba->tf->failed();
+    goto out;
+  }
+
+  start = system_ticks;
+  for (r = 0; r < BENCH_ROUNDS; r++) {
+    for (i = 0; i < BENCH_PAGES; i++) {
+      bench_pages[i] = mmpool_alloc_pages(ba->pool, 1);
+      if (!bench_pages[i]) {
+        ba->tf->printf("Can't allocate page from pool \"%s\"\n",
+                       ba->pool->name);
+        ba->tf->failed();
+        break;
+      }
+
+      atomic_sub(&ba->pool->num_free_pages, 1);
+      p = pframe_to_virt(bench_pages[i]);
+      memset(p, 0, PAGE_SIZE);
+      p[PAGE_SIZE / sizeof(long) - 1] = r;
+    }
+    while (i--) {
+      p = pframe_to_virt(bench_pages[i]);
+      if (p[PAGE_SIZE / sizeof(long) - 1] != r) {
+        ba->tf->printf("Page #%#x is corrupted\n", pframe_number(bench_pages[i]));
+        ba->tf->failed();
+      }
+
+      free_page(bench_pages[i]);
+    }
+  }
+
+  ba->ticks = system_ticks - start;
+out:
+  ba->done = true;
+  sys_exit(0);
+}
+
+static uint64_t bench_run(test_framework_t *tf, cpu_id_t cpu, mmpool_t *pool)
+{
+  bench_args_t ba;
+
+  ba.tf = tf;
+  ba.cpu = cpu;
+  ba.pool = pool;
+  ba.ticks = 0;
+  ba.done = false;
+  if (kernel_thread(bench_thread, &ba, NULL)) {
+    tf->printf("Can't create benchmark thread!\n");
+    tf->abort();
+  }
+  while (!ba.done)
+    sleep(HZ / 10);
+
+  return ba.ticks;
+}
+
+static void tc_local_alloc(test_framework_t *tf)
+{
+  page_frame_t *page;
+  mmpool_t *pool;
+  int node;
+  cpu_id_t c;
+
+  for (node = 0; node < numa_num_nodes; node++) {
+    c = __node_cpu(node);
+    if (c < 0)
+      continue;
+    if (sched_move_task_to_cpu(current_task(), c)) {
+      tf->printf("Can't move to CPU #%d\n", c);
+      tf->abort();
+    }
+
+    page = alloc_page(MMPOOL_KERN);
+    if (!page) {
+      tf->printf("Can't allocate page on CPU #%d\n", c);
+      tf->abort();
+    }
+
+    pool = get_mmpool_by_type(PFRAME_MMPOOL_TYPE(page));
+    if (pool->node != mmpool_get_node_preferred(node, PREF_MMPOOL_KERN)->node) {
+      tf->printf("CPU #%d of node %d got page of node %d\n",
+                 c, node, pool->node);
+      tf->failed();
+    }
+
+    free_page(page);
+  }
+
+  tf->printf("ok\n");
+}
+
+static void tc_bandwidth(test_framework_t *tf)
+{
+  uint64_t ticks, mbytes;
+  int cpu_node, mem_node;
+  mmpool_t *pool;
+  cpu_id_t c;
+
+  mbytes = ((uint64_t)BENCH_PAGES * BENCH_ROUNDS * PAGE_SIZE) >> 20;
+  for (cpu_node = 0; cpu_node < numa_num_nodes; cpu_node++) {
+    c = __node_cpu(cpu_node);
+    if (c < 0)
+      continue;
+
+    for (mem_node = 0; mem_node < numa_num_nodes; mem_node++) {
+      pool = mmpool_get_node_preferred(mem_node, PREF_MMPOOL_KERN);
+      if (pool->node != mem_node)
+        continue;
+
+      ticks = bench_run(tf, c, pool);
+      if (!ticks)
+        ticks = 1;
+
+      tf->printf("CPU #%d (node %d), memory of node %d (%s, distance %d): "
+                 "%dM in %d ticks, %dM/s\n", c, cpu_node, mem_node,
+                 (cpu_node == mem_node) ? "local" : "remote",
+                 numa_distance(cpu_node, mem_node), mbytes, ticks,
+                 (mbytes * HZ) / ticks);
+    }
+  }
+}
+
+static void numa_tests_runner(void *ctx)
+{
+  test_framework_t *tf = ctx;
+
+  tf->printf("%d NUMA node(s) found.\n", numa_num_nodes);
+  tf->printf("Check that pages are allocated from CPU's node.\n");
+  tc_local_alloc(tf);
+  tf->printf("Measure local and remote page fault-in bandwidth.\n");
+  tc_bandwidth(tf);
+  finished = true;
+  sys_exit(0);
+}
+
+static void numa_test_run(test_framework_t *tf, void *ctx)
+{
+  if (kernel_thread(numa_tests_runner, tf, NULL)) {
+    tf->printf("Can't create kernel thread!");
+    tf->abort();
+  }
+
+  tf->test_completion_loop(NUMA_TEST_ID, &finished);
+}
+
+static bool numa_test_init(void **ctx)
+{
+  finished = false;
+  return true;
+}
+
+static void numa_test_deinit(void *unused)
+{
+}
+
+testcase_t numa_testcase = {
+  .id = NUMA_TEST_ID,
+  .initialize = numa_test_init,
+  .deinitialize = numa_test_deinit,
+  .run = numa_test_run,
+};
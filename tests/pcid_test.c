@@ -0,0 +1,318 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * (c) Copyright 2006,2007,2008 MString Core Team <http://mstring.jarios.org>
+ *
+ * tests/pcid_test.c: IPC round-trip latency between two address spaces
+ *                    with and without PCIDs.
+ */
+
+#include <config.h>
+#include <test.h>
+#include <mm/page.h>
+#include <mm/mem.h>
+#include <mm/vmm.h>
+#include <arch/mem.h>
+#include <arch/tlb.h>
+#include <arch/atomic.h>
+#include <arch/timer.h>
+#include <ipc/ipc.h>
+#include <ipc/port.h>
+#include <ipc/channel.h>
+#include <mstring/task.h>
+#include <mstring/scheduler.h>
+#include <mstring/time.h>
+#include <kernel/syscalls.h>
+#include <mstring/types.h>
+
+#define PCID_TEST_ID "PCID test"
+
+#define PINGPONG_ROUNDS 4096
+#define WS_PAGES        32 /* Pages touched by each side per message */
+#define MSG_STOP        (~0UL)
+
+#define CLIENT 0
+#define SERVER 1
+
+static bool finished = false;
+
+/*
+ * Client and server run on the same CPU, each in its own address
+ * space. Both areas are mapped to the same address, so a CPU using
+ * TLB entries of the wrong address space makes a side see values
+ * written by the other one.
+ */
+typedef struct __pingpong_ctx {
+  test_framework_t *tf;
+  vmm_t *vmms[2];
+  uintptr_t addr;
+  pid_t server_pid;
+  volatile long port;
+  volatile bool done[2];
+  atomic_t wrong_reads;
+  uint64_t cycles;
+} pingpong_ctx_t;
+
+static pingpong_ctx_t pp;
+
+static long __map(test_framework_t *tf, vmm_t *vmm, uintptr_t addr)
+{
+  vmrange_flags_t flags = VMR_READ | VMR_WRITE | VMR_PRIVATE |
+    VMR_ANON | VMR_POPULATE;
+  long ret;
+
+  if (addr)
+    flags |= VMR_FIXED;
+
+  rwsem_down_write(&vmm->rwsem);
+  ret = vmrange_map(generic_memobj, vmm, addr, WS_PAGES, flags, 0);
+  rwsem_up_write(&vmm->rwsem);
+  if (ret < 0) {
+    tf->printf("Can't map %d pages: %d\n", WS_PAGES, ret);
+    tf->abort();
+  }
+
+  return ret;
+}
+
+static void __unmap(vmm_t *vmm, uintptr_t addr)
+{
+  rwsem_down_write(&vmm->rwsem);
+  unmap_vmranges(vmm, addr, WS_PAGES);
+  rwsem_up_write(&vmm->rwsem);
+}
+
+/* Check that working set keeps what this side wrote last time */
+static void __touch(int side, ulong_t val)
+{
+  volatile ulong_t *p;
+  page_idx_t i;
+
+  for (i = 0; i < WS_PAGES; i++) {
+    p = (volatile ulong_t *)(pp.addr + ((uintptr_t)i << PAGE_WIDTH));
+    if (val && (*p != (((val - 1) << 1) | side)))
+      atomic_inc(&pp.wrong_reads);
+
+    *p = (val << 1) | side;
+  }
+}
+
+static void server_thread(void *unused)
+{
+  test_framework_t *tf = pp.tf;
+  port_msg_info_t msg_info;
+  ipc_gen_port_t *p;
+  iovec_t iov;
+  off_t offset;
+  ulong_t msg;
+  long port, r;
+
+  if (sched_move_task_to_cpu(current_task(), 0)) {
+    tf->printf("Can't move server to CPU #0\n");
+    tf->abort();
+  }
+
+  tlb_use_rpd(&pp.vmms[SERVER]->rpd);
+  port = sys_create_port(IPC_BLOCKED_ACCESS, 0);
+  if (port < 0) {
+    tf->printf("Can't create a port: %d\n", port);
+    tf->abort();
+  }
+
+  p = ipc_get_port(current_task(), port, &r);
+  if (!p) {
+    tf->printf("Can't get port %d: %d\n", port, r);
+    tf->abort();
+  }
+
+  iov.iov_base = &msg;
+  iov.iov_len = sizeof(msg);
+  pp.server_pid = current_task()->pid;
+  pp.port = port;
+  for (;;) {
+    r = ipc_port_receive(p, IPC_BLOCKED_ACCESS, &iov, 1, &msg_info);
+    if (r) {
+      tf->printf("Server can't receive a message: %d\n", r);
+      tf->failed();
+      break;
+    }
+    if (msg != MSG_STOP)
+      __touch(SERVER, msg++);
+
+    offset = 0;
+    ipc_port_msg_write(p, msg_info.msg_id, &iov, 1, &offset, sizeof(msg),
+                       true, 0, false);
+    if (msg == MSG_STOP)
+      break;
+  }
+
+  ipc_put_port(p);
+  sys_close_port(port);
+  tlb_use_rpd(NULL);
+  pp.done[SERVER] = true;
+  sys_exit(0);
+}
+
+static void client_thread(void *unused)
+{
+  test_framework_t *tf = pp.tf;
+  iovec_t snd_iov, rcv_iov;
+  ulong_t msg, reply;
+  ipc_channel_t *c;
+  uint64_t start;
+  long channel, r;
+
+  if (sched_move_task_to_cpu(current_task(), 0)) {
+    tf->printf("Can't move client to CPU #0\n");
+    tf->abort();
+  }
+
+  tlb_use_rpd(&pp.vmms[CLIENT]->rpd);
+  channel = sys_open_channel(pp.server_pid, pp.port,
+                             IPC_CHANNEL_FLAG_BLOCKED_MODE);
+  if (channel < 0) {
+    tf->printf("Can't open a channel to %d:%d: %d\n", pp.server_pid,
+               pp.port, channel);
+    tf->abort();
+  }
+
+  c = ipc_get_channel(current_task(), channel);
+  if (!c) {
+    tf->printf("Can't get channel %d\n", channel);
+    tf->abort();
+  }
+
+  snd_iov.iov_base = &msg;
+  snd_iov.iov_len = sizeof(msg);
+  rcv_iov.iov_base = &reply;
+  rcv_iov.iov_len = sizeof(reply);
+  start = arch_cycles();
+  for (msg = 0; msg < PINGPONG_ROUNDS; msg++) {
+    __touch(CLIENT, msg);
+    r = ipc_port_send_iov(c, &snd_iov, 1, &rcv_iov, 1);
+    if ((r != sizeof(reply)) || (reply != msg + 1)) {
+      tf->printf("Wrong reply to message %d: %d, %d\n", msg, r, reply);
+      tf->failed();
+      break;
+    }
+  }
+
+  pp.cycles = arch_cycles() - start;
+  msg = MSG_STOP;
+  ipc_port_send_iov(c, &snd_iov, 1, &rcv_iov, 1);
+  ipc_put_channel(c);
+  sys_close_channel(channel);
+  tlb_use_rpd(NULL);
+  pp.done[CLIENT] = true;
+  sys_exit(0);
+}
+
+/* Returns cycles per IPC round trip */
+static uint64_t __pingpong(test_framework_t *tf)
+{
+  pp.port = -1;
+  pp.done[CLIENT] = pp.done[SERVER] = false;
+  pp.addr = __map(tf, pp.vmms[CLIENT], 0);
+  __map(tf, pp.vmms[SERVER], pp.addr);
+  if (kernel_thread(server_thread, NULL, NULL)) {
+    tf->printf("Can't create server thread!\n");
+    tf->abort();
+  }
+  while (pp.port < 0)
+    sleep(HZ / 10);
+
+  if (kernel_thread(client_thread, NULL, NULL)) {
+    tf->printf("Can't create client thread!\n");
+    tf->abort();
+  }
+  while (!pp.done[CLIENT] || !pp.done[SERVER])
+    sleep(HZ / 10);
+
+  __unmap(pp.vmms[CLIENT], pp.addr);
+  __unmap(pp.vmms[SERVER], pp.addr);
+  return pp.cycles / PINGPONG_ROUNDS;
+}
+
+static void pcid_tests_runner(void *ctx)
+{
+  test_framework_t *tf = ctx;
+  bool pcid = tlb_pcid_enabled;
+  uint64_t cycles_off, cycles_on = 0;
+  int i;
+
+  pp.tf = tf;
+  atomic_set(&pp.wrong_reads, 0);
+  for (i = CLIENT; i <= SERVER; i++) {
+    pp.vmms[i] = vmm_create(current_task());
+    if (!pp.vmms[i]) {
+      tf->printf("Can't create VMM!\n");
+      tf->abort();
+    }
+
+    /* Client and server run with address spaces of the VMMs loaded */
+    map_kernel_area(pp.vmms[i]);
+  }
+
+  tlb_set_pcid(false);
+  cycles_off = __pingpong(tf);
+  if (tlb_set_pcid(true))
+    tf->printf("CPU doesn't support PCIDs.\n");
+  else
+    cycles_on = __pingpong(tf);
+
+  tlb_set_pcid(pcid);
+  tf->printf("IPC round trip touching %d pages on each side: "
+             "%d cycles without PCIDs, %d cycles with PCIDs\n",
+             WS_PAGES, cycles_off, cycles_on);
+  if (atomic_get(&pp.wrong_reads)) {
+    tf->printf("%d reads saw pages of the other address space\n",
+               atomic_get(&pp.wrong_reads));
+    tf->failed();
+  }
+
+  for (i = CLIENT; i <= SERVER; i++)
+    vmm_destroy(pp.vmms[i]);
+
+  finished = true;
+  sys_exit(0);
+}
+
+static void pcid_test_run(test_framework_t *tf, void *ctx)
+{
+  if (kernel_thread(pcid_tests_runner, tf, NULL)) {
+    tf->printf("Can't create kernel thread!");
+    tf->abort();
+  }
+
+  tf->test_completion_loop(PCID_TEST_ID, &finished);
+}
+
+static bool pcid_test_init(void **ctx)
+{
+  finished = false;
+  return true;
+}
+
+static void pcid_test_deinit(void *unused)
+{
+}
+
+testcase_t pcid_testcase = {
+  .id = PCID_TEST_ID,
+  .initialize = pcid_test_init,
+  .deinitialize = pcid_test_deinit,
+  .run = pcid_test_run,
+};
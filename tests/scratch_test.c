@@ -0,0 +1,127 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * (c) Copyright 2006,2007,2008 MString Core Team <http://mstring.jarios.org>
+ *
+ *
+ * tests/scratch_test.c: Scratch arena test.
+ */
+
+#include <config.h>
+#include <test.h>
+#include <mm/scratch.h>
+#include <mstring/task.h>
+#include <kernel/syscalls.h>
+#include <mstring/types.h>
+
+#define SCRATCH_TEST_ID "Scratch arena test"
+
+static bool finished = false;
+
+static void tc_alloc_release(test_framework_t *tf)
+{
+  scratch_mark_t mark, inner;
+  char *a, *b, *c;
+
+  mark = scratch_mark();
+  a = scratch_alloc(3);
+  b = scratch_alloc(sizeof(long));
+  if (!a || !b) {
+    tf->printf("Can't allocate scratch memory!\n");
+    tf->abort();
+  }
+  if (((uintptr_t)b & (sizeof(long) - 1)) || (b != (a + sizeof(long)))) {
+    tf->printf("Scratch objects %p and %p aren't packed and aligned\n", a, b);
+    tf->failed();
+  }
+
+  inner = scratch_mark();
+  c = scratch_alloc(16);
+  scratch_release(inner);
+  if (scratch_alloc(16) != c) {
+    tf->printf("Released scratch memory %p wasn't reused\n", c);
+    tf->failed();
+  }
+
+  scratch_release(mark);
+  if (scratch_alloc(1) != a) {
+    tf->printf("Arena wasn't released to its mark\n");
+    tf->failed();
+  }
+
+  scratch_release(mark);
+  tf->printf("ok\n");
+}
+
+static void tc_overflow(test_framework_t *tf)
+{
+  scratch_mark_t mark = scratch_mark();
+
+  if (scratch_alloc(SCRATCH_ARENA_SIZE + 1)) {
+    tf->printf("Allocation exceeding the arena succeeded!\n");
+    tf->failed();
+  }
+  if (!scratch_alloc(SCRATCH_ARENA_SIZE - mark)) {
+    tf->printf("Can't allocate the rest of the arena!\n");
+    tf->failed();
+  }
+  if (scratch_alloc(1)) {
+    tf->printf("Allocation from the full arena succeeded!\n");
+    tf->failed();
+  }
+
+  scratch_release(mark);
+  tf->printf("ok\n");
+}
+
+static void scratch_tests_runner(void *ctx)
+{
+  test_framework_t *tf = ctx;
+
+  tf->printf("Check allocation and release of scratch memory.\n");
+  tc_alloc_release(tf);
+  tf->printf("Check that arena doesn't overflow.\n");
+  tc_overflow(tf);
+  finished = true;
+  sys_exit(0);
+}
+
+static void scratch_test_run(test_framework_t *tf, void *ctx)
+{
+  if (kernel_thread(scratch_tests_runner, tf, NULL)) {
+    tf->printf("Can't create kernel thread!");
+    tf->abort();
+  }
+
+  tf->test_completion_loop(SCRATCH_TEST_ID, &finished);
+}
+
+static bool scratch_test_init(void **ctx)
+{
+  finished = false;
+  return true;
+}
+
+static void scratch_test_deinit(void *unused)
+{
+}
+
+testcase_t scratch_testcase = {
+  .id = SCRATCH_TEST_ID,
+  .initialize = scratch_test_init,
+  .deinitialize = scratch_test_deinit,
+  .run = scratch_test_run,
+};
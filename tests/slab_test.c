@@ -0,0 +1,372 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * (c) Copyright 2006,2007,2008 MString Core Team <http://mstring.jarios.org>
+ *
+ * tests/slab_test.c: Slab allocator test and memalloc/memfree
+ *                    throughput benchmark.
+ */
+
+#include <config.h>
+#include <test.h>
+#include <mm/slab.h>
+#include <mm/shrinker.h>
+#include <mstring/task.h>
+#include <mstring/scheduler.h>
+#include <mstring/smp.h>
+#include <mstring/time.h>
+#include <mstring/string.h>
+#include <kernel/syscalls.h>
+#include <arch/atomic.h>
+#include <arch/preempt.h>
+#include <mstring/types.h>
+
+#define SLAB_TEST_ID "Slab test"
+
+#define BENCH_OBJ_SIZE  64
+#define BENCH_BATCH     16    /* Objects allocated before freeing them */
+#define BENCH_ROUNDS    20000
+
+static bool finished = false;
+static atomic_t bench_running;
+static volatile bool bench_failed;
+
+typedef struct __bench_thread {
+  memcache_t *cache;    /* NULL means memalloc/memfree */
+  cpu_id_t cpu;
+} bench_thread_t;
+
+static bench_thread_t bench_threads[CONFIG_NRCPUS];
+
+static void bench_thread(void *arg)
+{
+  bench_thread_t *bt = arg;
+  void *objs[BENCH_BATCH];
+  int i, j;
+
+  if (sched_move_task_to_cpu(current_task(), bt->cpu))
+    bench_failed = true;
+
+  for (i = 0; (i < BENCH_ROUNDS) && !bench_failed; i++) {
+    for (j = 0; j < BENCH_BATCH; j++) {
+      if (bt->cache)
+        objs[j] = alloc_from_memcache(bt->cache, 0);
+      else
+        objs[j] = memalloc(BENCH_OBJ_SIZE);
+      if (!objs[j]) {
+        bench_failed = true;
+        break;
+      }
+
+      *(long *)objs[j] = i;
+    }
+    while (j--) {
+      if (*(long *)objs[j] != i)
+        bench_failed = true;
+
+      memfree(objs[j]);
+    }
+  }
+
+  atomic_dec(&bench_running);
+  sys_exit(0);
+}
+
+/*
+ * Run one allocating thread on each of the first "ncpus" online CPUs
+ * and return number of ticks all of them took.
+ */
+static uint64_t bench_run(test_framework_t *tf, memcache_t *cache, int ncpus)
+{
+  uint64_t start;
+  cpu_id_t c;
+  int n = 0;
+
+  bench_failed = false;
+  atomic_set(&bench_running, ncpus);
+  start = system_ticks;
+  for_each_cpu(c) {
+    if (!is_cpu_online(c) || (n == ncpus))
+      continue;
+
+    bench_threads[n].cache = cache;
+    bench_threads[n].cpu = c;
+    if (kernel_thread(bench_thread, &bench_threads[n], NULL)) {
+      tf->printf("Can't create benchmark thread!\n");
+      tf->abort();
+    }
+
+    n++;
+  }
+  while (atomic_get(&bench_running))
+    sleep(HZ / 10);
+
+  if (bench_failed) {
+    tf->printf("Benchmark on %d CPUs failed!\n", ncpus);
+    tf->failed();
+    return 0;
+  }
+
+  return system_ticks - start;
+}
+
+static void tc_magazines(test_framework_t *tf)
+{
+  memcache_t *cache;
+  void *obj, *obj2;
+
+  cache = create_memcache("slab test", BENCH_OBJ_SIZE, 1,
+                          MMPOOL_KERN | SMCF_UNIQUE);
+  if (!cache) {
+    tf->printf("Can't create memory cache!\n");
+    tf->abort();
+  }
+  if (!memcache_set_magazine_size(cache, SLAB_MAGAZINE_MAX + 1)) {
+    tf->printf("Too big magazine size was accepted!\n");
+    tf->failed();
+  }
+  if (memcache_set_magazine_size(cache, 8)) {
+    tf->printf("Can't set magazine size!\n");
+    tf->abort();
+  }
+
+  /* Freed object must be the very next one allocated on the same CPU */
+  preempt_disable();
+  obj = alloc_from_memcache(cache, 0);
+  memfree(obj);
+  obj2 = alloc_from_memcache(cache, 0);
+  preempt_enable();
+  if (obj != obj2) {
+    tf->printf("Freed object %p wasn't cached: %p was allocated\n", obj, obj2);
+    tf->failed();
+  }
+
+  memfree(obj2);
+  memcache_drain_magazines(cache);
+  destroy_memcache(cache);
+  tf->printf("ok\n");
+}
+
+#define STAT_OBJS 10
+
+static int __find_stat(kcontrol_memcache_stat_t *stat, void *ctx)
+{
+  kcontrol_memcache_stat_t *found = ctx;
+
+  if (strcmp(stat->name, found->name))
+    return 0;
+
+  *found = *stat;
+  return 1;
+}
+
+static void __check_stat(test_framework_t *tf, ulong_t allocs,
+                         ulong_t frees, ulong_t max_objects)
+{
+  kcontrol_memcache_stat_t stat;
+
+  memset(&stat, 0, sizeof(stat));
+  strcpy(stat.name, "slab stats");
+  if (!memcaches_walk_stats(__find_stat, &stat)) {
+    tf->printf("Statistics of memory cache weren't found!\n");
+    tf->abort();
+  }
+  if ((stat.allocs != allocs) || (stat.frees != frees) ||
+      (stat.objects != (allocs - frees)) || (stat.max_objects != max_objects)) {
+    tf->printf("Wrong statistics: %d allocs, %d frees, %d objects, "
+               "%d max objects (expected %d, %d, %d, %d)\n",
+               stat.allocs, stat.frees, stat.objects, stat.max_objects,
+               allocs, frees, allocs - frees, max_objects);
+    tf->failed();
+  }
+}
+
+static void tc_statistics(test_framework_t *tf)
+{
+  memcache_t *cache;
+  void *objs[STAT_OBJS];
+  int i;
+
+  cache = create_memcache("slab stats", BENCH_OBJ_SIZE, 1,
+                          MMPOOL_KERN | SMCF_UNIQUE);
+  if (!cache) {
+    tf->printf("Can't create memory cache!\n");
+    tf->abort();
+  }
+
+  for (i = 0; i < STAT_OBJS; i++)
+    objs[i] = alloc_from_memcache(cache, 0);
+
+  /* High watermark is sampled when statistics are read */
+  __check_stat(tf, STAT_OBJS, 0, STAT_OBJS);
+  for (i = 0; i < STAT_OBJS / 2; i++)
+    memfree(objs[i]);
+
+  __check_stat(tf, STAT_OBJS, STAT_OBJS / 2, STAT_OBJS);
+  for (; i < STAT_OBJS; i++)
+    memfree(objs[i]);
+
+  __check_stat(tf, STAT_OBJS, STAT_OBJS, STAT_OBJS);
+  memcache_drain_magazines(cache);
+  destroy_memcache(cache);
+  tf->printf("ok\n");
+}
+
+#define SHRINK_OBJS ((4 << PAGE_WIDTH) / BENCH_OBJ_SIZE)
+
+static void *shrink_objs[SHRINK_OBJS];
+
+static ulong_t __nslabs(test_framework_t *tf, const char *name)
+{
+  kcontrol_memcache_stat_t stat;
+
+  memset(&stat, 0, sizeof(stat));
+  strcpy(stat.name, name);
+  if (!memcaches_walk_stats(__find_stat, &stat)) {
+    tf->printf("Statistics of memory cache weren't found!\n");
+    tf->abort();
+  }
+
+  return stat.nslabs;
+}
+
+/*
+ * Objects cached in magazines of a CPU keep their slabs busy, so
+ * reclaim must flush them before it looks for empty slabs.
+ */
+static void tc_shrink(test_framework_t *tf)
+{
+  memcache_t *cache;
+  ulong_t before, after;
+  int i;
+
+  cache = create_memcache("slab shrink", BENCH_OBJ_SIZE, 1,
+                          MMPOOL_KERN | SMCF_UNIQUE);
+  if (!cache) {
+    tf->printf("Can't create memory cache!\n");
+    tf->abort();
+  }
+  if (memcache_set_magazine_size(cache, 8)) {
+    tf->printf("Can't set magazine size!\n");
+    tf->abort();
+  }
+
+  /*
+   * Objects of the first slab are freed last, so they stay in magazines
+   * of this CPU, and only the active slab of this CPU may remain.
+   */
+  preempt_disable();
+  for (i = 0; i < SHRINK_OBJS; i++) {
+    shrink_objs[i] = alloc_from_memcache(cache, 0);
+    if (!shrink_objs[i]) {
+      preempt_enable();
+      tf->printf("Can't allocate object %d!\n", i);
+      tf->abort();
+    }
+  }
+  while (i--)
+    memfree(shrink_objs[i]);
+
+  preempt_enable();
+  before = __nslabs(tf, "slab shrink");
+  shrink_memory();
+  after = __nslabs(tf, "slab shrink");
+  if (after > 1) {
+    tf->printf("%d of %d slabs weren't reclaimed\n", after, before);
+    tf->failed();
+  }
+
+  destroy_memcache(cache);
+  tf->printf("ok\n");
+}
+
+static void tc_throughput(test_framework_t *tf)
+{
+  memcache_t *cache;
+  uint64_t plain, mags, generic;
+  int ncpus = 0;
+  cpu_id_t c;
+
+  cache = create_memcache("slab bench", BENCH_OBJ_SIZE, 1,
+                          MMPOOL_KERN | SMCF_UNIQUE);
+  if (!cache) {
+    tf->printf("Can't create memory cache!\n");
+    tf->abort();
+  }
+
+  for_each_cpu(c) {
+    if (!is_cpu_online(c))
+      continue;
+
+    ncpus++;
+    memcache_set_magazine_size(cache, 0);
+    plain = bench_run(tf, cache, ncpus);
+    memcache_set_magazine_size(cache, SLAB_MAGAZINE_MAX / 2);
+    mags = bench_run(tf, cache, ncpus);
+    generic = bench_run(tf, NULL, ncpus);
+    if (!plain || !mags || !generic)
+      break;
+
+    tf->printf("%d CPUs, %d alloc/free pairs per CPU: %d ticks without "
+               "magazines, %d ticks with magazines, %d ticks via memalloc\n",
+               ncpus, BENCH_ROUNDS * BENCH_BATCH, plain, mags, generic);
+  }
+
+  destroy_memcache(cache);
+}
+
+static void slab_tests_runner(void *ctx)
+{
+  test_framework_t *tf = ctx;
+
+  tf->printf("Check that freed objects are cached per CPU.\n");
+  tc_magazines(tf);
+  tf->printf("Check allocation statistics of memory cache.\n");
+  tc_statistics(tf);
+  tf->printf("Check that reclaim returns slabs with cached objects.\n");
+  tc_shrink(tf);
+  tf->printf("Measure memalloc/memfree throughput across CPUs.\n");
+  tc_throughput(tf);
+  finished = true;
+  sys_exit(0);
+}
+
+static void slab_test_run(test_framework_t *tf, void *ctx)
+{
+  if (kernel_thread(slab_tests_runner, tf, NULL)) {
+    tf->printf("Can't create kernel thread!");
+    tf->abort();
+  }
+
+  tf->test_completion_loop(SLAB_TEST_ID, &finished);
+}
+
+static bool slab_test_init(void **ctx)
+{
+  finished = false;
+  return true;
+}
+
+static void slab_test_deinit(void *unused)
+{
+}
+
+testcase_t slab_testcase = {
+  .id = SLAB_TEST_ID,
+  .initialize = slab_test_init,
+  .deinitialize = slab_test_deinit,
+  .run = slab_test_run,
+};
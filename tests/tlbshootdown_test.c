@@ -0,0 +1,376 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * (c) Copyright 2006,2007,2008 MString Core Team <http://mstring.jarios.org>
+ *
+ * tests/tlbshootdown_test.c: Stale TLB entries after munmap test and
+ *                            multi-threaded munmap stress.
+ */
+
+#include <config.h>
+#include <test.h>
+#include <mm/page.h>
+#include <mm/mem.h>
+#include <mm/vmm.h>
+#include <arch/mem.h>
+#include <arch/tlb.h>
+#include <arch/atomic.h>
+#include <arch/preempt.h>
+#include <arch/timer.h>
+#include <mstring/task.h>
+#include <mstring/scheduler.h>
+#include <mstring/smp.h>
+#include <mstring/time.h>
+#include <kernel/syscalls.h>
+#include <mstring/types.h>
+
+#define TLBSHOOTDOWN_TEST_ID "TLB shootdown test"
+
+#define CHECK_ROUNDS  256
+#define STRESS_ROUNDS 1024
+#define STRESS_PAGES  16
+#define ROUND_STOP    (-1)
+
+static bool finished = false;
+
+typedef struct __check_ctx {
+  test_framework_t *tf;
+  vmm_t *vmm;
+  volatile uintptr_t addr;
+  volatile page_idx_t npages;
+  volatile long round;
+  atomic_t readers_done;
+  atomic_t readers_exited;
+  atomic_t stale_reads;
+} check_ctx_t;
+
+typedef struct __stress_args {
+  test_framework_t *tf;
+  vmm_t *vmm;
+  cpu_id_t cpu;
+  uint64_t cycles;
+  bool done;
+} stress_args_t;
+
+static check_ctx_t check_ctx;
+static stress_args_t stress_args[CONFIG_NRCPUS];
+
+static long __map(test_framework_t *tf, vmm_t *vmm, uintptr_t addr,
+                  page_idx_t npages)
+{
+  vmrange_flags_t flags = VMR_READ | VMR_WRITE | VMR_PRIVATE |
+    VMR_ANON | VMR_POPULATE;
+  long ret;
+
+  if (addr)
+    flags |= VMR_FIXED;
+
+  rwsem_down_write(&vmm->rwsem);
+  ret = vmrange_map(generic_memobj, vmm, addr, npages, flags, 0);
+  rwsem_up_write(&vmm->rwsem);
+  if (ret < 0) {
+    tf->printf("Can't map %d pages: %d\n", npages, ret);
+    tf->abort();
+  }
+
+  return ret;
+}
+
+static void __unmap(vmm_t *vmm, uintptr_t addr, page_idx_t npages)
+{
+  rwsem_down_write(&vmm->rwsem);
+  unmap_vmranges(vmm, addr, npages);
+  rwsem_up_write(&vmm->rwsem);
+}
+
+/* Write @a val to each page of the area via kernel mapping of its pages */
+static void __fill(vmm_t *vmm, uintptr_t addr, page_idx_t npages, long val)
+{
+  page_idx_t i, pidx;
+
+  for (i = 0; i < npages; i++) {
+    RPD_LOCK_READ(&vmm->rpd);
+    pidx = vaddr_to_pidx(&vmm->rpd, addr + ((uintptr_t)i << PAGE_WIDTH));
+    RPD_UNLOCK_READ(&vmm->rpd);
+    *(volatile long *)pframe_to_virt(pframe_by_id(pidx)) = val;
+  }
+}
+
+static cpu_id_t __num_online_cpus(void)
+{
+  cpu_id_t c, n = 0;
+
+  for_each_cpu(c) {
+    if (is_cpu_online(c))
+      n++;
+  }
+
+  return n;
+}
+
+/*
+ * Keep address space of the VMM loaded and read the area mapped by
+ * the owner each round. Interrupts stay enabled, so shootdown IPIs
+ * are served. A stale TLB entry makes the reader see page of one of
+ * the previous rounds: the area is remapped to the same address.
+ */
+static void reader_thread(void *arg)
+{
+  cpu_id_t cpu = (cpu_id_t)(ulong_t)arg;
+  check_ctx_t *cc = &check_ctx;
+  long round, seen = 0;
+  page_idx_t i;
+
+  if (sched_move_task_to_cpu(current_task(), cpu)) {
+    cc->tf->printf("Can't move reader to CPU #%d\n", cpu);
+    cc->tf->failed();
+    goto out;
+  }
+
+  preempt_disable();
+  load_rpd(&cc->vmm->rpd);
+  for (;;) {
+    while ((round = cc->round) == seen)
+      ;
+    if (round == ROUND_STOP)
+      break;
+
+    for (i = 0; i < cc->npages; i++) {
+      if (*(volatile long *)(cc->addr + ((uintptr_t)i << PAGE_WIDTH))
+          != round) {
+        atomic_inc(&cc->stale_reads);
+      }
+    }
+
+    seen = round;
+    atomic_inc(&cc->readers_done);
+  }
+
+  load_rpd(task_get_rpd(current_task()));
+  preempt_enable();
+out:
+  atomic_inc(&cc->readers_exited);
+  sys_exit(0);
+}
+
+static void tc_stale_entries(test_framework_t *tf, vmm_t *vmm,
+                             page_idx_t npages, cpu_id_t nr_readers)
+{
+  check_ctx_t *cc = &check_ctx;
+  uint64_t start, cycles = 0;
+  ulong_t ipis = 0, ipis0;
+  uintptr_t addr = 0;
+  cpu_id_t c;
+  long r;
+
+  cc->tf = tf;
+  cc->vmm = vmm;
+  cc->npages = npages;
+  cc->round = 0;
+  atomic_set(&cc->readers_done, 0);
+  atomic_set(&cc->readers_exited, 0);
+  atomic_set(&cc->stale_reads, 0);
+  for_each_cpu(c) {
+    if (!c || !is_cpu_online(c))
+      continue;
+    if (kernel_thread(reader_thread, (void *)(ulong_t)c, NULL)) {
+      tf->printf("Can't create reader thread!\n");
+      tf->abort();
+    }
+  }
+  for (r = 1; r <= CHECK_ROUNDS; r++) {
+    addr = __map(tf, vmm, addr, npages);
+    __fill(vmm, addr, npages, r);
+    atomic_set(&cc->readers_done, 0);
+    cc->addr = addr;
+    atomic_mb();
+    cc->round = r;
+    while (atomic_get(&cc->readers_done) != nr_readers)
+      ;
+
+    ipis0 = tlb_shootdown_ipis;
+    start = arch_cycles();
+    __unmap(vmm, addr, npages);
+    cycles += arch_cycles() - start;
+    ipis += tlb_shootdown_ipis - ipis0;
+  }
+
+  cc->round = ROUND_STOP;
+  while (atomic_get(&cc->readers_exited) != nr_readers)
+    sleep(HZ / 10);
+
+  tf->printf("%d pages x %d rounds, %d readers: %d IPIs per munmap, "
+             "%d cycles per munmap, %d stale reads\n", npages, CHECK_ROUNDS,
+             nr_readers, ipis / CHECK_ROUNDS, cycles / CHECK_ROUNDS,
+             atomic_get(&cc->stale_reads));
+  if (atomic_get(&cc->stale_reads)) {
+    tf->failed();
+  }
+
+  /* Invalidations of one munmap are sent by a single IPI to each reader */
+  if (ipis > (ulong_t)nr_readers * CHECK_ROUNDS) {
+    tf->printf("Expected at most %d IPIs per munmap\n", nr_readers);
+    tf->failed();
+  }
+}
+
+/*
+ * Map, touch and munmap an area in the shared address space. Other
+ * threads keep the address space loaded while they touch their areas,
+ * so each munmap shoots down TLB of them.
+ */
+static void stress_thread(void *arg)
+{
+  stress_args_t *sa = arg;
+  uintptr_t addr;
+  uint64_t start;
+  page_idx_t i;
+  int r;
+
+  if (sched_move_task_to_cpu(current_task(), sa->cpu)) {
+    sa->tf->printf("Can't move stress thread to CPU #%d\n", sa->cpu);
+    sa->tf->failed();
+    goto out;
+  }
+
+  for (r = 0; r < STRESS_ROUNDS; r++) {
+    addr = __map(sa->tf, sa->vmm, 0, STRESS_PAGES);
+    preempt_disable();
+    load_rpd(&sa->vmm->rpd);
+    for (i = 0; i < STRESS_PAGES; i++)
+      *(volatile long *)(addr + ((uintptr_t)i << PAGE_WIDTH)) = r;
+    for (i = 0; i < STRESS_PAGES; i++) {
+      if (*(volatile long *)(addr + ((uintptr_t)i << PAGE_WIDTH)) != r) {
+        sa->tf->printf("[CPU #%d] Page %p is corrupted\n", sa->cpu,
+                       addr + ((uintptr_t)i << PAGE_WIDTH));
+        sa->tf->failed();
+      }
+    }
+
+    load_rpd(task_get_rpd(current_task()));
+    preempt_enable();
+    start = arch_cycles();
+    __unmap(sa->vmm, addr, STRESS_PAGES);
+    sa->cycles += arch_cycles() - start;
+  }
+
+out:
+  sa->done = true;
+  sys_exit(0);
+}
+
+static void tc_stress(test_framework_t *tf, vmm_t *vmm)
+{
+  uint64_t cycles = 0;
+  ulong_t ipis0 = tlb_shootdown_ipis;
+  int nr_threads = 0;
+  cpu_id_t c;
+
+  for_each_cpu(c) {
+    if (!is_cpu_online(c))
+      continue;
+
+    stress_args[c].tf = tf;
+    stress_args[c].vmm = vmm;
+    stress_args[c].cpu = c;
+    stress_args[c].cycles = 0;
+    stress_args[c].done = false;
+    if (kernel_thread(stress_thread, &stress_args[c], NULL)) {
+      tf->printf("Can't create stress thread!\n");
+      tf->abort();
+    }
+
+    nr_threads++;
+  }
+  for_each_cpu(c) {
+    if (!is_cpu_online(c))
+      continue;
+
+    while (!stress_args[c].done)
+      sleep(HZ / 10);
+
+    cycles += stress_args[c].cycles;
+  }
+
+  tf->printf("%d threads x %d munmaps of %d pages: %d IPIs, "
+             "%d cycles per munmap\n", nr_threads, STRESS_ROUNDS,
+             STRESS_PAGES, tlb_shootdown_ipis - ipis0,
+             cycles / ((uint64_t)nr_threads * STRESS_ROUNDS));
+}
+
+static void tlbshootdown_tests_runner(void *ctx)
+{
+  test_framework_t *tf = ctx;
+  cpu_id_t nr_readers = __num_online_cpus() - 1;
+  vmm_t *vmm;
+
+  vmm = vmm_create(current_task());
+  if (!vmm) {
+    tf->printf("Can't create VMM!\n");
+    tf->abort();
+  }
+
+  /* Threads access user addresses with address space of the VMM loaded */
+  map_kernel_area(vmm);
+  if (!nr_readers) {
+    tf->printf("Only one CPU is online, no TLB shootdowns are done.\n");
+  }
+  else {
+    if (sched_move_task_to_cpu(current_task(), 0)) {
+      tf->printf("Can't move to CPU #0\n");
+      tf->abort();
+    }
+
+    /* Invalidations of both batched pages and whole TLB are checked */
+    tf->printf("Check for stale TLB entries after munmap.\n");
+    tc_stale_entries(tf, vmm, TLB_BATCH_PAGES / 2, nr_readers);
+    tc_stale_entries(tf, vmm, TLB_BATCH_PAGES * 4, nr_readers);
+  }
+
+  tf->printf("Concurrent munmap stress.\n");
+  tc_stress(tf, vmm);
+
+  vmm_destroy(vmm);
+  finished = true;
+  sys_exit(0);
+}
+
+static void tlbshootdown_test_run(test_framework_t *tf, void *ctx)
+{
+  if (kernel_thread(tlbshootdown_tests_runner, tf, NULL)) {
+    tf->printf("Can't create kernel thread!");
+    tf->abort();
+  }
+
+  tf->test_completion_loop(TLBSHOOTDOWN_TEST_ID, &finished);
+}
+
+static bool tlbshootdown_test_init(void **ctx)
+{
+  finished = false;
+  return true;
+}
+
+static void tlbshootdown_test_deinit(void *unused)
+{
+}
+
+testcase_t tlbshootdown_testcase = {
+  .id = TLBSHOOTDOWN_TEST_ID,
+  .initialize = tlbshootdown_test_init,
+  .deinitialize = tlbshootdown_test_deinit,
+  .run = tlbshootdown_test_run,
+};
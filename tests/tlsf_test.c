@@ -30,15 +30,23 @@
 #include <mm/vmm.h>
 #include <mm/tlsf.h>
 #include <mstring/task.h>
+#include <mstring/scheduler.h>
+#include <mstring/smp.h>
+#include <mstring/time.h>
 #include <kernel/syscalls.h>
+#include <arch/atomic.h>
 #include <mstring/types.h>
 
 #define TLSF_TEST_ID "TLSF test"
 
+#ifndef CONFIG_DEBUG_MM
+#define tlsf_validate_dbg(tlsf)
+#endif /* !CONFIG_DEBUG_MM */
+
 static int __pr = 0;
 
 static struct tlsf_test_ctx {
-  mm_pool_t *pool;
+  mmpool_t *pool;
   tlsf_t *tlsf;
   bool completed;
 } tlsf_ctx;
@@ -53,9 +61,8 @@ static inline int __simple_random(void)
 #define MAX_PGS_NCONT 128
 
 /* TODO DK: check automatically if all merges were done properly! */
-static void tc_alloc_dealloc(void *ctx)
+static void tc_alloc_dealloc(test_framework_t *tf)
 {
-  test_framework_t *tf = ctx;  
   list_node_t *iter;
   list_head_t head;
   page_idx_t allocated, saved_ap, resr = 0;
@@ -63,15 +70,15 @@ static void tc_alloc_dealloc(void *ctx)
   page_idx_t c;
 
   tf->printf("Target MM pool: %s\n", tlsf_ctx.pool->name);
-  tf->printf("Number of allocatable pages: %d\n", tlsf_ctx.pool->free_pages);
-  saved_ap = atomic_get(&tlsf_ctx.pool->free_pages);
+  tf->printf("Number of allocatable pages: %d\n", tlsf_ctx.pool->num_free_pages);
+  saved_ap = atomic_get(&tlsf_ctx.pool->num_free_pages);
 
 #ifdef CONFIG_SMP
   for_each_cpu(c) {
-    if (!tlsf_ctx.tlsf->percpu[c] || !c)
+    if (c == cpu_id())
       continue;
 
-    resr += tlsf_ctx.tlsf->percpu[c]->noc_pages;
+    resr += tlsf_ctx.tlsf->percpu[c].noc_pages;
   }
 #endif /* CONFIG_SMP */
 
@@ -87,9 +94,9 @@ static void tc_alloc_dealloc(void *ctx)
     list_add2tail(&head, &pages->chain_node);
     allocated++;    
   }
-  if (atomic_get(&tlsf_ctx.pool->free_pages) != resr) {
+  if (atomic_get(&tlsf_ctx.pool->num_free_pages) != resr) {
     tf->printf("Failed to allocate %d pages. %d pages rest\n",
-               saved_ap, atomic_get(&tlsf_ctx.pool->free_pages));
+               saved_ap, atomic_get(&tlsf_ctx.pool->num_free_pages));
     tf->failed();
   }
   if (allocated != saved_ap) {
@@ -102,15 +109,15 @@ static void tc_alloc_dealloc(void *ctx)
   pages = list_entry(list_node_first(&head), page_frame_t, chain_node);
   list_cut_head(&head);
   free_pages_chain(pages);
-  if (atomic_get(&tlsf_ctx.pool->free_pages) != saved_ap) {
+  if (atomic_get(&tlsf_ctx.pool->num_free_pages) != saved_ap) {
     tf->printf("Not all pages were fried: %d rest (%d total)\n",
-               saved_ap - atomic_get(&tlsf_ctx.pool->free_pages), saved_ap);
+               saved_ap - atomic_get(&tlsf_ctx.pool->num_free_pages), saved_ap);
     tf->failed();
   }
 
   mmpool_allocator_dump(tlsf_ctx.pool);
   tf->printf("Allocate all possible pages usign non-continous allocation\n");
-  pages = alloc_pages(saved_ap - resr, AF_ZERO | AF_USER);
+  pages = alloc_pages(saved_ap - resr, AF_ZERO | MMPOOL_USER);
   if (!pages) {
     tf->printf("Failed to allocate non-continous %d pages!\n", saved_ap);
     tf->failed();
@@ -129,20 +136,254 @@ static void tc_alloc_dealloc(void *ctx)
 
   list_cut_head(&head);
   free_pages_chain(pages);
-  if (atomic_get(&tlsf_ctx.pool->free_pages) != saved_ap) {
+  if (atomic_get(&tlsf_ctx.pool->num_free_pages) != saved_ap) {
     tf->printf("Not all pages were fried: %d rest (%d total)\n",
-               saved_ap - atomic_get(&tlsf_ctx.pool->free_pages), saved_ap);
+               saved_ap - atomic_get(&tlsf_ctx.pool->num_free_pages), saved_ap);
     tf->failed();
   }
 
   mmpool_allocator_dump(tlsf_ctx.pool);
+}
+
+#define STRESS_WINDOW 16    /* Blocks each thread holds at a time */
+#define STRESS_ROUNDS 4000
+
+/* Mix of sizes cached per CPU and not */
+static const page_idx_t stress_sizes[] = { 1, 2, 1, 4, 3, 1, 8, 2 };
+
+static atomic_t stress_running;
+static volatile bool stress_failed;
+static cpu_id_t stress_cpus[CONFIG_NRCPUS];
+
+static void stress_thread(void *arg)
+{
+  cpu_id_t *cpu = arg;
+  page_frame_t *blocks[STRESS_WINDOW];
+  page_idx_t sizes[STRESS_WINDOW];
+  int r, i, j;
+
+  if (sched_move_task_to_cpu(current_task(), *cpu))
+    stress_failed = true;
+
+  for (r = 0; (r < STRESS_ROUNDS) && !stress_failed; r++) {
+    for (i = 0; i < STRESS_WINDOW; i++) {
+      sizes[i] = stress_sizes[(r + i + *cpu) % ARRAY_SIZE(stress_sizes)];
+      blocks[i] = alloc_pages(sizes[i], MMPOOL_KERN | AF_CONTIG);
+      if (!blocks[i]) {
+        stress_failed = true;
+        break;
+      }
+      for (j = 0; j < sizes[i]; j++)
+        *(ulong_t *)pframe_to_virt(blocks[i] + j) = pframe_number(blocks[i] + j) ^ r;
+    }
+
+    /* Nobody else may have got our pages in the meantime */
+    while (i--) {
+      for (j = 0; j < sizes[i]; j++) {
+        if (*(ulong_t *)pframe_to_virt(blocks[i] + j) !=
+            (pframe_number(blocks[i] + j) ^ r)) {
+          stress_failed = true;
+        }
+      }
+
+      free_pages(blocks[i], sizes[i]);
+    }
+  }
+
+  atomic_dec(&stress_running);
+  sys_exit(0);
+}
+
+/*
+ * Allocate and free blocks of different sizes on all online CPUs
+ * concurrently, so blocks migrate between per-CPU caches and the TLSF map.
+ */
+static void tc_parallel_stress(test_framework_t *tf)
+{
+  page_idx_t saved_ap = atomic_get(&tlsf_ctx.pool->num_free_pages);
+  cpu_id_t c;
+  int n = 0;
+
+  stress_failed = false;
+  for_each_cpu(c) {
+    if (is_cpu_online(c))
+      n++;
+  }
+
+  atomic_set(&stress_running, n);
+  n = 0;
+  for_each_cpu(c) {
+    if (!is_cpu_online(c))
+      continue;
+
+    stress_cpus[n] = c;
+    if (kernel_thread(stress_thread, &stress_cpus[n], NULL)) {
+      tf->printf("Can't create stress thread!\n");
+      tf->abort();
+    }
+
+    n++;
+  }
+  while (atomic_get(&stress_running))
+    sleep(HZ / 10);
+
+  if (stress_failed) {
+    tf->printf("Parallel allocation on %d CPUs failed!\n", n);
+    tf->failed();
+  }
+
+  tlsf_validate_dbg(tlsf_ctx.tlsf);
+  tf->printf("%d CPUs: %d free pages before, %d after.\n", n, saved_ap,
+             atomic_get(&tlsf_ctx.pool->num_free_pages));
+}
+
+/*
+ * Largest block TLSF of the target pool can give right now.
+ * Free pages counter isn't touched since the block is freed immediately.
+ */
+static page_idx_t __largest_free_block(void)
+{
+  mmpool_t *pool = tlsf_ctx.pool;
+  page_idx_t lo = 0, hi, n;
+  page_frame_t *pages;
+
+  hi = pool->allocator->max_block_size - 1;
+  if (hi > atomic_get(&pool->num_free_pages))
+    hi = atomic_get(&pool->num_free_pages);
+
+  while (lo < hi) {
+    n = (lo + hi + 1) / 2;
+    pages = mmpool_alloc_pages(pool, n);
+    if (pages) {
+      mmpool_free_pages(pool, pages, n);
+      lo = n;
+    }
+    else
+      hi = n - 1;
+  }
+
+  return lo;
+}
+
+#define CHURN_PROCS      64
+#define CHURN_ROUNDS     20000
+#define CHURN_PDIRS      4   /* Page directories of a new address space */
+#define CHURN_MAX_ANON   64  /* Max anonymous pages of a process */
+#define CHURN_MAX_BLOCKS (CHURN_PDIRS + CHURN_MAX_ANON + 2)
+
+static struct churn_proc {
+  page_frame_t *blocks[CHURN_MAX_BLOCKS];
+  page_idx_t sizes[CHURN_MAX_BLOCKS];
+  int nblocks;
+} churn_procs[CHURN_PROCS];
+
+static bool __churn_alloc(struct churn_proc *proc, page_idx_t n)
+{
+  page_frame_t *pages = alloc_pages(n, MMPOOL_KERN | AF_CONTIG);
+
+  if (!pages)
+    return false;
+
+  proc->blocks[proc->nblocks] = pages;
+  proc->sizes[proc->nblocks++] = n;
+  return true;
+}
+
+/* Allocate what a new process needs: page tables, stack, buffers, anonymous memory */
+static bool churn_fork(struct churn_proc *proc)
+{
+  int i, nanon = 8 + __simple_random() % (CHURN_MAX_ANON - 8);
+
+  proc->nblocks = 0;
+  for (i = 0; i < CHURN_PDIRS; i++) {
+    if (!__churn_alloc(proc, 1))
+      return false;
+  }
+  if (!__churn_alloc(proc, CONFIG_KCORE_STACK_PAGES) ||
+      !__churn_alloc(proc, 4)) {
+    return false;
+  }
+  for (i = 0; i < nanon; i++) {
+    if (!__churn_alloc(proc, 1))
+      return false;
+  }
+
+  return true;
+}
+
+static void churn_exit(struct churn_proc *proc)
+{
+  while (proc->nblocks--)
+    free_pages(proc->blocks[proc->nblocks], proc->sizes[proc->nblocks]);
+
+  proc->nblocks = 0;
+}
+
+/*
+ * Replace random processes by new ones for a long time and see how big
+ * contiguous blocks TLSF can give while processes are alive and after
+ * all of them exited.
+ */
+static void tc_fragmentation(test_framework_t *tf)
+{
+  page_idx_t before, alive = 0, after;
+  uint64_t ticks;
+  int i, r;
+
+  before = __largest_free_block();
+  ticks = system_ticks;
+  for (i = 0; i < CHURN_PROCS; i++) {
+    if (!churn_fork(&churn_procs[i])) {
+      tf->printf("Can't allocate pages for process %d!\n", i);
+      tf->failed();
+      goto out;
+    }
+  }
+  for (r = 0; r < CHURN_ROUNDS; r++) {
+    i = __simple_random() % CHURN_PROCS;
+    churn_exit(&churn_procs[i]);
+    if (!churn_fork(&churn_procs[i])) {
+      tf->printf("Can't allocate pages on round %d!\n", r);
+      tf->failed();
+      goto out;
+    }
+  }
+
+  alive = __largest_free_block();
+out:
+  ticks = system_ticks - ticks;
+  for (i = 0; i < CHURN_PROCS; i++)
+    churn_exit(&churn_procs[i]);
+
+  tlsf_validate_dbg(tlsf_ctx.tlsf);
+  after = __largest_free_block();
+  tf->printf("%d fork/exit rounds took %d ticks. Largest free block: %d pages "
+             "before, %d with %d processes alive, %d after they exited\n",
+             CHURN_ROUNDS, ticks, before, alive, CHURN_PROCS, after);
+
+  /* Only pages cached per CPU may stay between freed blocks */
+  if (after < (before >> 1)) {
+    tf->printf("Freed blocks weren't merged back!\n");
+    tf->failed();
+  }
+}
+
+static void tlsf_tests_runner(void *ctx)
+{
+  test_framework_t *tf = ctx;
+
+  tc_alloc_dealloc(tf);
+  tf->printf("Allocate and free pages on all CPUs in parallel.\n");
+  tc_parallel_stress(tf);
+  tf->printf("Measure fragmentation after long fork/exit churn.\n");
+  tc_fragmentation(tf);
   tlsf_ctx.completed = true;
   sys_exit(0);
 }
 
 static void tlsf_test_run(test_framework_t *tf, void *unused)
 {
-  if (kernel_thread(tc_alloc_dealloc, tf, NULL)) {
+  if (kernel_thread(tlsf_tests_runner, tf, NULL)) {
     tf->printf("Can't create kernel thread!");
     tf->abort();
   }
@@ -153,13 +394,13 @@ static void tlsf_test_run(test_framework_t *tf, void *unused)
 static bool tlsf_test_init(void **unused)
 {
   memset(&tlsf_ctx, 0, sizeof(tlsf_ctx));
-  tlsf_ctx.pool = POOL_GENERAL();
-  if (!tlsf_ctx.pool->is_active)
+  tlsf_ctx.pool = mmpool_get_preferred(PREF_MMPOOL_KERN);
+  if (!(tlsf_ctx.pool->flags & MMPOOL_ACTIVE))
     return false;
-  if (tlsf_ctx.pool->allocator.type != PFA_TLSF)
+  if (tlsf_ctx.pool->allocator != default_allocator)
     return false;
 
-  tlsf_ctx.tlsf = tlsf_ctx.pool->allocator.alloc_ctx;
+  tlsf_ctx.tlsf = tlsf_ctx.pool->alloc_ctx;
   tlsf_ctx.completed = false;
   return true;
 }